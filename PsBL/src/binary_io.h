@@ -0,0 +1,120 @@
+#ifndef BINARY_IO_H
+#define BINARY_IO_H
+
+#include "pan_type.h"
+#include "exceptions.h"
+
+#include <fstream>
+
+namespace pan{
+
+/**** Little-endian integers and varints of the binary files (btab, bgTab, bsig) ****/
+
+// the low bytes of value
+inline void put_fixed(string &buffer, uLONG value, const uINT &bytes)
+{
+    for(uINT i=0; i<bytes; i++)
+    {
+        buffer.push_back( char(value & 0xFF) );
+        value >>= 8;
+    }
+}
+
+// the caller makes sure that p has the bytes
+inline uLONG get_fixed(const char *&p, const uINT &bytes)
+{
+    uLONG value = 0;
+    for(uINT i=0; i<bytes; i++)
+        value |= uLONG((unsigned char)p[i]) << (8*i);
+    p += bytes;
+    return value;
+}
+
+// throw Bad_IO if the data ends before the value
+inline uLONG get_fixed(const char *&p, const char *end, const uINT &bytes)
+{
+    if(uLONG(end - p) < bytes)
+        throw Bad_IO("FATAL Error: truncated binary data");
+    return get_fixed(p, bytes);
+}
+
+inline void put_varint(string &buffer, uLONG value)
+{
+    while(value >= 0x80)
+    {
+        buffer.push_back( char((value & 0x7F) | 0x80) );
+        value >>= 7;
+    }
+    buffer.push_back( char(value) );
+}
+
+// write a varint at p, at most 10 bytes, return the end
+inline char *put_varint(char *p, uLONG value)
+{
+    while(value >= 0x80)
+    {
+        *p++ = char((value & 0x7F) | 0x80);
+        value >>= 7;
+    }
+    *p++ = char(value);
+    return p;
+}
+
+inline uLONG get_varint(const char *&p, const char *end)
+{
+    uLONG value = 0;
+    uINT shift = 0;
+    while(p < end)
+    {
+        const unsigned char byte = *p++;
+        value |= uLONG(byte & 0x7F) << shift;
+        if(not (byte & 0x80))
+            return value;
+        shift += 7;
+    }
+    throw Bad_IO("FATAL Error: truncated binary data");
+}
+
+// map signed difference to unsigned: 0,-1,1,-2,2... => 0,1,2,3,4...
+inline void put_zigzag(string &buffer, const uLONG &cur, const uLONG &last)
+{
+    if(cur >= last)
+        put_varint(buffer, (cur - last) << 1);
+    else
+        put_varint(buffer, ((last - cur) << 1) - 1);
+}
+
+inline uLONG get_zigzag(const char *&p, const char *end, const uLONG &last)
+{
+    const uLONG code = get_varint(p, end);
+    if(code & 1)
+        return last - ((code + 1) >> 1);
+    else
+        return last + (code >> 1);
+}
+
+// varint size and the text
+inline void put_text(string &buffer, const char *text, const uLONG &size)
+{
+    put_varint(buffer, size);
+    buffer.append(text, size);
+}
+
+inline void get_text(const char *&p, const char *end, string &text)
+{
+    const uLONG size = get_varint(p, end);
+    if(uLONG(end - p) < size)
+        throw Bad_IO("FATAL Error: truncated binary data");
+    text.assign(p, size);
+    p += size;
+}
+
+inline void read_exact(ifstream &IN, char *buffer, const uLONG &size, const string &file_name)
+{
+    if(not IN.read(buffer, size))
+        throw Bad_IO("FATAL Error: truncated file "+file_name);
+}
+
+}
+
+#endif // BINARY_IO_H
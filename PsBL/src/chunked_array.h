@@ -0,0 +1,119 @@
+#ifndef CHUNKED_ARRAY_H
+#define CHUNKED_ARRAY_H
+
+#include "pan_type.h"
+
+#include <memory>
+#include <iterator>
+#include <algorithm>
+
+namespace pan{
+
+/*
+A fixed-size array stored in blocks of 2^block_bits values, a block is allocated on the first write
+and the unallocated blocks read as the fill value. It is used for the per-base coverage of a chromosome,
+which is zero in most blocks
+
+Chunked_Array<uINT> RT(chr_size+1);
+++RT.ref(100);                  // allocate the block of 100
+uINT v = RT[200];               // 0, no allocation
+RT.set(300, 0);                 // no allocation for the fill value
+for(uINT v: RT) ...             // all values from 0 to size()-1
+
+Positions at or beyond size() in the last block read as the fill value too
+*/
+template<typename T>
+class Chunked_Array
+{
+public:
+    explicit Chunked_Array(const uLONG &size=0, const T &fill=T(), const uINT &block_bits=16):
+        array_size(size), fill(fill), block_bits(block_bits), block_mask((uLONG(1)<<block_bits)-1),
+        blocks((size+block_mask) >> block_bits) {}
+
+    Chunked_Array(Chunked_Array &&) = default;
+    Chunked_Array &operator=(Chunked_Array &&) = default;
+
+    uLONG size() const { return array_size; }
+    T fill_value() const { return fill; }
+
+    T operator[](const uLONG &i) const
+    {
+        const uLONG b = i >> block_bits;
+        if(b >= blocks.size() or not blocks[b])
+            return fill;
+        return blocks[b][i & block_mask];
+    }
+
+    // reference of a value, the block is allocated if it is not
+    T &ref(const uLONG &i)
+    {
+        return write_block(i >> block_bits)[i & block_mask];
+    }
+
+    void set(const uLONG &i, const T &value)
+    {
+        const uLONG b = i >> block_bits;
+        if(blocks[b])
+            blocks[b][i & block_mask] = value;
+        else if(value != fill)
+            write_block(b)[i & block_mask] = value;
+    }
+
+    /**** Blocks ****/
+
+    uLONG block_num() const { return blocks.size(); }
+    uLONG block_size() const { return block_mask+1; }
+
+    // nullptr if the block is not allocated
+    const T *block(const uLONG &b) const { return blocks[b].get(); }
+
+    // allocate the block if it is not
+    T *write_block(const uLONG &b)
+    {
+        if(not blocks[b])
+        {
+            blocks[b].reset(new T[block_mask+1]);
+            std::fill(blocks[b].get(), blocks[b].get()+block_mask+1, fill);
+        }
+        return blocks[b].get();
+    }
+
+    uLONG allocated_blocks() const
+    {
+        uLONG num = 0;
+        for(const std::unique_ptr<T[]> &b: blocks)
+            num += bool(b);
+        return num;
+    }
+
+    /**** Dense iterator ****/
+
+    class const_iterator: public std::iterator<std::forward_iterator_tag, T>
+    {
+    public:
+        const_iterator(const Chunked_Array *array, const uLONG &i): array(array), i(i) {}
+        T operator*() const { return (*array)[i]; }
+        const_iterator &operator++() { ++i; return *this; }
+        bool operator==(const const_iterator &other) const { return i == other.i; }
+        bool operator!=(const const_iterator &other) const { return i != other.i; }
+        uLONG index() const { return i; }
+
+    private:
+        const Chunked_Array *array;
+        uLONG i;
+    };
+
+    const_iterator begin() const { return const_iterator(this, 0); }
+    const_iterator end() const { return const_iterator(this, array_size); }
+
+private:
+    uLONG array_size;
+    T fill;
+    uINT block_bits;
+    uLONG block_mask;
+    vector< std::unique_ptr<T[]> > blocks;
+};
+
+}
+
+#endif // CHUNKED_ARRAY_H
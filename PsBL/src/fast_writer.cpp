@@ -0,0 +1,200 @@
+#include "fast_writer.h"
+#include "string_split.h"
+
+#include <cmath>
+#include <cstdio>
+
+namespace pan{
+
+// the error of value*10^k is at most half ulp, which is far below this distance for the scaled values (< 1e9) here
+static const double TIE_DISTANCE = 1e-6;
+
+// round a scaled value to the nearest integer (ties to even, as printf in the default rounding mode),
+// return false if it is too close to a tie to be decided
+static inline bool round_scaled(const double &scaled, unsigned long long &rounded)
+{
+    const double floor_value = std::floor(scaled);
+    if(std::fabs(scaled - floor_value - 0.5) < TIE_DISTANCE)
+        return false;
+    rounded = static_cast<unsigned long long>(std::nearbyint(scaled));
+    return true;
+}
+
+// write the digits of value to the end of buff, return the begin
+static inline char *format_digits(unsigned long long value, char *end)
+{
+    do{
+        *--end = '0' + value % 10;
+        value /= 10;
+    }while(value);
+    return end;
+}
+
+const uLONG Fast_Writer::MAX_NUMBER_LENGTH;
+
+Fast_Writer::Fast_Writer(ostream &OUT, const uLONG &buffer_size):
+    OUT(OUT), buffer_size(buffer_size < MAX_NUMBER_LENGTH ? MAX_NUMBER_LENGTH : buffer_size)
+{
+    buffer.reset(new char[this->buffer_size]);
+}
+
+Fast_Writer::~Fast_Writer()
+{
+    flush();
+}
+
+void Fast_Writer::flush()
+{
+    if(tail > 0)
+        OUT.write(buffer.get(), tail);
+    tail = 0;
+}
+
+void Fast_Writer::write(const char *data, const uLONG &length)
+{
+    if(buffer_size - tail < length)
+    {
+        flush();
+        if(length >= buffer_size)
+        {
+            OUT.write(data, length);
+            return;
+        }
+    }
+    memcpy(buffer.get()+tail, data, length);
+    tail += length;
+}
+
+void Fast_Writer::write_unsigned(unsigned long long value)
+{
+    reserve();
+    char digits[MAX_NUMBER_LENGTH];
+    char *end = digits + MAX_NUMBER_LENGTH;
+    char *begin = format_digits(value, end);
+    memcpy(buffer.get()+tail, begin, end-begin);
+    tail += end-begin;
+}
+
+void Fast_Writer::write_signed(const long long &value)
+{
+    if(value < 0)
+    {
+        reserve();
+        buffer[tail++] = '-';
+        // -(value+1)+1 does not overflow for the minimum value
+        write_unsigned(static_cast<unsigned long long>(-(value+1)) + 1);
+    }else
+        write_unsigned(value);
+}
+
+void Fast_Writer::write_printf(const char *format, const uINT &decimals, const double &value)
+{
+    // %.9f of the max double has 319 characters
+    char buff[400];
+    write(buff, snprintf(buff, sizeof(buff), format, int(decimals), value));
+}
+
+bool Fast_Writer::scale_general(const double &value, unsigned long long &digits, int &exp)
+{
+    // %g uses fixed notation when the decimal exponent X of the value rounded to 6 digits is in [-4, 6)
+    const double abs_value = std::fabs(value);
+    if(not std::isfinite(value) or abs_value < 1e-5 or abs_value >= 1e6)
+        return false;
+
+    // abs_value in [10^exp, 10^(exp+1)), exp in [-5, 5]
+    exp = 5;
+    while(abs_value < (exp >= 0 ? POW10[exp] : 1.0/POW10[-exp]))
+        --exp;
+
+    if(not round_scaled(abs_value * POW10[5-exp], digits))
+        return false;
+    if(digits == 1000000)
+    {
+        digits = 100000;
+        ++exp;
+    }
+    return digits >= 100000 and digits < 1000000 and exp >= -4 and exp <= 5;
+}
+
+bool Fast_Writer::scale_fixed(const double &value, const uINT &decimals, unsigned long long &scaled)
+{
+    // the scaled value is below 2^30, so the rounding error is far below TIE_DISTANCE
+    const double abs_value = std::fabs(value);
+    return decimals <= 9 and std::isfinite(value) and abs_value * POW10[decimals] < 1e9 and round_scaled(abs_value * POW10[decimals], scaled);
+}
+
+uLONG Fast_Writer::format_general(const double &value, char *buff)
+{
+    char *p = buff;
+    if(value == 0)
+    {
+        if(std::signbit(value))
+            *p++ = '-';
+        *p++ = '0';
+        return p - buff;
+    }
+
+    unsigned long long digits;
+    int exp;
+    if(not scale_general(value, digits, exp))
+        return snprintf(buff, MAX_NUMBER_LENGTH, "%g", value);
+
+    // the 6 digits, the trailing zeros are removed
+    char digit_buff[8];
+    format_digits(digits, digit_buff+6);
+    int digit_num = 6;
+    while(digit_num > exp+1 and digit_buff[digit_num-1] == '0')
+        --digit_num;
+
+    if(value < 0)
+        *p++ = '-';
+    if(exp >= 0)
+    {
+        memcpy(p, digit_buff, exp+1);
+        p += exp+1;
+        if(digit_num > exp+1)
+        {
+            *p++ = '.';
+            memcpy(p, digit_buff+exp+1, digit_num-exp-1);
+            p += digit_num-exp-1;
+        }
+    }else{
+        *p++ = '0';
+        *p++ = '.';
+        for(int i=exp+1; i<0; i++)
+            *p++ = '0';
+        memcpy(p, digit_buff, digit_num);
+        p += digit_num;
+    }
+    return p - buff;
+}
+
+void Fast_Writer::write_fixed(const double &value, const uINT &decimals)
+{
+    unsigned long long scaled;
+    if(not scale_fixed(value, decimals, scaled))
+        return write_printf("%.*f", decimals, value);
+
+    reserve();
+    if(std::signbit(value))
+        buffer[tail++] = '-';
+
+    char digits[MAX_NUMBER_LENGTH];
+    char *end = digits + MAX_NUMBER_LENGTH;
+    char *begin = format_digits(scaled, end);
+    // pad zeros to have one digit before the point
+    while(end - begin < long(decimals) + 1)
+        *--begin = '0';
+
+    const uLONG int_num = (end - begin) - decimals;
+    memcpy(buffer.get()+tail, begin, int_num);
+    tail += int_num;
+    if(decimals > 0)
+    {
+        buffer[tail++] = '.';
+        memcpy(buffer.get()+tail, begin+int_num, decimals);
+        tail += decimals;
+    }
+}
+
+}
@@ -0,0 +1,103 @@
+#ifndef FAST_WRITER_H
+#define FAST_WRITER_H
+
+#include "pan_type.h"
+
+#include <ostream>
+#include <memory>
+
+namespace pan{
+
+/*
+A buffered text writer for large tables, the formatted values are collected in a buffer
+and written to the stream in blocks. The output is the same as ostream with the default format:
+integers are printed in decimal and floats in %g with 6 significant digits.
+write_fixed() prints a float with a fixed number of decimals, same as %.Nf
+
+ofstream OUT("out.txt");
+Fast_Writer writer(OUT);
+writer << chr_id << '\t' << pos << '\t' << score << '\n';
+writer.write_fixed(score, 3);
+writer.flush();                 // also flushed by the destructor
+
+The float values are formatted by scaling with an exact power of 10 and rounding; the values which are
+near a rounding tie, out of the fixed notation range of %g, NaN or infinite are formatted by snprintf
+*/
+class Fast_Writer
+{
+public:
+    explicit Fast_Writer(ostream &OUT, const uLONG &buffer_size=1<<16);
+    ~Fast_Writer();
+
+    Fast_Writer(const Fast_Writer &) = delete;
+    Fast_Writer &operator=(const Fast_Writer &) = delete;
+
+    Fast_Writer &operator<<(const char &c)
+    {
+        if(tail == buffer_size)
+            flush();
+        buffer[tail++] = c;
+        return *this;
+    }
+
+    Fast_Writer &operator<<(const char *str) { write(str, strlen(str)); return *this; }
+    Fast_Writer &operator<<(const string &str) { write(str.data(), str.size()); return *this; }
+
+    Fast_Writer &operator<<(const int &value) { write_signed(value); return *this; }
+    Fast_Writer &operator<<(const long &value) { write_signed(value); return *this; }
+    Fast_Writer &operator<<(const long long &value) { write_signed(value); return *this; }
+    Fast_Writer &operator<<(const unsigned int &value) { write_unsigned(value); return *this; }
+    Fast_Writer &operator<<(const unsigned long &value) { write_unsigned(value); return *this; }
+    Fast_Writer &operator<<(const unsigned long long &value) { write_unsigned(value); return *this; }
+
+    // same as ostream << value, %g with 6 significant digits
+    Fast_Writer &operator<<(const float &value) { write_general(value); return *this; }
+    Fast_Writer &operator<<(const double &value) { write_general(value); return *this; }
+
+    // same as %.Nf, decimals is at most 9
+    void write_fixed(const double &value, const uINT &decimals);
+
+    void write(const char *data, const uLONG &length);
+
+    // write the buffer to the stream
+    void flush();
+
+    // %g of value in the fixed notation is the 6 digits / 10^(5-exp) with the trailing zeros removed,
+    // return false if it is 0, in the exponent notation, NaN, infinite or near a rounding tie
+    static bool scale_general(const double &value, unsigned long long &digits, int &exp);
+    // |value|*10^decimals rounded as %.Nf, return false for the values which are formatted by snprintf
+    static bool scale_fixed(const double &value, const uINT &decimals, unsigned long long &scaled);
+
+    // the longest formatted number
+    static const uLONG MAX_NUMBER_LENGTH = 64;
+
+    // format value as %g with 6 significant digits into buff of MAX_NUMBER_LENGTH bytes, return the length
+    static uLONG format_general(const double &value, char *buff);
+
+private:
+
+    void reserve()
+    {
+        if(buffer_size - tail < MAX_NUMBER_LENGTH)
+            flush();
+    }
+
+    void write_unsigned(unsigned long long value);
+    void write_signed(const long long &value);
+    void write_general(const double &value)
+    {
+        reserve();
+        tail += format_general(value, buffer.get()+tail);
+    }
+    void write_printf(const char *format, const uINT &decimals, const double &value);
+
+    ostream &OUT;
+    // not initialized, it is cheap to create a writer for a small output
+    std::unique_ptr<char[]> buffer;
+    const uLONG buffer_size;
+    uLONG tail = 0;
+};
+
+}
+
+#endif // FAST_WRITER_H
@@ -1,6 +1,11 @@
 
 #include "fasta.h"
 
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+
 using namespace std;
 
 namespace pan{
@@ -230,11 +235,36 @@ void qFasta::build_fasta_index(const string &fastaFn)
     SEQ.close();
 }
 
-void qFasta::load_fasta_file(const string &fastaFn)
+void qFasta::load_fasta_file(const string &fastaFn, bool memory_map)
 {
-    this->FASTA.open(fastaFn, ifstream::binary);
-    if(not this->FASTA)
-        throw runtime_error( "Bad_Input_File: "+fastaFn );
+    if(memory_map)
+    {
+        int fd = open(fastaFn.c_str(), O_RDONLY);
+        if(fd == -1)
+            throw runtime_error( "Bad_Input_File: "+fastaFn );
+        struct stat file_stat;
+        if(fstat(fd, &file_stat) == -1)
+        {
+            close(fd);
+            throw runtime_error( "Bad_Input_File: "+fastaFn );
+        }
+        this->mapped_size = file_stat.st_size;
+        if(this->mapped_size > 0)
+        {
+            void *addr = mmap(nullptr, this->mapped_size, PROT_READ, MAP_PRIVATE, fd, 0);
+            if(addr == MAP_FAILED)
+            {
+                close(fd);
+                throw runtime_error( "Bad_Input_File: mmap "+fastaFn );
+            }
+            this->mapped_data = static_cast<char *>(addr);
+        }
+        close(fd);
+    }else{
+        this->FASTA.open(fastaFn, ifstream::binary);
+        if(not this->FASTA)
+            throw runtime_error( "Bad_Input_File: "+fastaFn );
+    }
 
     ifstream IN(fastaFn+".fai", ifstream::in);
     if(not IN)
@@ -259,9 +289,17 @@ void qFasta::load_fasta_file(const string &fastaFn)
     IN.close();
 }
 
-qFasta::qFasta(const string &fastaFn)
+qFasta::qFasta(const string &fastaFn, bool memory_map)
+{
+    this->load_fasta_file(fastaFn, memory_map);
+}
+
+qFasta::~qFasta()
 {
-    this->load_fasta_file(fastaFn);
+    if(FASTA)
+        FASTA.close();
+    if(mapped_data)
+        munmap(mapped_data, mapped_size);
 }
 
 StringArray qFasta::get_chr_ids() const
@@ -304,6 +342,18 @@ string qFasta::get_chr_subbseq(const string &chrID, uLONG start, uLONG len, STRA
     len = (start+len > chr_len) ? chr_len-start : len;
 
     const fai_item index = this->fa_index.at(chrID);
+
+    if(this->mapped_data)
+    {
+        Seq_View view(this->mapped_data+index.chr_start, chr_len, index.chr_line_len);
+        string read_seq(len, 'N');
+        for(uLONG i=0; i<len; i++)
+            read_seq[i] = view[start+i];
+        if(strand == POSITIVE)
+            return read_seq;
+        else
+            return reverse_comp(read_seq);
+    }
     
     // Locate to the position
     uLONG offset = index.chr_start + start + start / index.chr_line_len;
@@ -341,6 +391,23 @@ string qFasta::get_chr_subbseq(const string &chrID, uLONG start, uLONG len, STRA
         return reverse_comp(read_seq);
 }
 
+Seq_View qFasta::get_chr_view(const string &chrID, STRAND strand) const
+{
+    if(not this->mapped_data)
+        throw runtime_error( "Unexpected_Error: get_chr_view needs a memory mapped fasta" );
+
+    const fai_item &index = this->fa_index.at(chrID);
+    if(index.chr_len == 0)
+        return Seq_View();
+
+    // the last base is at chr_len-1 plus a '\n' per full line
+    if(index.chr_start + index.chr_len + (index.chr_len-1)/index.chr_line_len > this->mapped_size)
+        throw runtime_error( "Unexpected_Error: "+chrID+" is out of the fasta file, the fai index may be outdated" );
+
+    const bool reverse_comp = (strand == NEGATIVE);
+    return Seq_View(this->mapped_data+index.chr_start, index.chr_len, index.chr_line_len, reverse_comp, reverse_comp);
+}
+
 // **************************
 //  Other common functions
 // **************************
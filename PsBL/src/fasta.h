@@ -125,17 +125,98 @@ typedef struct {
     uLONG chr_line_len;
 } fai_item;
 
+// the complementary base used by reverse_comp (DNA)
+inline char comp_base(const char &base)
+{
+    switch(base)
+    {
+        case 'A': return 'T';
+        case 'a': return 't';
+        case 'T': case 'U': return 'A';
+        case 't': case 'u': return 'a';
+        case 'C': return 'G';
+        case 'c': return 'g';
+        case 'G': return 'C';
+        case 'g': return 'c';
+        default: return 'N';
+    }
+}
+
+/*
+A read-only view of a sequence stored in fasta lines (line_len bases and a '\n' per line), the bases
+are not copied. A reversed view reads from the end and a complemented view returns comp_base()
+
+Seq_View view = fasta.get_chr_view("chr1", NEGATIVE);     // reverse-complement of chr1
+char base = view[10];
+string seq = view.str();
+*/
+class Seq_View
+{
+public:
+    // return the base i of a source which is not stored as fasta lines, such as a packed genome
+    using Base_Getter = char (*)(const void *source, const uLONG &i);
+
+    Seq_View() {}
+    Seq_View(const char *data, const uLONG &len, const uLONG &line_len, const bool &reverse=false, const bool &complement=false):
+        data(data), len(len), line_len(line_len), reverse(reverse), complement(complement) {}
+    Seq_View(const void *source, Base_Getter getter, const uLONG &len, const bool &reverse=false, const bool &complement=false):
+        source(source), getter(getter), len(len), reverse(reverse), complement(complement) {}
+
+    uLONG size() const { return len; }
+    bool empty() const { return len == 0; }
+
+    char operator[](uLONG i) const
+    {
+        if(reverse)
+            i = len - 1 - i;
+        const char base = getter ? getter(source, i) : data[i + i/line_len];
+        return complement ? comp_base(base) : base;
+    }
+
+    // the same bases in the reverse order
+    Seq_View reversed() const
+    {
+        Seq_View view(*this);
+        view.reverse = not reverse;
+        return view;
+    }
+
+    string str() const
+    {
+        string seq(len, 'N');
+        for(uLONG i=0; i<len; i++)
+            seq[i] = (*this)[i];
+        return seq;
+    }
+
+private:
+    const char *data = nullptr;
+    const void *source = nullptr;
+    Base_Getter getter = nullptr;
+    uLONG len = 0;
+    uLONG line_len = 1;
+    bool reverse = false;
+    bool complement = false;
+};
+
 // Quick fasta: a class to fetch sequence from disk rather than memory
 class qFasta
 {
 
 public:
-    // Read fasta sequence and load into the object
-    void load_fasta_file(const string &fastaFn);
+    /*
+    Read the fasta index, the sequence is read from the file
+    fastaFn             -- Input fasta file
+    memory_map          -- Map the file into memory, get_chr_view is available and the class is thread-safe
+    */
+    void load_fasta_file(const string &fastaFn, bool memory_map=false);
 
     qFasta(){};
-    qFasta(const string &fastaFn);
-    ~qFasta(){ if(FASTA) FASTA.close(); }
+    qFasta(const string &fastaFn, bool memory_map=false);
+    ~qFasta();
+
+    qFasta(const qFasta &) = delete;
+    qFasta &operator=(const qFasta &) = delete;
 
     /*
     Return the raw chrID list
@@ -173,6 +254,15 @@ public:
     */
     string get_chr_subbseq(const string &chrID, uLONG start, uLONG len=string::npos/2, STRAND strand=POSITIVE);
 
+    /*
+    Return a view of the sequence of given chrID without copy, the fasta must be memory mapped
+    chrID               -- The chrID
+    strand              -- Strand, the view of NEGATIVE is the reverse-complement
+    */
+    Seq_View get_chr_view(const string &chrID, STRAND strand=POSITIVE) const;
+
+    bool is_memory_mapped() const { return mapped_data != nullptr; }
+
     /*
     Test if a chrID is in the Fasta
     chrID                 -- The chrID
@@ -183,6 +273,10 @@ private:
     ifstream FASTA;
     MapStringT<fai_item> fa_index;
 
+    // the memory mapped fasta file
+    char *mapped_data = nullptr;
+    uLONG mapped_size = 0;
+
 public:
     /*
         Build fasta index (produce a .fai file)
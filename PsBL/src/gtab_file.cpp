@@ -0,0 +1,442 @@
+#include "gtab_file.h"
+#include "binary_io.h"
+
+#include <zlib.h>
+#include <cstdlib>
+
+namespace pan{
+
+static const char BGTAB_MAGIC[] = "BGTB";
+static const uINT BGTAB_VERSION = 1;
+static const float GTAB_NULL = -1.0;
+
+/**** Binary encoding helpers ****/
+
+static void put_float(string &buffer, const float &value)
+{
+    uINT bits;
+    memcpy(&bits, &value, 4);
+    put_fixed(buffer, bits, 4);
+}
+
+static float get_float(const char *&p, const char *end)
+{
+    if(end - p < 4)
+        throw Bad_IO("FATAL Error: truncated block in bgTab file");
+    const uINT bits = get_fixed(p, 4);
+    float value;
+    memcpy(&value, &bits, 4);
+    return value;
+}
+
+/**** Records and layout ****/
+
+void GTab_Records::clear()
+{
+    chr_id.clear();
+    pos.clear();
+    bases.clear();
+    for(vector<uINT> &column: counts)
+        column.clear();
+    shape.clear();
+    shape_num.clear();
+    window_offsets.assign(1, 0);
+    window_values.clear();
+    window_single.clear();
+}
+
+GTab_Layout GTab_Layout::from_head(const string &head)
+{
+    GTab_Layout layout;
+    layout.count_num = head.find("@D_RT") == string::npos ? 2 : 4;
+    layout.has_base = head.find("@Base") != string::npos;
+    return layout;
+}
+
+/**** Writer ****/
+
+BGTab_Writer::BGTab_Writer(const string &file_name, const string &head, const uLONG &block_rows):
+    file_name(file_name), layout(GTab_Layout::from_head(head)), block_rows(block_rows)
+{
+    OUT.open(file_name, ofstream::out | ofstream::binary);
+    if(not OUT)
+        throw Bad_IO("FATAL Error: cannot write "+file_name);
+
+    block.counts.resize(layout.count_num);
+
+    string file_head(BGTAB_MAGIC, 4);
+    put_fixed(file_head, BGTAB_VERSION, 4);
+    put_fixed(file_head, layout.count_num, 1);
+    put_fixed(file_head, layout.has_base, 1);
+    put_fixed(file_head, layout.double_tab, 1);
+    put_fixed(file_head, head.size(), 4);
+    file_head += head;
+    OUT.write(file_head.data(), file_head.size());
+}
+
+// digits of an integer in text, without sign or leading zeros
+static uLONG parse_count(const char *p, const uLONG &size, const uLONG &max_value, const string &line)
+{
+    if(size == 0 or size > 20 or (size > 1 and p[0] == '0'))
+        throw Unexpected_Error("FATAL Error: bad integer in gTab line: "+line);
+    uLONG value = 0;
+    for(uLONG i=0; i<size; i++)
+    {
+        if(p[i] < '0' or p[i] > '9')
+            throw Unexpected_Error("FATAL Error: bad integer in gTab line: "+line);
+        const uLONG digit = p[i] - '0';
+        if(value > (max_value - digit) / 10)
+            throw Unexpected_Error("FATAL Error: integer overflow in gTab line: "+line);
+        value = value * 10 + digit;
+    }
+    return value;
+}
+
+// a float which is printed as the same text
+static float parse_score(const char *p, const uLONG &size, const string &line)
+{
+    char *end = nullptr;
+    const float value = strtof(p, &end);
+    char buff[Fast_Writer::MAX_NUMBER_LENGTH];
+    if(size == 0 or end != p+size or Fast_Writer::format_general(value, buff) != size or memcmp(buff, p, size) != 0)
+        throw Unexpected_Error("FATAL Error: the score cannot be stored as float in gTab line: "+line);
+    return value;
+}
+
+void BGTab_Writer::write_line(const string &line)
+{
+    fields.clear();
+    field_sizes.clear();
+    uLONG start = 0;
+    for(uLONG i=0; i<=line.size(); i++)
+        if(i == line.size() or line[i] == '\t')
+        {
+            fields.push_back(line.data()+start);
+            field_sizes.push_back(i-start);
+            start = i+1;
+        }
+
+    const uLONG field_num = 3 + layout.double_tab + layout.has_base + layout.count_num + 3;
+    if(fields.size() != field_num or field_sizes[1] != 1 or
+        (layout.double_tab and field_sizes[3] != 0) or (layout.has_base and field_sizes[3+layout.double_tab] != 1))
+        throw Unexpected_Error("FATAL Error: the gTab line does not match the head: "+line);
+
+    // parse the whole row before it is added, so a bad row leaves the block unchanged
+    uLONG field = 2;
+    const uLONG pos = parse_count(fields[field], field_sizes[field], uLONG(-1), line);
+    field += 1 + layout.double_tab;
+    const char base = layout.has_base ? fields[field++][0] : 0;
+    uINT counts[4];
+    for(uINT c=0; c<layout.count_num; c++, field++)
+        counts[c] = parse_count(fields[field], field_sizes[field], uINT(-1), line);
+    const float shape = parse_score(fields[field], field_sizes[field], line);
+    ++field;
+    const uINT shape_num = parse_count(fields[field], field_sizes[field], uINT(-1), line);
+    ++field;
+
+    // v1,v2,..., or a single value
+    window.clear();
+    const char *p = fields[field];
+    const char *end = p + field_sizes[field];
+    const bool single = p != end and end[-1] != ',';
+    if(single)
+        window.push_back( parse_score(p, end-p, line) );
+    else
+        while(p < end)
+        {
+            const char *comma = p;
+            while(*comma != ',')
+                ++comma;
+            window.push_back( parse_score(p, comma-p, line) );
+            p = comma + 1;
+        }
+
+    const string chr_id = string(fields[0], field_sizes[0]) + fields[1][0];
+    if(index.empty() or index.back().chr_id != chr_id)
+    {
+        if(written_chrs.count(chr_id))
+            throw Unexpected_Error("FATAL Error: rows of "+chr_id+" are not contiguous");
+        flush_block();
+        written_chrs.insert(chr_id);
+
+        index.push_back( GTab_Index_Item() );
+        index.back().chr_id = chr_id;
+        index.back().offset = OUT.tellp();
+    }
+
+    block.pos.push_back(pos);
+    if(layout.has_base)
+        block.bases.push_back(base);
+    for(uINT c=0; c<layout.count_num; c++)
+        block.counts[c].push_back(counts[c]);
+    block.shape.push_back(shape);
+    block.shape_num.push_back(shape_num);
+    block.window_values.insert(block.window_values.end(), window.begin(), window.end());
+    block.window_single.push_back(single);
+    block.window_offsets.push_back( block.window_values.size() );
+
+    if(block.size() >= block_rows)
+        flush_block();
+}
+
+void BGTab_Writer::flush_block()
+{
+    const uLONG row_num = block.size();
+    if(row_num == 0)
+        return;
+
+    raw.clear();
+    uLONG last_pos = 0;
+    for(const uLONG &pos: block.pos)
+    {
+        put_zigzag(raw, pos, last_pos);
+        last_pos = pos;
+    }
+    raw += block.bases;
+    for(const vector<uINT> &column: block.counts)
+        for(const uINT &count: column)
+            put_varint(raw, count);
+
+    string bitmap((row_num+7)/8, '\0');
+    for(uLONG i=0; i<row_num; i++)
+        if(block.shape[i] == GTAB_NULL)
+            bitmap[i/8] |= char(1 << (i%8));
+    raw += bitmap;
+    for(const float &shape: block.shape)
+        if(shape != GTAB_NULL)
+            put_float(raw, shape);
+
+    for(const uINT &num: block.shape_num)
+        put_varint(raw, num);
+    for(uLONG i=0; i<row_num; i++)
+        put_varint(raw, ((block.window_offsets[i+1]-block.window_offsets[i]) << 1) | uLONG(block.window_single[i]));
+    for(const float &value: block.window_values)
+        put_float(raw, value);
+
+    uLongf compressed_size = compressBound(raw.size());
+    string compressed(compressed_size, '\0');
+    if(compress2((Bytef*)&compressed[0], &compressed_size, (const Bytef*)raw.data(), raw.size(), Z_DEFAULT_COMPRESSION) != Z_OK)
+        throw Unexpected_Error("FATAL Error: compress bgTab block failed");
+
+    string block_head;
+    put_fixed(block_head, raw.size(), 4);
+    put_fixed(block_head, compressed_size, 4);
+    put_fixed(block_head, row_num, 4);
+    OUT.write(block_head.data(), block_head.size());
+    OUT.write(compressed.data(), compressed_size);
+
+    ++index.back().block_num;
+    index.back().row_num += row_num;
+    index.back().window_num += block.window_values.size();
+    block.clear();
+}
+
+void BGTab_Writer::close()
+{
+    if(closed)
+        return;
+    flush_block();
+
+    const uLONG footer_offset = OUT.tellp();
+    string footer;
+    put_fixed(footer, index.size(), 8);
+    for(const GTab_Index_Item &item: index)
+    {
+        put_fixed(footer, item.chr_id.size(), 4);
+        footer += item.chr_id;
+        put_fixed(footer, item.offset, 8);
+        put_fixed(footer, item.block_num, 8);
+        put_fixed(footer, item.row_num, 8);
+        put_fixed(footer, item.window_num, 8);
+    }
+    put_fixed(footer, footer_offset, 8);
+    footer.append(BGTAB_MAGIC, 4);
+    OUT.write(footer.data(), footer.size());
+
+    OUT.close();
+    if(not OUT)
+        throw Bad_IO("FATAL Error: cannot write "+file_name);
+    closed = true;
+}
+
+/**** Reader ****/
+
+static void read_bgtab_blocks(ifstream &IN, const string &file_name, const GTab_Layout &layout, const GTab_Index_Item &item,
+    GTab_Records &records, string &compressed, string &raw)
+{
+    records.clear();
+    records.chr_id = item.chr_id;
+    records.counts.resize(layout.count_num);
+    records.pos.reserve(item.row_num);
+    records.window_values.reserve(item.window_num);
+
+    IN.clear();
+    IN.seekg(item.offset);
+    for(uLONG b=0; b<item.block_num; b++)
+    {
+        char head[12];
+        read_exact(IN, head, 12, file_name);
+        const char *p = head;
+        uLongf raw_size = get_fixed(p, 4);
+        const uLONG compressed_size = get_fixed(p, 4);
+        const uLONG row_num = get_fixed(p, 4);
+
+        compressed.resize(compressed_size);
+        read_exact(IN, &compressed[0], compressed_size, file_name);
+        raw.resize(raw_size);
+        if(uncompress((Bytef*)&raw[0], &raw_size, (const Bytef*)compressed.data(), compressed_size) != Z_OK or raw_size != raw.size())
+            throw Bad_IO("FATAL Error: bad bgTab block in "+file_name);
+
+        p = raw.data();
+        const char *end = p + raw.size();
+        uLONG last_pos = 0;
+        for(uLONG i=0; i<row_num; i++)
+        {
+            last_pos = get_zigzag(p, end, last_pos);
+            records.pos.push_back(last_pos);
+        }
+        if(layout.has_base)
+        {
+            if(uLONG(end - p) < row_num)
+                throw Bad_IO("FATAL Error: truncated block in bgTab file "+file_name);
+            records.bases.append(p, row_num);
+            p += row_num;
+        }
+        for(vector<uINT> &column: records.counts)
+            for(uLONG i=0; i<row_num; i++)
+                column.push_back( get_varint(p, end) );
+
+        const char *bitmap = p;
+        p += (row_num+7)/8;
+        if(p > end)
+            throw Bad_IO("FATAL Error: truncated block in bgTab file "+file_name);
+        for(uLONG i=0; i<row_num; i++)
+            records.shape.push_back( (bitmap[i/8] >> (i%8)) & 1 ? GTAB_NULL : get_float(p, end) );
+
+        for(uLONG i=0; i<row_num; i++)
+            records.shape_num.push_back( get_varint(p, end) );
+        const uLONG window_start = records.window_offsets.back();
+        for(uLONG i=0; i<row_num; i++)
+        {
+            const uLONG code = get_varint(p, end);
+            records.window_offsets.push_back( records.window_offsets.back() + (code >> 1) );
+            records.window_single.push_back( char(code & 1) );
+        }
+        for(uLONG i=window_start; i<records.window_offsets.back(); i++)
+            records.window_values.push_back( get_float(p, end) );
+    }
+
+    if(records.size() != item.row_num)
+        throw Bad_IO("FATAL Error: the index does not match the blocks in "+file_name);
+}
+
+BGTab_Reader::BGTab_Reader(const string &file_name): file_name(file_name)
+{
+    IN.open(file_name, ifstream::in | ifstream::binary);
+    if(not IN)
+        throw Bad_IO("FATAL Error: "+file_name+" cannot be read");
+
+    char file_head[15];
+    read_exact(IN, file_head, 15, file_name);
+    if(strncmp(file_head, BGTAB_MAGIC, 4) != 0)
+        throw Bad_IO("FATAL Error: bad bgTab file "+file_name);
+    const char *p = file_head + 4;
+    if(get_fixed(p, 4) != BGTAB_VERSION)
+        throw Bad_IO("FATAL Error: unknown bgTab version of "+file_name);
+    file_layout.count_num = get_fixed(p, 1);
+    file_layout.has_base = get_fixed(p, 1);
+    file_layout.double_tab = get_fixed(p, 1);
+    head_lines.resize( get_fixed(p, 4) );
+    read_exact(IN, &head_lines[0], head_lines.size(), file_name);
+
+    char trailer[12];
+    IN.seekg(-12, ios::end);
+    read_exact(IN, trailer, 12, file_name);
+    if(strncmp(trailer+8, BGTAB_MAGIC, 4) != 0)
+        throw Bad_IO("FATAL Error: bad bgTab file "+file_name);
+
+    p = trailer;
+    const uLONG footer_offset = get_fixed(p, 8);
+    const uLONG footer_size = uLONG(IN.tellg()) - 12 - footer_offset;
+
+    string footer(footer_size, '\0');
+    IN.seekg(footer_offset);
+    read_exact(IN, &footer[0], footer_size, file_name);
+
+    p = footer.data();
+    const uLONG chr_num = get_fixed(p, 8);
+    for(uLONG i=0; i<chr_num; i++)
+    {
+        GTab_Index_Item item;
+        const uLONG key_size = get_fixed(p, 4);
+        item.chr_id.assign(p, key_size);
+        p += key_size;
+        item.offset = get_fixed(p, 8);
+        item.block_num = get_fixed(p, 8);
+        item.row_num = get_fixed(p, 8);
+        item.window_num = get_fixed(p, 8);
+        index_map[item.chr_id] = index.size();
+        index.push_back(item);
+    }
+}
+
+const GTab_Index_Item *BGTab_Reader::find_chr(const string &chr_id) const
+{
+    auto it = index_map.find(chr_id);
+    return it == index_map.end() ? nullptr : &index[it->second];
+}
+
+bool BGTab_Reader::read_chr(GTab_Records &records)
+{
+    records.clear();
+    if(next_chr >= index.size())
+        return false;
+
+    read_bgtab_blocks(IN, file_name, file_layout, index[next_chr++], records, compressed, raw);
+    return true;
+}
+
+bool BGTab_Reader::load_chr(const string &chr_id, GTab_Records &records) const
+{
+    records.clear();
+    const GTab_Index_Item *item = find_chr(chr_id);
+    if(not item)
+        return false;
+
+    ifstream CHR_IN(file_name, ifstream::in | ifstream::binary);
+    if(not CHR_IN)
+        throw Bad_IO("FATAL Error: "+file_name+" cannot be read");
+    string chr_compressed, chr_raw;
+    read_bgtab_blocks(CHR_IN, file_name, file_layout, *item, records, chr_compressed, chr_raw);
+    return true;
+}
+
+/**** Text ****/
+
+void write_gtab_text(const GTab_Records &records, const GTab_Layout &layout, Fast_Writer &OUT)
+{
+    if(records.chr_id.empty())
+        return;
+    const string chr = records.chr_id.substr(0, records.chr_id.size()-1);
+    const char strand = records.chr_id.back();
+
+    for(uLONG i=0; i<records.size(); i++)
+    {
+        OUT << chr << '\t' << strand << '\t' << records.pos[i] << '\t';
+        if(layout.double_tab)
+            OUT << '\t';
+        if(layout.has_base)
+            OUT << records.bases[i] << '\t';
+        for(const vector<uINT> &column: records.counts)
+            OUT << column[i] << '\t';
+        OUT << records.shape[i] << '\t' << records.shape_num[i] << '\t';
+        if(records.window_single[i])
+            OUT << records.window_values[records.window_offsets[i]];
+        else
+            for(uLONG j=records.window_offsets[i]; j<records.window_offsets[i+1]; j++)
+                OUT << records.window_values[j] << ',';
+        OUT << '\n';
+    }
+}
+
+}
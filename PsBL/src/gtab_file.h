@@ -0,0 +1,145 @@
+#ifndef GTAB_FILE_H
+#define GTAB_FILE_H
+
+#include "pan_type.h"
+#include "exceptions.h"
+#include "fast_writer.h"
+
+#include <fstream>
+#include <unordered_set>
+
+namespace pan{
+
+/**** Binary columnar gTab file (.bgTab) ****/
+
+// A .bgTab file holds the same rows as a sorted .gTab file of calc_sliding_shape, and it can be converted
+// back to the same text. Columns of a text row:
+//     chr_id \t strand \t pos \t [\t] [base \t] counts(2 or 4) \t shape \t shape_num \t window shapes
+// The window shapes are a list of values with trailing commas (v1,v2,...,) or a single value without comma.
+//
+// Format:
+//     "BGTB" version(u32) | layout | head | blocks | footer | footer offset(u64) "BGTB"
+//     layout: count number(u8) has base(u8) double tab after pos(u8); head: size(u32) and the @ lines
+//     A block holds up to 16384 rows of a single chr_id+strand, compressed with zlib:
+//         raw size(u32) compressed size(u32) row number(u32) zlib data
+//     The columns of a block:
+//         zigzag(pos - last pos) of every row; a byte of base per row (if has base);
+//         varint of every row for each count column; null bitmap of shape and float32 of non-null shapes;
+//         varint(shape_num) of every row; varint(window size << 1 | single value) of every row and float32 of window values
+//     Null shape is the value -1 in text. Floats are stored in little-endian.
+//     The footer gives the offset of the first block and the block/row/window value number of every chr_id+strand
+
+// rows of a chr_id+strand in columns
+struct GTab_Records
+{
+    string chr_id;                                  // chr_id+strand, eg. chr1+
+    vector<uLONG> pos;
+    string bases;                                   // a base per row if the file has base
+    vector<vector<uINT>> counts;                    // counts[c][row], N_RT N_BD [D_RT D_BD]
+    FloatArray shape;                               // null shapes are -1
+    vector<uINT> shape_num;
+    vector<uLONG> window_offsets = vector<uLONG>(1, 0);   // window shapes of row i are window_values[window_offsets[i], window_offsets[i+1])
+    FloatArray window_values;
+    vector<char> window_single;                     // the window column is a single value without comma
+
+    uLONG size() const { return pos.size(); }
+    void clear();
+};
+
+// column layout of a file, it is read from the @ head lines of calc_sliding_shape
+struct GTab_Layout
+{
+    uINT count_num = 4;                             // 4 with DMSO (TrtCont mode), 2 without DMSO (Trt mode)
+    bool has_base = false;
+    bool double_tab = true;                         // an empty column after pos, as written by sort_gTab
+
+    // count_num and has_base by @D_RT and @Base
+    static GTab_Layout from_head(const string &head);
+};
+
+// index of a chr_id+strand
+struct GTab_Index_Item
+{
+    string chr_id;                                  // chr_id+strand
+    uLONG offset = 0;                               // file offset of the first block
+    uLONG block_num = 0;
+    uLONG row_num = 0;
+    uLONG window_num = 0;
+};
+
+// .bgTab file name
+inline bool is_bgtab_file(const string &file_name)
+{
+    return file_name.size() >= 6 and file_name.compare(file_name.size()-6, 6, ".bgTab") == 0;
+}
+
+class BGTab_Writer
+{
+public:
+    // head -- the @ lines, each ends with \n
+    BGTab_Writer(const string &file_name, const string &head, const uLONG &block_rows=1<<14);
+    ~BGTab_Writer(){ close(); }
+
+    // a text row without \n, rows of a chr_id+strand must be contiguous.
+    // Throw Unexpected_Error if the row does not match the layout or cannot be converted back to the same text
+    void write_line(const string &line);
+    void close();
+
+private:
+    void flush_block();
+
+    ofstream OUT;
+    const string file_name;
+    const GTab_Layout layout;
+    const uLONG block_rows;
+    bool closed = false;
+
+    GTab_Records block;
+    vector<const char *> fields;
+    vector<uLONG> field_sizes;
+    FloatArray window;
+    string raw;
+
+    vector<GTab_Index_Item> index;
+    std::unordered_set<string> written_chrs;
+};
+
+class BGTab_Reader
+{
+public:
+    BGTab_Reader(const string &file_name);
+
+    const string &head() const { return head_lines; }
+    const GTab_Layout &layout() const { return file_layout; }
+    const vector<GTab_Index_Item> &get_index() const { return index; }
+
+    // return nullptr if chr_id+strand is not in the file
+    const GTab_Index_Item *find_chr(const string &chr_id) const;
+
+    // read all rows of next chr_id+strand, return false at the end of file
+    bool read_chr(GTab_Records &records);
+
+    // load a chr_id+strand with a private file handle, so it can be called from multiple threads.
+    // return false if it is not in the file
+    bool load_chr(const string &chr_id, GTab_Records &records) const;
+
+private:
+    ifstream IN;
+    const string file_name;
+
+    string head_lines;
+    GTab_Layout file_layout;
+    vector<GTab_Index_Item> index;
+    MapStringuLONG index_map;                       // chr_id+strand => position in index
+    uLONG next_chr = 0;
+
+    string compressed;
+    string raw;
+};
+
+// write the rows as text, the same as the .gTab file
+void write_gtab_text(const GTab_Records &records, const GTab_Layout &layout, Fast_Writer &OUT);
+
+}
+
+#endif // GTAB_FILE_H
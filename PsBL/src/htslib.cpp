@@ -169,6 +169,48 @@ string getBamCigar(bam1_t *record)
     return cigar;
 }
 
+bool getBamMatchRegion(bam1_t *record, RegionArray &matchRegion)
+{
+    uint32_t n_cigar = record->core.n_cigar;
+    auto codedCigar = bam_get_cigar(record);
+    matchRegion.clear();
+
+    uLONG lastStartPos = getBamRefPos(record);
+    uLONG curGenomePos = lastStartPos;
+    for(uint32_t i=0; i<n_cigar; i++)
+    {
+        auto op = bam_cigar_op(codedCigar[i]);
+        auto op_len = bam_cigar_oplen(codedCigar[i]);
+
+        switch(op)
+        {
+            case BAM_CMATCH: case BAM_CDEL: case BAM_CEQUAL: case BAM_CDIFF:
+                curGenomePos += op_len;
+                break;
+            case BAM_CINS: case BAM_CSOFT_CLIP: case BAM_CHARD_CLIP:
+                if(lastStartPos != curGenomePos)
+                {
+                    matchRegion.push_back(Region(lastStartPos, curGenomePos-1));
+                    lastStartPos = curGenomePos;
+                }
+                break;
+            case BAM_CPAD:
+                break;
+            case BAM_CREF_SKIP:
+                if(lastStartPos != curGenomePos)
+                    matchRegion.push_back(Region(lastStartPos, curGenomePos-1));
+                lastStartPos = curGenomePos = curGenomePos + op_len;
+                break;
+            default:
+                matchRegion.clear();
+                return false;
+        }
+    }
+
+    if(lastStartPos != curGenomePos)
+        matchRegion.push_back(Region(lastStartPos, curGenomePos-1));
+    return true;
+}
 
 bool getBamHead(bam_hdr_t *hdr, MapStringT<uLONG> &chr_len)
 {
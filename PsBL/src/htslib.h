@@ -61,6 +61,10 @@ string getBamSeq(bam1_t *record);						// Get read sequence
 string getBamQuanlity(bam1_t *record);					// Get read quanlity
 string getBamTag(bam1_t *record);						// Get bam tags -- TODO: get full attribute list
 
+// Get global match regions from the binary cigar, the same as get_global_match_region(getBamCigar(record), getBamRefPos(record), ...)
+// return false and clear matchRegion if the cigar has an unknown operation
+bool getBamMatchRegion(bam1_t *record, RegionArray &matchRegion);
+
 bool getBamHead(bam_hdr_t *hdr, MapStringT<uLONG> &chr_len);	// Get bam head
 
 };
@@ -0,0 +1,93 @@
+#ifndef ORDER_STAT_H
+#define ORDER_STAT_H
+
+#include "pan_type.h"
+#include "exceptions.h"
+
+#include <algorithm>
+
+namespace pan{
+
+/*
+Order statistics of an array by selection (std::nth_element), without sorting the whole array.
+The values are copied into a scratch buffer which is reused by next assign(),
+so there is no allocation once the buffer is large enough
+
+Order_Stat<float> stat;
+stat.assign(data.cbegin(), data.cend());
+float lower = stat.kth_smallest(10);
+float upper = stat.kth_largest(10);
+
+stat.sort_ranks(5, 20);         // stat[5], stat[6]... stat[19] are the 5th...19th smallest values
+*/
+template<typename T>
+class Order_Stat
+{
+public:
+    template<typename Iter>
+    void assign(Iter begin, Iter end)
+    {
+        scratch.clear();
+        scratch.insert(scratch.end(), begin, end);
+    }
+
+    // values equal to ignore are skipped, such as the null scores
+    template<typename Iter>
+    void assign_not(Iter begin, Iter end, const T &ignore)
+    {
+        scratch.clear();
+        for(Iter it=begin; it!=end; ++it)
+            if(*it != ignore)
+                scratch.push_back(*it);
+    }
+
+    uLONG size() const { return scratch.size(); }
+
+    // number of values > value
+    uLONG count_greater(const T &value) const
+    {
+        return std::count_if(scratch.cbegin(), scratch.cend(), [&value](const T &v){ return v > value; });
+    }
+
+    // the k-th smallest value, k starts from 0
+    T kth_smallest(const uLONG &k)
+    {
+        if(k >= scratch.size())
+            throw Unexpected_Error("Order_Stat: rank "+std::to_string(k)+" out of range "+std::to_string(scratch.size()));
+        std::nth_element(scratch.begin(), scratch.begin()+k, scratch.end());
+        return scratch[k];
+    }
+
+    // the k-th largest value, k starts from 0
+    T kth_largest(const uLONG &k)
+    {
+        if(k >= scratch.size())
+            throw Unexpected_Error("Order_Stat: rank "+std::to_string(k)+" out of range "+std::to_string(scratch.size()));
+        return kth_smallest(scratch.size()-1-k);
+    }
+
+    // put the values of rank [first, last) to the same positions in ascending order,
+    // costs O(n) selection plus sorting last-first values
+    void sort_ranks(const uLONG &first, const uLONG &last)
+    {
+        if(first > last or last > scratch.size())
+            throw Unexpected_Error("Order_Stat: ranks ["+std::to_string(first)+","+std::to_string(last)+") out of range "+std::to_string(scratch.size()));
+        if(first == last)
+            return;
+        if(first > 0)
+            std::nth_element(scratch.begin(), scratch.begin()+first, scratch.end());
+        if(last < scratch.size())
+            std::nth_element(scratch.begin()+first, scratch.begin()+last, scratch.end());
+        std::sort(scratch.begin()+first, scratch.begin()+last);
+    }
+
+    // the value at position i, it is the i-th smallest value after sort_ranks covering i
+    const T &operator[](const uLONG &i) const { return scratch[i]; }
+
+private:
+    vector<T> scratch;
+};
+
+}
+
+#endif // ORDER_STAT_H
@@ -0,0 +1,365 @@
+#include "packed_genome.h"
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <cctype>
+
+using namespace std;
+
+namespace pan{
+
+static const char PGENOME_MAGIC[] = "PGENOME1";
+static const uint64_t BYTE_ORDER_MARK = 0x0102030405060708ULL;
+static const char CODE_BASES[] = "ACGT";
+// 01 in every 2 bits
+static const uint64_t EVEN_BITS = 0x5555555555555555ULL;
+
+/**** Packed_Chr ****/
+
+char Packed_Chr::base(const uLONG &pos) const
+{
+    char c = CODE_BASES[(words[pos>>5] >> ((pos&31)<<1)) & 3];
+
+    // the last run which starts at or before pos
+    const Genome_Run *e = upper_bound(exception_runs, exception_runs+exception_num, pos,
+        [](const uLONG &p, const Genome_Run &run){ return p < run.start; });
+    if(e != exception_runs and pos < (e-1)->start + (e-1)->length)
+        c = char((e-1)->base);
+
+    uLONG lo = 0, hi = soft_num;
+    while(lo < hi)
+    {
+        const uLONG mid = (lo+hi) / 2;
+        if(soft_runs[2*mid] <= pos)
+            lo = mid+1;
+        else
+            hi = mid;
+    }
+    if(lo > 0 and pos < soft_runs[2*(lo-1)] + soft_runs[2*(lo-1)+1])
+        c = tolower(c);
+
+    return c;
+}
+
+static char packed_base(const void *source, const uLONG &i)
+{
+    return static_cast<const Packed_Chr *>(source)->base(i);
+}
+
+/**** Build ****/
+
+namespace{
+
+// a sequence being packed
+struct Chr_Builder
+{
+    string name;
+    uLONG length = 0;
+    vector<uint64_t> words;
+    vector<Genome_Run> exception_runs;
+    vector<uint64_t> soft_runs;
+
+    void add(const char &c)
+    {
+        const char upper = toupper(c);
+        uint64_t code = 0;
+        switch(upper)
+        {
+            case 'A': code = 0; break;
+            case 'C': code = 1; break;
+            case 'G': code = 2; break;
+            case 'T': code = 3; break;
+            default:
+                if(not exception_runs.empty() and exception_runs.back().base == uint64_t(upper) and
+                    exception_runs.back().start + exception_runs.back().length == length)
+                    ++exception_runs.back().length;
+                else
+                    exception_runs.push_back(Genome_Run{length, 1, uint64_t(upper)});
+        }
+
+        if(islower(c))
+        {
+            if(not soft_runs.empty() and soft_runs[soft_runs.size()-2] + soft_runs.back() == length)
+                ++soft_runs.back();
+            else{
+                soft_runs.push_back(length);
+                soft_runs.push_back(1);
+            }
+        }
+
+        if((length & 31) == 0)
+            words.push_back(0);
+        words.back() |= code << ((length & 31) << 1);
+        ++length;
+    }
+};
+
+void write_u64(ofstream &OUT, const uint64_t &value)
+{
+    OUT.write(reinterpret_cast<const char *>(&value), 8);
+}
+
+void write_chr(ofstream &OUT, const Chr_Builder &chr)
+{
+    write_u64(OUT, chr.name.size());
+    string name = chr.name;
+    name.resize((name.size()+7)/8*8, '\0');
+    OUT.write(name.data(), name.size());
+    write_u64(OUT, chr.length);
+    write_u64(OUT, chr.exception_runs.size());
+    write_u64(OUT, chr.soft_runs.size()/2);
+    OUT.write(reinterpret_cast<const char *>(chr.exception_runs.data()), chr.exception_runs.size()*sizeof(Genome_Run));
+    OUT.write(reinterpret_cast<const char *>(chr.soft_runs.data()), chr.soft_runs.size()*8);
+    OUT.write(reinterpret_cast<const char *>(chr.words.data()), chr.words.size()*8);
+}
+
+}
+
+void Packed_Genome::build(const string &fasta_file, const string &file_name)
+{
+    ifstream IN(fasta_file, ifstream::in);
+    if(not IN)
+        throw Bad_IO("FATAL Error: cannot read "+fasta_file);
+
+    // the chr number is written at the end
+    ofstream OUT(file_name, ofstream::out | ofstream::binary);
+    if(not OUT)
+        throw Bad_IO("FATAL Error: cannot write "+file_name);
+    OUT.write(PGENOME_MAGIC, 8);
+    write_u64(OUT, BYTE_ORDER_MARK);
+    write_u64(OUT, 0);
+
+    uLONG chr_num = 0;
+    Chr_Builder chr;
+    bool in_chr = false;
+    string line;
+    while(getline(IN, line))
+    {
+        if(not line.empty() and line.back() == '\r')
+            line.pop_back();
+        if(line.empty())
+            continue;
+        if(line[0] == '>')
+        {
+            if(in_chr)
+            {
+                write_chr(OUT, chr);
+                ++chr_num;
+            }
+            chr = Chr_Builder();
+            chr.name = line.substr(1, line.find_first_of(" \t")-1);
+            in_chr = true;
+        }else if(in_chr){
+            for(const char &c: line)
+                chr.add(c);
+        }
+    }
+    if(in_chr)
+    {
+        write_chr(OUT, chr);
+        ++chr_num;
+    }
+
+    OUT.seekp(16);
+    write_u64(OUT, chr_num);
+    OUT.close();
+    if(not OUT)
+        throw Bad_IO("FATAL Error: cannot write "+file_name);
+}
+
+/**** Load ****/
+
+Packed_Genome::~Packed_Genome()
+{
+    if(mapped_data)
+        munmap(mapped_data, mapped_size);
+}
+
+void Packed_Genome::load(const string &file_name)
+{
+    int fd = open(file_name.c_str(), O_RDONLY);
+    if(fd == -1)
+        throw Bad_IO("FATAL Error: cannot read "+file_name);
+    struct stat file_stat;
+    if(fstat(fd, &file_stat) == -1 or file_stat.st_size < 24)
+    {
+        close(fd);
+        throw Bad_IO("FATAL Error: bad pgenome file "+file_name);
+    }
+    void *addr = mmap(nullptr, file_stat.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if(addr == MAP_FAILED)
+        throw Bad_IO("FATAL Error: cannot mmap "+file_name);
+
+    if(mapped_data)
+        munmap(mapped_data, mapped_size);
+    mapped_data = static_cast<char *>(addr);
+    mapped_size = file_stat.st_size;
+    chr_ids.clear();
+    chrs.clear();
+
+    // the file is 8-byte aligned, so are the mapped u64
+    const uint64_t *p = reinterpret_cast<const uint64_t *>(mapped_data);
+    const uint64_t *end = p + mapped_size/8;
+    if(strncmp(mapped_data, PGENOME_MAGIC, 8) != 0 or p[1] != BYTE_ORDER_MARK)
+        throw Bad_IO("FATAL Error: not a pgenome file of this byte order "+file_name);
+    const uLONG chr_num = p[2];
+    p += 3;
+
+    auto take = [&](const uLONG &num) -> const uint64_t *
+    {
+        if(uLONG(end - p) < num)
+            throw Bad_IO("FATAL Error: truncated pgenome file "+file_name);
+        const uint64_t *begin = p;
+        p += num;
+        return begin;
+    };
+
+    for(uLONG c=0; c<chr_num; c++)
+    {
+        const uLONG name_size = *take(1);
+        const char *name = reinterpret_cast<const char *>(take((name_size+7)/8));
+        const uint64_t *head = take(3);
+
+        Packed_Chr chr;
+        chr.length = head[0];
+        chr.exception_num = head[1];
+        chr.soft_num = head[2];
+        chr.exception_runs = reinterpret_cast<const Genome_Run *>(take(3*chr.exception_num));
+        chr.soft_runs = take(2*chr.soft_num);
+        chr.words = take((chr.length+31)/32);
+
+        chr_ids.push_back(string(name, name_size));
+        chrs[chr_ids.back()] = chr;
+    }
+}
+
+/**** Query ****/
+
+Seq_View Packed_Genome::get_chr_view(const string &chrID, STRAND strand) const
+{
+    const Packed_Chr &chr = chrs.at(chrID);
+    const bool reverse_comp = (strand == NEGATIVE);
+    return Seq_View(&chr, packed_base, chr.length, reverse_comp, reverse_comp);
+}
+
+// 1 bits of [begin, end) in a word
+static inline uint64_t range_bits(const uLONG &begin, const uLONG &end)
+{
+    return (end-begin == 64 ? ~uint64_t(0) : ((uint64_t(1) << (end-begin)) - 1)) << begin;
+}
+
+// bits of the positions [first, first+64) which are covered by the runs, the runs are sorted and not overlapped.
+// cur is the first run which may cover first, it moves forward with first
+template<typename Start_Length>
+static inline uint64_t run_bits(const uLONG &run_num, uLONG &cur, const uLONG &first, Start_Length start_length)
+{
+    uLONG start, length;
+    while(cur < run_num)
+    {
+        start_length(cur, start, length);
+        if(start + length > first)
+            break;
+        ++cur;
+    }
+
+    uint64_t bits = 0;
+    for(uLONG r=cur; r<run_num; r++)
+    {
+        start_length(r, start, length);
+        if(start >= first+64)
+            break;
+        const uLONG begin = max<uLONG>(start, first);
+        const uLONG end = min<uLONG>(start+length, first+64);
+        bits |= range_bits(begin-first, end-first);
+    }
+    return bits;
+}
+
+// the bases of code in a word of 32 bases are 32 bits
+static inline uint64_t code_bits(const uint64_t &word, const uint64_t &code)
+{
+    const uint64_t diff = word ^ (code * EVEN_BITS);
+    uint64_t bits = ~(diff | (diff >> 1)) & EVEN_BITS;
+    // move the even bits together
+    bits = (bits | (bits >> 1)) & 0x3333333333333333ULL;
+    bits = (bits | (bits >> 2)) & 0x0F0F0F0F0F0F0F0FULL;
+    bits = (bits | (bits >> 4)) & 0x00FF00FF00FF00FFULL;
+    bits = (bits | (bits >> 8)) & 0x0000FFFF0000FFFFULL;
+    bits = (bits | (bits >> 16)) & 0x00000000FFFFFFFFULL;
+    return bits;
+}
+
+void Packed_Genome::base_mask(const string &chrID, const STRAND &strand, const vector<char> &bases, Base_Mask &mask) const
+{
+    const Packed_Chr &chr = chrs.at(chrID);
+    auto in_bases = [&](char c) -> bool
+    {
+        if(strand == NEGATIVE)
+            c = comp_base(c);
+        return find(bases.cbegin(), bases.cend(), c) != bases.cend();
+    };
+
+    // the codes of the bases in uppercase and lowercase
+    vector<uint64_t> upper_codes, lower_codes;
+    for(uint64_t code=0; code<4; code++)
+    {
+        if(in_bases(CODE_BASES[code]))
+            upper_codes.push_back(code);
+        if(in_bases(tolower(CODE_BASES[code])))
+            lower_codes.push_back(code);
+    }
+
+    // the exception runs of the bases in uppercase and lowercase
+    vector<uLONG> upper_runs, lower_runs;
+    for(uLONG r=0; r<chr.exception_num; r++)
+    {
+        if(in_bases(char(chr.exception_runs[r].base)))
+            upper_runs.push_back(r);
+        if(in_bases(tolower(char(chr.exception_runs[r].base))))
+            lower_runs.push_back(r);
+    }
+
+    auto exception_run = [&](const uLONG &r, uLONG &start, uLONG &length)
+        { start = chr.exception_runs[r].start; length = chr.exception_runs[r].length; };
+    auto upper_run = [&](const uLONG &r, uLONG &start, uLONG &length) { exception_run(upper_runs[r], start, length); };
+    auto lower_run = [&](const uLONG &r, uLONG &start, uLONG &length) { exception_run(lower_runs[r], start, length); };
+    auto soft_run = [&](const uLONG &r, uLONG &start, uLONG &length)
+        { start = chr.soft_runs[2*r]; length = chr.soft_runs[2*r+1]; };
+
+    mask.assign(chr.length+1, false);
+    uLONG exception_cur = 0, upper_cur = 0, lower_cur = 0, soft_cur = 0;
+    for(uLONG w=0; w*64<chr.length; w++)
+    {
+        const uLONG first = w*64;
+        uint64_t upper = 0, lower = 0;
+        for(uLONG half=0; half<2; half++)
+        {
+            const uLONG word_index = 2*w + half;
+            if(word_index*32 >= chr.length)
+                break;
+            const uint64_t word = chr.words[word_index];
+            for(const uint64_t &code: upper_codes)
+                upper |= code_bits(word, code) << (32*half);
+            for(const uint64_t &code: lower_codes)
+                lower |= code_bits(word, code) << (32*half);
+        }
+
+        const uint64_t soft = run_bits(chr.soft_num, soft_cur, first, soft_run);
+        const uint64_t exception = run_bits(chr.exception_num, exception_cur, first, exception_run);
+        upper = (upper & ~exception) | run_bits(upper_runs.size(), upper_cur, first, upper_run);
+        lower = (lower & ~exception) | run_bits(lower_runs.size(), lower_cur, first, lower_run);
+        uint64_t bits = (upper & ~soft) | (lower & soft);
+        if(chr.length - first < 64)
+            bits &= range_bits(0, chr.length - first);
+
+        // bit i of the mask is the 1-based position i
+        mask.word(w) |= bits << 1;
+        if(w+1 < mask.word_num())
+            mask.word(w+1) |= bits >> 63;
+    }
+}
+
+}
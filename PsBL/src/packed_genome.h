@@ -0,0 +1,131 @@
+#ifndef PACKED_GENOME_H
+#define PACKED_GENOME_H
+
+#include "pan_type.h"
+#include "exceptions.h"
+#include "fasta.h"
+
+#include <cstdint>
+
+namespace pan{
+
+/**** Bit mask of bases ****/
+
+// a fixed-size bit array, the bits are stored in 64-bit words
+class Base_Mask
+{
+public:
+    Base_Mask() {}
+    explicit Base_Mask(const uLONG &size): bit_num(size), words((size+63)/64, 0) {}
+
+    uLONG size() const { return bit_num; }
+    bool empty() const { return bit_num == 0; }
+    void clear() { bit_num = 0; words.clear(); }
+    void assign(const uLONG &size, const bool &value)
+    {
+        bit_num = size;
+        words.assign((size+63)/64, value ? ~uint64_t(0) : 0);
+    }
+
+    bool operator[](const uLONG &i) const { return (words[i>>6] >> (i&63)) & 1; }
+    void set(const uLONG &i) { words[i>>6] |= uint64_t(1) << (i&63); }
+    void reset(const uLONG &i) { words[i>>6] &= ~(uint64_t(1) << (i&63)); }
+
+    // the bits [64*w, 64*w+64)
+    uint64_t &word(const uLONG &w) { return words[w]; }
+    uint64_t word(const uLONG &w) const { return words[w]; }
+    uLONG word_num() const { return words.size(); }
+
+private:
+    uLONG bit_num = 0;
+    vector<uint64_t> words;
+};
+
+/**** 2-bit packed genome (.pgenome) ****/
+
+// A .pgenome file holds the sequences of a fasta file in 2 bits per base (A=0 C=1 G=2 T=3), the other
+// characters are kept as runs of the same character and the lowercase (soft-masked) bases as runs, so the
+// sequences are the same as the fasta file. It is built once by fa2pgenome and memory mapped.
+//
+// Format, all integers are u64 in the host byte order (checked by a byte order mark):
+//     "PGENOME1" byte_order_mark chr_num | chr ...
+//     chr: name size | name padded to 8 bytes | length | exception run number | soft-mask run number |
+//          exception runs (start length character) | soft-mask runs (start length) | ceil(length/32) words
+//     The base i is bits [2*(i%32), 2*(i%32)+2) of word i/32, the runs are sorted by start
+
+// a run of the same character or of soft-masked bases
+struct Genome_Run
+{
+    uint64_t start;
+    uint64_t length;
+    uint64_t base;                                  // the uppercase character of an exception run, 0 for soft-mask runs
+};
+
+// a sequence of the packed genome, the data is in the mapped file
+struct Packed_Chr
+{
+    uLONG length = 0;
+    const uint64_t *words = nullptr;
+    const Genome_Run *exception_runs = nullptr;
+    uLONG exception_num = 0;
+    const uint64_t *soft_runs = nullptr;            // start and length of each run
+    uLONG soft_num = 0;
+
+    // the character at 0-based pos as in the fasta file
+    char base(const uLONG &pos) const;
+};
+
+// .pgenome file name
+inline bool is_packed_genome_file(const string &file_name)
+{
+    return file_name.size() >= 8 and file_name.compare(file_name.size()-8, 8, ".pgenome") == 0;
+}
+
+class Packed_Genome
+{
+public:
+    Packed_Genome() {}
+    explicit Packed_Genome(const string &file_name) { load(file_name); }
+    ~Packed_Genome();
+
+    Packed_Genome(const Packed_Genome &) = delete;
+    Packed_Genome &operator=(const Packed_Genome &) = delete;
+
+    // map a .pgenome file
+    void load(const string &file_name);
+
+    // pack the sequences of a fasta file into a .pgenome file, the chr_id is the head line before the first space
+    static void build(const string &fasta_file, const string &file_name);
+
+    bool has_chr(const string &chrID) const { return chrs.find(chrID) != chrs.cend(); }
+    uLONG get_chr_len(const string &chrID) const { return chrs.at(chrID).length; }
+    uLONG get_chr_num() const { return chr_ids.size(); }
+    // chr_ids in the file order
+    const StringArray &get_chr_ids() const { return chr_ids; }
+
+    /*
+    Return a view of the sequence of given chrID without unpacking, the same as qFasta::get_chr_view
+    chrID               -- The chrID
+    strand              -- Strand, the view of NEGATIVE is the reverse-complement
+    */
+    Seq_View get_chr_view(const string &chrID, STRAND strand=POSITIVE) const;
+
+    /*
+    Set the mask of the bases which are in the list, 32 bases are compared at a time
+    chrID               -- The chrID
+    strand              -- The bases of NEGATIVE are complementary, in the coordinates of the positive strand
+    bases               -- Base list, case-sensitive as the fasta file
+    mask                -- chr_len+1 bits, bit i is the 1-based position i, bit 0 is not set
+    */
+    void base_mask(const string &chrID, const STRAND &strand, const vector<char> &bases, Base_Mask &mask) const;
+
+private:
+    char *mapped_data = nullptr;
+    uLONG mapped_size = 0;
+    StringArray chr_ids;
+    MapStringT<Packed_Chr> chrs;
+};
+
+}
+
+#endif // PACKED_GENOME_H
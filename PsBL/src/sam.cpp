@@ -92,6 +92,16 @@ bool read_a_sam_record(istream &IN, Sam_Record &read_record)
     read_record.attributes.clear();
 
     string cur_line;
+    if(not read_a_sam_line(IN, cur_line))
+        return false;
+
+    parse_sam_record(cur_line, read_record);
+    return true;
+}
+
+bool read_a_sam_line(istream &IN, string &cur_line)
+{
+    cur_line.clear();
     //cout << "read_a_sam_record..." << endl;
     while(IN and cur_line.empty())
         getline(IN, cur_line);
@@ -105,6 +115,13 @@ bool read_a_sam_record(istream &IN, Sam_Record &read_record)
     {
         return false;
     }
+    return true;
+}
+
+void parse_sam_record(const string &cur_line, Sam_Record &read_record)
+{
+    read_record.attributes.clear();
+
     istringstream string_in(cur_line);
     string_in >> read_record.read_id >> read_record.flag >> read_record.chr_id >> read_record.pos >> 
         read_record.map_quanlity >> read_record.cigar >> read_record.read_id_next >> read_record.pos_next >> 
@@ -117,8 +134,6 @@ bool read_a_sam_record(istream &IN, Sam_Record &read_record)
         string_in >> cur_attributes;
         read_record.attributes.push_back(cur_attributes);
     }
-
-    return true;
 }
 
 
@@ -74,6 +74,8 @@ using ReadPair = pair<Sam_Record, Sam_Record>;
 
 /****** FUNCTION from Sam file *******/
 bool read_a_sam_record(istream &IN, Sam_Record &read_record);                   // read a record from sam file
+bool read_a_sam_line(istream &IN, string &cur_line);                            // read the line of next record from sam file
+void parse_sam_record(const string &cur_line, Sam_Record &read_record);         // parse a record line of sam file
 void write_a_sam_record(ostream &OUT, const Sam_Record &read_record);           // write a record to sam file
 bool read_a_read_record(istream &IN, vector<Sam_Record> &read_records);         // read records for multi-map from sam file (slow)
 void write_a_read_record(ostream &OUT, const vector<Sam_Record> &read_records); // write records for multi-map to sam file (slow)
@@ -0,0 +1,456 @@
+#include "signal_file.h"
+#include "binary_io.h"
+#include "string_split.h"
+
+#include <zlib.h>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <limits>
+
+namespace pan{
+
+static const char BSIG_MAGIC[] = "BSIG";
+static const uINT BSIG_VERSION = 2;
+
+// the types of the arrays
+static const unsigned char UINT32_ARRAY = 0;
+static const unsigned char FLOAT32_ARRAY = 1;
+static const unsigned char FLOAT64_ARRAY = 2;
+
+// the byte of decimals of the %g numbers
+static const unsigned char GENERAL_CODE = 255;
+static const int MAX_DECIMALS = 15;
+
+// the arrays are copied as they are in memory
+static void check_byte_order()
+{
+    const uint32_t one = 1;
+    if(*reinterpret_cast<const unsigned char*>(&one) != 1)
+        throw Unexpected_Error("FATAL Error: bsig files are only supported on little-endian machines");
+}
+
+/**** Numbers ****/
+
+// the longest number text of format_number
+static const uLONG MAX_NUMBER_TEXT = 512;
+
+// value as %.Nf for N decimals, %g for GENERAL_NUMBER, NULL for NaN, return the size
+static uLONG format_number(const double &value, const char &decimals, char *buff)
+{
+    if(std::isnan(value))
+    {
+        memcpy(buff, "NULL", 4);
+        return 4;
+    }
+    if(decimals == Signal_Row::GENERAL_NUMBER)
+        return Fast_Writer::format_general(value, buff);
+    if(decimals < 0 or decimals > MAX_DECIMALS)
+        throw Unexpected_Error("FATAL Error: unknown decimals of a number: "+to_string(int(decimals)));
+    return snprintf(buff, MAX_NUMBER_TEXT, "%.*f", int(decimals), value);
+}
+
+// the same as parse_double of the text of value
+static double text_value(const double &value, const char &decimals)
+{
+    if(std::isnan(value) or value == 0)
+        return value;
+
+    unsigned long long scaled;
+    int exp;
+    if(decimals >= 0 and Fast_Writer::scale_fixed(value, decimals, scaled))
+    {
+        const double text_value = double(scaled) / POW10[int(decimals)];
+        return std::signbit(value) ? -text_value : text_value;
+    }
+    if(decimals == Signal_Row::GENERAL_NUMBER and Fast_Writer::scale_general(value, scaled, exp))
+    {
+        const double text_value = double(scaled) / POW10[5-exp];
+        return std::signbit(value) ? -text_value : text_value;
+    }
+
+    char buff[MAX_NUMBER_TEXT];
+    const uLONG size = format_number(value, decimals, buff);
+    return parse_double(Field_View(buff, size));
+}
+
+// the number of N decimals of a float
+inline double float_value(const float &value, const double &scale)
+{
+    const double text_value = std::round(std::fabs(double(value)) * scale) / scale;
+    return std::signbit(value) ? -text_value : text_value;
+}
+
+const char Signal_Row::GENERAL_NUMBER;
+
+string signal_number_text(const double &value, const char &decimals)
+{
+    char buff[MAX_NUMBER_TEXT];
+    return string(buff, format_number(value, decimals, buff));
+}
+
+void Signal_Row::write_value(Fast_Writer &OUT, const uLONG &i) const
+{
+    if(std::isnan(values[i]))
+        OUT.write("NULL", 4);
+    else if(decimals == GENERAL_NUMBER)
+        OUT << values[i];
+    else
+        OUT.write_fixed(values[i], decimals);
+}
+
+void Signal_Row::write_value(ostream &OUT, const uLONG &i) const
+{
+    char buff[MAX_NUMBER_TEXT];
+    OUT.write(buff, format_number(values[i], decimals, buff));
+}
+
+/**** Writer ****/
+
+BSig_Writer::BSig_Writer(const string &file_name, const Signal_Layout &layout, const int &level, const uLONG &block_size):
+    file_name(file_name), layout(layout), level(level), block_size(block_size)
+{
+    if(layout.group == 0)
+        throw Unexpected_Error("FATAL Error: the group size of a signal file should be positive");
+    check_byte_order();
+
+    OUT.open(file_name, ofstream::out | ofstream::binary);
+    if(not OUT)
+        throw Bad_IO("FATAL Error: cannot write "+file_name);
+
+    string file_head(BSIG_MAGIC, 4);
+    put_fixed(file_head, BSIG_VERSION, 4);
+    OUT.write(file_head.data(), file_head.size());
+}
+
+void BSig_Writer::write_head(const string &line)
+{
+    head += line;
+    head += '\n';
+}
+
+void BSig_Writer::write_record(const Signal_Record &record)
+{
+    for(const Signal_Row &row: record.rows)
+    {
+        if(row.heads.size() != layout.head_num or row.values.size() % layout.group != 0)
+            throw Unexpected_Error("FATAL Error: the signal row of "+record.id+" does not match the layout");
+        if(row.decimals != Signal_Row::GENERAL_NUMBER and (row.decimals < 0 or row.decimals > MAX_DECIMALS))
+            throw Unexpected_Error("FATAL Error: unknown decimals of the signal row of "+record.id);
+        put_row(record, row);
+    }
+}
+
+void BSig_Writer::put_row(const Signal_Record &record, const Signal_Row &row)
+{
+    // a transcript starts a block if the block is full
+    if(index.empty() or index.back().len != record.len or index.back().id != record.id)
+    {
+        if(raw.size() >= block_size)
+            flush_block();
+        Signal_Index_Item item;
+        item.id = record.id;
+        item.len = record.len;
+        item.block = block_offsets.size();
+        item.offset = raw.size();
+        index.push_back(item);
+    }
+    ++index.back().row_num;
+
+    for(const string &head: row.heads)
+        put_text(raw, head.data(), head.size());
+    put_varint(raw, row.size() / layout.group);
+
+    // the smallest array of the numbers, a float keeps a number of N decimals if it is rounded back to it
+    const bool fixed = row.decimals != Signal_Row::GENERAL_NUMBER;
+    const double scale = fixed ? POW10[int(row.decimals)] : 1;
+    bool is_uint32 = true, is_float32 = fixed;
+    numbers.resize(row.size());
+    for(uLONG i=0; i<row.size(); i++)
+    {
+        const double value = text_value(row.values[i], row.decimals);
+        numbers[i] = value;
+        if(is_uint32 and not (value >= 0 and value <= 4294967295.0 and value == std::floor(value) and not std::signbit(value)))
+            is_uint32 = false;
+        if(is_float32 and not std::isnan(value) and not (std::fabs(value) < 1e30 and float_value(float(value), scale) == value))
+            is_float32 = false;
+    }
+
+    const unsigned char type = is_uint32 ? UINT32_ARRAY : (is_float32 ? FLOAT32_ARRAY : FLOAT64_ARRAY);
+    raw.push_back( char(type) );
+    raw.push_back( char(fixed ? row.decimals : GENERAL_CODE) );
+
+    const uLONG raw_size = raw.size();
+    if(type == UINT32_ARRAY)
+    {
+        raw.resize(raw_size + numbers.size()*4);
+        char *p = &raw[raw_size];
+        for(const double &value: numbers)
+        {
+            const uint32_t number = value;
+            memcpy(p, &number, 4);
+            p += 4;
+        }
+    }else if(type == FLOAT32_ARRAY)
+    {
+        raw.resize(raw_size + numbers.size()*4);
+        char *p = &raw[raw_size];
+        for(const double &value: numbers)
+        {
+            const float number = value;
+            memcpy(p, &number, 4);
+            p += 4;
+        }
+    }else{
+        raw.resize(raw_size + numbers.size()*8);
+        if(not numbers.empty())
+            memcpy(&raw[raw_size], numbers.data(), numbers.size()*8);
+    }
+}
+
+// raw size, stored size and the data, which is compressed if it is smaller
+void BSig_Writer::write_data(const string &data)
+{
+    const char *stored = data.data();
+    uLONG stored_size = data.size();
+    if(level > 0)
+    {
+        uLongf compressed_size = compressBound(data.size());
+        compressed.resize(compressed_size);
+        if(compress2((Bytef*)&compressed[0], &compressed_size, (const Bytef*)data.data(), data.size(), level) != Z_OK)
+            throw Unexpected_Error("FATAL Error: compress bsig block failed");
+        if(compressed_size < data.size())
+        {
+            stored = compressed.data();
+            stored_size = compressed_size;
+        }
+    }
+
+    string block_head;
+    put_fixed(block_head, data.size(), 4);
+    put_fixed(block_head, stored_size, 4);
+    OUT.write(block_head.data(), block_head.size());
+    OUT.write(stored, stored_size);
+}
+
+void BSig_Writer::flush_block()
+{
+    if(raw.empty())
+        return;
+    block_offsets.push_back(OUT.tellp());
+    write_data(raw);
+    raw.clear();
+}
+
+void BSig_Writer::close()
+{
+    if(closed)
+        return;
+    flush_block();
+
+    string footer;
+    put_text(footer, head.data(), head.size());
+    put_varint(footer, layout.head_num);
+    put_varint(footer, layout.group);
+    put_varint(footer, block_offsets.size());
+    for(const uLONG &offset: block_offsets)
+        put_varint(footer, offset);
+    put_varint(footer, index.size());
+    for(const Signal_Index_Item &item: index)
+    {
+        put_text(footer, item.id.data(), item.id.size());
+        put_varint(footer, item.len);
+        put_varint(footer, item.block);
+        put_varint(footer, item.offset);
+        put_varint(footer, item.row_num);
+    }
+
+    const uLONG footer_offset = OUT.tellp();
+    write_data(footer);
+
+    string trailer;
+    put_fixed(trailer, footer_offset, 8);
+    trailer.append(BSIG_MAGIC, 4);
+    OUT.write(trailer.data(), trailer.size());
+
+    OUT.close();
+    if(not OUT)
+        throw Bad_IO("FATAL Error: cannot write "+file_name);
+    closed = true;
+}
+
+/**** Reader ****/
+
+// read a block at offset into raw
+static void read_bsig_data(ifstream &IN, const string &file_name, const uLONG &offset, string &compressed, string &raw)
+{
+    IN.clear();
+    IN.seekg(offset);
+    char head[8];
+    read_exact(IN, head, 8, file_name);
+    const char *p = head;
+    uLongf raw_size = get_fixed(p, 4);
+    const uLONG stored_size = get_fixed(p, 4);
+
+    raw.resize(raw_size);
+    if(stored_size == raw_size)
+    {
+        if(raw_size > 0)
+            read_exact(IN, &raw[0], raw_size, file_name);
+        return;
+    }
+    compressed.resize(stored_size);
+    read_exact(IN, &compressed[0], stored_size, file_name);
+    if(uncompress((Bytef*)&raw[0], &raw_size, (const Bytef*)compressed.data(), stored_size) != Z_OK or raw_size != raw.size())
+        throw Bad_IO("FATAL Error: bad bsig block in "+file_name);
+}
+
+static void read_signal_row(const char *&p, const char *end, const Signal_Layout &layout, Signal_Row &row)
+{
+    row.heads.resize(layout.head_num);
+    for(string &head: row.heads)
+        get_text(p, end, head);
+
+    const uLONG number_num = get_varint(p, end) * layout.group;
+    if(end - p < 2)
+        throw Bad_IO("FATAL Error: truncated block in bsig file");
+    const unsigned char type = *p++;
+    const unsigned char decimals = *p++;
+    if(type > FLOAT64_ARRAY or (decimals > MAX_DECIMALS and decimals != GENERAL_CODE))
+        throw Bad_IO("FATAL Error: bad line in bsig file");
+    row.decimals = decimals == GENERAL_CODE ? Signal_Row::GENERAL_NUMBER : char(decimals);
+
+    const uLONG array_size = number_num * (type == FLOAT64_ARRAY ? 8 : 4);
+    if(uLONG(end - p) < array_size)
+        throw Bad_IO("FATAL Error: truncated block in bsig file");
+
+    row.values.resize(number_num);
+    if(type == UINT32_ARRAY)
+    {
+        for(uLONG i=0; i<number_num; i++)
+        {
+            uint32_t number;
+            memcpy(&number, p+i*4, 4);
+            row.values[i] = number;
+        }
+    }else if(type == FLOAT32_ARRAY)
+    {
+        const double scale = POW10[int(row.decimals)];
+        for(uLONG i=0; i<number_num; i++)
+        {
+            float number;
+            memcpy(&number, p+i*4, 4);
+            row.values[i] = float_value(number, scale);
+        }
+    }else if(number_num > 0)
+        memcpy(&row.values[0], p, array_size);
+    p += array_size;
+}
+
+BSig_Reader::BSig_Reader(const string &file_name): file_name(file_name)
+{
+    check_byte_order();
+    IN.open(file_name, ifstream::in | ifstream::binary);
+    if(not IN)
+        throw Bad_IO("FATAL Error: "+file_name+" cannot be read");
+
+    char file_head[8];
+    read_exact(IN, file_head, 8, file_name);
+    if(strncmp(file_head, BSIG_MAGIC, 4) != 0)
+        throw Bad_IO("FATAL Error: bad bsig file "+file_name);
+    const char *p = file_head + 4;
+    if(get_fixed(p, 4) != BSIG_VERSION)
+        throw Bad_IO("FATAL Error: unknown bsig version of "+file_name);
+
+    char trailer[12];
+    IN.seekg(-12, ios::end);
+    read_exact(IN, trailer, 12, file_name);
+    if(strncmp(trailer+8, BSIG_MAGIC, 4) != 0)
+        throw Bad_IO("FATAL Error: bad bsig file "+file_name);
+    p = trailer;
+    const uLONG footer_offset = get_fixed(p, 8);
+
+    string footer;
+    read_bsig_data(IN, file_name, footer_offset, compressed, footer);
+
+    p = footer.data();
+    const char *end = p + footer.size();
+    get_text(p, end, head_lines);
+    file_layout.head_num = get_varint(p, end);
+    file_layout.group = get_varint(p, end);
+    block_offsets.resize( get_varint(p, end) );
+    for(uLONG &offset: block_offsets)
+        offset = get_varint(p, end);
+    index.resize( get_varint(p, end) );
+    for(uLONG i=0; i<index.size(); i++)
+    {
+        Signal_Index_Item &item = index[i];
+        get_text(p, end, item.id);
+        item.len = get_varint(p, end);
+        item.block = get_varint(p, end);
+        item.offset = get_varint(p, end);
+        item.row_num = get_varint(p, end);
+        if(item.block >= block_offsets.size())
+            throw Bad_IO("FATAL Error: bad index of bsig file "+file_name);
+        index_map.insert( pair<string, uLONG>(item.id, i) );
+    }
+}
+
+long BSig_Reader::find(const string &id) const
+{
+    auto it = index_map.find(id);
+    return it == index_map.end() ? -1 : long(it->second);
+}
+
+bool BSig_Reader::next(Signal_Record &record)
+{
+    if(next_item >= index.size())
+        return false;
+    read(next_item++, record);
+    return true;
+}
+
+void BSig_Reader::load_block(const uLONG &block)
+{
+    if(cached_block == long(block))
+        return;
+    cached_block = -1;
+    read_bsig_data(IN, file_name, block_offsets[block], compressed, raw);
+    cached_block = block;
+}
+
+void BSig_Reader::read(const uLONG &i, Signal_Record &record)
+{
+    const Signal_Index_Item &item = index.at(i);
+    load_block(item.block);
+    if(item.offset > raw.size())
+        throw Bad_IO("FATAL Error: bad index of bsig file "+file_name);
+
+    record.id = item.id;
+    record.len = item.len;
+    record.rows.resize(item.row_num);
+    const char *p = raw.data() + item.offset;
+    const char *end = raw.data() + raw.size();
+    for(Signal_Row &row: record.rows)
+        read_signal_row(p, end, file_layout, row);
+}
+
+/**** Text ****/
+
+void write_signal_text(const Signal_Record &record, const Signal_Layout &layout, Fast_Writer &OUT)
+{
+    for(const Signal_Row &row: record.rows)
+    {
+        OUT << record.id << '\t' << record.len;
+        for(const string &head: row.heads)
+            OUT << '\t' << head;
+        for(uLONG i=0; i<row.size(); i++)
+        {
+            OUT << (i % layout.group == 0 ? '\t' : ',');
+            row.write_value(OUT, i);
+        }
+        OUT << '\n';
+    }
+}
+
+}
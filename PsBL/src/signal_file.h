@@ -0,0 +1,172 @@
+#ifndef SIGNAL_FILE_H
+#define SIGNAL_FILE_H
+
+#include "pan_type.h"
+#include "exceptions.h"
+#include "fast_writer.h"
+
+#include <fstream>
+
+namespace pan{
+
+/**** Binary transcript signal file (.bsig) ****/
+
+// A .bsig file holds the same lines as a transcript signal file of icSHAPE (calcRT, combineRTreplicates,
+// normalizeRTfile, calcEnrich, filterEnrich), and it can be converted back to the same text. A text line:
+//     id \t len \t head columns \t value columns
+// The head columns (type, rpkm, scaling factors) are kept as text. A value column is a number, or a group of
+// numbers joined by ',' (calcEnrich). The numbers of a line are printed as %.Nf or %g, or NULL. The lines of a
+// transcript are consecutive, the # lines are the head.
+//
+// Format, all integers and arrays are little-endian:
+//     "BSIG" version(u32) | blocks | footer | footer offset(u64) "BSIG"
+//     block: raw size(u32) stored size(u32) data, the data is compressed by zlib if the stored size < raw size
+//     The lines of a transcript are in one block, a line in the raw data:
+//         varint size and text of each head column; varint(value column number); a byte of type, a byte of
+//         decimals (N of %.Nf, 255 for %g) and the array of the numbers:
+//         UINT32: uint32 of each number, the numbers are integers
+//         FLOAT32: float of each number, a number of N decimals is round(float*10^N)/10^N
+//         FLOAT64: double of each number
+//         NULL is NaN
+//     footer, stored as a block: varint of head size and head text, head column number, group size, block number,
+//         the offset of each block, transcript number, and the id (size and text), len, block, offset in the raw block
+//         and line number of each transcript
+//     A number is the same as parse_double of the text, the writer takes the type of the smallest array which
+//     keeps the numbers of a line
+
+// columns of a line
+struct Signal_Layout
+{
+    uINT head_num = 1;                              // head columns between len and the values
+    uINT group = 1;                                 // numbers in a value column
+
+    Signal_Layout() {}
+    Signal_Layout(const uINT &head_num, const uINT &group): head_num(head_num), group(group) {}
+
+    bool operator==(const Signal_Layout &other) const { return head_num == other.head_num and group == other.group; }
+    bool operator!=(const Signal_Layout &other) const { return not (*this == other); }
+};
+
+// a line of a transcript
+struct Signal_Row
+{
+    // decimals of the numbers written as ostream << value (%g)
+    static const char GENERAL_NUMBER = -1;
+
+    StringArray heads;
+    DoubleArray values;                             // the numbers of value column i are [i*group, i*group+group), NULL is NaN
+    char decimals = 3;                              // the numbers are printed as %.Nf, or %g for GENERAL_NUMBER
+
+    uLONG size() const { return values.size(); }
+
+    // write number i as in the text file
+    void write_value(Fast_Writer &OUT, const uLONG &i) const;
+    void write_value(ostream &OUT, const uLONG &i) const;
+};
+
+// the consecutive lines of a transcript
+struct Signal_Record
+{
+    string id;
+    uLONG len = 0;
+    vector<Signal_Row> rows;
+};
+
+// a transcript in the file
+struct Signal_Index_Item
+{
+    string id;
+    uLONG len = 0;
+    uLONG block = 0;
+    uLONG offset = 0;                               // offset in the raw block
+    uLONG row_num = 0;
+};
+
+// .bsig file name
+inline bool is_bsig_file(const string &file_name)
+{
+    return file_name.size() >= 5 and file_name.compare(file_name.size()-5, 5, ".bsig") == 0;
+}
+
+class BSig_Writer
+{
+public:
+    // level -- zlib compression level of the blocks, 0 to store the blocks without compression
+    BSig_Writer(const string &file_name, const Signal_Layout &layout, const int &level=0, const uLONG &block_size=1<<20);
+    ~BSig_Writer(){ close(); }
+
+    // a # line of the head without \n
+    void write_head(const string &line);
+    // the rows of a transcript, a number is stored as parse_double of its text, so the file is the same as
+    // the one of the text lines. The row heads are the head columns.
+    // Throw Unexpected_Error if a row does not match the layout
+    void write_record(const Signal_Record &record);
+    void close();
+
+private:
+    void flush_block();
+    void write_data(const string &data);
+    // add a row of the numbers to the block of transcript id
+    void put_row(const Signal_Record &record, const Signal_Row &row);
+
+    ofstream OUT;
+    const string file_name;
+    const Signal_Layout layout;
+    const int level;
+    const uLONG block_size;
+    bool closed = false;
+
+    string head;
+    string raw;
+    string compressed;
+    DoubleArray numbers;                            // the numbers of a row as parse_double of the text
+
+    vector<uLONG> block_offsets;
+    vector<Signal_Index_Item> index;
+};
+
+class BSig_Reader
+{
+public:
+    BSig_Reader(const string &file_name);
+
+    const string &head() const { return head_lines; }
+    const Signal_Layout &layout() const { return file_layout; }
+    const vector<Signal_Index_Item> &get_index() const { return index; }
+
+    // position of a transcript in the index (the first one of a duplicated id), -1 if it is not in the file
+    long find(const string &id) const;
+
+    // the next transcript in the file order, return false at the end of file
+    bool next(Signal_Record &record);
+
+    // the transcript at position i of the index, the last block is cached
+    void read(const uLONG &i, Signal_Record &record);
+
+private:
+    void load_block(const uLONG &block);
+
+    ifstream IN;
+    const string file_name;
+
+    string head_lines;
+    Signal_Layout file_layout;
+    vector<uLONG> block_offsets;
+    vector<Signal_Index_Item> index;
+    MapStringuLONG index_map;
+    uLONG next_item = 0;
+
+    long cached_block = -1;
+    string compressed;
+    string raw;
+};
+
+// value as a number of the text file: %.Nf for N decimals, %g for GENERAL_NUMBER, NULL for NaN
+string signal_number_text(const double &value, const char &decimals);
+
+// write the lines of a transcript as text, the same as the text file
+void write_signal_text(const Signal_Record &record, const Signal_Layout &layout, Fast_Writer &OUT);
+
+}
+
+#endif // SIGNAL_FILE_H
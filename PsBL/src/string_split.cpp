@@ -73,6 +73,134 @@ void split(const string &String, StringArray &Vec)
     while( ss >> cur_item ) Vec.push_back(cur_item);
 }
 
+/**** Fields without copy ****/
+
+void split(const string &String, const char &c, FieldArray &Vec)
+{
+    split(Field_View(String.data(), String.size()), c, Vec);
+}
+
+void split(const Field_View &field, const char &c, FieldArray &Vec)
+{
+    Vec.clear();
+    const char *begin = field.data();
+    const char *end = begin + field.size();
+    const char *sep;
+    while( (sep = static_cast<const char *>(memchr(begin, c, end-begin))) != nullptr )
+    {
+        Vec.emplace_back(begin, sep-begin);
+        begin = sep + 1;
+    }
+    Vec.emplace_back(begin, end-begin);
+}
+
+void split(const string &String, FieldArray &Vec)
+{
+    Vec.clear();
+    const char *p = String.data();
+    const char *end = p + String.size();
+    while(true)
+    {
+        while(p != end and isspace(*p))
+            ++p;
+        if(p == end)
+            break;
+        const char *begin = p;
+        while(p != end and not isspace(*p))
+            ++p;
+        Vec.emplace_back(begin, p-begin);
+    }
+}
+
+// parse [+-]digits of at most 18 digits, return false for the other forms
+static inline bool parse_plain_integer(const Field_View &field, bool &negative, uLONG &value)
+{
+    const char *p = field.data();
+    const char *end = p + field.size();
+    negative = false;
+    if(p != end and (*p == '-' or *p == '+'))
+        negative = (*p++ == '-');
+    const char *digits = p;
+    value = 0;
+    while(p != end and is_digit(*p))
+        value = value * 10 + (*p++ - '0');
+    return p != digits and p - digits <= 18;
+}
+
+uLONG parse_uLONG(const Field_View &field)
+{
+    bool negative;
+    uLONG value;
+    if(not parse_plain_integer(field, negative, value))
+        return stoul(field.str());
+    // stoul negates the value in unsigned
+    return negative ? -value : value;
+}
+
+long parse_long(const Field_View &field)
+{
+    bool negative;
+    uLONG value;
+    if(not parse_plain_integer(field, negative, value))
+        return stol(field.str());
+    return negative ? -long(value) : long(value);
+}
+
+bool parse_plain_decimal(const Field_View &field, const uLONG &max_mantissa, const uLONG &max_decimals,
+    bool &negative, uLONG &mantissa, uLONG &decimals)
+{
+    const char *p = field.data();
+    const char *end = p + field.size();
+    negative = false;
+    if(p != end and (*p == '-' or *p == '+'))
+        negative = (*p++ == '-');
+
+    mantissa = 0;
+    decimals = 0;
+    uLONG digit_num = 0;
+    while(p != end and is_digit(*p))
+    {
+        mantissa = mantissa * 10 + (*p++ - '0');
+        ++digit_num;
+    }
+    if(p != end and *p == '.')
+    {
+        ++p;
+        while(p != end and is_digit(*p))
+        {
+            mantissa = mantissa * 10 + (*p++ - '0');
+            ++digit_num;
+            ++decimals;
+        }
+    }
+    // exponent or hex
+    if(p != end and (*p == 'e' or *p == 'E' or *p == 'x' or *p == 'X'))
+        return false;
+    return digit_num > 0 and digit_num <= 18 and mantissa <= max_mantissa and decimals <= max_decimals;
+}
+
+double parse_double(const Field_View &field)
+{
+    bool negative;
+    uLONG mantissa, decimals;
+    // mantissa and 10^decimals are exact doubles, so the division is rounded once as strtod
+    if(not parse_plain_decimal(field, uLONG(1) << 53, 22, negative, mantissa, decimals))
+        return stod(field.str());
+    const double value = double(mantissa) / POW10[decimals];
+    return negative ? -value : value;
+}
+
+float parse_float(const Field_View &field)
+{
+    bool negative;
+    uLONG mantissa, decimals;
+    // mantissa and 10^decimals are exact floats, so the division is rounded once as strtof
+    if(not parse_plain_decimal(field, uLONG(1) << 24, 10, negative, mantissa, decimals))
+        return stof(field.str());
+    const float value = float(mantissa) / float(POW10[decimals]);
+    return negative ? -value : value;
+}
+
 // trimming a string
 void trim(string &String, const char &c)
 {
@@ -17,6 +17,78 @@ void split(const string &String, const char *seperators, StringArray &Vec);
 void split(const string &String, StringArray &Vec);
 
 
+/**** Fields without copy ****/
+
+/*
+A field of a line, it points into the line and is valid until the line is changed. With a FieldArray
+kept across lines, splitting and parsing a line do not allocate memory
+
+string line;
+FieldArray data;
+while(getline(IN, line))
+{
+    split(line, '\t', data);
+    uLONG pos = parse_uLONG(data[1]);
+    double value = parse_double(data[2]);
+    string chr_id = data[0];
+}
+*/
+class Field_View
+{
+public:
+    Field_View() {}
+    Field_View(const char *ptr, const uLONG &len): ptr(ptr), len(len) {}
+
+    const char *data() const { return ptr; }
+    uLONG size() const { return len; }
+    bool empty() const { return len == 0; }
+    char operator[](const uLONG &i) const { return ptr[i]; }
+
+    string str() const { return string(ptr, len); }
+    operator string() const { return str(); }
+
+    bool operator==(const Field_View &other) const { return len == other.len and memcmp(ptr, other.ptr, len) == 0; }
+    bool operator==(const string &other) const { return len == other.size() and memcmp(ptr, other.data(), len) == 0; }
+    bool operator==(const char *other) const { return strncmp(ptr, other, len) == 0 and other[len] == '\0'; }
+    template<typename T>
+    bool operator!=(const T &other) const { return not (*this == other); }
+
+private:
+    const char *ptr = "";
+    uLONG len = 0;
+};
+
+inline ostream &operator<<(ostream &OUT, const Field_View &field) { return OUT.write(field.data(), field.size()); }
+
+using FieldArray = vector<Field_View>;
+
+// split a string or a field with a char into fields, the memory of Vec is reused
+void split(const string &String, const char &c, FieldArray &Vec);
+void split(const Field_View &field, const char &c, FieldArray &Vec);
+// split a string with blank spaces into fields
+void split(const string &String, FieldArray &Vec);
+
+// the same as stoul/stol/stod/stof, the plain decimal numbers are parsed in place and the others
+// (blank spaces, exponents, inf/nan, too many digits, errors) by the std functions
+uLONG parse_uLONG(const Field_View &field);
+long parse_long(const Field_View &field);
+double parse_double(const Field_View &field);
+float parse_float(const Field_View &field);
+
+// 10^0...10^22 are exact doubles
+const double POW10[] = {
+    1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+    1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+};
+
+inline bool is_digit(const char &c) { return c >= '0' and c <= '9'; }
+
+// parse [+-]digits[.digits] at the start of field to the exact mantissa and the number of decimals, return
+// false for the other forms, the mantissa > max_mantissa and the decimals > max_decimals. The chars after the
+// number (an exponent or hex is rejected) are left to the caller
+bool parse_plain_decimal(const Field_View &field, const uLONG &max_mantissa, const uLONG &max_decimals,
+    bool &negative, uLONG &mantissa, uLONG &decimals);
+
 // trimming a string
 void trim(string &String, const char &c);
 void trim(string &String);
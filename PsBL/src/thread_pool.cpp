@@ -0,0 +1,48 @@
+#include "thread_pool.h"
+
+namespace pan{
+
+Thread_Pool::Thread_Pool(uINT thread_num)
+{
+    if(thread_num < 1)
+        thread_num = 1;
+
+    for(uINT i=0; i<thread_num; i++)
+        workers.push_back( std::thread(&Thread_Pool::worker_loop, this) );
+}
+
+Thread_Pool::~Thread_Pool()
+{
+    {
+        std::lock_guard<std::mutex> lock(queue_mutex);
+        stopped = true;
+    }
+    queue_cv.notify_all();
+    for(std::thread &worker: workers)
+        worker.join();
+}
+
+void Thread_Pool::worker_loop()
+{
+    while(true)
+    {
+        std::function<void()> task;
+        {
+            std::unique_lock<std::mutex> lock(queue_mutex);
+            queue_cv.wait(lock, [this](){ return stopped or not tasks.empty(); });
+            if(tasks.empty())
+                return;
+            task = std::move(tasks.front());
+            tasks.pop();
+        }
+        task();
+    }
+}
+
+uINT hardware_threads()
+{
+    uINT thread_num = std::thread::hardware_concurrency();
+    return thread_num == 0 ? 1 : thread_num;
+}
+
+}
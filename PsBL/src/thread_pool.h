@@ -0,0 +1,69 @@
+#ifndef THREAD_POOL_H
+#define THREAD_POOL_H
+
+#include "pan_type.h"
+
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <future>
+#include <queue>
+
+namespace pan{
+
+/*
+A fixed-size pool of worker threads, tasks are run in FIFO order
+
+Thread_Pool pool(8);
+std::future<int> result = pool.submit([](){ return 1; });
+int value = result.get();       // the exception of a task is re-thrown by get()
+*/
+class Thread_Pool
+{
+public:
+    // thread_num is at least 1
+    explicit Thread_Pool(uINT thread_num);
+    // wait all submitted tasks and join the threads
+    ~Thread_Pool();
+
+    Thread_Pool(const Thread_Pool &) = delete;
+    Thread_Pool &operator=(const Thread_Pool &) = delete;
+
+    template<typename Func>
+    auto submit(Func task) -> std::future<decltype(task())>;
+
+    uINT size() const { return workers.size(); }
+
+private:
+    void worker_loop();
+
+    vector<std::thread> workers;
+    std::queue< std::function<void()> > tasks;
+
+    std::mutex queue_mutex;
+    std::condition_variable queue_cv;
+    bool stopped = false;
+};
+
+template<typename Func>
+auto Thread_Pool::submit(Func task) -> std::future<decltype(task())>
+{
+    using Result = decltype(task());
+
+    // std::function must be copyable, so the packaged task is shared
+    auto packaged = std::make_shared< std::packaged_task<Result()> >(task);
+    std::future<Result> result = packaged->get_future();
+    {
+        std::lock_guard<std::mutex> lock(queue_mutex);
+        tasks.push( [packaged](){ (*packaged)(); } );
+    }
+    queue_cv.notify_one();
+    return result;
+}
+
+// number of hardware threads, at least 1
+uINT hardware_threads();
+
+}
+
+#endif // THREAD_POOL_H
@@ -0,0 +1,2 @@
+g++ -O3 -std=c++0x -o test_chunked_array test_chunked_array.cpp
+./test_chunked_array 1000000
@@ -0,0 +1,68 @@
+
+#include "../../src/chunked_array.h"
+#include <iostream>
+#include <random>
+
+using namespace std;
+using namespace pan;
+
+// random writes on a dense vector and a chunked array with small blocks
+int check_random(const uLONG &size, const uINT &block_bits)
+{
+    int failed = 0;
+    mt19937 rng(5);
+    vector<float> dense(size, -1);
+    Chunked_Array<float> chunked(size, -1, block_bits);
+
+    // writes in a few regions, as the coverage of reads
+    for(int r=0; r<20; r++)
+    {
+        const uLONG start = rng() % size;
+        for(uLONG i=start; i<size and i<start+300; i++)
+        {
+            const float v = (rng() % 4 == 0) ? -1 : float(rng() % 100);
+            dense[i] = v;
+            chunked.set(i, v);
+            if(rng() % 3 == 0)
+            {
+                dense[i] += 1;
+                chunked.ref(i) += 1;
+            }
+        }
+    }
+
+    for(uLONG i=0; i<size; i++)
+        failed += dense[i] != chunked[i];
+    failed += not equal(dense.cbegin(), dense.cend(), chunked.begin());
+    failed += chunked[size+1] != -1;
+    failed += chunked.allocated_blocks() > 20 * (300/(1<<block_bits) + 2);
+
+    // the fill value does not allocate
+    Chunked_Array<float> empty(size, -1, block_bits);
+    for(uLONG i=0; i<size; i+=7)
+        empty.set(i, -1);
+    failed += empty.allocated_blocks() != 0;
+
+    cout << "size=" << size << "\tblock_bits=" << block_bits << "\tallocated " << chunked.allocated_blocks()
+         << "/" << chunked.block_num() << " blocks\t" << (failed ? "FAILED" : "same") << endl;
+    return failed;
+}
+
+int main(int argc, char *argv[])
+{
+    const uLONG size = argc > 1 ? stoul(argv[1]) : 1000000;
+    int failed = 0;
+    for(uINT block_bits: {4, 10, 16})
+    {
+        failed += check_random(size, block_bits);
+        failed += check_random(size+13, block_bits);
+    }
+
+    if(failed)
+    {
+        cerr << "FAILED: " << failed << " checks" << endl;
+        return -1;
+    }
+    cout << "All passed" << endl;
+    return 0;
+}
@@ -0,0 +1,4 @@
+g++ -O3 -std=c++0x -o test_fast_writer test_fast_writer.cpp ../../src/fast_writer.cpp
+./test_fast_writer 1000000
+cmp bench_rows.ostream bench_rows.fast && rm bench_rows.ostream bench_rows.fast
+
@@ -0,0 +1,156 @@
+#include "../../src/fast_writer.h"
+#include <iostream>
+#include <sstream>
+#include <fstream>
+#include <random>
+#include <chrono>
+#include <cmath>
+#include <limits>
+
+using namespace std;
+using namespace pan;
+
+// values of gTab and RT files: counts, scores in [0,1], log ratios, null and special values
+vector<double> test_values(const uLONG &num)
+{
+    vector<double> values = { 0, -0.0, -1, 1, 0.5, 1.5, 2.5, 0.125, 1e-4, 9.99999e-5, 9.999995e-5, 0.1, 0.3, 123456, 999999, 999999.5, 
+        999999.4, 1e6, 1234567, 1e-5, 1.5e-5, 3.14159265, 0.0001234565, 1.0000005, 12.34565, 99999.95, 
+        numeric_limits<double>::infinity(), -numeric_limits<double>::infinity(), numeric_limits<double>::quiet_NaN(),
+        numeric_limits<double>::min(), numeric_limits<double>::max(), numeric_limits<double>::denorm_min() };
+
+    mt19937 rng(3);
+    uniform_real_distribution<double> unit(0, 1), log_scale(-8, 8);
+    poisson_distribution<int> count(30);
+    for(uLONG i=0; i<num; i++)
+    {
+        values.push_back( float(unit(rng)) );
+        values.push_back( -float(unit(rng)) * 3 );
+        values.push_back( pow(10, log_scale(rng)) );
+        values.push_back( count(rng) );
+        values.push_back( count(rng) / 7.0 );
+        values.push_back( round(unit(rng)*1e6) / 1e6 );
+    }
+    return values;
+}
+
+int check_general(const vector<double> &values)
+{
+    ostringstream expected, single;
+    Fast_Writer writer(single, 100);
+    for(double v: values)
+    {
+        expected << v << '\t' << float(v) << '\n';
+        writer << v << '\t' << float(v) << '\n';
+    }
+    writer.flush();
+
+    int failed = expected.str() != single.str();
+    cout << "%g of " << values.size() << " doubles and floats: " << (failed ? "FAILED" : "same") << endl;
+    return failed;
+}
+
+int check_fixed(const vector<double> &values)
+{
+    int failed = 0;
+    for(uINT decimals: { 0, 1, 3, 6, 9 })
+    {
+        string expected;
+        ostringstream result;
+        Fast_Writer writer(result);
+        char buff[400];
+        for(double v: values)
+        {
+            snprintf(buff, sizeof(buff), "%.*f,", int(decimals), v);
+            expected += buff;
+            writer.write_fixed(v, decimals);
+            writer << ',';
+        }
+        writer.flush();
+        bool same = expected == result.str();
+        failed += not same;
+        cout << "%." << decimals << "f: " << (same ? "same" : "FAILED") << endl;
+    }
+    return failed;
+}
+
+int check_integer()
+{
+    ostringstream expected, result;
+    Fast_Writer writer(result);
+    for(long long v: { 0LL, 1LL, -1LL, 9LL, 10LL, 1234567890123LL, numeric_limits<long long>::max(), numeric_limits<long long>::min() })
+    {
+        expected << v << ' ' << int(v) << ' ' << (unsigned long long)(v) << ' ' << (unsigned int)(v) << ' ';
+        writer << v << ' ' << int(v) << ' ' << (unsigned long long)(v) << ' ' << (unsigned int)(v) << ' ';
+    }
+    writer.flush();
+    int failed = expected.str() != result.str();
+    cout << "integers: " << (failed ? "FAILED" : "same") << endl;
+    return failed;
+}
+
+// rows of sliding window gTab file: 4 counts, a score and 20 window scores
+void benchmark(const uLONG &rows, const string &file_name)
+{
+    mt19937 rng(5);
+    uniform_real_distribution<float> unit(0, 1);
+    poisson_distribution<unsigned int> count(30);
+    vector<float> scores(1000);
+    for(float &v: scores)
+        v = unit(rng);
+    vector<unsigned int> counts(1000);
+    for(unsigned int &v: counts)
+        v = count(rng);
+    const string chr_id = "chr1";
+
+    auto t0 = chrono::steady_clock::now();
+    {
+        ofstream OUT(file_name+".ostream");
+        for(uLONG i=0; i<rows; i++)
+        {
+            OUT << chr_id << '\t' << '+' << '\t' << i << '\t' << counts[i%1000] << '\t' << counts[(i+1)%1000] << '\t' 
+                << counts[(i+2)%1000] << '\t' << counts[(i+3)%1000] << '\t' << scores[i%1000] << '\t' << 20 << '\t';
+            for(uLONG j=0; j<20; j++)
+                OUT << scores[(i+j)%1000] << ',';
+            OUT << '\n';
+        }
+    }
+    auto t1 = chrono::steady_clock::now();
+    {
+        ofstream OUT(file_name+".fast");
+        Fast_Writer writer(OUT);
+        for(uLONG i=0; i<rows; i++)
+        {
+            writer << chr_id << '\t' << '+' << '\t' << i << '\t' << counts[i%1000] << '\t' << counts[(i+1)%1000] << '\t' 
+                << counts[(i+2)%1000] << '\t' << counts[(i+3)%1000] << '\t' << scores[i%1000] << '\t' << 20 << '\t';
+            for(uLONG j=0; j<20; j++)
+                writer << scores[(i+j)%1000] << ',';
+            writer << '\n';
+        }
+    }
+    auto t2 = chrono::steady_clock::now();
+
+    double ostream_time = chrono::duration<double>(t1-t0).count();
+    double fast_time = chrono::duration<double>(t2-t1).count();
+    cout << "ostream: " << rows/ostream_time << " rows/sec" << endl;
+    cout << "Fast_Writer: " << rows/fast_time << " rows/sec (" << ostream_time/fast_time << "x)" << endl;
+}
+
+int main(int argc, char *argv[])
+{
+    int failed = 0;
+    const vector<double> values = test_values(200000);
+    failed += check_general(values);
+    failed += check_fixed(values);
+    failed += check_integer();
+
+    if(argc > 1)
+        benchmark(stoul(argv[1]), "bench_rows");
+
+    if(failed)
+    {
+        cerr << "FAILED: " << failed << " checks" << endl;
+        return -1;
+    }
+    cout << "All passed" << endl;
+    return 0;
+}
@@ -36,5 +36,26 @@ int main(int argc, char *argv[])
     cout << "ENSMUST00000146358.7 39, 76 -" << endl;
     cout << seq.get_chr_subbseq("ENSMUST00000146358.7", 39, 76, NEGATIVE) << endl << endl;
 
+    cout << "test memory mapped qFasta..." << endl;
+    qFasta mapped_seq(argv[1], true);
+    for(const string &chr_id: seq.get_chr_ids())
+    {
+        const string pos_seq = seq.get_chr_seq(chr_id);
+        const string neg_seq = seq.get_chr_subbseq(chr_id, 0, string::npos/2, NEGATIVE);
+        const Seq_View pos_view = mapped_seq.get_chr_view(chr_id, POSITIVE);
+        const Seq_View neg_view = mapped_seq.get_chr_view(chr_id, NEGATIVE);
+        if(pos_view.str() != pos_seq or neg_view.str() != neg_seq or neg_view.reversed().str() != string(neg_seq.rbegin(), neg_seq.rend()))
+        {
+            cerr << "FAILED: different view of " << chr_id << endl;
+            return 1;
+        }
+        if(mapped_seq.get_chr_subbseq(chr_id, 3, 20, NEGATIVE) != seq.get_chr_subbseq(chr_id, 3, 20, NEGATIVE))
+        {
+            cerr << "FAILED: different sub-sequence of " << chr_id << endl;
+            return 1;
+        }
+    }
+    cout << "memory mapped views are same" << endl;
+
     return 0;
 }
@@ -0,0 +1,3 @@
+g++ -O3 -std=c++0x -o test_gtab test_gtab.cpp ../../src/gtab_file.cpp ../../src/fast_writer.cpp -lz
+./test_gtab
+rm -f test.bgTab
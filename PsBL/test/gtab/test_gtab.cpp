@@ -0,0 +1,154 @@
+
+#include "../../src/gtab_file.h"
+#include <iostream>
+#include <sstream>
+#include <random>
+
+using namespace std;
+using namespace pan;
+
+const string TRT_CONT_HEAD = "@ColNum 11\n@ChrID 1\n@Strand 2\n@ChrPos 3\n@Base 4\n@N_RT 5\n@N_BD 6\n@D_RT 7\n@D_BD 8\n@Shape 9\n@ShapeNum 10\n@WindowShape 11\n";
+const string TRT_HEAD = "@ColNum 8\n@ChrID 1\n@Strand 2\n@ChrPos 3\n@N_RT 4\n@N_BD 5\n@Shape 6\n@ShapeNum 7\n@WindowShape 8\n";
+
+// rows as written by sort_gTab: pos is followed by two tabs
+vector<string> make_rows(const string &head, const uLONG &chr_num, const bool &single_window)
+{
+    const GTab_Layout layout = GTab_Layout::from_head(head);
+    mt19937 rng(7);
+    uniform_int_distribution<int> step(1, 30), count(0, 5000), window(0, 12), base(0, 3);
+    uniform_real_distribution<float> score(0, 1);
+
+    vector<string> rows;
+    for(uLONG c=0; c<chr_num; c++)
+        for(const char strand: {'+', '-'})
+        {
+            uLONG pos = step(rng);
+            const uLONG row_num = 50 + rng() % 700;
+            for(uLONG i=0; i<row_num; i++, pos+=step(rng))
+            {
+                ostringstream row;
+                row << "chr" << c << "\t" << strand << "\t" << pos << "\t\t";
+                if(layout.has_base)
+                    row << "ACGT"[base(rng)] << "\t";
+                for(uINT k=0; k<layout.count_num; k++)
+                    row << count(rng) << "\t";
+                row << (i % 5 == 0 ? -1.0f : score(rng)) << "\t" << window(rng) << "\t";
+                if(single_window)
+                    row << (i % 7 == 0 ? -1.0f : score(rng));
+                else
+                    for(int w=window(rng); w>0; w--)
+                        row << (w % 4 == 0 ? -1.0f : score(rng)) << ",";
+                rows.push_back(row.str());
+            }
+        }
+    return rows;
+}
+
+string to_text(const vector<string> &rows, const string &chr_id="")
+{
+    string text;
+    for(const string &row: rows)
+    {
+        const uLONG tab = row.find('\t');
+        if(chr_id.empty() or row.substr(0, tab)+row[tab+1] == chr_id)
+            text += row + "\n";
+    }
+    return text;
+}
+
+int check_round_trip(const string &head, const bool &single_window)
+{
+    int failed = 0;
+    const vector<string> rows = make_rows(head, 5, single_window);
+    {
+        BGTab_Writer writer("test.bgTab", head, 100);
+        for(const string &row: rows)
+            writer.write_line(row);
+        writer.close();
+    }
+
+    BGTab_Reader reader("test.bgTab");
+    if(reader.head() != head or reader.get_index().size() != 10)
+    {
+        cerr << "bad head or index" << endl;
+        ++failed;
+    }
+
+    ostringstream text;
+    {
+        Fast_Writer writer(text);
+        GTab_Records records;
+        while(reader.read_chr(records))
+            write_gtab_text(records, reader.layout(), writer);
+    }
+    if(text.str() != to_text(rows))
+    {
+        cerr << "round trip failed" << endl;
+        ++failed;
+    }
+
+    ostringstream chr_text;
+    {
+        Fast_Writer writer(chr_text);
+        GTab_Records records;
+        if(not reader.load_chr("chr3-", records) or reader.load_chr("chr9+", records))
+            ++failed;
+        reader.load_chr("chr3-", records);
+        write_gtab_text(records, reader.layout(), writer);
+    }
+    if(chr_text.str() != to_text(rows, "chr3-"))
+    {
+        cerr << "load_chr failed" << endl;
+        ++failed;
+    }
+    return failed;
+}
+
+// lines which cannot be stored are rejected
+int check_bad_lines()
+{
+    const vector<string> bad_lines = {
+        "chr1\t+\t10\t\t1\t2\t0.12345678\t3\t0.5,",            // float cannot be printed back
+        "chr1\t+\t10\t\t1\t2\t0.5\t3",                          // missing column
+        "chr1\t+\t10\t1\t2\t0.5\t3\t0.5,",                      // single tab after pos
+        "chr1\t+\t10\t\t01\t2\t0.5\t3\t0.5,",                   // leading zero
+        "chr1\t+\t10\t\t1\t2\t0.5\t3\t0.5,0.25",                // mixed window list
+    };
+    int failed = 0;
+    for(const string &line: bad_lines)
+    {
+        BGTab_Writer writer("test.bgTab", TRT_HEAD);
+        try{
+            writer.write_line(line);
+            cerr << "not rejected: " << line << endl;
+            ++failed;
+        }catch(Unexpected_Error &e){}
+    }
+
+    BGTab_Writer writer("test.bgTab", TRT_HEAD);
+    writer.write_line("chr1\t+\t10\t\t1\t2\t0.5\t3\t0.5,");
+    writer.write_line("chr2\t+\t10\t\t1\t2\t0.5\t3\t0.5,");
+    try{
+        writer.write_line("chr1\t+\t20\t\t1\t2\t0.5\t3\t0.5,");
+        cerr << "not contiguous rows are not rejected" << endl;
+        ++failed;
+    }catch(Unexpected_Error &e){}
+    return failed;
+}
+
+int main(int argc, char *argv[])
+{
+    int failed = 0;
+    failed += check_round_trip(TRT_CONT_HEAD, false);
+    failed += check_round_trip(TRT_HEAD, false);
+    failed += check_round_trip(TRT_HEAD, true);
+    failed += check_bad_lines();
+
+    if(failed)
+    {
+        cerr << "FAILED: " << failed << " checks" << endl;
+        return -1;
+    }
+    cout << "All passed" << endl;
+    return 0;
+}
@@ -0,0 +1,4 @@
+g++ -O3 -std=c++0x -o test_order_stat test_order_stat.cpp
+./test_order_stat 200 20000
+./test_order_stat 1000 5000
+
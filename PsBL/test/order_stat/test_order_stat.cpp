@@ -0,0 +1,95 @@
+#include "../../src/order_stat.h"
+#include <iostream>
+#include <random>
+#include <chrono>
+
+using namespace std;
+using namespace pan;
+
+// the sorting way: decile (10%-20% of largest values) median and 5% winsor bounds
+void by_sort(const vector<float> &data, float &median, float &lower, float &upper)
+{
+    vector<float> sorted_data(data);
+    sort(sorted_data.rbegin(), sorted_data.rend());
+
+    uLONG len = sorted_data.size();
+    uLONG selectStart = len/10, selectEnd = 2*len/10 - 1;
+    vector<float> rangeOfSelection(sorted_data.begin()+selectStart, sorted_data.begin()+selectEnd+1);
+    uLONG n = rangeOfSelection.size();
+    median = n%2==0 ? (rangeOfSelection[n/2-1] + rangeOfSelection[n/2]) / 2 : rangeOfSelection[(n-1)/2];
+
+    vector<float> winsor_data(data);
+    sort(winsor_data.begin(), winsor_data.end());
+    uLONG winsorLen = 0.05 * len;
+    lower = winsor_data[winsorLen];
+    upper = winsor_data[len-winsorLen-1];
+}
+
+// the selection way
+void by_select(Order_Stat<float> &stat, const vector<float> &data, float &median, float &lower, float &upper)
+{
+    stat.assign(data.cbegin(), data.cend());
+
+    uLONG len = stat.size();
+    uLONG selectStart = len/10, selectNum = 2*len/10 - selectStart;
+    stat.sort_ranks(len-selectStart-selectNum, len-selectStart);
+    auto desc = [&](uLONG i){ return stat[len-1-selectStart-i]; };
+    median = selectNum%2==0 ? (desc(selectNum/2-1) + desc(selectNum/2)) / 2 : desc((selectNum-1)/2);
+
+    uLONG winsorLen = 0.05 * len;
+    lower = stat.kth_smallest(winsorLen);
+    upper = stat.kth_smallest(len-winsorLen-1);
+}
+
+int main(int argc, char *argv[])
+{
+    if(argc < 3)
+    {
+        cerr << "Usage: test_order_stat wsize windows" << endl;
+        return 0;
+    }
+
+    const uLONG wsize = stoul(argv[1]);
+    const uLONG windows = stoul(argv[2]);
+
+    // RT-like counts with many ties
+    mt19937 rng(7);
+    poisson_distribution<int> dist(8);
+    vector< vector<float> > data(windows, vector<float>(wsize));
+    for(auto &window: data)
+        for(float &v: window)
+            v = dist(rng);
+
+    vector<float> sort_result, select_result;
+    float median, lower, upper;
+
+    auto t0 = chrono::steady_clock::now();
+    for(const auto &window: data)
+    {
+        by_sort(window, median, lower, upper);
+        sort_result.push_back(median); sort_result.push_back(lower); sort_result.push_back(upper);
+    }
+    auto t1 = chrono::steady_clock::now();
+    Order_Stat<float> stat;
+    for(const auto &window: data)
+    {
+        by_select(stat, window, median, lower, upper);
+        select_result.push_back(median); select_result.push_back(lower); select_result.push_back(upper);
+    }
+    auto t2 = chrono::steady_clock::now();
+
+    double sort_ms = chrono::duration<double, milli>(t1-t0).count();
+    double select_ms = chrono::duration<double, milli>(t2-t1).count();
+
+    cout << "wsize: " << wsize << "\twindows: " << windows << endl;
+    cout << "\tsort: " << sort_ms << " ms\tselect: " << select_ms << " ms\tspeedup: " << sort_ms/select_ms << endl;
+
+    if(sort_result != select_result)
+    {
+        cerr << "FAILED: different order statistics" << endl;
+        return -1;
+    }
+    cout << "\tsame results" << endl;
+
+    return 0;
+}
@@ -0,0 +1,3 @@
+g++ -O3 -std=c++0x -o test_packed_genome test_packed_genome.cpp ../../src/packed_genome.cpp ../../src/fasta.cpp ../../src/string_split.cpp
+./test_packed_genome
+rm -f test.fa test.fa.fai test.pgenome
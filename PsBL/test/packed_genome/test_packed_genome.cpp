@@ -0,0 +1,88 @@
+
+#include "../../src/packed_genome.h"
+#include <iostream>
+#include <fstream>
+#include <random>
+
+using namespace std;
+using namespace pan;
+
+// sequences with soft-masked runs, N runs and other IUPAC bases
+void write_fasta(const string &file_name)
+{
+    mt19937 rng(11);
+    const string upper = "ACGT", others = "NRYUn-";
+    ofstream OUT(file_name);
+    for(uLONG c=0; c<5; c++)
+    {
+        string seq;
+        const uLONG length = c == 0 ? 31 : 1000 + rng() % 5000;
+        while(seq.size() < length)
+        {
+            const uLONG run = 1 + rng() % 80;
+            const int kind = rng() % 6;
+            for(uLONG i=0; i<run and seq.size()<length; i++)
+            {
+                char base = upper[rng() % 4];
+                if(kind == 4)
+                    base = others[rng() % 2 == 0 ? 0 : rng() % others.size()];
+                if(kind >= 3 and rng() % 4 != 0)
+                    base = tolower(base);
+                seq += base;
+            }
+        }
+        OUT << ">chr" << c << " test sequence\n" << flat_seq(seq, 60);
+    }
+}
+
+int main()
+{
+    write_fasta("test.fa");
+    Packed_Genome::build("test.fa", "test.pgenome");
+    Packed_Genome genome("test.pgenome");
+    qFasta fasta("test.fa", true);
+
+    uLONG failed = 0;
+    if(genome.get_chr_num() != fasta.get_chr_num())
+        ++failed;
+
+    const vector< vector<char> > base_lists = { {'A'}, {'A', 'C'}, {'a', 'G', 't'}, {'N'}, {'n', 'T', 'R'}, {'U', 'c'} };
+    for(const string &chr_id: genome.get_chr_ids())
+    {
+        if(genome.get_chr_len(chr_id) != fasta.get_chr_len(chr_id))
+            ++failed;
+        for(const STRAND strand: {POSITIVE, NEGATIVE})
+        {
+            if(genome.get_chr_view(chr_id, strand).str() != fasta.get_chr_view(chr_id, strand).str())
+            {
+                cerr << "FAILED: different sequence of " << chr_id << endl;
+                ++failed;
+            }
+
+            // the mask of build_chr_mask
+            const Seq_View seq = strand == NEGATIVE ? fasta.get_chr_view(chr_id, strand).reversed() : fasta.get_chr_view(chr_id, strand);
+            for(const vector<char> &bases: base_lists)
+            {
+                Base_Mask mask;
+                genome.base_mask(chr_id, strand, bases, mask);
+                if(mask.size() != seq.size()+1 or mask[0])
+                    ++failed;
+                for(uLONG i=1; i<mask.size(); i++)
+                    if(mask[i] != (find(bases.cbegin(), bases.cend(), seq[i-1]) != bases.cend()))
+                    {
+                        cerr << "FAILED: different mask of " << chr_id << " at " << i << endl;
+                        ++failed;
+                        break;
+                    }
+            }
+        }
+    }
+
+    if(failed)
+    {
+        cerr << "FAILED: " << failed << " checks" << endl;
+        return -1;
+    }
+    cout << "All passed" << endl;
+    return 0;
+}
@@ -0,0 +1,3 @@
+g++ -O3 -std=c++0x -o test_signal_file test_signal_file.cpp ../../src/signal_file.cpp ../../src/fast_writer.cpp ../../src/string_split.cpp -lz
+./test_signal_file 20000
+rm -f test.bsig bench_signal.txt bench_signal.bsig
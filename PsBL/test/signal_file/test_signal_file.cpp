@@ -0,0 +1,261 @@
+#include "../../src/signal_file.h"
+#include "../../src/string_split.h"
+#include <iostream>
+#include <sstream>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <chrono>
+#include <random>
+#include <limits>
+
+using namespace std;
+using namespace pan;
+
+const string NORM_HEAD = "#transcript\tlength\ttype\tbase_frequency, start from position 1.";
+const double NaN = std::numeric_limits<double>::quiet_NaN();
+
+// the text of all transcripts of a .bsig file
+string bsig_text(const string &file_name)
+{
+    BSig_Reader reader(file_name);
+    ostringstream text;
+    text << reader.head();
+    {
+        Fast_Writer writer(text);
+        Signal_Record record;
+        while(reader.next(record))
+            write_signal_text(record, reader.layout(), writer);
+    }
+    return text.str();
+}
+
+// printf of a number of a row
+string printf_text(const double &value, const char &decimals)
+{
+    char buff[512];
+    if(std::isnan(value))
+        return "NULL";
+    if(decimals == Signal_Row::GENERAL_NUMBER)
+        snprintf(buff, sizeof(buff), "%g", value);
+    else
+        snprintf(buff, sizeof(buff), "%.*f", int(decimals), value);
+    return buff;
+}
+
+bool same_number(const double &a, const double &b)
+{
+    return memcmp(&a, &b, sizeof(double)) == 0 or (std::isnan(a) and std::isnan(b));
+}
+
+// rows of counts (uint32), of 3 decimals (float32), of large or many decimals and %g numbers (float64)
+Signal_Record test_record(const string &id)
+{
+    Signal_Record record;
+    record.id = id;
+    record.len = 7;
+    const vector<DoubleArray> values = {
+        { 0, 12, 4294967295.0, 7, 1, 0, 3 },
+        { 2.0005, 0.0015, -0.0001, 12, 1.0/3, NaN, 4095.9994 },
+        { 123456.789, 0.5, NaN, 1, 2, 3, 4 },
+        { 1e12, 1e-7, 1.0/3, 1234567, -0.0, 0.5, NaN },
+        { 2, 4294967296.0, 0, 0, 0, 0, 0 },
+        { 0.1234567, 1.5, 2, 3, 4, 5, 6 }
+    };
+    const char decimals[] = { 3, 3, 3, Signal_Row::GENERAL_NUMBER, Signal_Row::GENERAL_NUMBER, 7 };
+    for(uLONG r=0; r<values.size(); r++)
+    {
+        record.rows.emplace_back();
+        Signal_Row &row = record.rows.back();
+        row.heads = { "baseDensity", "200.000000", "1.5" };
+        row.values = values[r];
+        row.decimals = decimals[r];
+    }
+    return record;
+}
+
+// the text of the rows and the numbers of the reader, which are parse_double of the text
+int check_numbers(const int &level, const uLONG &block_size)
+{
+    vector<Signal_Record> records;
+    {
+        BSig_Writer writer("test.bsig", Signal_Layout(3, 1), level, block_size);
+        writer.write_head(NORM_HEAD);
+        for(const string &id: {"T1", "T2", "T3"})
+        {
+            records.push_back(test_record(id));
+            writer.write_record(records.back());
+        }
+    }
+
+    ostringstream text;
+    text << NORM_HEAD << "\n";
+    for(const Signal_Record &record: records)
+        for(const Signal_Row &row: record.rows)
+        {
+            text << record.id << "\t" << record.len;
+            for(const string &head: row.heads)
+                text << "\t" << head;
+            for(const double &value: row.values)
+                text << "\t" << printf_text(value, row.decimals);
+            text << "\n";
+        }
+    if(bsig_text("test.bsig") != text.str())
+    {
+        cerr << "round trip of the numbers failed, level=" << level << endl;
+        return 1;
+    }
+
+    BSig_Reader reader("test.bsig");
+    Signal_Record record;
+    reader.read(reader.find("T2"), record);
+    for(uLONG r=0; r<record.rows.size(); r++)
+    {
+        const Signal_Row &row = record.rows[r];
+        for(uLONG i=0; i<row.size(); i++)
+        {
+            const string number_text = printf_text(records[1].rows[r].values[i], row.decimals);
+            const double value = number_text == "NULL" ? NaN : parse_double(Field_View(number_text.data(), number_text.size()));
+            if(not same_number(row.values[i], value) or number_text != signal_number_text(value, row.decimals))
+            {
+                cerr << "bad number " << row.values[i] << " of " << number_text << endl;
+                return 1;
+            }
+        }
+    }
+    if(reader.find("T4") >= 0)
+        return 1;
+    return 0;
+}
+
+// the rows of the layout
+int check_layout()
+{
+    Signal_Record record = test_record("T1");
+    int failed = 0;
+    BSig_Writer writer("test.bsig", Signal_Layout(3, 2));
+    record.rows.resize(1);
+    record.rows[0].values.push_back(1);
+    record.rows[0].heads.pop_back();
+    try{
+        writer.write_record(record);
+        cerr << "bad heads not rejected" << endl;
+        ++failed;
+    }catch(Unexpected_Error &e){}
+
+    record.rows[0].heads.push_back("1.5");
+    record.rows[0].values.pop_back();
+    try{
+        writer.write_record(record);
+        cerr << "a column of 1 number in groups of 2 not rejected" << endl;
+        ++failed;
+    }catch(Unexpected_Error &e){}
+
+    record.rows[0].values.push_back(1);
+    record.rows[0].decimals = 16;
+    try{
+        writer.write_record(record);
+        cerr << "bad decimals not rejected" << endl;
+        ++failed;
+    }catch(Unexpected_Error &e){}
+    return failed;
+}
+
+// transcripts of a baseDensity line of counts and a RTstop line of 3 decimals, parsed from the text and read from the .bsig
+void benchmark(const uLONG &trans_num, const string &file_name)
+{
+    mt19937 rng(5);
+    poisson_distribution<unsigned int> count(30);
+    uniform_real_distribution<double> unit(0, 10);
+    const uLONG len = 1000;
+
+    Signal_Record record;
+    record.len = len;
+    record.rows.resize(2);
+    record.rows[0].heads = { "baseDensity", "200", "1.2" };
+    record.rows[1].heads = { "RTstop", "200", "2.4" };
+    for(uLONG i=0; i<=len; i++)
+    {
+        record.rows[0].values.push_back(count(rng));
+        record.rows[1].values.push_back(unit(rng));
+    }
+
+    auto t0 = chrono::steady_clock::now();
+    {
+        ofstream OUT(file_name+".txt");
+        Fast_Writer writer(OUT);
+        writer << NORM_HEAD << '\n';
+        for(uLONG t=0; t<trans_num; t++)
+        {
+            record.id = "T" + to_string(t);
+            write_signal_text(record, Signal_Layout(3, 1), writer);
+        }
+    }
+    auto t1 = chrono::steady_clock::now();
+    {
+        BSig_Writer writer(file_name+".bsig", Signal_Layout(3, 1));
+        writer.write_head(NORM_HEAD);
+        for(uLONG t=0; t<trans_num; t++)
+        {
+            record.id = "T" + to_string(t);
+            writer.write_record(record);
+        }
+    }
+    auto t2 = chrono::steady_clock::now();
+
+    double text_sum = 0, bsig_sum = 0;
+    {
+        ifstream IN(file_name+".txt");
+        string line;
+        FieldArray data;
+        DoubleArray values;
+        while(getline(IN, line))
+        {
+            if(line[0] == '#')
+                continue;
+            split(line, '\t', data);
+            values.clear();
+            for(uLONG i=5; i<data.size(); i++)
+                values.push_back(parse_double(data[i]));
+            text_sum += values[len];
+        }
+    }
+    auto t3 = chrono::steady_clock::now();
+    {
+        BSig_Reader reader(file_name+".bsig");
+        while(reader.next(record))
+            for(const Signal_Row &row: record.rows)
+                bsig_sum += row.values[len];
+    }
+    auto t4 = chrono::steady_clock::now();
+
+    const double lines = 2 * trans_num;
+    const double text_write = chrono::duration<double>(t1-t0).count();
+    const double bsig_write = chrono::duration<double>(t2-t1).count();
+    const double text_read = chrono::duration<double>(t3-t2).count();
+    const double bsig_read = chrono::duration<double>(t4-t3).count();
+    cout << "write text: " << lines/text_write << " lines/sec, bsig: " << lines/bsig_write << " lines/sec (" << text_write/bsig_write << "x)" << endl;
+    cout << "read text: " << lines/text_read << " lines/sec, bsig: " << lines/bsig_read << " lines/sec (" << text_read/bsig_read << "x)" << endl;
+    if(text_sum != bsig_sum)
+        cerr << "the numbers of the text and the bsig file are different" << endl;
+}
+
+int main(int argc, char *argv[])
+{
+    int failed = 0;
+    failed += check_numbers(0, 1<<20);
+    // compressed blocks of a transcript
+    failed += check_numbers(1, 10);
+    failed += check_layout();
+
+    if(argc > 1)
+        benchmark(stoul(argv[1]), "bench_signal");
+
+    if(failed)
+    {
+        cerr << "FAILED: " << failed << " checks" << endl;
+        return -1;
+    }
+    cout << "All passed" << endl;
+    return 0;
+}
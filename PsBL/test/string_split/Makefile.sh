@@ -0,0 +1,4 @@
+g++ -O3 -std=c++0x -o test_split_field test_split_field.cpp ../../src/string_split.cpp
+./test_split_field
+# parse throughput of a 10M-line .tab file
+./test_split_field bench 10000000
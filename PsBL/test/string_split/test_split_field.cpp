@@ -0,0 +1,159 @@
+
+#include "../../src/string_split.h"
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <random>
+#include <chrono>
+#include <cmath>
+
+using namespace std;
+using namespace pan;
+
+// parse_X(field) should be the same as stoX(string), including the exceptions
+template<typename T, typename Parse, typename Std>
+uLONG check_same(const string &text, Parse parse, Std std_parse)
+{
+    // the fields point into line
+    const string line = "x\t"+text+"\ty";
+    FieldArray fields;
+    split(line, '\t', fields);
+    string std_error, error;
+    T std_value = T(), value = T();
+    try{ std_value = std_parse(text); }catch(exception &e){ std_error = e.what(); }
+    try{ value = parse(fields[1]); }catch(exception &e){ error = e.what(); }
+    if(std_error.empty() != error.empty() or
+        (error.empty() and not (std_value == value and signbit(double(std_value)) == signbit(double(value))) and
+            not (std::isnan(double(std_value)) and std::isnan(double(value)))))
+    {
+        cerr << "FAILED: " << text << " " << std_value << " " << value << endl;
+        return 1;
+    }
+    return 0;
+}
+
+uLONG check_numbers()
+{
+    uLONG failed = 0;
+    vector<string> texts = {"0", "-0", "+7", "123", "-123", "18446744073709551615", "99999999999999999999",
+        "12abc", "", "-", "+", " 5", "abc", "1.", ".5", "-.5", "1.5.3", "0.1", "0.3", "2.675", "-0.0",
+        "1e5", "1E-3", "0x1A", "inf", "-nan", "NULL", "123456789012345678", "1234567890123456789",
+        "0.000000000000000000001", "3.14159265358979323846", "9007199254740993", "16777217", "0.1234567"};
+
+    mt19937 rng(5);
+    uniform_real_distribution<double> value(-1000, 1000);
+    for(int i=0; i<20000; i++)
+    {
+        ostringstream text;
+        text.precision(1 + rng() % 17);
+        text << (i % 3 == 0 ? std::fixed : std::defaultfloat) << value(rng);
+        texts.push_back(text.str());
+        texts.push_back(to_string(rng()));
+    }
+
+    for(const string &text: texts)
+    {
+        failed += check_same<uLONG>(text, parse_uLONG, [](const string &s){ return stoul(s); });
+        failed += check_same<long>(text, parse_long, [](const string &s){ return stol(s); });
+        failed += check_same<double>(text, parse_double, [](const string &s){ return stod(s); });
+        failed += check_same<float>(text, parse_float, [](const string &s){ return stof(s); });
+    }
+    return failed;
+}
+
+uLONG check_split()
+{
+    uLONG failed = 0;
+    for(const string &line: {string(""), string("a"), string("\t"), string("chr1\t+\t10\t20\t\t"), string("a,b,,c")})
+        for(const char c: {'\t', ','})
+        {
+            StringArray strings;
+            FieldArray fields;
+            split(line, c, strings);
+            split(line, c, fields);
+            if(strings.size() != fields.size())
+                ++failed;
+            else
+                for(uLONG i=0; i<fields.size(); i++)
+                    failed += (fields[i] != strings[i]) + (fields[i].str() != strings[i]);
+        }
+
+    StringArray strings;
+    FieldArray fields;
+    const string line = "  chr1 \t 100\t200  +  ";
+    split(line, strings);
+    split(line, fields);
+    if(strings.size() != fields.size() or fields[0] != "chr1" or fields[3] != "+" or fields[2] != strings[2])
+        ++failed;
+    return failed;
+}
+
+// parse chr_id strand start end ... lines with split/stoul and with fields/parse_uLONG
+void bench(const uLONG &line_num)
+{
+    const string file_name = "bench.tab";
+    {
+        mt19937 rng(3);
+        ofstream OUT(file_name);
+        uLONG pos = 0;
+        for(uLONG i=0; i<line_num; i++)
+        {
+            pos += rng() % 50;
+            OUT << "chr" << (i*20/line_num+1) << "\t+\t" << pos << "\t" << pos+40+rng()%60;
+            if(i % 4 == 0)
+                OUT << "\t" << pos+500 << "\t" << pos+560;
+            OUT << "\n";
+        }
+    }
+
+    uLONG sum_1 = 0, sum_2 = 0;
+    string line;
+
+    auto start = chrono::steady_clock::now();
+    {
+        ifstream IN(file_name);
+        StringArray data;
+        while(getline(IN, line))
+        {
+            split(line, '\t', data);
+            for(uLONG i=2; i<data.size(); i++)
+                sum_1 += stoul(data[i]) + data[0].size();
+        }
+    }
+    const double string_time = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+
+    start = chrono::steady_clock::now();
+    {
+        ifstream IN(file_name);
+        FieldArray data;
+        while(getline(IN, line))
+        {
+            split(line, '\t', data);
+            for(uLONG i=2; i<data.size(); i++)
+                sum_2 += parse_uLONG(data[i]) + data[0].size();
+        }
+    }
+    const double field_time = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    remove(file_name.c_str());
+
+    cout << line_num << " lines: StringArray+stoul " << string_time << " s, "
+         << "FieldArray+parse_uLONG " << field_time << " s" << (sum_1 == sum_2 ? "" : " DIFFERENT SUM") << endl;
+}
+
+int main(int argc, char *argv[])
+{
+    if(argc == 3 and string(argv[1]) == "bench")
+    {
+        bench(stoul(argv[2]));
+        return 0;
+    }
+
+    const uLONG failed = check_numbers() + check_split();
+    if(failed)
+    {
+        cerr << "FAILED: " << failed << " checks" << endl;
+        return -1;
+    }
+    cout << "All passed" << endl;
+    return 0;
+}
@@ -3,10 +3,18 @@
 #include <param.h>
 #include <string_split.h>
 #include <exceptions.h>
+#include <fast_writer.h>
+#include <thread_pool.h>
+#include <signal_file.h>
 #include <fstream>
+#include <sstream>
 #include <algorithm>
 #include <math.h>
+#include <cmath>
+#include <limits>
 #include <iomanip>
+#include <deque>
+#include <memory>
 
 using namespace std;
 using namespace pan;
@@ -39,7 +47,12 @@ void print_usage()
 
         " -d     number of leading nucleotides to crop\n"
         " -l     number of tailing nucleotides to crop\n"
-        " -g     input signals are in log rather than in normal space, then enrich method will be forced to subtraction \n\n";
+        " -g     input signals are in log rather than in normal space, then enrich method will be forced to subtraction \n"
+        " -p     threads to calculate the transcripts (default: 1)\n\n"
+
+        "# the transcripts are written in the order of the foreground file, the lines of a transcript must be consecutive\n"
+        "# (as written by normalizeRTfile). It is fastest when both files are in the same order\n"
+        "# the files ending with .bsig are binary signal files\n\n";
 
     sprintf(buff, help_info, "calcEnrich");
     cout << buff << endl;
@@ -61,6 +74,8 @@ struct Param
     double div_factor = 10;
 
     bool log_op = false;
+    uINT threads = 1;
+    bool bsig_output = false;               // the values are kept as numbers for a .bsig file
 
     operator bool() const {
         if( input_fg_file.empty() or input_bg_file.empty() or output_enrichment_file.empty() )
@@ -156,6 +171,13 @@ Param read_param(int argc, char *argv[])
                 //has_next(argc, i);
                 param.log_op = true;
                 //i++;
+            }else if(not strcmp(argv[i]+1, "p"))
+            {
+                has_next(argc, i);
+                param.threads = stoul(argv[i+1]);
+                if(param.threads < 1)
+                    param.threads = 1;
+                i++;
             }else{
                 cerr << RED << "FATAL ERROR: unknown option: " << argv[i] << DEF << endl;
                 print_usage();
@@ -167,6 +189,7 @@ Param read_param(int argc, char *argv[])
             exit(-1);
         }
     }
+    param.bsig_output = is_bsig_file(param.output_enrichment_file);
     return param;
 }
 
@@ -189,279 +212,545 @@ void ave_rpkm_string(const string &rpkm_string, double &rpkm)
 }
 */
 
-void readSignal(const string &signalFile, MapStringuLONG &trans_len, MapStringString &trans_rpkm, 
-    MapStringDouble &trans_scalingFactor_bd, MapStringT<DoubleArray> &trans_baseDensity, 
-    MapStringDouble &trans_scalingFactor_rt, MapStringT<DoubleArray> &trans_RTstop)
-{
-    ifstream SG(signalFile, ifstream::in);
-    string line;
+/**** Read the signal files by transcript ****/
 
-    uLONG lineCount = 0;
-    while(getline(SG, line))
+// a line of a text file, or the scaling factor and values of a line of a .bsig file
+struct Signal_Line
+{
+    string text;
+    bool parsed = false;
+    double scalingFactor = 0;
+    DoubleArray values;
+
+    bool empty() const { return not parsed and text.empty(); }
+    uLONG size() const { return text.size() + values.size() * sizeof(double); }
+    void clear()
     {
-        if(line[0]=='#') continue;
-
-        ++lineCount;
-        if(lineCount%10000==0)
-            cerr << "\tlines " << lineCount << endl;
+        text.clear();
+        parsed = false;
+        values.clear();
+    }
+};
 
-        trim(line);
-        StringArray data;
-        split(line, '\t', data);
-        string id(data[0]);
-        uINT len( stoul(data[1]) );
-        string type(data[2]);
-        string rpkm(data[3]);
-        double scalingFactor( stod(data[4]) );
-        //DoubleArray baseDensities;
-        
-        trans_len[id] = len;
-        trans_rpkm[id] = rpkm;
+// the lines of a transcript in a normalized signal file
+struct Signal_Lines
+{
+    string id;
+    uLONG len = 0;                          // length and rpkm of the last line
+    string rpkm;
+    Signal_Line bd_line;                    // empty if the transcript has no such line
+    Signal_Line rt_line;
+};
 
-        if(type == "baseDensity")
+/*  Read a normalized signal file transcript by transcript, the lines of a transcript 
+    must be consecutive. fetch() finds a transcript: when two files are in the same 
+    order it is the next one (a merge-join), otherwise the transcripts skipped on the 
+    way are indexed by their file offsets and read back by seeking. A .bsig file is
+    read by its index  */
+class Signal_Reader
+{
+public:
+    Signal_Reader(const string &file_name): file_name(file_name)
+    {
+        if(is_bsig_file(file_name))
         {
-            //ave_rpkm_string(rpkm, trans_rpkm[id]);
-            trans_scalingFactor_bd[id] = scalingFactor;
-            DoubleArray &baseDensities = trans_baseDensity[id];
-            for(auto it=data.cbegin()+5; it!=data.cend(); it++) baseDensities.push_back( stod(*it) );
-        }else if(type == "RTstop"){
-            //ave_rpkm_string(rpkm, trans_rpkm[id]);
-            trans_scalingFactor_rt[id] = scalingFactor;
-            DoubleArray &rtStop = trans_RTstop[id];
-            for(auto it=data.cbegin()+5; it!=data.cend(); it++) rtStop.push_back( stod(*it) );
+            try{
+                bsig.reset(new BSig_Reader(file_name));
+            }catch(Bad_IO &e){
+                cerr << RED << e.what() << DEF << endl;
+                exit(-1);
+            }
+            if(bsig->layout() != Signal_Layout(3, 1))
+            {
+                cerr << RED << "FATAL Error: " << file_name << " is not a normalized signal file" << DEF << endl;
+                exit(-1);
+            }
+            return;
+        }
 
+        IN.open(file_name, ifstream::in);
+        if(not IN)
+        {
+            cerr << RED << "FATAL Error: cannot read " << file_name << DEF << endl;
+            exit(-1);
         }
     }
-}
 
-void calcEnrich(const MapStringuLONG &trans_bg_len, const MapStringT<DoubleArray> &trans_bg_baseDensity, 
-                const MapStringT<DoubleArray> &trans_bg_RTstop, const MapStringuLONG &trans_fg_len, 
-                const MapStringT<DoubleArray> &trans_fg_baseDensity, const MapStringT<DoubleArray> &trans_fg_RTstop, 
-                MapStringT<DoubleArray> &trans_enrichment, const Param &param )
-{
-    uLONG skipHead = 0;
-    uLONG skipTail = 0;
-    double sub_fac = param.sub_factor;
-    double div_fac = param.div_factor;
+    // the next transcript in the file order
+    bool next(Signal_Lines &lines)
+    {
+        if(bsig)
+        {
+            if(not bsig->next(record))
+                return false;
+            take_record(lines);
+        }else if(not read_group(IN, next_line, next_offset, lines))
+            return false;
+        ++trans_count;
+        if(trans_count%10000==0)
+            cerr << "\t" << file_name << ": transcripts " << trans_count << endl;
+        return true;
+    }
 
-    uLONG transCount = 0;
-    for(auto it=trans_fg_RTstop.cbegin(); it!=trans_fg_RTstop.cend(); it++)
+    bool fetch(const string &id, Signal_Lines &lines)
     {
-        string trans(it->first);
-        
-        bool in_bg_len = (trans_bg_len.find(trans) != trans_bg_len.end());
-        bool in_bg_bd = (trans_bg_baseDensity.find(trans) != trans_bg_baseDensity.end());
-        bool in_bg_rt = (trans_bg_RTstop.find(trans) != trans_bg_RTstop.end());
-        if(not in_bg_len or not in_bg_bd or not in_bg_rt)
+        if(bsig)
         {
-            cerr << RED << "Warning! transcript " << trans << " not defined in background file.\n" << DEF;
-            continue;
+            const long i = bsig->find(id);
+            if(i < 0)
+                return false;
+            bsig->read(i, record);
+            take_record(lines);
+            return true;
         }
-        bool in_fg_len = (trans_fg_len.find(trans) != trans_fg_len.end());
-        if(not in_fg_len)
+
+        auto it = skipped.find(id);
+        if(it != skipped.end())
         {
-            cerr << RED << "Warning! transcript " << trans << " not defined in foreground file.\n" << DEF;
-            continue;
+            if(not SEEK_IN.is_open())
+                SEEK_IN.open(file_name, ifstream::in);
+            SEEK_IN.clear();
+            SEEK_IN.seekg(it->second);
+            skipped.erase(it);
+
+            string line;
+            uLONG offset = 0;
+            return read_group(SEEK_IN, line, offset, lines);
         }
-        if(trans_fg_len.at(trans) != trans_bg_len.at(trans))
+
+        uLONG offset = next_offset;
+        while(next(lines))
         {
-            cerr << RED << "Warning! transcript " << trans << " is of different length in background and foreground files.\n" << DEF;
-            continue;
+            if(lines.id == id)
+                return true;
+            skipped[lines.id] = offset;
+            offset = next_offset;
         }
+        return false;
+    }
 
-        ++transCount;
-        if(transCount%10000==0)
-            cerr << "\tprocess " << transCount << "..." << endl;
+private:
+    // the lines of the last record read from the .bsig file
+    void take_record(Signal_Lines &lines)
+    {
+        lines.id = record.id;
+        lines.len = record.len;
+        lines.bd_line.clear();
+        lines.rt_line.clear();
+        for(Signal_Row &row: record.rows)
+        {
+            Signal_Line *line = nullptr;
+            if(row.heads[0] == "baseDensity")
+                line = &lines.bd_line;
+            else if(row.heads[0] == "RTstop")
+                line = &lines.rt_line;
+            lines.rpkm = row.heads[1];
+            if(not line)
+                continue;
+            line->parsed = true;
+            line->scalingFactor = parse_double( Field_View(row.heads[2].data(), row.heads[2].size()) );
+            line->values.swap(row.values);
+        }
+    }
 
-        DoubleArray &siganlEnrichment = trans_enrichment[trans];
+    // read a line which is not empty or a comment, return its offset
+    static bool read_line(istream &in, string &line, uLONG &offset)
+    {
+        do{
+            offset = in.tellg();
+            if(not getline(in, line))
+                return false;
+        }while(line.empty() or line[0] == '#');
+        trim(line);
+        return true;
+    }
 
-        const DoubleArray &fg_rt_array = trans_fg_RTstop.at(trans);
-        const DoubleArray &bg_rt_array = trans_bg_RTstop.at(trans);
-        const DoubleArray &fg_bd_array = trans_fg_baseDensity.at(trans);
-        const DoubleArray &bg_bd_array = trans_bg_baseDensity.at(trans);
+    // read the consecutive lines of a transcript, line is the first line of the next transcript
+    static bool read_group(istream &in, string &line, uLONG &offset, Signal_Lines &lines)
+    {
+        if(line.empty() and not read_line(in, line, offset))
+            return false;
 
-        for(int i=0; i<skipHead; i++) siganlEnrichment.push_back(null);
+        lines.bd_line.clear();
+        lines.rt_line.clear();
+        lines.id.clear();
+        do{
+            const size_t t1 = line.find('\t');
+            const size_t t2 = line.find('\t', t1+1);
+            const size_t t3 = line.find('\t', t2+1);
+            const size_t t4 = line.find('\t', t3+1);
+            if(t4 == string::npos)
+                throw Unexpected_Error("FATAL Error: invalid line: "+line.substr(0, 100));
+            if(not lines.id.empty() and lines.id.compare(0, string::npos, line, 0, t1) != 0)
+                return true;
+
+            lines.id.assign(line, 0, t1);
+            lines.len = parse_uLONG( Field_View(line.data()+t1+1, t2-t1-1) );
+            lines.rpkm.assign(line, t3+1, t4-t3-1);
+            const Field_View type(line.data()+t2+1, t3-t2-1);
+            if(type == "baseDensity")
+                lines.bd_line.text.swap(line);
+            else if(type == "RTstop")
+                lines.rt_line.text.swap(line);
+            line.clear();
+        }while(read_line(in, line, offset));
+
+        line.clear();
+        return true;
+    }
 
-        if(param.log_op or param.enrich_method==SUBSTRACTION)
-        {
-            for(int i=skipHead; i<trans_fg_len.at(trans)-skipTail; i++)
-            {
-                //char buff[100];
-                //sprintf(buff, "%.3f", fg_rt_array[i]-sub_fac*bg_rt_array[i]);
-                siganlEnrichment.push_back( fg_rt_array[i]-sub_fac*bg_rt_array[i] );
-            }
-        }else if(param.enrich_method==DIVIDING)
-        {
-            for(int i=skipHead; i<trans_fg_len.at(trans)-skipTail; i++)
-                if(bg_bd_array[i] > 0)
-                {
-                    //char buff[100];
-                    //sprintf(buff, "%.3f", div_fac * fg_bd_array[i] / bg_bd_array[i]);
-                    siganlEnrichment.push_back( div_fac * fg_bd_array[i] / bg_bd_array[i] );
-                }else{
-                    siganlEnrichment.push_back(null);
-                }
+    const string file_name;
+    ifstream IN;
+    ifstream SEEK_IN;
+    string next_line;                       // the first line of the next transcript
+    uLONG next_offset = 0;
+    MapStringT<uLONG> skipped;              // offsets of the skipped transcripts
+    uLONG trans_count = 0;
 
-        }else{
-            for(int i=skipHead; i<trans_fg_len.at(trans)-skipTail; i++)
-                if(bg_bd_array[i] > 0)
-                {
-                    //char buff[100];
-                    //sprintf(buff, "%.3f", div_fac * (fg_rt_array[i]-sub_fac*bg_rt_array[i]) / bg_bd_array[i]);
-                    siganlEnrichment.push_back( div_fac * (fg_rt_array[i]-sub_fac*bg_rt_array[i]) / bg_bd_array[i] );
-                }else{
-                    siganlEnrichment.push_back(null);
-                }
-        }
-        for(int i=trans_fg_len.at(trans)-skipTail; i<trans_fg_len.at(trans); i++) siganlEnrichment.push_back(null);
+    unique_ptr<BSig_Reader> bsig;
+    Signal_Record record;
+};
+
+/**** Enrichment of a transcript ****/
+
+struct Enrich_Unit
+{
+    Signal_Lines fg;
+    Signal_Lines bg;
+
+    double fg_sf_rt = 0;
+    double bg_sf_bd = 0;
+    double bg_sf_rt = 0;
+    bool low_resolution = false;
+    string values;                          // "\tenrichment,fg_rt,bg_rt,bg_bd" of each position
+    DoubleArray numbers;                    // enrichment,fg_rt,bg_rt,bg_bd of each position for a .bsig file, NULL is NaN
+};
+
+// the scaling factor and the values of a line
+void parse_signal(Signal_Line &line, double &scalingFactor, DoubleArray &values)
+{
+    if(line.parsed)
+    {
+        scalingFactor = line.scalingFactor;
+        values.swap(line.values);
+        return;
     }
+
+    static thread_local FieldArray data;
+    split(line.text, '\t', data);
+    scalingFactor = parse_double(data[4]);
+    values.clear();
+    for(auto it=data.cbegin()+5; it!=data.cend(); it++) 
+        values.push_back( parse_double(*it) );
 }
 
-void winsorWindow(  const DoubleArray &enrichment, const uINT &headTopSkip, const uINT &trimed_last, 
-                    const double &winsor_factor, double &winsorLower, double &winsorUpper)
+void calcEnrich(const uLONG &len, const DoubleArray &fg_rt_array, const DoubleArray &fg_bd_array, 
+                const DoubleArray &bg_rt_array, const DoubleArray &bg_bd_array, DoubleArray &siganlEnrichment, const Param &param)
 {
-    /*
-    winsor_factor /= 100;
-    if(winsorFactor >= 0.5)
+    uLONG skipHead = 0;
+    uLONG skipTail = 0;
+    double sub_fac = param.sub_factor;
+    double div_fac = param.div_factor;
+
+    siganlEnrichment.clear();
+    for(int i=0; i<skipHead; i++) siganlEnrichment.push_back(null);
+
+    if(param.log_op or param.enrich_method==SUBSTRACTION)
     {
-        cerr << RED << "FATAL Error! Winsor factor must be less than 0.5.\n";
-        exit(-1);
+        for(int i=skipHead; i<len-skipTail; i++)
+            siganlEnrichment.push_back( fg_rt_array[i]-sub_fac*bg_rt_array[i] );
+    }else if(param.enrich_method==DIVIDING)
+    {
+        for(int i=skipHead; i<len-skipTail; i++)
+            if(bg_bd_array[i] > 0)
+                siganlEnrichment.push_back( div_fac * fg_bd_array[i] / bg_bd_array[i] );
+            else
+                siganlEnrichment.push_back(null);
+    }else{
+        for(int i=skipHead; i<len-skipTail; i++)
+            if(bg_bd_array[i] > 0)
+                siganlEnrichment.push_back( div_fac * (fg_rt_array[i]-sub_fac*bg_rt_array[i]) / bg_bd_array[i] );
+            else
+                siganlEnrichment.push_back(null);
     }
-    */
-    
-    //clog << "winsorWindow..." << endl;
-    //clog << "enrichment length: " << enrichment.size() << endl;
-    DoubleArray sortedTrimed_array;
+    for(int i=len-skipTail; i<len; i++) siganlEnrichment.push_back(null);
+}
+
+void winsorWindow(  const DoubleArray &enrichment, const uINT &headTopSkip, const uINT &trimed_last, 
+                    const double &winsor_factor, double &winsorLower, double &winsorUpper)
+{
+    static thread_local DoubleArray sortedTrimed_array;
+    sortedTrimed_array.clear();
     for(uINT i=headTopSkip; i<=trimed_last; i++)
     {
-       // cout << i << ": " << enrichment[i] << endl;
         if(enrichment[i] != null)
             sortedTrimed_array.push_back(enrichment[i]);
     }
 
-    //clog << "start to sort" << endl;
     sort(sortedTrimed_array.begin(), sortedTrimed_array.end());
 
-    //for(double v: sortedTrimed_array)
-    //    cout << v << " ";
-    //cout << "\n\n";
-
     uLONG len = sortedTrimed_array.size();
     uLONG winsorLen = winsor_factor * len;
 
     winsorLower = sortedTrimed_array[winsorLen];
     winsorUpper = sortedTrimed_array[len-winsorLen-1];
 }
- 
 
-void winsorization(const MapStringuLONG &trans_len, MapStringT<DoubleArray> &trans_signal, 
+// return false if the signal is not winsorized for low resolution
+bool winsorization(const uLONG &trans_len, DoubleArray &signal, 
                     const uINT &headTopSkip, const uINT &tailToSkip,
                     const double &winsor_factor, const uINT &winsor_scaling)
 {
-    cerr << "Winsorization...\n\t" << currentDateTime() << endl;
+    uINT trimed_last = trans_len - tailToSkip - 1;
 
-    uLONG transCount = 0;
-    for(auto it=trans_signal.begin(); it!=trans_signal.end(); it++)
-    {
-
-        ++transCount;
-        if(transCount%10000==0)
-            cerr << "\tprocess " << transCount << "...\n";
-
-        string trans(it->first);
-        uINT trimed_last = trans_len.at(trans) - tailToSkip - 1;
+    double winsorUpper, winsorLower;
+    winsorWindow(signal, headTopSkip+1, trimed_last, winsor_factor, winsorLower, winsorUpper);
 
-        //cerr << headTopSkip+1 << "\t" << trimed_last << endl;
+    if(winsorLower < 0) winsorLower = 0;
+    if(winsorLower >= winsorUpper)
+        return false;
 
-        double winsorUpper, winsorLower;
-        winsorWindow(it->second, headTopSkip+1, trimed_last, winsor_factor, winsorLower, winsorUpper);
-        //clog << "winsorLower: " << winsorLower << "\t" << "winsorUpper: " << winsorUpper << endl;
+    for(uLONG i=0; i<trans_len; i++)
+    {
+        if(signal[i] != null)
+        {
+            if(signal[i] > winsorUpper)
+                signal[i] = winsorUpper;
+            else if(signal[i] < winsorLower)
+                signal[i] = winsorLower;
+            if(winsor_scaling != 0)
+                signal[i] = (signal[i] - winsorLower)*winsor_scaling/(winsorUpper-winsorLower);
+        }
+    }
+    return true;
+}
 
-        if(winsorLower < 0) winsorLower = 0;
-        if(winsorLower >= winsorUpper)
+// calculate, winsorize and format the enrichment of a transcript, or keep the numbers for a .bsig file.
+// The buffers are reused by a thread
+void enrich_unit(Enrich_Unit &unit, const Param &param)
+{
+    static thread_local DoubleArray fg_rt, fg_bd, bg_rt, bg_bd, enrichment;
+    double fg_sf_bd = 0;
+
+    parse_signal(unit.fg.rt_line, unit.fg_sf_rt, fg_rt);
+    fg_bd.clear();
+    if(not unit.fg.bd_line.empty())
+        parse_signal(unit.fg.bd_line, fg_sf_bd, fg_bd);
+    parse_signal(unit.bg.rt_line, unit.bg_sf_rt, bg_rt);
+    parse_signal(unit.bg.bd_line, unit.bg_sf_bd, bg_bd);
+    unit.fg.bd_line.clear();
+    unit.fg.rt_line.clear();
+    unit.bg.bd_line.clear();
+    unit.bg.rt_line.clear();
+
+    const uLONG len = unit.bg.len;
+    calcEnrich(len, fg_rt, fg_bd, bg_rt, bg_bd, enrichment, param);
+
+    const uLONG headToSkip = 5;  const uLONG tailToSkip = 32;
+    unit.low_resolution = not winsorization(len, enrichment, headToSkip, tailToSkip, param.winsor_factor, param.winsor_scaling);
+
+    if(param.bsig_output)
+    {
+        unit.numbers.resize(4*len);
+        for(uLONG i=0; i<len; i++)
         {
-            cerr << "Not enough resolution! Skip transcript " << trans << endl;
-            continue;
+            unit.numbers[4*i] = (enrichment[i] == null) ? std::numeric_limits<double>::quiet_NaN() : enrichment[i];
+            unit.numbers[4*i+1] = unit.fg_sf_rt*fg_rt[i];
+            unit.numbers[4*i+2] = unit.bg_sf_rt*bg_rt[i];
+            unit.numbers[4*i+3] = unit.bg_sf_bd*bg_bd[i];
         }
-        if(winsor_scaling != 0)
+        return;
+    }
+
+    ostringstream buffer;
+    {
+        Fast_Writer writer(buffer);
+        for(uLONG i=0; i<len; i++)
         {
-            uLONG len = trans_len.at(it->first);
-            for(uLONG i=0; i<len; i++)
-            {
-                if(it->second[i] != null)
-                {
-                    if(it->second[i] > winsorUpper)
-                        it->second[i] = winsorUpper;
-                    else if(it->second[i] < winsorLower)
-                        it->second[i] = winsorLower;
-                    it->second[i] = (it->second[i] - winsorLower)*winsor_scaling/(winsorUpper-winsorLower);
-                }
-            }
-        }else{
-            uLONG len = trans_len.at(it->first);
-            for(uLONG i=0; i<len; i++)
-            {
-                if(it->second[i] != null)
-                {
-                    if(it->second[i] > winsorUpper)
-                        it->second[i] = winsorUpper;
-                    else if(it->second[i] < winsorLower)
-                        it->second[i] = winsorLower;
-                }
+            if(enrichment[i] == null)
+                writer << "\tNULL";
+            else{
+                writer << '\t';
+                writer.write_fixed(enrichment[i], 3);
             }
+            writer << ',';
+            writer.write_fixed(unit.fg_sf_rt*fg_rt[i], 3);
+            writer << ',';
+            writer.write_fixed(unit.bg_sf_rt*bg_rt[i], 3);
+            writer << ',';
+            writer.write_fixed(unit.bg_sf_bd*bg_bd[i], 3);
         }
     }
+    unit.values = buffer.str();
 }
 
+/*  The head is written with the stream format of OUT, which is std::fixed after 
+    the first transcript with values as in the old writer  */
+void write_unit(ostream &OUT, const Enrich_Unit &unit)
+{
+    if(unit.low_resolution)
+        cerr << "Not enough resolution! Skip transcript " << unit.bg.id << endl;
+
+    OUT << unit.bg.id << "\t" << unit.bg.len << "\t" << unit.fg.rpkm << "," << unit.bg.rpkm << "\t" << 
+        unit.fg_sf_rt << "," << unit.bg_sf_bd << "," << unit.bg_sf_rt;
 
-void outputEnrichment(const string &outputFile, const MapStringuLONG &trans_len, const MapStringT<DoubleArray> &trans_enrichment, const MapStringString &trans_fg_rpkm, 
-       const MapStringDouble &trans_fg_scalingFactor_rt, const MapStringT<DoubleArray> &trans_fg_RTstop, const MapStringString &trans_bg_rpkm, 
-       const MapStringDouble &trans_bg_scalingFactor_bd, const MapStringDouble &trans_bg_scalingFactor_rt, const MapStringT<DoubleArray> &trans_bg_baseDensity, 
-       const MapStringT<DoubleArray> &trans_bg_RTstop)
+    if(unit.bg.len > 0)
+    {
+        std::streamsize ss = OUT.precision();
+        OUT << std::fixed << std::setprecision(3);
+        OUT << unit.values;
+        OUT.precision(ss);
+    }
+    OUT << "\n";
+}
+
+/*  The numbers have 3 decimals. The heads are the text of the text file, where the stream
+    is std::fixed after the first transcript with values (fixed_heads)  */
+void write_unit(BSig_Writer &writer, const Enrich_Unit &unit, Signal_Record &record, bool &fixed_heads)
+{
+    if(unit.low_resolution)
+        cerr << "Not enough resolution! Skip transcript " << unit.bg.id << endl;
+
+    const char sf_decimals = fixed_heads ? 6 : Signal_Row::GENERAL_NUMBER;
+    record.id = unit.bg.id;
+    record.len = unit.bg.len;
+    record.rows.resize(1);
+    Signal_Row &row = record.rows[0];
+    row.heads = { unit.fg.rpkm+","+unit.bg.rpkm, signal_number_text(unit.fg_sf_rt, sf_decimals)+","+
+        signal_number_text(unit.bg_sf_bd, sf_decimals)+","+signal_number_text(unit.bg_sf_rt, sf_decimals) };
+    row.values = unit.numbers;
+    row.decimals = 3;
+    writer.write_record(record);
+
+    if(unit.bg.len > 0)
+        fixed_heads = true;
+}
+
+/*  The foreground transcripts are joined with the background in the order of the 
+    foreground file, calculated by a pool of workers with -p and written in order  */
+void enrich_files(const Param &param)
 {
     cerr << "Output enrichment scores to file $outputFile...\n\t" << currentDateTime() << endl;
 
-    ofstream OUT(outputFile, ofstream::out);
-    if(not OUT)
+    const string head_line("#transcript\tlength\tenrichment score, start from position 1.");
+    ofstream OUT;
+    unique_ptr<BSig_Writer> writer;
+    Signal_Record record;
+    bool fixed_heads = false;
+    if(param.bsig_output)
     {
-        cerr << RED << "FATAL Error: cannot write to " << outputFile << endl;
-        exit(-1);
+        try{
+            writer.reset(new BSig_Writer(param.output_enrichment_file, Signal_Layout(2, 4)));
+        }catch(Bad_IO &e){
+            cerr << RED << e.what() << DEF << endl;
+            exit(-1);
+        }
+        writer->write_head(head_line);
+    }else{
+        OUT.open(param.output_enrichment_file, ofstream::out);
+        if(not OUT)
+        {
+            cerr << RED << "FATAL Error: cannot write to " << param.output_enrichment_file << endl;
+            exit(-1);
+        }
+        OUT << head_line << "\n";
     }
 
-    OUT << "#transcript\tlength\tenrichment score, start from position 1.\n";
-    for(auto it=trans_enrichment.cbegin(); it!=trans_enrichment.cend(); it++)
+    Signal_Reader FG(param.input_fg_file);
+    Signal_Reader BG(param.input_bg_file);
+
+    typedef vector<Enrich_Unit> Unit_Batch;
+    const uLONG batch_bytes = 1<<22;
+    const uLONG batch_units = 256;
+
+    unique_ptr<Thread_Pool> pool;
+    if(param.threads > 1)
+        pool.reset(new Thread_Pool(param.threads));
+    deque< future< shared_ptr<Unit_Batch> > > pending;
+
+    auto calc_batch = [&param](shared_ptr<Unit_Batch> batch)
+    {
+        for(Enrich_Unit &unit: *batch)
+            enrich_unit(unit, param);
+        return batch;
+    };
+    auto write_batch = [&](const Unit_Batch &batch)
+    {
+        for(const Enrich_Unit &unit: batch)
+            if(writer)
+                write_unit(*writer, unit, record, fixed_heads);
+            else
+                write_unit(OUT, unit);
+    };
+
+    uLONG transCount = 0;
+    bool more = true;
+    while(more)
     {
-        string trans(it->first);
-
-        OUT << trans << "\t" << trans_len.at(trans) << "\t" << trans_fg_rpkm.at(trans) << "," << trans_bg_rpkm.at(trans) << "\t" << 
-        trans_fg_scalingFactor_rt.at(trans) << "," << trans_bg_scalingFactor_bd.at(trans) << "," << trans_bg_scalingFactor_rt.at(trans);
-
-        const auto &enrichment = trans_enrichment.at(trans);
-        const auto &fg_rt = trans_fg_RTstop.at(trans);
-        const auto &bg_rt = trans_bg_RTstop.at(trans);
-        const auto &bg_bd = trans_bg_baseDensity.at(trans);
-        const double fg_sf_rt = trans_fg_scalingFactor_rt.at(trans);
-        const double bg_sf_rt = trans_bg_scalingFactor_rt.at(trans);
-        const double bg_sf_bd = trans_bg_scalingFactor_bd.at(trans);
-        for(uLONG i=0; i<trans_len.at(trans); i++)
+        shared_ptr<Unit_Batch> batch = make_shared<Unit_Batch>();
+        uLONG bytes = 0;
+        while(bytes < batch_bytes and batch->size() < batch_units)
         {
-            std::streamsize ss = OUT.precision();
-            OUT << std::fixed << std::setprecision(3);
+            Enrich_Unit unit;
+            if(not FG.next(unit.fg))
+            {
+                more = false;
+                break;
+            }
+            if(unit.fg.rt_line.empty())
+                continue;
 
-            if(enrichment[i] == null)
-                OUT << "\tNULL";
-            else
-                OUT << "\t" << enrichment[i];
-            OUT << "," << fg_sf_rt*fg_rt[i];
-            OUT << "," << bg_sf_rt*bg_rt[i];
-            OUT << "," << bg_sf_bd*bg_bd[i];
+            const string &trans = unit.fg.id;
+            if(not BG.fetch(trans, unit.bg) or unit.bg.bd_line.empty() or unit.bg.rt_line.empty())
+            {
+                cerr << RED << "Warning! transcript " << trans << " not defined in background file.\n" << DEF;
+                continue;
+            }
+            if(unit.fg.len != unit.bg.len)
+            {
+                cerr << RED << "Warning! transcript " << trans << " is of different length in background and foreground files.\n" << DEF;
+                continue;
+            }
+            if(unit.fg.bd_line.empty() and not param.log_op and param.enrich_method == DIVIDING)
+            {
+                cerr << RED << "Warning! transcript " << trans << " has no baseDensity in foreground file.\n" << DEF;
+                continue;
+            }
+
+            ++transCount;
+            if(transCount%10000==0)
+                cerr << "\tprocess " << transCount << "..." << endl;
+
+            bytes += unit.fg.bd_line.size() + unit.fg.rt_line.size() + unit.bg.bd_line.size() + unit.bg.rt_line.size();
+            batch->push_back(std::move(unit));
+        }
 
-            OUT.precision(ss);
+        if(batch->empty())
+            continue;
+
+        if(not pool)
+        {
+            write_batch( *calc_batch(batch) );
+            continue;
+        }
+
+        pending.push_back( pool->submit([batch, &calc_batch](){ return calc_batch(batch); }) );
+        if(pending.size() >= 2*param.threads)
+        {
+            write_batch( *pending.front().get() );
+            pending.pop_front();
         }
-        OUT << "\n";
+    }
+
+    while(not pending.empty())
+    {
+        write_batch( *pending.front().get() );
+        pending.pop_front();
     }
 
     OUT.close();
+    if(writer)
+        writer->close();
 }
 
 int main(int argc, char *argv[])
@@ -474,42 +763,7 @@ int main(int argc, char *argv[])
         return -1;
     }
 
-   // double pp = null;
-   // if(null == pp)
-   //     cerr << "Yean" << endl;
-
-    MapStringuLONG trans_bg_len, trans_fg_len;
-    MapStringString trans_bg_rpkm, trans_fg_rpkm;
-    MapStringDouble trans_bg_scalingFactor_bd, trans_fg_scalingFactor_bd;
-    MapStringDouble trans_bg_scalingFactor_rt, trans_fg_scalingFactor_rt;
-    MapStringT<DoubleArray> trans_bg_baseDensity, trans_fg_baseDensity;
-    MapStringT<DoubleArray> trans_bg_RTstop, trans_fg_RTstop;
-    MapStringT<DoubleArray> trans_enrichment;
-    //MapStringDouble trans_bg_avgRTstop, trans_fg_avgRTstop;
-
-    cerr << "Start to read " << param.input_bg_file << endl;
-    readSignal(param.input_bg_file, trans_bg_len, trans_bg_rpkm, trans_bg_scalingFactor_bd, 
-            trans_bg_baseDensity, trans_bg_scalingFactor_rt, trans_bg_RTstop);
-    
-    cerr << "Start to read " << param.input_fg_file << endl;
-    readSignal(param.input_fg_file, trans_fg_len, trans_fg_rpkm, trans_fg_scalingFactor_bd, 
-            trans_fg_baseDensity, trans_fg_scalingFactor_rt, trans_fg_RTstop);
-
-    cerr << "Start to calculate enrichment " << endl;
-    calcEnrich(trans_bg_len, trans_bg_baseDensity, trans_bg_RTstop, 
-               trans_fg_len, trans_fg_baseDensity, trans_fg_RTstop, 
-               trans_enrichment, param );
-
-    cerr << "Start to calculate winsorization " << endl;
-    uLONG headToSkip = 5;  uLONG tailToSkip = 32;
-    winsorization(trans_fg_len, trans_enrichment, headToSkip, tailToSkip,
-                    param.winsor_factor, param.winsor_scaling);
-
-    cerr << "Start to calculate outputEnrichment " << endl;
-    outputEnrichment(param.output_enrichment_file, trans_fg_len, trans_enrichment, trans_fg_rpkm, 
-       trans_fg_scalingFactor_rt, trans_fg_RTstop, trans_bg_rpkm, 
-       trans_bg_scalingFactor_bd, trans_bg_scalingFactor_rt, trans_bg_baseDensity, 
-       trans_bg_RTstop);
+    enrich_files(param);
 
     return 0;
 }
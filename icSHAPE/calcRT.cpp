@@ -3,11 +3,17 @@
 #include <param.h>
 #include <string_split.h>
 #include <exceptions.h>
+#include <htslib.h>
+#include <thread_pool.h>
+#include <signal_file.h>
 #include <fstream>
 #include <algorithm>
 #include <math.h>
 #include <iomanip>
 #include <numeric>
+#include <deque>
+#include <mutex>
+#include <memory>
 
 using namespace std;
 using namespace pan;
@@ -23,18 +29,19 @@ void print_usage()
     char buff[4000];
     const char *help_info = 
         "## --------------------------------------\n"
-        "calculate RT stops from sam file\n\n"
+        "calculate RT stops from sam/bam file\n\n"
 
         "Command:\n"
         "%s -i input_sam_file -o output_RTstop_file -r transcript_rpkm_file\n\n"
 
         "# what it is:\n"
-        " -i     input sam file\n"
-        " -o     output RTstop file (with base density information)\n"
+        " -i     input sam file, or bam file if it ends with .bam\n"
+        " -o     output RTstop file (with base density information), a binary file if it ends with .bsig\n"
         " -r     rpkm file\n\n"
 
         "# more options:\n"
-        " -c     cutoff of RPKM\n\n";
+        " -c     cutoff of RPKM\n"
+        " -p     threads to count the reads (default: 1)\n\n";
 
     sprintf(buff, help_info, "calcRT");
     cout << buff << endl;
@@ -47,6 +54,7 @@ struct Param
     string rpkm_file;
 
     double rpkm_cutoff = 5.0;
+    uINT threads = 1;
 
     operator bool() const 
     {
@@ -97,6 +105,13 @@ Param read_param(int argc, char *argv[])
                 has_next(argc, i);
                 param.rpkm_cutoff = stod(argv[i+1]);
                 i++;
+            }else if(not strcmp(argv[i]+1, "p"))
+            {
+                has_next(argc, i);
+                param.threads = stoul(argv[i+1]);
+                if(param.threads < 1)
+                    param.threads = 1;
+                i++;
             }else{
                 cerr << RED << "FATAL ERROR: unknown option: " << argv[i] << DEF << endl;
                 print_usage();
@@ -122,18 +137,18 @@ void readRPKM(const string &rpkmFile, const double &minLoad, MapStringuLONG &tra
     }
 
     string line;
+    FieldArray data;
     while(getline(IN, line))
     {
         if(line[0] == '#') continue;
 
-        StringArray data;
         split(line, '\t', data);
 
         string trans(data[0]);
-        uLONG len = stoul(data[1]);
-        double uniqRead = stod(data[2]);
-        double multiRead = stod(data[3]);
-        double rpkm = stod(data[4]);
+        uLONG len = parse_uLONG(data[1]);
+        double uniqRead = parse_double(data[2]);
+        double multiRead = parse_double(data[3]);
+        double rpkm = parse_double(data[4]);
 
         if(rpkm < minLoad) continue;
 
@@ -144,41 +159,185 @@ void readRPKM(const string &rpkmFile, const double &minLoad, MapStringuLONG &tra
     IN.close();
 }
 
-void calcBaseDensity(const string &inputSamFile, MapStringT<uLONGArray> &baseDensity, MapStringT<uLONGArray> &RTstop,
-                    const MapStringuLONG &trans_len, const MapStringDouble &trans_rpkm)
+/*  The transcripts are indexed in the iteration order of trans_index, which is
+    the output order  */
+struct Trans_Table
 {
-    cerr << "Calculate base density from file " << inputSamFile <<"...\n\t" << currentDateTime() << endl;
+    MapStringT<uLONG> trans_index;
+    StringArray trans_ids;
+    uLONGArray trans_len;
+    DoubleArray trans_rpkm;
 
-    ifstream IN(inputSamFile, ifstream::in);
-    if(not IN)
+    Trans_Table(const MapStringuLONG &len_map, const MapStringDouble &rpkm_map)
     {
-        cerr << RED << "FATAL Error: cannot read " << inputSamFile << "..." << DEF << endl;
-        exit(-1);
+        for(auto it=len_map.cbegin(); it!=len_map.cend(); it++)
+            trans_index[it->first];
+        for(auto it=trans_index.begin(); it!=trans_index.end(); it++)
+        {
+            it->second = trans_ids.size();
+            trans_ids.push_back(it->first);
+            trans_len.push_back(len_map.at(it->first));
+            trans_rpkm.push_back(rpkm_map.at(it->first));
+        }
     }
 
-    string line;
-    string readID;
-    uLONG lineCount = 0;
-    MapStringuLONG hitID_start, hitID_end;
-    uLONG hitCount = 0;
+    // index of a transcript, -1 if it is not counted
+    long find(const string &trans) const
+    {
+        auto it = trans_index.find(trans);
+        return it == trans_index.end() ? -1 : it->second;
+    }
 
-    while(getline(IN, line))
+    uLONG size() const { return trans_ids.size(); }
+};
+
+// a hit of a read, the bases [start, end) are covered
+struct Read_Hit
+{
+    long trans;                             // -1 if the transcript is not counted
+    uLONG start;
+    uLONG end;
+};
+
+// the hits of consecutive lines of a read
+struct Read_Block
+{
+    string read_id;
+    vector<Read_Hit> hits;
+};
+
+/*  Base density and RT stops of each transcript, the arrays of a transcript 
+    are allocated when it is hit  */
+struct RT_Counter
+{
+    vector<uLONGArray> baseDensity;
+    vector<uLONGArray> RTstop;
+
+    RT_Counter(const Trans_Table &table): baseDensity(table.size()), RTstop(table.size()), table(table) {}
+
+    // a read hit n places adds 1/n to each of them, the last hit of a transcript is used
+    void count(const vector<Read_Hit> &hits)
+    {
+        const uLONG hitCount = hits.size();
+        for(uLONG h=0; h<hits.size(); h++)
+        {
+            const Read_Hit &hit = hits[h];
+            if(hit.trans < 0)
+                continue;
+
+            bool last = true;
+            for(uLONG k=h+1; k<hits.size() and last; k++)
+                last = hits[k].trans != hit.trans;
+            if(not last)
+                continue;
+
+            uLONGArray &bd = baseDensity[hit.trans];
+            uLONGArray &rt = RTstop[hit.trans];
+            if(bd.empty())
+            {
+                bd.resize(table.trans_len[hit.trans]+1);
+                rt.resize(table.trans_len[hit.trans]+1);
+            }
+            for(uLONG i=hit.start; i<hit.end; i++)
+                bd[i] += 1.0/hitCount;
+            rt[hit.start-1] += 1.0/hitCount;
+        }
+    }
+
+    // add the counts of other
+    void merge(RT_Counter &other)
+    {
+        for(uLONG t=0; t<table.size(); t++)
+        {
+            if(other.baseDensity[t].empty())
+                continue;
+            if(baseDensity[t].empty())
+            {
+                baseDensity[t].swap(other.baseDensity[t]);
+                RTstop[t].swap(other.RTstop[t]);
+                continue;
+            }
+            for(uLONG i=0; i<baseDensity[t].size(); i++)
+            {
+                baseDensity[t][i] += other.baseDensity[t][i];
+                RTstop[t][i] += other.RTstop[t][i];
+            }
+        }
+    }
+
+private:
+    const Trans_Table &table;
+};
+
+/*  Group the hits of a batch by read and count them, the first and the last 
+    reads may continue in the neighbouring batches and are returned uncounted  */
+class Batch_Counter
+{
+public:
+    Batch_Counter(RT_Counter &counter): counter(counter) {}
+
+    void add(const char *read_id, const uLONG &len, const Read_Hit &hit)
     {
-        if(line[0] == '@') continue;
+        if(current.hits.empty() or current.read_id.size() != len or current.read_id.compare(0, len, read_id, len) != 0)
+        {
+            if(not current.hits.empty())
+            {
+                if(edges.empty())
+                    edges.push_back(current);
+                else
+                    counter.count(current.hits);
+            }
+            current.read_id.assign(read_id, len);
+            current.hits.clear();
+        }
+        current.hits.push_back(hit);
+    }
 
-        ++lineCount;
-        //cout << lineCount << endl;
-        if(lineCount % 1000000 == 0)
-            cerr << "\tlines " << lineCount << endl;
+    vector<Read_Block> finish()
+    {
+        if(not current.hits.empty())
+            edges.push_back(current);
+        return edges;
+    }
+
+private:
+    RT_Counter &counter;
+    Read_Block current;
+    vector<Read_Block> edges;
+};
+
+// a batch of sam lines or bam records
+struct Read_Batch
+{
+    StringArray sam_lines;
+    vector<bam1_t *> bam_records;
+
+    uLONG size() const { return sam_lines.size() + bam_records.size(); }
+};
+
+// the hit ends at the end of the transcript
+inline Read_Hit make_hit(const long &trans, const uLONG &pos, const uLONG &tlen, const Trans_Table &table)
+{
+    Read_Hit hit{trans, pos, pos+tlen};
+    if(trans >= 0 and table.trans_len[trans] < hit.end)
+        hit.end = table.trans_len[trans] + 1;
+    return hit;
+}
 
-        StringArray data;
+vector<Read_Block> count_sam_batch(const Read_Batch &batch, const Trans_Table &table, RT_Counter &counter)
+{
+    Batch_Counter batch_counter(counter);
+    FieldArray data;
+    string hit;
+    for(const string &line: batch.sam_lines)
+    {
         split(line, '\t', data);
-        string read(data[0]);
-        string tag(data[1]);
-        string hit(data[2]);
-        uLONG pos = stoul(data[3]);
-        uLONG tlen = stoul(data[8]);
-        string seq(data[9]);
+        const Field_View &read = data[0];
+        const Field_View &tag = data[1];
+        hit.assign(data[2].data(), data[2].size());
+        uLONG pos = parse_uLONG(data[3]);
+        uLONG tlen = parse_uLONG(data[8]);
+        const Field_View &seq = data[9];
 
         if(tag == "99" or tag == "355")
         {
@@ -193,51 +352,242 @@ void calcBaseDensity(const string &inputSamFile, MapStringT<uLONGArray> &baseDen
             continue;
         }
 
-        if(read != readID)
+        const long trans = table.find(hit);
+        batch_counter.add(read.data(), read.size(), make_hit(trans, pos, tlen, table));
+    }
+    return batch_counter.finish();
+}
+
+// the same lines as count_sam_batch, a mate on the same reference is written as "=" in sam
+vector<Read_Block> count_bam_batch(Read_Batch &batch, const vector<long> &tid_trans, const Trans_Table &table, RT_Counter &counter)
+{
+    Batch_Counter batch_counter(counter);
+    for(bam1_t *record: batch.bam_records)
+    {
+        const uint16_t flag = getBamFlag(record);
+        uLONG tlen = record->core.isize;
+        bool accepted = true;
+        if(flag == 99 or flag == 355)
+        {
+            if(record->core.mtid == record->core.tid)
+                accepted = false;
+        }else if(flag == 0 or flag == 256)
+        {
+            // SEQ * is a sequence of size 1 in sam, and of size 0 in bam
+            tlen = record->core.l_qseq ? record->core.l_qseq : 1;
+        }else{
+            accepted = false;
+        }
+
+        if(accepted)
+        {
+            const long trans = record->core.tid < 0 ? -1 : tid_trans[record->core.tid];
+            const char *read_id = bam_get_qname(record);
+            batch_counter.add(read_id, strlen(read_id), make_hit(trans, getBamRefPos(record), tlen, table));
+        }
+        bam_destroy1(record);
+    }
+    batch.bam_records.clear();
+    return batch_counter.finish();
+}
+
+/*  Batches of lines are counted on a pool of workers, each worker counts into its 
+    own RT_Counter. A read may be split by the batches, so the first and the last 
+    read of each batch are joined in the reading order and counted here  */
+void calcBaseDensity(const string &inputSamFile, const Trans_Table &table, RT_Counter &total, const uINT &threads)
+{
+    cerr << "Calculate base density from file " << inputSamFile <<"...\n\t" << currentDateTime() << endl;
+
+    BGZF* bam_hd = nullptr;
+    bam_hdr_t *hdr = nullptr;
+    vector<long> tid_trans;
+    ifstream IN;
+    if( endswith(inputSamFile, ".bam") )
+    {
+        bam_hd = bgzf_open(inputSamFile.c_str(), "r");
+        if(not bam_hd)
+        {
+            cerr << RED << "FATAL Error: cannot read " << inputSamFile << "..." << DEF << endl;
+            exit(-1);
+        }
+        if(threads > 1)
+            bgzf_mt(bam_hd, threads, 256);
+        hdr = bam_hdr_read(bam_hd);
+        for(int32_t tid=0; tid<hdr->n_targets; tid++)
+            tid_trans.push_back( table.find(hdr->target_name[tid]) );
+    }else{
+        IN.open(inputSamFile, ifstream::in);
+        if(not IN)
+        {
+            cerr << RED << "FATAL Error: cannot read " << inputSamFile << "..." << DEF << endl;
+            exit(-1);
+        }
+    }
+
+    // the counters of the workers, a task takes a free one
+    vector< unique_ptr<RT_Counter> > counters;
+    vector<RT_Counter *> free_counters;
+    mutex counter_mutex;
+    for(uINT i=0; i<threads; i++)
+    {
+        counters.emplace_back( new RT_Counter(table) );
+        free_counters.push_back( counters.back().get() );
+    }
+
+    auto count_batch = [&](shared_ptr<Read_Batch> batch) -> vector<Read_Block>
+    {
+        RT_Counter *counter;
+        {
+            lock_guard<mutex> lock(counter_mutex);
+            counter = free_counters.back();
+            free_counters.pop_back();
+        }
+        vector<Read_Block> edges = bam_hd ? count_bam_batch(*batch, tid_trans, table, *counter) : count_sam_batch(*batch, table, *counter);
+        {
+            lock_guard<mutex> lock(counter_mutex);
+            free_counters.push_back(counter);
+        }
+        return edges;
+    };
+
+    // join the edge reads of the batches in order
+    Read_Block open;
+    auto collect = [&](vector<Read_Block> edges)
+    {
+        for(uLONG i=0; i<edges.size(); i++)
+        {
+            if(i == 0 and not open.hits.empty() and open.read_id == edges[0].read_id)
+            {
+                open.hits.insert(open.hits.end(), edges[0].hits.begin(), edges[0].hits.end());
+                continue;
+            }
+            if(not open.hits.empty())
+                total.count(open.hits);
+            open = edges[i];
+        }
+    };
+
+    const uLONG batch_size = 10000;
+    unique_ptr<Thread_Pool> pool;
+    if(threads > 1)
+        pool.reset(new Thread_Pool(threads));
+    deque< future< vector<Read_Block> > > pending;
+
+    uLONG lineCount = 0;
+    bool more = true;
+    while(more)
+    {
+        shared_ptr<Read_Batch> batch = make_shared<Read_Batch>();
+        while(batch->size() < batch_size)
         {
-            if(not readID.empty())
-                for(auto it=hitID_start.cbegin(); it!=hitID_start.cend(); it++)
+            if(bam_hd)
+            {
+                bam1_t *record = bam_init1();
+                if(bam_read1(bam_hd, record) < 0)
+                {
+                    bam_destroy1(record);
+                    more = false;
+                    break;
+                }
+                batch->bam_records.push_back(record);
+            }else{
+                batch->sam_lines.emplace_back();
+                string &line = batch->sam_lines.back();
+                if(not getline(IN, line))
                 {
-                    string trans(it->first);
-                    //if(trans_len.find(trans) == trans_len.end()) continue;
-                    for(uLONG i=it->second; i<hitID_end.at(trans); i++)
-                        baseDensity[trans][i] += 1.0/hitCount;
-                    RTstop[trans][it->second-1] += 1.0/hitCount;
+                    batch->sam_lines.pop_back();
+                    more = false;
+                    break;
                 }
-            hitCount = 0;
-            hitID_start.clear();
-            hitID_end.clear();
+                if(line.empty() or line[0] == '@')
+                {
+                    batch->sam_lines.pop_back();
+                    continue;
+                }
+            }
+
+            ++lineCount;
+            if(lineCount % 1000000 == 0)
+                cerr << "\tlines " << lineCount << endl;
         }
 
-        readID = read;
-        hitCount++;
-        if(trans_len.find(hit) != trans_len.end())
+        if(batch->size() == 0)
+            break;
+
+        if(not pool)
         {
-            hitID_start[hit] = pos;
-            hitID_end[hit] = pos+tlen;
-            if(trans_len.at(hit) < hitID_end[hit])
-                hitID_end[hit] = trans_len.at(hit) + 1;
+            collect( count_batch(batch) );
+            continue;
         }
-    }
 
-    if(not readID.empty())
-        for(auto it=hitID_start.cbegin(); it!=hitID_start.cend(); it++)
+        pending.push_back( pool->submit([batch, &count_batch](){ return count_batch(batch); }) );
+        if(pending.size() >= 4*threads)
         {
-            string trans(it->first);
-            //if(trans_len.find(trans) == trans_len.end()) continue;
-            for(uLONG i=it->second; i<hitID_end.at(trans); i++)
-                baseDensity[trans][i] += 1.0/hitCount;
-            RTstop[trans][it->second-1] += 1.0/hitCount;
+            collect( pending.front().get() );
+            pending.pop_front();
         }
+    }
 
-    IN.close();
+    while(not pending.empty())
+    {
+        collect( pending.front().get() );
+        pending.pop_front();
+    }
+    if(not open.hits.empty())
+        total.count(open.hits);
+
+    for(unique_ptr<RT_Counter> &counter: counters)
+        total.merge(*counter);
+
+    if(bam_hd)
+    {
+        bam_hdr_destroy(hdr);
+        bgzf_close(bam_hd);
+    }else
+        IN.close();
+}
+
+/*  The counts are written as an array of integers with 3 decimals. The rpkm is
+    the text of the text file, where the stream is left in std::fixed after the first line  */
+void output_baseDensity_bsig(const string &outputFile, const Trans_Table &table, const RT_Counter &counter)
+{
+    try{
+        BSig_Writer writer(outputFile, Signal_Layout(1, 1));
+        writer.write_head("#transcript\tbase frequency, start from position 0.");
+
+        Signal_Record record;
+        record.rows.resize(2);
+        for(uLONG t=0; t<table.size(); t++)
+        {
+            record.id = table.trans_ids[t];
+            record.len = table.trans_len[t];
+            const uLONGArray *counts[] = {&counter.baseDensity[t], &counter.RTstop[t]};
+            for(uINT r=0; r<2; r++)
+            {
+                Signal_Row &row = record.rows[r];
+                const char rpkm_decimals = (t == 0 and r == 0) ? Signal_Row::GENERAL_NUMBER : 6;
+                row.heads.assign(1, signal_number_text(table.trans_rpkm[t], rpkm_decimals));
+                row.values.assign(record.len+1, 0);
+                if(not counts[r]->empty())
+                    std::copy(counts[r]->cbegin(), counts[r]->cbegin()+record.len+1, row.values.begin());
+                row.decimals = 3;
+            }
+            writer.write_record(record);
+        }
+        writer.close();
+    }catch(Bad_IO &e){
+        cerr << RED << e.what() << DEF << endl;
+        exit(-1);
+    }
 }
 
-void output_baseDensity(const string &outputFile, const MapStringuLONG &trans_len, const MapStringDouble &trans_rpkm,
-        const MapStringT<uLONGArray> &baseDensity, const MapStringT<uLONGArray> &RTstop)
+void output_baseDensity(const string &outputFile, const Trans_Table &table, const RT_Counter &counter)
 {
     cerr << RED << "Output base density to file " << outputFile << "...\n\t" << currentDateTime() << endl;
 
+    if(is_bsig_file(outputFile))
+        return output_baseDensity_bsig(outputFile, table, counter);
+
     ofstream OUT(outputFile, ofstream::out);
     if(not OUT)
     {
@@ -245,26 +595,29 @@ void output_baseDensity(const string &outputFile, const MapStringuLONG &trans_le
         exit(-1);
     }
     OUT << "#transcript\tbase frequency, start from position 0.\n";
-    for(auto it=baseDensity.cbegin(); it!=baseDensity.cend(); it++)
+    for(uLONG t=0; t<table.size(); t++)
     {
-        string trans(it->first);
+        const string &trans = table.trans_ids[t];
+        const uLONG &len = table.trans_len[t];
 
         // BaseDensity
-        OUT << trans << "\t" << trans_len.at(trans) << "\t" << trans_rpkm.at(trans);
+        OUT << trans << "\t" << len << "\t" << table.trans_rpkm[t];
         std::streamsize ss = OUT.precision();
         OUT << std::fixed << std::setprecision(3);
-        for(uLONG i=0; i<=trans_len.at(trans); i++)
-            OUT << "\t" << double(baseDensity.at(trans).at(i));
+        const uLONGArray &bd = counter.baseDensity[t];
+        for(uLONG i=0; i<=len; i++)
+            OUT << "\t" << double(bd.empty() ? 0 : bd[i]);
         OUT.precision(ss);
 
         OUT << "\n";
 
         // RTstop
-        OUT << trans << "\t" << trans_len.at(trans) << "\t" << trans_rpkm.at(trans);
+        OUT << trans << "\t" << len << "\t" << table.trans_rpkm[t];
         ss = OUT.precision();
         OUT << std::fixed << std::setprecision(3);
-        for(uLONG i=0; i<=trans_len.at(trans); i++)
-            OUT << "\t" << double(RTstop.at(trans).at(i));
+        const uLONGArray &rt = counter.RTstop[t];
+        for(uLONG i=0; i<=len; i++)
+            OUT << "\t" << double(rt.empty() ? 0 : rt[i]);
         OUT.precision(ss);
 
         OUT << "\n";
@@ -273,17 +626,6 @@ void output_baseDensity(const string &outputFile, const MapStringuLONG &trans_le
     OUT.close();
 }
 
-void init_bd_rt(const MapStringuLONG &trans_len, MapStringT<uLONGArray> &baseDensity, MapStringT<uLONGArray> &RTstop)
-{
-    for(auto it=trans_len.cbegin(); it!=trans_len.cend(); it++)
-    {
-        baseDensity[it->first];
-        baseDensity[it->first].resize(it->second+1);
-        RTstop[it->first];
-        RTstop[it->first].resize(it->second+1);
-    }
-}
-
 int main(int argc, char *argv[])
 {
     Param param = read_param(argc, argv);
@@ -295,15 +637,14 @@ int main(int argc, char *argv[])
 
     MapStringuLONG trans_len;
     MapStringDouble trans_rpkm;
-    MapStringT<uLONGArray> baseDensity;
-    MapStringT<uLONGArray> RTstop;
     readRPKM(param.rpkm_file, param.rpkm_cutoff, trans_len, trans_rpkm);
     cerr << "Total number: " << trans_len.size() << endl;
 
-    init_bd_rt(trans_len, baseDensity, RTstop);
+    const Trans_Table table(trans_len, trans_rpkm);
+    RT_Counter counter(table);
 
-    calcBaseDensity(param.input_file, baseDensity, RTstop, trans_len, trans_rpkm);
-    output_baseDensity(param.output_file, trans_len, trans_rpkm, baseDensity, RTstop);
+    calcBaseDensity(param.input_file, table, counter, param.threads);
+    output_baseDensity(param.output_file, table, counter);
 }
 
 
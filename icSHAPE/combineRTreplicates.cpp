@@ -3,7 +3,12 @@
 #include <param.h>
 #include <string_split.h>
 #include <exceptions.h>
+#include <fast_writer.h>
+#include <signal_file.h>
 #include <fstream>
+#include <algorithm>
+#include <functional>
+#include <memory>
 
 using namespace std;
 using namespace pan;
@@ -22,11 +27,14 @@ void print_usage()
             "Command:\n"
             "%s -i input_rt_1:input_rt_2 -o output_combined_signal_file \n"
             " # what it is:\n"
-            " -i     input signal files\n"
-            " -o     output combined signal files\n\n"
+            " -i     input signal files, joined by transcript in one pass\n"
+            " -o     output combined signal files\n"
+            " # the files ending with .bsig are binary signal files\n\n"
             
             "# more options:\n"
-            " -f     input format (normalized or count, default: count)\n";
+            " -f     input format (normalized or count, default: count)\n\n"
+
+            "# the transcripts are written in the order of the first input file\n";
     sprintf(buff, help_info, "combineRTreplicates");
     cout << buff << endl;
 }
@@ -93,157 +101,427 @@ Param read_param(int argc, char *argv[])
 }
 
 
-void combineSignals(const string &rt_file, MapStringuLONG &trans_len, MapStringString &trans_rpkm, 
-                    MapStringString &trans_scalingFactor, MapStringT<DoubleArray> &trans_rtstop, 
-                    MapStringT<DoubleArray> &trans_bd, const string &format)
+/**** Read the replicates by transcript ****/
+
+// a transcript of a replicate file
+struct Replicate_Trans
 {
-    cerr << "read signal from " << rt_file << "\n\t" << currentDateTime() << endl;
+    string id;
+    uLONG len = 0;                          // length, rpkm and scaling factor of the last line
+    string rpkm;
+    string scalingFactor;
+    string bd_line;                         // empty if the transcript has no such line
+    string rt_line;
+    const Signal_Row *bd_row = nullptr;     // the lines of a .bsig file, which are valid until the next read
+    const Signal_Row *rt_row = nullptr;
+
+    bool has_bd() const { return bd_row or not bd_line.empty(); }
+    bool has_rt() const { return rt_row or not rt_line.empty(); }
+};
 
-    string id, idOld, type, lineOld;
-    uLONG len;
-    string rpkm, scalingFactor;
+/*  Read a signal file transcript by transcript, the lines of a transcript must be 
+    consecutive. In count files the first line is the base density and the second is 
+    the RT stop, in normalized files the type is the third column. fetch() finds a 
+    transcript: when the files are in the same order it is the next one (a merge-join), 
+    otherwise the transcripts skipped on the way are indexed by their file offsets and 
+    read back by seeking. A .bsig file is read by its index  */
+class Replicate_Reader
+{
+public:
+    Replicate_Reader(const string &file_name, const bool &normalized): file_name(file_name), normalized(normalized)
+    {
+        if(is_bsig_file(file_name))
+        {
+            try{
+                bsig.reset(new BSig_Reader(file_name));
+            }catch(Bad_IO &e){
+                cerr << RED << e.what() << DEF << endl;
+                exit(-1);
+            }
+            if(bsig->layout() != (normalized ? Signal_Layout(3, 1) : Signal_Layout(1, 1)))
+            {
+                cerr << RED << "FATAL Error: " << file_name << " is not a " << (normalized ? "normalized" : "count") << " signal file" << DEF << endl;
+                exit(-1);
+            }
+            fetched.assign(bsig->get_index().size(), false);
+            return;
+        }
 
-    ifstream IN(rt_file, ifstream::in);
-    if(not IN)
+        IN.open(file_name, ifstream::in);
+        if(not IN)
+        {
+            cerr << RED << "FATAL Error: " << file_name << " is not exists" << DEF << endl;
+            exit(-1);
+        }
+    }
+
+    const string &name() const { return file_name; }
+
+    // the next transcript in the file order
+    bool next(Replicate_Trans &trans)
     {
-        cerr << "FATAL Error: " << rt_file << " is not exists" << endl;
-        exit(-1);
+        if(not read_group(IN, next_line, next_offset, trans))
+            return false;
+        ++trans_count;
+        if(trans_count%10000==0)
+            cerr << "\t" << file_name << ": transcripts " << trans_count << endl;
+        return true;
     }
 
-    string line; uLONG lineCount(0);
-    while(getline(IN, line))
+    bool fetch(const string &id, Replicate_Trans &trans)
     {
-        if(line[0] == '#') continue;
+        if(bsig)
+        {
+            const long i = bsig->find(id);
+            if(i < 0 or fetched[i])
+                return false;
+            return read_bsig(i, trans);
+        }
 
-        ++lineCount;
-        if(lineCount % 10000 == 0)
-            cerr << "  line: " << lineCount << endl;
+        auto it = skipped.find(id);
+        if(it != skipped.end())
+        {
+            const uLONG offset = it->second;
+            skipped.erase(it);
+            return read_at(offset, trans);
+        }
 
-        trim(line);
-        StringArray data;
-        split(line, '\t', data);
+        uLONG offset = next_offset;
+        while(next(trans))
+        {
+            if(trans.id == id)
+                return true;
+            skipped[trans.id] = offset;
+            offset = next_offset;
+        }
+        return false;
+    }
 
-        DoubleArray rtstops, baseDensities;
+    // the transcripts which are not fetched yet in the file order, fetch() is not called after it
+    bool next_unfetched(Replicate_Trans &trans)
+    {
+        if(bsig)
+        {
+            while(unfetched < fetched.size() and fetched[unfetched])
+                ++unfetched;
+            if(unfetched == fetched.size())
+                return false;
+            return read_bsig(unfetched, trans);
+        }
 
-        if(data[0] == idOld)
+        if(not skipped.empty())
         {
-            if(format == "normalized")
+            for(const auto &item: skipped)
+                skipped_offsets.push_back(item.second);
+            skipped.clear();
+            sort(skipped_offsets.begin(), skipped_offsets.end(), std::greater<uLONG>());
+        }
+        if(not skipped_offsets.empty())
+        {
+            const uLONG offset = skipped_offsets.back();
+            skipped_offsets.pop_back();
+            return read_at(offset, trans);
+        }
+        return next(trans);
+    }
+
+private:
+    // the transcript i of the .bsig file, the first line is the base density in count files
+    bool read_bsig(const uLONG &i, Replicate_Trans &trans)
+    {
+        fetched[i] = true;
+        bsig->read(i, record);
+        trans.id = record.id;
+        trans.len = record.len;
+        trans.bd_line.clear();
+        trans.rt_line.clear();
+        trans.bd_row = trans.rt_row = nullptr;
+        for(const Signal_Row &row: record.rows)
+        {
+            if(normalized)
             {
-                if(line.find("baseDensity") != string::npos)
-                {
-                    if(lineOld.find("RTstop") != string::npos)
-                    {
-                        //( $id, $len, $type, $rpkm, $scalingFactor, @baseDensities ) = split ( /\t/, $line );
-                        //( $id, $len, $type, $rpkm, $scalingFactor, @rtstops ) = split ( /\t/, $lineOld );
-
-                        id = data[0];
-                        len = stoul(data[1]);
-                        type = data[2];
-                        rpkm = data[3];
-                        scalingFactor = data[4];
-                        for(auto it=data.cbegin()+5; it!=data.cend(); it++) baseDensities.push_back( stod(*it) );
-                        // baseDensities.assign(data.cbegin()+5, data.cend());
-
-                        StringArray oldData;
-                        split(lineOld, '\t', oldData);
-                        for(auto it=oldData.cbegin()+5; it!=oldData.cend(); it++) rtstops.push_back( stod(*it) );
-                        //rtstops.assign(oldData.cbegin()+5, oldData.cend());
-                    }
-                }else if(line.find("RTstop") != string::npos){
-                    if(lineOld.find("baseDensity") != string::npos){
-                        
-                        id = data[0];
-                        len = stoul(data[1]);
-                        type = data[2];
-                        rpkm = data[3];
-                        scalingFactor = data[4];
-                        for(auto it=data.cbegin()+5; it!=data.cend(); it++) rtstops.push_back( stod(*it) );
-                        //rtstops.assign(data.cbegin()+5, data.cend());
-
-                        StringArray oldData;
-                        split(lineOld, '\t', oldData);
-                        for(auto it=oldData.cbegin()+5; it!=oldData.cend(); it++) baseDensities.push_back( stod(*it) );
-                        //baseDensities.assign(oldData.cbegin()+5, oldData.cend());
-                    }
-                }
+                trans.rpkm = row.heads[1];
+                trans.scalingFactor = row.heads[2];
+                if(row.heads[0] == "baseDensity")
+                    trans.bd_row = &row;
+                else if(row.heads[0] == "RTstop")
+                    trans.rt_row = &row;
             }else{
-                    id = data[0];
-                    len = stoul(data[1]);
-                    rpkm = data[2];
-                    for(auto it=data.cbegin()+3; it!=data.cend(); it++) rtstops.push_back( stod(*it) );
-                    //baseDensities.assign(data.cbegin()+4, data.cend());
-
-                    StringArray oldData;
-                    split(lineOld, '\t', oldData);
-                    for(auto it=oldData.cbegin()+3; it!=oldData.cend(); it++) baseDensities.push_back( stod(*it) );
-                    //rtstops.assign(oldData.cbegin()+4, oldData.cend());
+                trans.rpkm = row.heads[0];
+                if(&row == &record.rows[0])
+                    trans.bd_row = &row;
+                else
+                    trans.rt_row = &row;
             }
+        }
+        return true;
+    }
+
+    bool read_at(const uLONG &offset, Replicate_Trans &trans)
+    {
+        if(not SEEK_IN.is_open())
+            SEEK_IN.open(file_name, ifstream::in);
+        SEEK_IN.clear();
+        SEEK_IN.seekg(offset);
+
+        string line;
+        uLONG line_offset = 0;
+        return read_group(SEEK_IN, line, line_offset, trans);
+    }
 
-            if( trans_len.find(id) == trans_len.end() )
-            //if(true)
+    // read a line which is not empty or a comment, return its offset
+    static bool read_line(istream &in, string &line, uLONG &offset)
+    {
+        do{
+            offset = in.tellg();
+            if(not getline(in, line))
+                return false;
+        }while(line.empty() or line[0] == '#');
+        trim(line);
+        return true;
+    }
+
+    // read the consecutive lines of a transcript, line is the first line of the next transcript
+    bool read_group(istream &in, string &line, uLONG &offset, Replicate_Trans &trans) const
+    {
+        if(line.empty() and not read_line(in, line, offset))
+            return false;
+
+        trans.bd_line.clear();
+        trans.rt_line.clear();
+        trans.bd_row = trans.rt_row = nullptr;
+        trans.id.clear();
+        do{
+            const size_t t1 = line.find('\t');
+            const size_t t2 = line.find('\t', t1+1);
+            const size_t t3 = line.find('\t', t2+1);
+            const size_t t4 = (normalized and t3 != string::npos) ? line.find('\t', t3+1) : t3;
+            const size_t t5 = (normalized and t4 != string::npos) ? line.find('\t', t4+1) : t4;
+            if(t5 == string::npos)
+                throw Unexpected_Error("FATAL Error: invalid line: "+line.substr(0, 100));
+            if(not trans.id.empty() and trans.id.compare(0, string::npos, line, 0, t1) != 0)
+                return true;
+
+            const bool first = trans.id.empty();
+            trans.id.assign(line, 0, t1);
+            trans.len = parse_uLONG( Field_View(line.data()+t1+1, t2-t1-1) );
+            if(normalized)
             {
-                trans_len[id] = len;
-                trans_rpkm[id] = rpkm;
-                if(format == "normalized")
-                    trans_scalingFactor[id] = scalingFactor;
-                trans_rtstop[id] = rtstops;
-                trans_bd[id] = baseDensities;
+                trans.rpkm.assign(line, t3+1, t4-t3-1);
+                trans.scalingFactor.assign(line, t4+1, t5-t4-1);
+                const Field_View type(line.data()+t2+1, t3-t2-1);
+                if(type == "baseDensity")
+                    trans.bd_line.swap(line);
+                else if(type == "RTstop")
+                    trans.rt_line.swap(line);
             }else{
-                if(len != trans_len[id])
-                    throw Unexpected_Error("FATAL Error: "+id+" different transcript length "+to_string(len)+"/"+to_string(trans_len[id]));
-
-                trans_rpkm[id] += ","+rpkm;
-                if(format == "normalized")
-                    trans_scalingFactor[id] += ","+scalingFactor;
-
-                DoubleArray &ref_trans_rtstop = trans_rtstop[id];
-                DoubleArray &ref_trans_bd = trans_bd[id];
-                for(int idxPos=0; idxPos<=len; idxPos++)
-                {
-                    ref_trans_rtstop[idxPos] += rtstops[idxPos];
-                    ref_trans_bd[idxPos] += baseDensities[idxPos];
-                }
+                trans.rpkm.assign(line, t2+1, t3-t2-1);
+                if(first)
+                    trans.bd_line.swap(line);
+                else
+                    trans.rt_line.swap(line);
             }
-        }else{
-            idOld = data[0];
-            lineOld = line;
-        }
+            line.clear();
+        }while(read_line(in, line, offset));
+
+        line.clear();
+        return true;
+    }
+
+    const string file_name;
+    const bool normalized;
+    ifstream IN;
+    ifstream SEEK_IN;
+    string next_line;                       // the first line of the next transcript
+    uLONG next_offset = 0;
+    MapStringT<uLONG> skipped;              // offsets of the skipped transcripts
+    vector<uLONG> skipped_offsets;          // offsets of the transcripts left by fetch(), in the reverse order
+    uLONG trans_count = 0;
+
+    unique_ptr<BSig_Reader> bsig;
+    Signal_Record record;
+    vector<bool> fetched;                   // the transcripts of the .bsig file which are read
+    uLONG unfetched = 0;
+};
+
+/**** Sum the replicates ****/
+
+// a transcript summed over the replicates
+struct Combined_Trans
+{
+    string id;
+    uLONG len = 0;
+    string rpkm;                            // the rpkm and scaling factors of the replicates, joined by ','
+    string scalingFactor;
+    DoubleArray bd;
+    DoubleArray rt;
+    uINT replicates = 0;
+};
+
+// parse the values of a signal line after the head columns
+void parse_values(const string &line, const uINT &head_cols, DoubleArray &values)
+{
+    static FieldArray data;
+    split(line, '\t', data);
+    values.resize(data.size() - head_cols);
+    for(size_t i=head_cols; i<data.size(); i++)
+        values[i-head_cols] = parse_double(data[i]);
+}
+
+// the values of a line of a text or .bsig file
+const DoubleArray &line_values(const string &line, const Signal_Row *row, const uINT &head_cols, DoubleArray &buffer)
+{
+    if(row)
+        return row->values;
+    parse_values(line, head_cols, buffer);
+    return buffer;
+}
+
+// add the values of a signal line to the sum
+void add_values(const string &id, const DoubleArray &values, DoubleArray &sum)
+{
+    if(values.size() != sum.size())
+        throw Unexpected_Error("FATAL Error: "+id+" different value number "+to_string(values.size())+"/"+to_string(sum.size()));
+
+    double *sum_data = sum.data();
+    const double *value_data = values.data();
+    const uLONG size = sum.size();
+    for(uLONG i=0; i<size; i++)
+        sum_data[i] += value_data[i];
+}
+
+// add a replicate to the sum, the transcript without base density or RT stop is skipped
+void add_replicate(const string &file_name, const Replicate_Trans &trans, const bool &normalized, Combined_Trans &combined)
+{
+    if(not trans.has_bd() or not trans.has_rt())
+    {
+        cerr << YELLOW << "Warning! transcript " << trans.id << " has no baseDensity or RTstop line in " << file_name << DEF << endl;
+        return;
     }
-    IN.close();
+
+    static DoubleArray bd_buffer, rt_buffer;
+    const uINT head_cols = normalized ? 5 : 3;
+    const DoubleArray &bd = line_values(trans.bd_line, trans.bd_row, head_cols, bd_buffer);
+    const DoubleArray &rt = line_values(trans.rt_line, trans.rt_row, head_cols, rt_buffer);
+    if(combined.replicates == 0)
+    {
+        combined.len = trans.len;
+        combined.rpkm = trans.rpkm;
+        combined.scalingFactor = trans.scalingFactor;
+        combined.bd = bd;
+        combined.rt = rt;
+    }else{
+        if(trans.len != combined.len)
+            throw Unexpected_Error("FATAL Error: "+trans.id+" different transcript length "+to_string(trans.len)+"/"+to_string(combined.len));
+
+        combined.rpkm += ","+trans.rpkm;
+        if(normalized)
+            combined.scalingFactor += ","+trans.scalingFactor;
+        add_values(trans.id, bd, combined.bd);
+        add_values(trans.id, rt, combined.rt);
+    }
+    ++combined.replicates;
 }
 
-void outputSignals(const string &rt_file, const MapStringuLONG &trans_len, const MapStringString &trans_rpkm, 
-                    const MapStringString &trans_scalingFactor, const MapStringT<DoubleArray> &trans_rtstop, 
-                    const MapStringT<DoubleArray> &trans_bd, const string &format)
+// the sums are %g numbers, the same as the text lines
+void write_combined(BSig_Writer &writer, const Combined_Trans &combined, const bool &normalized, Signal_Record &record)
 {
-    cerr << "output signal to " << rt_file << "\n\t" << currentDateTime() << endl;
-    ofstream OUT(rt_file, ofstream::out);
-    if(not OUT)
+    record.id = combined.id;
+    record.len = combined.len;
+    record.rows.resize(2);
+    const DoubleArray *values[] = {&combined.bd, &combined.rt};
+    for(uINT r=0; r<2; r++)
     {
-        cerr << "FATAL Error: cannot write to " << rt_file << "..." << endl;
-        exit(-1);
+        Signal_Row &row = record.rows[r];
+        row.heads.assign(1, combined.rpkm);
+        if(normalized)
+            row.heads.push_back(combined.scalingFactor);
+        row.values = *values[r];
+        row.decimals = Signal_Row::GENERAL_NUMBER;
+    }
+    writer.write_record(record);
+}
+
+void write_combined(Fast_Writer &writer, const Combined_Trans &combined, const bool &normalized)
+{
+    for(const DoubleArray *values: {&combined.bd, &combined.rt})
+    {
+        writer << combined.id << '\t' << combined.len << '\t' << combined.rpkm;
+        if(normalized)
+            writer << '\t' << combined.scalingFactor;
+        for(const double &value: *values)
+            writer << '\t' << value;
+        writer << '\n';
+    }
+}
+
+/*  N-way join of the replicates on the transcript ID in one pass: the transcripts are 
+    combined in the order of the first file, then the ones only in the later files. 
+    Only the transcript being combined is kept in memory  */
+void combine_replicates(const Param &param)
+{
+    const bool normalized = (param.format == "normalized");
+
+    vector< unique_ptr<Replicate_Reader> > readers;
+    for(const string &file_name: param.input_rt_list)
+    {
+        cerr << "read signal from " << file_name << "\n\t" << currentDateTime() << endl;
+        readers.emplace_back(new Replicate_Reader(file_name, normalized));
+    }
+
+    cerr << "output signal to " << param.output_rt << "\n\t" << currentDateTime() << endl;
+    // the combined normalized lines have no type column
+    ofstream OUT;
+    unique_ptr<BSig_Writer> bsig;
+    Signal_Record record;
+    if(is_bsig_file(param.output_rt))
+    {
+        try{
+            bsig.reset(new BSig_Writer(param.output_rt, Signal_Layout(normalized ? 2 : 1, 1)));
+        }catch(Bad_IO &e){
+            cerr << RED << e.what() << DEF << endl;
+            exit(-1);
+        }
+    }else{
+        OUT.open(param.output_rt, ofstream::out);
+        if(not OUT)
+        {
+            cerr << RED << "FATAL Error: cannot write to " << param.output_rt << "..." << DEF << endl;
+            exit(-1);
+        }
     }
-    //OUT << std::fixed << std::setprecision(3);
-    string line; uLONG lineCount(0);
+    // not used for the .bsig file
+    Fast_Writer writer(OUT);
 
-    cerr << "Will write " << trans_len.size() << " transcripts" << endl;
-    for(auto item=trans_len.cbegin(); item!=trans_len.cend(); item++)
+    Replicate_Trans trans;
+    Combined_Trans combined;
+    uLONG transCount = 0;
+    for(size_t first=0; first<readers.size(); first++)
     {
-        const string &id = item->first;
-        
-        OUT << id << "\t" << trans_len.at(id) << "\t" << trans_rpkm.at(id);
-        if(format == "normalized") OUT << "\t" << trans_scalingFactor.at(id);
-        for(const double &bd: trans_bd.at(id))
-            OUT << "\t" << bd;
-        OUT << "\n";
-
-        OUT << id << "\t" << trans_len.at(id) << "\t" << trans_rpkm.at(id);
-        if(format == "normalized") OUT << "\t" << trans_scalingFactor.at(id);
-        for(const double &rt: trans_rtstop.at(id))
-            OUT << "\t" << rt;
-        OUT << "\n";
+        while(readers[first]->next_unfetched(trans))
+        {
+            combined.id = trans.id;
+            combined.replicates = 0;
+            add_replicate(readers[first]->name(), trans, normalized, combined);
+            for(size_t i=first+1; i<readers.size(); i++)
+                if(readers[i]->fetch(combined.id, trans))
+                    add_replicate(readers[i]->name(), trans, normalized, combined);
+
+            if(combined.replicates == 0)
+                continue;
+            if(bsig)
+                write_combined(*bsig, combined, normalized, record);
+            else
+                write_combined(writer, combined, normalized);
+            ++transCount;
+        }
     }
+
+    writer.flush();
     OUT.close();
+    if(bsig)
+        bsig->close();
+    cerr << "Write " << transCount << " transcripts" << endl;
 }
 
 
@@ -257,22 +535,8 @@ int main(int argc, char *argv[])
         return -1;
     }
 
-    MapStringuLONG trans_len;
-    MapStringString trans_rpkm;
-    MapStringString trans_scalingFactor;
-    MapStringT<DoubleArray> trans_rtstop;
-    MapStringT<DoubleArray> trans_bd;
-
-    cout << "start to read..." << endl;
-    for(auto file_name: param.input_rt_list)
-        combineSignals(file_name, trans_len, trans_rpkm, trans_scalingFactor, trans_rtstop, trans_bd, param.format);
-
-    cout << "start to write..." << endl;
-    outputSignals(param.output_rt, trans_len, trans_rpkm, trans_scalingFactor, trans_rtstop, trans_bd, param.format);
+    cout << "start to combine..." << endl;
+    combine_replicates(param);
 
     return 0;
 }
-
-
-
-
@@ -3,11 +3,14 @@
 #include <param.h>
 #include <string_split.h>
 #include <exceptions.h>
+#include <signal_file.h>
 #include <fstream>
 #include <algorithm>
 #include <math.h>
 #include <iomanip>
 #include <numeric>
+#include <memory>
+#include <limits>
 
 using namespace std;
 using namespace pan;
@@ -29,7 +32,8 @@ void print_usage()
         " %s -i input_signal_file -o output_shape_file \n"
         "# what it is:\n"
         " -i     input signal file \n"
-        " -o     input shape file \n\n"
+        " -o     input shape file \n"
+        " # the files ending with .bsig are binary signal files\n\n"
 
         "# more options:\n"
         " -t     threshold of minimun coverage (default: 200)\n"
@@ -134,7 +138,7 @@ double ave_rpkm_string(const string &rpkm_string)
         StringArray rpkm_list;
         split(rpkm_string, ',', rpkm_list);
         
-        double Sum;
+        double Sum = 0;
         for(const string &it: rpkm_list)
             Sum += stod(it);
         
@@ -146,20 +150,136 @@ double ave_rpkm_string(const string &rpkm_string)
     return rpkm;
 }
 
-void readSignals(const Param &param)
+// the output file, the rows of numbers for a .bsig file
+struct Filter_Output
+{
+    ofstream text;
+    unique_ptr<BSig_Writer> bsig;
+    Signal_Record record;
+};
+
+/*  Write the scores of a transcript if the coverage is enough. write_score(j) writes the score of
+    base j as text, score_value(j) is the number of it with the decimals for a .bsig file  */
+template<typename Score_Writer, typename Score_Value>
+void write_filtered(Filter_Output &output, const string &id, const uLONG &len, const double &rpkm, 
+                    const DoubleArray &fgRT, const DoubleArray &bgDB, Score_Writer write_score, 
+                    Score_Value score_value, const char &decimals, const Param &param)
 {
-    uINT bd_cutoff = param.bd_cutoff;
-    double rt_cutoff = param.rt_cutoff;
-    uINT head_skip = param.head_skip;
-    uINT tail_skip = param.tail_skip;
+    double coverage = std::accumulate(fgRT.cbegin(), fgRT.cend(), 0.0) / fgRT.size();
+    if(coverage <= param.rt_cutoff)
+        return;
+
+    auto kept = [&](const uINT &j){ return j>param.head_skip and j<len-param.tail_skip and bgDB.at(j) >= param.bd_cutoff; };
+    if(output.bsig)
+    {
+        Signal_Record &record = output.record;
+        record.id = id;
+        record.len = len;
+        record.rows.resize(1);
+        Signal_Row &row = record.rows[0];
+        row.heads.assign(1, signal_number_text(rpkm, Signal_Row::GENERAL_NUMBER));
+        row.values.resize(len);
+        for(uINT j=0; j<len; j++)
+            row.values[j] = kept(j) ? score_value(j) : std::numeric_limits<double>::quiet_NaN();
+        row.decimals = decimals;
+        output.bsig->write_record(record);
+        return;
+    }
+
+    ofstream &OUT = output.text;
+    OUT << id << "\t" << len << "\t" << rpkm;
+    for(uINT j=0; j<len; j++)
+    {
+        if(kept(j))
+        {
+            OUT << "\t";
+            write_score(j);
+        }
+        else
+            OUT << "\tNULL";
+    }
+    OUT << "\n";
+}
 
-    ofstream OUT(param.output_file, ofstream::out);
-    if(not OUT)
+// the transcripts of a .bsig file of calcEnrich
+void read_bsig_signals(const Param &param, Filter_Output &output)
+{
+    unique_ptr<BSig_Reader> IN;
+    try{
+        IN.reset(new BSig_Reader(param.input_file));
+    }catch(Bad_IO &e){
+        cerr << RED << e.what() << DEF << endl;
+        exit(-1);
+    }
+    if(IN->layout() != Signal_Layout(2, 4))
     {
-        cerr << RED << "FATAL Error: cannot write to " << param.output_file << DEF << endl;
+        cerr << RED << "FATAL Error: " << param.input_file << " is not a signal file of calcEnrich" << DEF << endl;
         exit(-1);
     }
 
+    cerr << "Start to read " << param.input_file << endl;
+
+    Signal_Record record;
+    DoubleArray fgRT, bgDB;
+    uLONG lineCount = 0;
+    while(IN->next(record))
+    {
+        for(const Signal_Row &row: record.rows)
+        {
+            lineCount += 1;
+            if(lineCount % 1000 == 0)
+                cerr << "\t line " << lineCount << endl;
+
+            fgRT.clear();
+            bgDB.clear();
+            for(uLONG i=0; i<record.len; i++)
+            {
+                fgRT.push_back( row.values[i*4+1] );
+                bgDB.push_back( row.values[i*4+3] );
+            }
+
+            write_filtered(output, record.id, record.len, ave_rpkm_string(row.heads[0]), fgRT, bgDB, 
+                [&](const uINT &j){ row.write_value(output.text, j*4); }, 
+                [&](const uINT &j){ return row.values[j*4]; }, row.decimals, param);
+        }
+    }
+}
+
+void close_output(Filter_Output &output)
+{
+    if(output.bsig)
+        output.bsig->close();
+    else
+        output.text.close();
+}
+
+void readSignals(const Param &param)
+{
+    Filter_Output output;
+    if(is_bsig_file(param.output_file))
+    {
+        try{
+            output.bsig.reset(new BSig_Writer(param.output_file, Signal_Layout(1, 1)));
+        }catch(Bad_IO &e){
+            cerr << RED << "FATAL Error: cannot write to " << param.output_file << DEF << endl;
+            exit(-1);
+        }
+    }else{
+        output.text.open(param.output_file, ofstream::out);
+        if(not output.text)
+        {
+            cerr << RED << "FATAL Error: cannot write to " << param.output_file << DEF << endl;
+            exit(-1);
+        }
+    }
+
+    if(is_bsig_file(param.input_file))
+    {
+        read_bsig_signals(param, output);
+        close_output(output);
+        return;
+    }
+
     ifstream IN(param.input_file, ifstream::in);
     if(not IN)
     {
@@ -170,6 +290,7 @@ void readSignals(const Param &param)
     cerr << "Start to read " << param.input_file << endl;
 
     string line;
+    FieldArray data, mini_data;
     uLONG lineCount = 0;
     while(getline(IN, line))
     {
@@ -179,44 +300,30 @@ void readSignals(const Param &param)
         if(lineCount % 1000 == 0)
             cerr << "\t line " << lineCount << endl;
 
-        StringArray data;
         split(line, '\t', data);
 
         string id(data.at(0));
-        uLONG len = stoul(data.at(1));
+        uLONG len = parse_uLONG(data.at(1));
         double rpkm = ave_rpkm_string(data.at(2));
         string scalingFactors(data.at(3));
 
-        StringArray scores;
+        // the fields of a base point into line
+        FieldArray scores;
         DoubleArray fgRT, bgDB;
         for(uINT i=0; i<len; i++)
         {
-            StringArray mini_data;
             split(data.at(i+4), ',', mini_data);
             scores.push_back(mini_data.at(0));
-            fgRT.push_back( stod(mini_data.at(1)) );
-            bgDB.push_back( stod(mini_data.at(3)) );
+            fgRT.push_back( parse_double(mini_data.at(1)) );
+            bgDB.push_back( parse_double(mini_data.at(3)) );
         }
 
-        double coverage = std::accumulate(fgRT.cbegin(), fgRT.cend(), 0.0) / fgRT.size();
-        if(coverage > rt_cutoff)
-        {
-            OUT << id << "\t" << len << "\t" << rpkm;
-
-            for(uINT j=0; j<len; j++)
-            {
-                if(j>head_skip and j<len-tail_skip)
-                    if(bgDB.at(j) >= bd_cutoff)
-                        OUT << "\t" << scores.at(j);
-                    else
-                        OUT << "\tNULL";
-                else
-                    OUT << "\tNULL";
-            }
-            OUT << "\n";
-        }
+        // the scores of calcEnrich have 3 decimals
+        write_filtered(output, id, len, rpkm, fgRT, bgDB, [&](const uINT &j){ output.text << scores.at(j); },
+            [&](const uINT &j){ return scores.at(j) == "NULL" ? std::numeric_limits<double>::quiet_NaN() : parse_double(scores.at(j)); },
+            3, param);
     }
-    OUT.close();
+    close_output(output);
 }
 
 int main(int argc, char *argv[])
@@ -233,4 +340,3 @@ int main(int argc, char *argv[])
 
 
 
-
@@ -3,7 +3,14 @@
 #include <param.h>
 #include <string_split.h>
 #include <exceptions.h>
+#include <order_stat.h>
+#include <fast_writer.h>
+#include <thread_pool.h>
+#include <signal_file.h>
 #include <fstream>
+#include <sstream>
+#include <deque>
+#include <memory>
 #include <algorithm>
 #include <math.h>
 #include <iomanip>
@@ -26,7 +33,8 @@ void print_usage()
             "%s -i input_baseDensity_file -o output_normalized_baseDensity_file \n"
             " # what it is:\n"
             " -i     input_baseDensity_file\n"
-            " -o     output_normalized_baseDensity_file\n\n"
+            " -o     output_normalized_baseDensity_file\n"
+            " # the files ending with .bsig are binary signal files\n\n"
 
             "# more options:\n"
             " -d     head to skip (default: 32)\n"
@@ -35,6 +43,7 @@ void print_usage()
 
             " -m     normalize method (default: mean:vigintile2)\n\n"
             
+            " -p     threads to normalize the transcripts (default: 1)\n"
             " -v     verbose mode \n"
             " -r     raw mode (100%% identical with perl icSHAPE pipeline, because I correct a bug from it)\n\n";
 
@@ -64,6 +73,8 @@ struct Param
 
     bool verbose = false;
     bool raw_mode = false;
+    uINT threads = 1;
+    bool bsig_output = false;               // the normalized values are kept as numbers for a .bsig file
 
     operator bool() const { 
         if( input_file.empty() or output_file.empty() ) return false;
@@ -195,6 +206,13 @@ Param read_param(int argc, char *argv[])
                 has_next(argc, i);
                 param.norm_method = argv[i+1];
                 i++;
+            }else if(not strcmp(argv[i]+1, "p"))
+            {
+                has_next(argc, i);
+                param.threads = stoul(argv[i+1]);
+                if(param.threads < 1)
+                    param.threads = 1;
+                i++;
             }else if(not strcmp(argv[i]+1, "v"))
             {
                 //has_next(argc, i);
@@ -218,31 +236,26 @@ Param read_param(int argc, char *argv[])
     }
 
     parse_norm_method(param);
+    param.bsig_output = is_bsig_file(param.output_file);
     return param;
 }
 
+// scaling factor of data_array[start, end], only the sampled values are sorted
 double calcScalingFactor(const DoubleArray &data_array, const uINT &start, 
                         const uINT &end, const Param &param)
 {
-    DoubleArray sorted_data(data_array.cbegin()+start, data_array.cbegin()+end+1);
-    sort(sorted_data.rbegin(), sorted_data.rend());
+    static thread_local Order_Stat<double> stat;
+    stat.assign(data_array.cbegin()+start, data_array.cbegin()+end+1);
 
-    //cout << start << "\t" << end << endl;
-    //for(double v: sorted_data)
-    //    cout << " " << v;
-    //cout << " " << sorted_data.size() << "\n";
+    uINT len = stat.size();
 
-    uINT len = sorted_data.size();
-    DoubleArray rangeOfSelection;
+    // ranks of the selection, counted from the largest value
+    uINT selectStart = 0;
+    uINT selectNum = 0;
     if(param.norm_sample_method == SMART)
     {
-        for(int idx=0; idx<len; idx++)
-        {
-            if(sorted_data[idx] <= 0) break;
-            rangeOfSelection.push_back(sorted_data[idx]);
-        }
+        selectNum = stat.count_greater(0);
     }else{
-        uINT selectStart = 0;
         uINT selectEnd = len - 1;
 
         double f = param.norm_sample_factor;
@@ -266,314 +279,398 @@ double calcScalingFactor(const DoubleArray &data_array, const uINT &start,
             exit(-1);
         }
 
-        for(auto it=sorted_data.cbegin()+selectStart; it!=sorted_data.cbegin()+selectEnd+1; it++)
-            rangeOfSelection.push_back(*it);
+        if(selectEnd+1 > selectStart)
+            selectNum = selectEnd + 1 - selectStart;
     }
 
-    len = rangeOfSelection.size();
+    if(selectNum == 0)
+        return 0;
+
+    // rangeOfSelection(i) is the (selectStart+i)-th largest value
+    stat.sort_ranks(len-selectStart-selectNum, len-selectStart);
+    auto rangeOfSelection = [len, selectStart](const uINT &i){ return stat[len-1-selectStart-i]; };
+
+    len = selectNum;
 
     double scalling_factor = 1.0;
     if(param.norm_calc_method == MEDIAN)
     {
         double median = 1;
-        if ( len % 2 == 0 ) {  median = (rangeOfSelection[len/2-1] + rangeOfSelection[len/2]) /2;  }
-        else {  median = rangeOfSelection[(len-1)/2];  }
+        if ( len % 2 == 0 ) {  median = (rangeOfSelection(len/2-1) + rangeOfSelection(len/2)) /2;  }
+        else {  median = rangeOfSelection((len-1)/2);  }
         scalling_factor = median;
 
     }else if(param.norm_calc_method == MEAN)
     {
-        double Sum;
-        for(const double &v: rangeOfSelection) Sum += v;
-        scalling_factor = Sum/rangeOfSelection.size();
+        double Sum = 0;
+        for(uINT i=0; i<len; i++) Sum += rangeOfSelection(i);
+        scalling_factor = Sum/len;
 
     }else if(param.norm_calc_method == PEAK)
     {
-        scalling_factor = rangeOfSelection[0];
+        scalling_factor = rangeOfSelection(0);
     }
 
     return scalling_factor;
 }
-/*
-void read_full_file(const Param &param, vector<StringArray> &contents)
+
+/*  A transcript is a baseDensity line and a RTstop line. The lines are normalized 
+    separately (on the workers) and written in the input order  */
+struct Trans_Record
 {
-    contents.clear();
+    string bd_line;
+    string rt_line;
+    DoubleArray bd_signal;                  // the values of a .bsig file, the lines are empty
+    DoubleArray rt_signal;
 
-    const string input_file(param.input_file);
+    // the values of [head_skip, trimed_last] are used for the scaling factor
+    uINT head_skip = 0;
+    uINT trimed_last = 0;
 
-    cerr << "Read " << input_file << " now " << currentDateTime() << endl;
+    string transcript;
+    uLONG len = 0;
+    string rpkm;
+
+    bool bd_kept = false;
+    bool rt_kept = false;
+    double bd_factor = 1.0;
+    double rt_factor = 1.0;
+    string bd_values;                       // "\tvalue" of positions 1..len
+    string rt_values;
+    DoubleArray bd_normed;                  // the values of positions 1..len for a .bsig file
+    DoubleArray rt_normed;
+};
 
-    ifstream IN(input_file, ifstream::in);
+// the length field of a trimmed line
+uLONG line_trans_len(const string &line)
+{
+    const size_t t1 = line.find('\t');
+    const size_t t2 = line.find('\t', t1+1);
+    if(t1 == string::npos or t2 == string::npos)
+        throw Unexpected_Error("FATAL Error: invalid line: "+line.substr(0, 100));
+    return parse_uLONG( Field_View(line.data()+t1+1, t2-t1-1) );
+}
 
-    if(not IN)
+// the values of a text line, from position 0
+void parse_signal(const FieldArray &data, DoubleArray &signal)
+{
+    signal.clear();
+    for(auto it=data.cbegin()+3; it!=data.cend(); it++) 
+        signal.push_back( parse_double(*it) );
+}
+
+/*  Scale the values of a line by the scaling factor of [head_skip, trimed_last] if the 
+    factor > 1, the values are formatted, or kept as numbers for a .bsig file  */
+void normalize_line(const DoubleArray &signal, const Trans_Record &record, bool &kept, double &factor, 
+                    string &values, DoubleArray &normed, const Param &param)
+{
+    double scalling_factor = calcScalingFactor(signal, record.head_skip, record.trimed_last, param);
+    kept = scalling_factor > 1;
+    values.clear();
+    normed.clear();
+    // the factor of a filtered line is reported as it is
+    factor = scalling_factor;
+    if(not kept)
+        return;
+
+    scalling_factor = scalling_factor / param.scalling_form;
+    factor = scalling_factor;
+
+    if(param.bsig_output)
     {
-        cerr << RED << "FATAL Error: cannot open " << input_file << DEF << endl;
-        exit(-1);
+        normed.resize(record.len);
+        for(uLONG i=1; i<=record.len; i++)
+            normed[i-1] = param.log_op ? log2(signal[i]/scalling_factor+1) : signal[i]/scalling_factor;
+        return;
     }
 
-    string line;
-    while(getline(IN, line))
+    ostringstream buffer;
     {
-        if(line[0] == '#') continue;
-        StringArray data;
-        trim(line);
-        split(line, '\t', data);
-        contents.push_back(data);
+        Fast_Writer writer(buffer);
+        for(uLONG i=1; i<=record.len; i++)
+        {
+            writer << '\t';
+            if(param.log_op)
+                writer.write_fixed(log2(signal[i]/scalling_factor+1), 3);
+            else
+                writer.write_fixed(signal[i]/scalling_factor, 3);
+        }
     }
+    values = buffer.str();
 }
 
-void process_full_file(const Param &param, StringMatrix &contents)
+// the buffers are reused by a thread
+void normalize_record(Trans_Record &record, const Param &param)
 {
-    cerr << "Normalize base density from file $baseDensityFile...\n\t" << currentDateTime() << endl;
-
-    const string output_file(param.output_file);
-    const string norm_method(param.norm_method);
-    uINT headToSkip(param.head_skip);
-    uINT tailToSkip(param.tail_skip);
-    const double scalling_form(param.scalling_form);
+    static thread_local FieldArray data;
+    static thread_local DoubleArray signal;
 
-    headToSkip++;
-    ofstream OUT(output_file, ofstream::out);
-
-        if(not OUT)
+    if(record.bd_line.empty())
     {
-        cerr << RED << "FATAL Error: cannot write to " << output_file << DEF << endl;
-        exit(-1);
+        normalize_line(record.bd_signal, record, record.bd_kept, record.bd_factor, record.bd_values, record.bd_normed, param);
+        normalize_line(record.rt_signal, record, record.rt_kept, record.rt_factor, record.rt_values, record.rt_normed, param);
+        DoubleArray().swap(record.bd_signal);
+        DoubleArray().swap(record.rt_signal);
+        return;
     }
-    OUT << "#transcript\tlength\ttype\tbase_frequency, start from position 1.\n";
-
-    string transcript;
-    uLONG len = 0;
-    string rpkm;
-    
-    uLONG lineCount = 0;
-    for(uLONG i=0; i<contents.size(); i++)
-    {
-        ++lineCount;
-        if(lineCount % 1000 == 0) 
-            cerr << "  line: " << lineCount << endl;
-
-        DoubleArray baseDensity, rtstop;
-        double scalling_factor = 1.0;
-        //trim(line);
-
-        const StringArray &data = contents[i];
-        //StringArray data;
-        //split(line, '\t', data);
-        transcript = data[0];
-        len = stoul(data[1]);
-        rpkm = data[2];
-        for(auto it=data.cbegin()+3; it!=data.cend(); it++) baseDensity.push_back( stod(*it) );
-
-        uINT trimed_last = len - tailToSkip;
-        while(trimed_last < headToSkip+40)
-        {
-            headToSkip /= 2;
-            tailToSkip /= 2;
-            trimed_last = len - tailToSkip;
-            cerr << "Warning! Transcript $transcript too short. update headToSkip: " << headToSkip << "; tailToSkip: " << tailToSkip << endl;
-            if(headToSkip==0 and tailToSkip==0) break;
-        }
 
-        scalling_factor = calcScalingFactor(baseDensity, headToSkip, trimed_last, param);
+    split(record.bd_line, '\t', data);
+    record.transcript = data[0];
+    record.rpkm = data[2];
+    parse_signal(data, signal);
+    normalize_line(signal, record, record.bd_kept, record.bd_factor, record.bd_values, record.bd_normed, param);
 
-        if(scalling_factor > 1)
-        {
-            scalling_factor = scalling_factor / scalling_form;
-            OUT << transcript << "\t" << len << "\tbaseDensity\t" << rpkm << "\t" << scalling_factor;
-            if(norm_method == "log")
-            {
-                for(int i=1; i<=len; i++)
-                {
-                    char buff[400];
-                    sprintf(buff, "%.3f", log2(baseDensity[i]/scalling_factor+1));
-                    OUT << "\t" << buff;
-                }
-            }else{
-                for(int i=1; i<=len; i++)
-                {
-                    char buff[400];
-                    sprintf(buff, "%.3f", baseDensity[i]/scalling_factor);
-                    OUT << "\t" << buff;
-                }
-            }
-            OUT << "\n";
-        }
+    split(record.rt_line, '\t', data);
+    parse_signal(data, signal);
+    normalize_line(signal, record, record.rt_kept, record.rt_factor, record.rt_values, record.rt_normed, param);
 
-        i++;
-        const StringArray &rt_data = contents[i];
+    record.bd_line.clear();
+    record.rt_line.clear();
+}
 
-        //getline(IN, line);
-        //trim(line);
-        //split(line, '\t', data);
-        for(auto it=rt_data.cbegin()+3; it!=rt_data.cend(); it++) rtstop.push_back( stod(*it) );
-        scalling_factor = calcScalingFactor(rtstop, headToSkip, trimed_last, param);
+// the next transcript of a .bsig file, the values of the lines are taken by the record
+bool read_bsig_record(BSig_Reader &reader, Signal_Record &signal, Trans_Record &record)
+{
+    if(not reader.next(signal))
+        return false;
+    if(signal.rows.size() != 2)
+        throw Unexpected_Error("FATAL Error: transcript "+signal.id+" has "+to_string(signal.rows.size())+" lines, a baseDensity line and a RTstop line are expected");
+
+    record.transcript = signal.id;
+    record.len = signal.len;
+    record.rpkm = signal.rows[0].heads[0];
+    record.bd_signal.swap(signal.rows[0].values);
+    record.rt_signal.swap(signal.rows[1].values);
+    return true;
+}
 
-        if(scalling_factor > 1)
-        {
-            scalling_factor = scalling_factor / scalling_form;
+/*  The head is written with the stream format of OUT, which is std::fixed after 
+    the first baseDensity line as in the old single-pass writer  */
+void write_record(ostream &OUT, const Trans_Record &record, const Param &param)
+{
+    if(record.bd_kept)
+    {
+        OUT << record.transcript << "\t" << record.len << "\tbaseDensity\t" << record.rpkm << "\t" << record.bd_factor;
 
-            OUT << transcript << "\t" << len << "\tRTstop\t" << rpkm << "\t" << scalling_factor;
-            if(norm_method == "log")
-            {
-                for(int i=1; i<=len; i++)
-                {
-                    char buff[400];
-                    sprintf(buff, "%.3f", log2(rtstop[i]/scalling_factor+1));
-                    OUT << "\t" << buff;
-                }
-            }else{
-                for(int i=1; i<=len; i++)
-                {
-                    char buff[400];
-                    sprintf(buff, "%.3f", rtstop[i]/scalling_factor);
-                    OUT << "\t" << buff;
-                }
-            }
-            OUT << "\n";
-        }
+        auto ss = OUT.precision();
+        OUT << std::fixed << std::setprecision(3);
+        OUT << record.bd_values;
+        OUT.precision(ss);
+        OUT << "\n";
     }
 
-    //IN.close();
-    OUT.close();
+    if(record.rt_kept)
+    {
+        OUT << record.transcript << "\t" << record.len << "\tRTstop\t" << record.rpkm << "\t" << record.rt_factor;
+        OUT << record.rt_values;
+        OUT << "\n";
+    }else{
+        if(param.verbose)
+            cerr << "Filter RTstop of " << record.transcript << " for small scalling_factor=" << record.rt_factor << endl;
+    }
+}
 
+/*  The values are numbers of 3 decimals. The heads are the text of the text file, where the
+    stream is std::fixed after the first baseDensity line (fixed_heads)  */
+void write_record(BSig_Writer &writer, const Trans_Record &record, const Param &param, Signal_Record &signal, bool &fixed_heads)
+{
+    signal.id = record.transcript;
+    signal.len = record.len;
+    signal.rows.clear();
+    auto add_row = [&](const char *type, const double &factor, const DoubleArray &normed)
+    {
+        signal.rows.emplace_back();
+        Signal_Row &row = signal.rows.back();
+        row.heads = { type, record.rpkm, signal_number_text(factor, fixed_heads ? 6 : Signal_Row::GENERAL_NUMBER) };
+        row.values = normed;
+        row.decimals = 3;
+    };
+
+    if(record.bd_kept)
+    {
+        add_row("baseDensity", record.bd_factor, record.bd_normed);
+        fixed_heads = true;
+    }
+    if(record.rt_kept)
+        add_row("RTstop", record.rt_factor, record.rt_normed);
+    else if(param.verbose)
+        cerr << "Filter RTstop of " << record.transcript << " for small scalling_factor=" << record.rt_factor << endl;
+    writer.write_record(signal);
 }
-*/
 
+/*  The transcripts are read one at a time, so the memory does not grow with the file.
+    With -p, batches of transcripts are normalized on a pool of workers and written 
+    in the input order, the output is the same as a single thread  */
 void normalizeBaseDensity(const Param &param)
 {
     cerr << "Normalize base density from file $baseDensityFile...\n\t" << currentDateTime() << endl;
 
     const string input_file(param.input_file);
     const string output_file(param.output_file);
-    const bool log_op(param.log_op);
     uINT headToSkip(param.head_skip+1);
     uINT tailToSkip(param.tail_skip);
-    const double scalling_form(param.scalling_form);
 
-    ifstream IN(input_file, ifstream::in);
-    ofstream OUT(output_file, ofstream::out);
-
-    if(not IN)
-    {
-        cerr << RED << "FATAL Error: cannot open " << input_file << DEF << endl;
-        exit(-1);
-    }
-    if(not OUT)
+    ifstream IN;
+    unique_ptr<BSig_Reader> bsig;
+    Signal_Record signal;
+    if(is_bsig_file(input_file))
     {
-        cerr << RED << "FATAL Error: cannot write to " << output_file << DEF << endl;
-        exit(-1);
+        try{
+            bsig.reset(new BSig_Reader(input_file));
+        }catch(Bad_IO &e){
+            cerr << RED << e.what() << DEF << endl;
+            exit(-1);
+        }
+        if(bsig->layout() != Signal_Layout(1, 1))
+        {
+            cerr << RED << "FATAL Error: " << input_file << " is not a signal file of calcRT" << DEF << endl;
+            exit(-1);
+        }
+    }else{
+        IN.open(input_file, ifstream::in);
+        if(not IN)
+        {
+            cerr << RED << "FATAL Error: cannot open " << input_file << DEF << endl;
+            exit(-1);
+        }
     }
-    OUT << "#transcript\tlength\ttype\tbase_frequency, start from position 1.\n";
 
-    string transcript;
-    uLONG len = 0;
-    string rpkm;
-    
-    string line;
-    uLONG lineCount = 0;
-    while(getline(IN, line))
+    const string head_line("#transcript\tlength\ttype\tbase_frequency, start from position 1.");
+    ofstream OUT;
+    unique_ptr<BSig_Writer> writer;
+    Signal_Record output_signal;
+    bool fixed_heads = false;
+    if(param.bsig_output)
     {
-        if(line[0] == '#') continue;
-
-        if(not param.raw_mode)
+        try{
+            writer.reset(new BSig_Writer(output_file, Signal_Layout(3, 1)));
+        }catch(Bad_IO &e){
+            cerr << RED << e.what() << DEF << endl;
+            exit(-1);
+        }
+        writer->write_head(head_line);
+    }else{
+        OUT.open(output_file, ofstream::out);
+        if(not OUT)
         {
-            headToSkip = param.head_skip+1;
-            tailToSkip = param.tail_skip;
+            cerr << RED << "FATAL Error: cannot write to " << output_file << DEF << endl;
+            exit(-1);
         }
+        OUT << head_line << "\n";
+    }
 
-        ++lineCount;
-        if(lineCount % 1000 == 0) 
-            cerr << "  line: " << lineCount << endl;
-
-        DoubleArray baseDensity, rtstop;
-        double scalling_factor = 1.0;
-        trim(line);
+    typedef vector<Trans_Record> Record_Batch;
+    const uLONG batch_bytes = 1<<22;
+    const uLONG batch_records = 256;
 
-        StringArray data;
-        split(line, '\t', data);
-        transcript = data[0];
-        len = stoul(data[1]);
-        rpkm = data[2];
-        for(auto it=data.cbegin()+3; it!=data.cend(); it++) baseDensity.push_back( stod(*it) );
+    unique_ptr<Thread_Pool> pool;
+    if(param.threads > 1)
+        pool.reset(new Thread_Pool(param.threads));
+    deque< future< shared_ptr<Record_Batch> > > pending;
 
-        uINT trimed_last = len - tailToSkip;
-        while(trimed_last < headToSkip+40)
-        {
-            headToSkip /= 2;
-            tailToSkip /= 2;
-            trimed_last = len - tailToSkip;
-            if(not param.verbose)
-                cerr << "Warning! Transcript $transcript too short. update headToSkip: " << headToSkip << "; tailToSkip: " << tailToSkip << endl;
-            if(headToSkip==0 and tailToSkip==0) break;
-        }
-
-        scalling_factor = calcScalingFactor(baseDensity, headToSkip, trimed_last, param);
+    auto write_batch = [&](const Record_Batch &batch)
+    {
+        for(const Trans_Record &record: batch)
+            if(writer)
+                write_record(*writer, record, param, output_signal, fixed_heads);
+            else
+                write_record(OUT, record, param);
+    };
 
-        if(scalling_factor > 1)
+    uLONG lineCount = 0;
+    bool more = true;
+    while(more)
+    {
+        shared_ptr<Record_Batch> batch = make_shared<Record_Batch>();
+        uLONG bytes = 0;
+        while(bytes < batch_bytes and batch->size() < batch_records)
         {
-            scalling_factor = scalling_factor / scalling_form;
-            OUT << transcript << "\t" << len << "\tbaseDensity\t" << rpkm << "\t" << scalling_factor;
-            
-            auto ss = OUT.precision();
-            OUT << std::fixed << std::setprecision(3);
-            if(log_op)
+            Trans_Record record;
+            if(bsig)
             {
-                for(int i=1; i<=len; i++)
+                if(not read_bsig_record(*bsig, signal, record))
                 {
-                    char buff[400];
-                    sprintf(buff, "%.3f", log2(baseDensity[i]/scalling_factor+1));
-                    OUT << "\t" << buff;
+                    more = false;
+                    break;
                 }
             }else{
-                for(int i=1; i<=len; i++)
+                if(not getline(IN, record.bd_line))
                 {
-                    //char buff[400];
-                    //cout << baseDensity[i] << "/" << scalling_factor << endl;
-                    //sprintf(buff, "%.3f", baseDensity[i]/scalling_factor);
-                    OUT << "\t" << baseDensity[i]/scalling_factor;
+                    more = false;
+                    break;
                 }
-                
+                if(record.bd_line[0] == '#') continue;
+                trim(record.bd_line);
+                record.len = line_trans_len(record.bd_line);
             }
-            OUT.precision(ss);
-            OUT << "\n";
-        }
 
-        getline(IN, line);
-        trim(line);
-        split(line, '\t', data);
-        for(auto it=data.cbegin()+3; it!=data.cend(); it++) rtstop.push_back( stod(*it) );
-        scalling_factor = calcScalingFactor(rtstop, headToSkip, trimed_last, param);
+            if(not param.raw_mode)
+            {
+                headToSkip = param.head_skip+1;
+                tailToSkip = param.tail_skip;
+            }
 
-        if(scalling_factor > 1)
-        {
-            scalling_factor = scalling_factor / scalling_form;
+            ++lineCount;
+            if(lineCount % 1000 == 0) 
+                cerr << "  line: " << lineCount << endl;
 
-            OUT << transcript << "\t" << len << "\tRTstop\t" << rpkm << "\t" << scalling_factor;
-            if(log_op)
+            uINT trimed_last = record.len - tailToSkip;
+            while(trimed_last < headToSkip+40)
             {
-                for(int i=1; i<=len; i++)
-                {
-                    char buff[400];
-                    sprintf(buff, "%.3f", log2(rtstop[i]/scalling_factor+1));
-                    OUT << "\t" << buff;
-                }
-            }else{
-                for(int i=1; i<=len; i++)
-                {
-                    char buff[400];
-                    sprintf(buff, "%.3f", rtstop[i]/scalling_factor);
-                    OUT << "\t" << buff;
-                }
+                headToSkip /= 2;
+                tailToSkip /= 2;
+                trimed_last = record.len - tailToSkip;
+                if(not param.verbose)
+                    cerr << "Warning! Transcript $transcript too short. update headToSkip: " << headToSkip << "; tailToSkip: " << tailToSkip << endl;
+                if(headToSkip==0 and tailToSkip==0) break;
             }
-            OUT << "\n";
-        }else{
-            if(param.verbose)
-                cerr << "Filter RTstop of " << transcript << " for small scalling_factor=" << scalling_factor << endl;
+            record.head_skip = headToSkip;
+            record.trimed_last = trimed_last;
+
+            if(not bsig)
+            {
+                getline(IN, record.rt_line);
+                trim(record.rt_line);
+            }
+
+            bytes += record.bd_line.size() + record.rt_line.size() + (record.bd_signal.size() + record.rt_signal.size()) * 6;
+            batch->push_back(std::move(record));
+        }
+
+        if(batch->empty())
+            break;
+
+        if(not pool)
+        {
+            for(Trans_Record &record: *batch)
+                normalize_record(record, param);
+            write_batch(*batch);
+            continue;
+        }
+
+        pending.push_back( pool->submit([batch, &param]()
+        {
+            for(Trans_Record &record: *batch)
+                normalize_record(record, param);
+            return batch;
+        }) );
+        if(pending.size() >= 2*param.threads)
+        {
+            write_batch( *pending.front().get() );
+            pending.pop_front();
         }
     }
 
+    while(not pending.empty())
+    {
+        write_batch( *pending.front().get() );
+        pending.pop_front();
+    }
+
     IN.close();
     OUT.close();
+    if(writer)
+        writer->close();
 }
 
 int main(int argc, char *argv[])
@@ -589,10 +686,6 @@ int main(int argc, char *argv[])
     cout << "normalize method: " << param.show_norm_method() << endl;
     normalizeBaseDensity(param);
 
-    //StringMatrix rt_data;
-    //read_full_file(param, rt_data);
-    //process_full_file(param, rt_data);
-
     return 0;
 }
 
@@ -2,10 +2,13 @@
 #include <param.h>
 #include <string_split.h>
 #include <exceptions.h>
+#include <fast_writer.h>
+#include <signal_file.h>
 #include <fstream>
 #include <algorithm>
 #include <math.h>
 #include <iomanip>
+#include <memory>
 
 using namespace std;
 using namespace pan;
@@ -24,7 +27,8 @@ void print_usage()
         "Calculate enrichment file using RT stop as foreground and base density as background\n\n"
 
         "Command:\n"
-        " %s -i input_normedRT -r output_rt_bedGraph -b output_bd_bedGraph \n\n";
+        " %s -i input_normedRT -r output_rt_bedGraph -b output_bd_bedGraph \n"
+        " # input_normedRT is a binary signal file if it ends with .bsig\n\n";
 
     sprintf(buff, help_info, "normedRT2bedGraph");
     cout << buff << endl;
@@ -96,12 +100,69 @@ Param read_param(int argc, char *argv[])
     return param;
 }
 
+// the same as readSignal for a .bsig file of normalizeRTfile
+void readBSigSignal(const string &signalFile, MapStringuLONG &trans_len, MapStringString &trans_rpkm, 
+    MapStringDouble &trans_scalingFactor_bd, MapStringT<DoubleArray> &trans_baseDensity, 
+    MapStringDouble &trans_scalingFactor_rt, MapStringT<DoubleArray> &trans_RTstop)
+{
+    unique_ptr<BSig_Reader> SG;
+    try{
+        SG.reset(new BSig_Reader(signalFile));
+    }catch(Bad_IO &e){
+        cerr << RED << e.what() << DEF << endl;
+        exit(-1);
+    }
+    if(SG->layout() != Signal_Layout(3, 1))
+    {
+        cerr << RED << "FATAL Error: " << signalFile << " is not a normalized signal file" << DEF << endl;
+        exit(-1);
+    }
+
+    Signal_Record record;
+    uLONG lineCount = 0;
+    while(SG->next(record))
+    {
+        for(const Signal_Row &row: record.rows)
+        {
+            ++lineCount;
+            if(lineCount%10000==0)
+                cerr << "\tlines " << lineCount << endl;
+
+            const string &id = record.id;
+            const string &type = row.heads[0];
+            double scalingFactor( parse_double( Field_View(row.heads[2].data(), row.heads[2].size()) ) );
+
+            trans_len[id] = record.len;
+            trans_rpkm[id] = row.heads[1];
+
+            if(type == "baseDensity")
+            {
+                trans_scalingFactor_bd[id] = scalingFactor;
+                DoubleArray &baseDensities = trans_baseDensity[id];
+                baseDensities.insert(baseDensities.end(), row.values.cbegin(), row.values.cend());
+            }else if(type == "RTstop"){
+                trans_scalingFactor_rt[id] = scalingFactor;
+                DoubleArray &rtStop = trans_RTstop[id];
+                rtStop.insert(rtStop.end(), row.values.cbegin(), row.values.cend());
+            }
+        }
+    }
+}
+
 void readSignal(const string &signalFile, MapStringuLONG &trans_len, MapStringString &trans_rpkm, 
     MapStringDouble &trans_scalingFactor_bd, MapStringT<DoubleArray> &trans_baseDensity, 
     MapStringDouble &trans_scalingFactor_rt, MapStringT<DoubleArray> &trans_RTstop)
 {
+    if(is_bsig_file(signalFile))
+    {
+        readBSigSignal(signalFile, trans_len, trans_rpkm, trans_scalingFactor_bd, trans_baseDensity, 
+            trans_scalingFactor_rt, trans_RTstop);
+        return;
+    }
+
     ifstream SG(signalFile, ifstream::in);
     string line;
+    FieldArray data;
 
     uLONG lineCount = 0;
     while(getline(SG, line))
@@ -113,13 +174,12 @@ void readSignal(const string &signalFile, MapStringuLONG &trans_len, MapStringSt
             cerr << "\tlines " << lineCount << endl;
 
         trim(line);
-        StringArray data;
         split(line, '\t', data);
         string id(data[0]);
-        uINT len( stoul(data[1]) );
-        string type(data[2]);
+        uINT len( parse_uLONG(data[1]) );
+        const Field_View &type = data[2];
         string rpkm(data[3]);
-        double scalingFactor( stod(data[4]) );
+        double scalingFactor( parse_double(data[4]) );
         //DoubleArray baseDensities;
         
         trans_len[id] = len;
@@ -130,12 +190,12 @@ void readSignal(const string &signalFile, MapStringuLONG &trans_len, MapStringSt
             //ave_rpkm_string(rpkm, trans_rpkm[id]);
             trans_scalingFactor_bd[id] = scalingFactor;
             DoubleArray &baseDensities = trans_baseDensity[id];
-            for(auto it=data.cbegin()+5; it!=data.cend(); it++) baseDensities.push_back( stod(*it) );
+            for(auto it=data.cbegin()+5; it!=data.cend(); it++) baseDensities.push_back( parse_double(*it) );
         }else if(type == "RTstop"){
             //ave_rpkm_string(rpkm, trans_rpkm[id]);
             trans_scalingFactor_rt[id] = scalingFactor;
             DoubleArray &rtStop = trans_RTstop[id];
-            for(auto it=data.cbegin()+5; it!=data.cend(); it++) rtStop.push_back( stod(*it) );
+            for(auto it=data.cbegin()+5; it!=data.cend(); it++) rtStop.push_back( parse_double(*it) );
 
         }
     }
@@ -158,6 +218,7 @@ void writeBedGraph(const string &outRTFile, const string &outBDFile, MapStringDo
         exit(-1);
     }
 
+    Fast_Writer RT_writer(RT), BD_writer(BD);
     for(auto it=trans_RTstop.cbegin(); it!=trans_RTstop.cend(); it++)
     {
         string trans(it->first);
@@ -166,10 +227,12 @@ void writeBedGraph(const string &outRTFile, const string &outBDFile, MapStringDo
         const DoubleArray &BD_array = trans_baseDensity.at(trans);
         const double BD_scaling = trans_scalingFactor_bd.at(trans);
         for(int i=0;i<RT_array.size();i++)
-            RT << trans << "\t" << i << "\t" << i+1 << "\t" << RT_array.at(i) << "\n";
+            RT_writer << trans << "\t" << i << "\t" << i+1 << "\t" << RT_array.at(i) << "\n";
         for(int i=0;i<BD_array.size();i++)
-            BD << trans << "\t" << i << "\t" << i+1 << "\t" << round(BD_scaling*BD_array.at(i)) << "\n";
+            BD_writer << trans << "\t" << i << "\t" << i+1 << "\t" << round(BD_scaling*BD_array.at(i)) << "\n";
     }
+    RT_writer.flush();
+    BD_writer.flush();
 
     RT.close();
     BD.close();
@@ -0,0 +1,4 @@
+g++ -O3 -std=c++0x -pthread -I../../PsBL/src -L../../PsBL/src -o normalizeRTfile ../normalizeRTfile.cpp -lPsBL -lz
+sh test_normalizeRTfile.sh ./normalizeRTfile
+g++ -O3 -std=c++0x -pthread -I../../PsBL/src -L../../PsBL/src -o calcRT ../calcRT.cpp -lPsBL -lhts -lz
+sh test_calcRT.sh ./calcRT
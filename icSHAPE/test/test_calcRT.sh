@@ -0,0 +1,48 @@
+# check that calcRT counts the same reads from a sam file and from the bam file of it
+# usage: sh test_calcRT.sh calcRT
+# the bam file is made by samtools
+
+calcRT=$1
+
+if ! command -v samtools > /dev/null
+then
+    echo "samtools is not found, skip the bam checks"
+    exit 0
+fi
+
+printf "#id\tlen\tuniq\tmulti\trpkm\nT1\t60\t10\t0\t100.0\nT2\t50\t10\t0\t100.0\n" > test_reads.rpkm
+
+# single reads with and without a sequence (SEQ *), a secondary read, a reverse read
+# and read pairs on the same and on different transcripts
+awk 'BEGIN{
+    printf "@HD\tVN:1.0\tSO:unsorted\n@SQ\tSN:T1\tLN:60\n@SQ\tSN:T2\tLN:50\n";
+    printf "r1\t0\tT1\t5\t255\t10M\t*\t0\t0\tACGTACGTAC\tIIIIIIIIII\n";
+    printf "r2\t0\tT1\t20\t255\t12M\t*\t0\t0\t*\t*\n";
+    printf "r3\t256\tT2\t8\t255\t6M\t*\t0\t0\tACGTAC\tIIIIII\n";
+    printf "r4\t16\tT1\t30\t255\t6M\t*\t0\t0\tACGTAC\tIIIIII\n";
+    printf "r5\t0\tT2\t40\t255\t5M\t*\t0\t0\t*\t*\n";
+    printf "p1\t99\tT1\t10\t255\t8M\t=\t30\t28\tACGTACGT\tIIIIIIII\n";
+    printf "p1\t147\tT1\t30\t255\t8M\t=\t10\t-28\tACGTACGT\tIIIIIIII\n";
+    printf "p2\t99\tT1\t40\t255\t8M\tT2\t3\t0\tACGTACGT\tIIIIIIII\n";
+    printf "p2\t147\tT2\t3\t255\t8M\tT1\t40\t0\tACGTACGT\tIIIIIIII\n";
+}' > test_reads.sam
+samtools view -b -o test_reads.bam test_reads.sam
+
+$calcRT -i test_reads.sam -o test_reads.sam.rt -r test_reads.rpkm -c 1 2> /dev/null > /dev/null
+$calcRT -i test_reads.bam -o test_reads.bam.rt -r test_reads.rpkm -c 1 2> /dev/null > /dev/null
+
+failed=0
+if ! cmp -s test_reads.sam.rt test_reads.bam.rt
+then
+    echo "the counts of the sam and bam files are different:"
+    diff test_reads.sam.rt test_reads.bam.rt | cut -c1-200
+    failed=1
+fi
+
+rm -f test_reads.rpkm test_reads.sam test_reads.bam test_reads.sam.rt test_reads.bam.rt
+if [ $failed -ne 0 ]
+then
+    echo "FAILED"
+    exit 1
+fi
+echo "All passed"
@@ -0,0 +1,32 @@
+# check the verbose messages of normalizeRTfile
+# usage: sh test_normalizeRTfile.sh normalizeRTfile
+
+normalizeRTfile=$1
+failed=0
+
+# a transcript of 100 bases, the RTstop of 0.5 at each base is filtered
+awk 'BEGIN{
+    printf "#transcript\tbase frequency, start from position 0.\n";
+    printf "T1\t100\t200"; for(i=0; i<=100; i++) printf "\t100.000"; printf "\n";
+    printf "T1\t100\t200.000000"; for(i=0; i<=100; i++) printf "\t0.500"; printf "\n";
+}' > test_small_rt.rt
+
+# the message has the scaling factor of the RTstop, not divided by the scaling form
+for output in test_small_rt.txt test_small_rt.bsig
+do
+    $normalizeRTfile -i test_small_rt.rt -o $output -d 5 -l 5 -v > /dev/null 2> test_small_rt.log
+    if ! grep -q "^Filter RTstop of T1 for small scalling_factor=0.5$" test_small_rt.log
+    then
+        echo "bad message of the filtered RTstop in $output:"
+        grep "Filter RTstop" test_small_rt.log
+        failed=$((failed+1))
+    fi
+done
+
+rm -f test_small_rt.rt test_small_rt.txt test_small_rt.bsig test_small_rt.log
+if [ $failed -ne 0 ]
+then
+    echo "FAILED: $failed checks"
+    exit 1
+fi
+echo "All passed"
@@ -1,13 +1,17 @@
 
 #include "sliding_shape.h"
 #include "version.h"
+#include <thread_pool.h>
 #include <stdio.h>
 
+#include <functional>
+#include <memory>
+
 #define WARNING "The input tab file must be sorted (generated by sam2tab)"
 
 void print_usage_root()
 {
-    char buff[3000];
+    char buff[4000];
     const char *help_info = 
             "calc_sliding_shape - calculate SHAPE score with a sliding window\n"
             "=============================================================\n"
@@ -33,18 +37,18 @@ void print_usage_root()
 
 void print_usage_smartSHAPE()
 {
-    char buff[3000];
+    char buff[4000];
     const char *help_info = 
             "calc_sliding_shape Trt - calculate SHAPE score with a sliding window with Treatment (NAI-N3) samples\n"
             "====================================================================================================\n"
             "\e[1mUSAGE:\e[0m\n"
             "\tsliding_shape Trt -N inputTab1,inputTab2... -size chrSizeFile [-ijf junctionFile] -out out.gTab\n"
             "\e[1mHELP:\e[0m\n"
-            "\t-N: input Treatment (NAI-N3) tab files generated by sam2tab (must be sorted)\n"
+            "\t-N: input Treatment (NAI-N3) tab files (.tab or .btab) generated by sam2tab (must be sorted)\n"
             "\t-size: input a chromosome size file generated by STAR (chrNameLength.txt) \n"
             "\t-ijf: input a junction file generated by STAR (sjdbList.fromGTF.out.tab)\n"
             "\t-ojf: output a junction file with sopported reads\n"
-            "\t-out: output RT, BD and shape scores\n"
+            "\t-out: output RT, BD and shape scores (.bgTab for a binary columnar file, see gtab view)\n"
             "\t-noparam: don't output a parameter file\n\n"
 
             "\t-wsize: window size (default: 200)\n"
@@ -61,11 +65,12 @@ void print_usage_smartSHAPE()
             "\t-omc: minimul NAI BD for output (default: 50)\n"
             "\t-mc: minimul NAI BD for valid shape score (default: 100)\n\n"
 
-            "\t-genome: genome fasta file, base will be output (default: None)\n"
+            "\t-genome: genome fasta file or .pgenome file of fa2pgenome, base will be output (default: None)\n"
             "\t-bases: base to calculate shape scores, such as A,C,a,c, -genome should be provided\n"
             "\t-non-sliding: Calculate the shape score as a whole, without using the sliding window (default: None)\n"
             "\t              Suitable for short RNAs. Some parameters will be ignored in this case\n"
-            "\t-separate: Each base is calculated separately (default: None) -genome/-bases should be provided\n\n"
+            "\t-separate: Each base is calculated separately (default: None) -genome/-bases should be provided\n"
+            "\t-threads: <int> chromosomes calculated in parallel, the memory is multiplied (default: 1)\n\n"
 
             "\e[1mWARNING:\e[0m\n\t%s\n"
             "\e[1mVERSION:\e[0m\n\t%s\n"
@@ -82,19 +87,19 @@ void print_usage_smartSHAPE()
 
 void print_usage_icSHAPE()
 {
-    char buff[3000];
+    char buff[4000];
     const char *help_info = 
             "calc_sliding_shape TrtCont - calculate SHAPE score with a sliding window with Treatment (NAI-N3) and Control (DMSO) samples\n"
             "===========================================================================================================================\n"
             "\e[1mUSAGE:\e[0m\n"
             "\tsliding_shape TrtCont -D inputTab1,inputTab2... -N inputTab1,inputTab2... -size chrSizeFile [-ijf junctionFile] -out out.gTab\n"
             "\e[1mHELP:\e[0m\n"
-            "\t-D: input Control (DMSO) tab files generated by sam2tab (must be sorted)\n"
-            "\t-N: input Treatment (NAI-N3) tab files generated by sam2tab (must be sorted)\n"
+            "\t-D: input Control (DMSO) tab files (.tab or .btab) generated by sam2tab (must be sorted)\n"
+            "\t-N: input Treatment (NAI-N3) tab files (.tab or .btab) generated by sam2tab (must be sorted)\n"
             "\t-size: input a chromosome size file generated by STAR (chrNameLength.txt) \n"
             "\t-ijf: input a junction file generated by STAR (sjdbList.fromGTF.out.tab)\n"
             "\t-ojf: output a junction file with sopported reads\n"
-            "\t-out: output RT/BD/shape scores\n"
+            "\t-out: output RT/BD/shape scores (.bgTab for a binary columnar file, see gtab view)\n"
             "\t-noparam: don't output a parameter file\n\n"
 
             "\t-wsize: window size (default: 200)\n"
@@ -104,6 +109,7 @@ void print_usage_icSHAPE()
                 "\t\t div: div_fac*nai_bd/dmso_bd \n"
                 "\t\t complex: div_fac*(nai_rt-sub_fac*dmso_rt)/dmso_bd \n"
                 "\t\t log: log2( (nai_rt+add_fac)/(dmso_rt+add_fac) ) \n"
+            "\t-fastlog: use a fast log2 approximation for -enm log (absolute error < 1e-6 for |log2| < 8) \n"
             "\t-nom: <sm/upp/qua/dec/vigi> normalization method.(default: dec)\n" 
                 "\t\t sm: all sorted non-zero values \n"
                 "\t\t upp: upper half part of all sorted non-zero values \n"
@@ -122,11 +128,12 @@ void print_usage_icSHAPE()
             "\t-omc: minimul DMSO BD for output (default: 50)\n"
             "\t-mc: minimul DMSO BD for valid shape score (default: 100)\n\n"
 
-            "\t-genome: genome fasta file (default: None)\n"
+            "\t-genome: genome fasta file or .pgenome file of fa2pgenome (default: None)\n"
             "\t-bases: base to calculate shape scores, such as A,C,a,c, -genome should be provided\n"
             "\t-non-sliding: Calculate the shape score as a whole, without using the sliding window (default: None)\n"
             "\t              Suitable for short RNAs. Some parameters will be ignored in this case\n"
-            "\t-separate: Each base is calculated separately (default: None), -genome/-bases should be provided\n\n"
+            "\t-separate: Each base is calculated separately (default: None), -genome/-bases should be provided\n"
+            "\t-threads: <int> chromosomes calculated in parallel, the memory is multiplied (default: 1)\n\n"
 
             "\e[1mWARNING:\e[0m\n\t%s\n"
             "\e[1mVERSION:\e[0m\n\t%s\n"
@@ -245,6 +252,7 @@ struct General_Param
     uINT norm_sample_factor = 2;
     EnrichMethod icSHAPE_enrich_method = COMPLEX;
     uINT winsor_scaling = 1;
+    bool fast_log = false;
 
     /* smartSHAPE Part */
 
@@ -252,6 +260,8 @@ struct General_Param
     EnrichMethod smartSHAPE_enrich_method = RT;
     uLONG BD_ext = 0;
 
+    uINT threads = 1;
+
     operator bool()
     {
         if(mode == Unknown)
@@ -303,6 +313,7 @@ icSHAPE_Param build_icSHAPE_param(const General_Param &param)
     shape_param.wsize = param.wsize;
     shape_param.wstep = param.wstep;
     shape_param.no_sliding = param.no_sliding;
+    shape_param.fast_log = param.fast_log;
 
     return shape_param;
 }
@@ -470,6 +481,9 @@ General_Param read_param(int argc, char *argv[])
                 has_next(argc, argv, i);
                 check_norm_calc_method(param.norm_calc_method, argv[i+1]);
                 i++;
+            }else if(not strcmp(argv[i]+1, "fastlog"))
+            {
+                param.fast_log = true;
             }
 
             else if(not strcmp(argv[i]+1, "genome"))
@@ -496,6 +510,11 @@ General_Param read_param(int argc, char *argv[])
                 //has_next(argc, argv, i);
                 param.base_separate = true;
                 //i++;
+            }else if(not strcmp(argv[i]+1, "threads"))
+            {
+                has_next(argc, argv, i);
+                param.threads = max(1, stoi(argv[i+1]));
+                i++;
             }
 
             else{
@@ -641,6 +660,258 @@ void record_param(const General_Param &param, const int argc, char *argv[])
     OUT.close();
 }
 
+typedef vector<Map_Records> Record_Array;
+
+// calculate a chr_id+strand with its records and junctions, and write the scores to OUT
+typedef function<void(const string &chr_id, Record_Array &record_array, JunctionArray &chr_junctions, ostream &OUT)> Unit_Calc;
+
+// check if a chr_id+strand can be calculated and init its junctions, return nullptr to skip it
+JunctionArray *check_unit(const string &chr_id, const General_Param &param, const Genome &genome, 
+                        const MapStringuLONG &chr_size, MapStringT<JunctionArray> &junctions, int &index)
+{
+    const string chr = chr_id.substr(0, chr_id.size()-1);
+    bool use_mask = param.bases.empty() ? false : true;
+
+    if(use_mask and not genome.has_chr(chr))
+    {
+        cerr << RED << "Warning: " << chr_id << " not found on genome file, skip it" << DEF << endl;
+        return nullptr;
+    }
+
+    if(chr_size.find(chr_id) == chr_size.end())
+    {
+        cerr << RED << "Warning: " << chr_id << " not found on size file, skip it" << DEF << endl;
+        return nullptr;
+    }
+
+    // 2. calculation
+    clog << index++ <<  ". read_chr " << chr_id << "\tsite: " << chr_size.at(chr_id) << endl;
+
+    if(junctions.find(chr_id) == junctions.end())
+    {
+        if(not param.no_sliding)
+            cerr << RED << "Warning: " << chr_id << " junction not found, init empty junctions" << DEF << endl;
+        junctions[chr_id];
+    }
+
+    return &junctions.at(chr_id);
+}
+
+// calculate every chr_id+strand shared by the input files in order.
+// With -threads, the chr_id+strand are calculated by a worker pool into their own buffers, 
+// and the buffers are written to OUT in the same order, so the output is the same with a single thread.
+// The records are loaded by the workers when all inputs are indexed, or read here otherwise.
+// The junctions map is only changed by this thread
+void run_units(vector<Tab_Reader *> &i_vec, const General_Param &param, const Genome &genome, 
+                const MapStringuLONG &chr_size, MapStringT<JunctionArray> &junctions, 
+                const Unit_Calc &calc_unit, ostream &OUT)
+{
+    StringArray chr_ids(i_vec.size());
+    Record_Array record_array(i_vec.size());
+    int index = 1;
+
+    if(param.threads <= 1)
+    {
+        while(sync_chrs(i_vec, chr_ids, record_array))
+        {
+            const string chr_id = chr_ids.front();
+            JunctionArray *chr_junctions = check_unit(chr_id, param, genome, chr_size, junctions, index);
+            if(chr_junctions)
+                calc_unit(chr_id, record_array, *chr_junctions, OUT);
+        }
+        return;
+    }
+
+    bool indexed = true;
+    for(const Tab_Reader *hander: i_vec)
+        indexed = indexed and hander->has_index();
+
+    Thread_Pool pool(param.threads);
+    deque< future<string> > pending;
+
+    // records is nullptr if the worker should load it
+    auto submit_unit = [&](const string &chr_id, JunctionArray *chr_junctions, shared_ptr<Record_Array> records)
+    {
+        if(pending.size() >= param.threads)
+        {
+            OUT << pending.front().get();
+            pending.pop_front();
+        }
+
+        pending.push_back( pool.submit([&i_vec, &calc_unit, chr_id, chr_junctions, records]() -> string
+        {
+            Record_Array loaded;
+            if(not records)
+            {
+                loaded.resize(i_vec.size());
+                for(uLONG i=0; i<i_vec.size(); i++)
+                    load_chr(loaded[i], i_vec[i], chr_id);
+            }
+
+            ostringstream buffer;
+            calc_unit(chr_id, records ? *records : loaded, *chr_junctions, buffer);
+            return buffer.str();
+        }) );
+    };
+
+    if(indexed)
+    {
+        for(const string &chr_id: shared_chrs(i_vec))
+        {
+            JunctionArray *chr_junctions = check_unit(chr_id, param, genome, chr_size, junctions, index);
+            if(chr_junctions)
+                submit_unit(chr_id, chr_junctions, nullptr);
+        }
+    }else{
+        while(sync_chrs(i_vec, chr_ids, record_array))
+        {
+            const string chr_id = chr_ids.front();
+            JunctionArray *chr_junctions = check_unit(chr_id, param, genome, chr_size, junctions, index);
+            if(not chr_junctions)
+                continue;
+
+            shared_ptr<Record_Array> records = make_shared<Record_Array>(i_vec.size());
+            records->swap(record_array);
+            submit_unit(chr_id, chr_junctions, records);
+        }
+    }
+
+    while(not pending.empty())
+    {
+        OUT << pending.front().get();
+        pending.pop_front();
+    }
+}
+
+// calculate a chr_id+strand in [TrtCont] mode, the first D_num records are DMSO samples
+void calc_TrtCont_unit(const string &chr_id, Record_Array &record_array, JunctionArray &chr_junctions, 
+                        const uLONG &cSize, const uLONG &D_num, const General_Param &param, 
+                        const icSHAPE_Param &shape_param, const Genome &genome, ostream &OUT)
+{
+    const string chr = chr_id.substr(0, chr_id.size()-1);
+    const char strand = chr_id.back();
+    const uLONG N_num = record_array.size() - D_num;
+    bool use_mask = param.bases.empty() ? false : true;
+
+    if(chr_junctions.size() > 0)
+    {
+        clog << "Start to build_junction_support" << endl;
+        for(uLONG d=0; d<D_num; d++)
+            build_junction_support(record_array.at(d), chr_junctions);
+
+        clog << "Start to combine_junction" << endl;
+        combine_junction(chr_junctions);
+
+        clog << "Start to check_overlap" << endl;
+        check_overlap(chr_junctions, cSize);
+    }
+
+    uLONG BD_ext = 0;
+    uLONG binsize = 1000000;
+
+    Score_Array score(cSize+1, null);
+    STRAND s = strand=='+' ? POSITIVE : NEGATIVE;
+
+    // the DMSO replicates are summed in track 0 and the NAI replicates in track 1
+    clog << "Start to calc_chr_BDRT" << endl;
+    vector<Coverage_Array> RT, BD;
+    for(uLONG t=0; t<2; t++)
+    {
+        RT.emplace_back(cSize+1);
+        BD.emplace_back(cSize+1);
+    }
+    vector<uLONG> track_of(D_num+N_num, 1);
+    fill(track_of.begin(), track_of.begin()+D_num, 0);
+    calc_chr_BDRT(RT, BD, record_array, track_of, chr_junctions, cSize, s, BD_ext, binsize);
+    const Coverage_Array &d_rt = RT[0], &d_bd = BD[0];
+    const Coverage_Array &n_rt = RT[1], &n_bd = BD[1];
+
+    Base_Mask chr_mask;
+    Seq_View chr_seq;
+
+    if(param.base_separate){
+        for(char c: param.bases)
+        {
+            clog << "Start to calculate base " << c << endl;
+            vector<char> v;
+            v.push_back(c);
+            if(use_mask)
+                build_chr_mask(genome, chr, s, v, chr_mask, chr_seq);
+            sliding_non_junction( n_rt, d_rt, n_bd, d_bd, chr_junctions, score, chr, s, OUT, shape_param, chr_mask, chr_seq);
+            sliding_junction( n_rt, d_rt, n_bd, d_bd, chr_junctions, score, chr, s, OUT, shape_param, chr_mask, chr_seq);
+        }
+    }else{
+        clog << "Start to calculate all base " << param.bases << endl;
+        if(use_mask)
+            build_chr_mask(genome, chr, s, param.bases, chr_mask, chr_seq);
+        sliding_non_junction( n_rt, d_rt, n_bd, d_bd, chr_junctions, score, chr, s, OUT, shape_param, chr_mask, chr_seq);
+        sliding_junction( n_rt, d_rt, n_bd, d_bd, chr_junctions, score, chr, s, OUT, shape_param, chr_mask, chr_seq);
+    }
+
+    clog << " Finish " << chr_id << endl;
+}
+
+// calculate a chr_id+strand in [Trt] mode
+void calc_Trt_unit(const string &chr_id, Record_Array &record_array, JunctionArray &chr_junctions, 
+                    const uLONG &cSize, const General_Param &param, const smartSHAPE_Param &shape_param, 
+                    const Genome &genome, ostream &OUT)
+{
+    const string chr = chr_id.substr(0, chr_id.size()-1);
+    const char strand = chr_id.back();
+    const uLONG N_num = record_array.size();
+    bool use_mask = param.bases.empty() ? false : true;
+
+    if(chr_junctions.size() >= 1)
+    {
+        clog << "build_junction_support" << endl;
+        for(uLONG n=0; n<N_num; n++)
+            build_junction_support(record_array.at(n), chr_junctions);
+
+        clog << "combine_junction" << endl;
+        combine_junction(chr_junctions);
+
+        clog << "check_overlap" << endl;
+        check_overlap(chr_junctions, cSize);
+    }
+
+
+    uLONG binsize = 1000000;
+    Score_Array score(cSize+1, null);
+    STRAND s = strand=='+' ? POSITIVE : NEGATIVE;
+
+    // all replicates are summed in a track
+    clog << "Start to calc_chr_BDRT" << endl;
+    vector<Coverage_Array> RT, BD;
+    RT.emplace_back(cSize+1);
+    BD.emplace_back(cSize+1);
+    calc_chr_BDRT(RT, BD, record_array, vector<uLONG>(N_num, 0), chr_junctions, cSize, s, shape_param.BD_ext, binsize);
+    const Coverage_Array &n_rt = RT[0], &n_bd = BD[0];
+
+    Base_Mask chr_mask;
+    Seq_View chr_seq;
+
+    if(param.base_separate){
+        for(char c: param.bases)
+        {
+            clog << "Start to calculate base " << c << endl;
+            vector<char> v;
+            v.push_back(c);
+            if(use_mask)
+                build_chr_mask(genome, chr, s, v, chr_mask, chr_seq);
+            sliding_non_junction( n_rt, n_bd, chr_junctions, score, chr, s, OUT, shape_param, chr_mask, chr_seq);
+            sliding_junction( n_rt, n_bd, chr_junctions, score, chr, s, OUT, shape_param, chr_mask, chr_seq);
+        }
+    }else{
+        clog << "Start to calculate all base " << param.bases << endl;
+        if(use_mask)
+            build_chr_mask(genome, chr, s, param.bases, chr_mask, chr_seq);
+        sliding_non_junction( n_rt, n_bd, chr_junctions, score, chr, s, OUT, shape_param, chr_mask, chr_seq);
+        sliding_junction( n_rt, n_bd, chr_junctions, score, chr, s, OUT, shape_param, chr_mask, chr_seq);
+    }
+
+    clog << " Finish " << chr_id << endl;
+}
+
 int main(int argc, char *argv[])
 {
 
@@ -661,6 +932,8 @@ int main(int argc, char *argv[])
     if(not param.noParam)
         record_param(param, argc, argv);
 
+    clog << "SIMD kernels: " << simd_level_name(simd_level()) << endl;
+
     MapStringT<JunctionArray> junctions;
     MapStringuLONG chr_size;
 
@@ -676,12 +949,10 @@ int main(int argc, char *argv[])
         load_junctions(param.junction_file, junctions, chr_size);
     }
 
-    vector<bool> chr_mask;
-    string chr_seq;
     bool use_mask = param.bases.empty() ? false : true;
-    qFasta fasta;
+    Genome genome;
     if(use_mask)
-        fasta.load_fasta_file(param.genome_seq_file);
+        genome.load(param.genome_seq_file);
 
     ofstream OUT(param.out_file+".tmp", ofstream::out);
     check_output_handle(OUT, param.out_file);
@@ -705,137 +976,24 @@ int main(int argc, char *argv[])
         DNFfiles.insert( DNFfiles.end(), param.DFiles.begin(), param.DFiles.end() );
         DNFfiles.insert( DNFfiles.end(), param.NFiles.begin(), param.NFiles.end() );
 
-        vector<ifstream *> i_vec;
+        vector<Tab_Reader *> i_vec;
         for(string fn: DNFfiles)
         {
-            i_vec.push_back( new ifstream(fn, ifstream::in) );
-            check_input_handle(*i_vec.back(), fn);
+            i_vec.push_back( open_tab_reader(fn) );
         }
 
-        StringArray chr_ids(D_num+N_num);
-        vector< vector<Map_Record> > record_array(D_num+N_num);
-
         // parameter
         icSHAPE_Param shape_param = build_icSHAPE_param(param);
 
-        int index = 1;
-        while(sync_chrs(i_vec, chr_ids, record_array))
-        {
-            const string chr_id = chr_ids.front();
-            const string chr = chr_id.substr(0, chr_id.size()-1);
-            const char strand = chr_id.back();
-
-            if(use_mask and not fasta.has_chr(chr))
-            {
-                cerr << RED << "Warning: " << chr_id << " not found on genome file, skip it" << DEF << endl;
-                continue;
-            }
-
-            if(chr_size.find(chr_id) == chr_size.end())
-            {
-                cerr << RED << "Warning: " << chr_id << " not found on size file, skip it" << DEF << endl;
-                continue;
-            }
-
-            // 2. calculation
-            clog << index++ <<  ". read_chr " << chr_id << "\tsite: " << chr_size.at(chr_id) << endl;
-
-            if(junctions.find(chr_id) == junctions.end())
-            {
-                if(not param.no_sliding)
-                    cerr << RED << "Warning: " << chr_id << " junction not found, init empty junctions" << DEF << endl;
-                junctions[chr_id]; 
-            }
-
-            if(junctions[chr_id].size() > 0)
-            {
-                clog << "Start to build_junction_support" << endl;
-                for(uLONG d=0; d<D_num; d++)
-                    build_junction_support(record_array.at(d), junctions.at(chr_id));
-
-                clog << "Start to combine_junction" << endl;
-                combine_junction(junctions[chr_id]);
-
-                clog << "Start to check_overlap" << endl;
-                check_overlap(junctions[chr_id], chr_size.at(chr_id));
-            }
-
-            uLONG cSize = chr_size.at(chr_id);
-            uIntArray n_rt(cSize+1, 0), n_bd(cSize+1, 0);
-            uIntArray d_rt(cSize+1, 0), d_bd(cSize+1, 0);
-
-            uLONG BD_ext = 0;
-            uLONG binsize = 1000000;
-
-            FloatArray score(cSize+1, null);
-
-            //ofstream OUT("test");
-
-            if(strand == '+')
-            {
-                clog << "Start to calc_chr_BDRT_Pos" << endl;
-                for(uLONG d=0; d<D_num; d++)
-                {
-                    calc_chr_BDRT_Pos(d_bd, d_rt, record_array.at(d), junctions[chr_id], cSize, BD_ext, binsize);
-                    //for(int i=0;l)
-                }
-                for(uLONG n=0; n<N_num; n++)
-                    calc_chr_BDRT_Pos(n_bd, n_rt, record_array.at(n+D_num), junctions[chr_id], cSize, BD_ext, binsize);
-
-                //clog << "Start to sliding_non_junction..." << endl;
-                //sliding_non_junction( n_rt, d_rt, n_bd, d_bd, junctions[chr_id], score, chr, POSITIVE, OUT, shape_param, chr_mask, chr_seq);
-
-                //clog << "Start to sliding_junction..." << endl;
-                //sliding_junction( n_rt, d_rt, n_bd, d_bd, junctions[chr_id], score, chr, POSITIVE, OUT, shape_param, chr_mask, chr_seq);
-            }
-            else
+        run_units(i_vec, param, genome, chr_size, junctions, 
+            [&](const string &chr_id, Record_Array &record_array, JunctionArray &chr_junctions, ostream &UNIT_OUT)
             {
-                clog << "Start to calc_chr_BDRT_Neg" << endl;
-                for(uLONG d=0; d<D_num; d++)
-                    calc_chr_BDRT_Neg(d_bd, d_rt, record_array.at(d), junctions[chr_id], cSize, BD_ext, binsize);
-                for(uLONG n=0; n<N_num; n++)
-                    calc_chr_BDRT_Neg(n_bd, n_rt, record_array.at(n+D_num), junctions[chr_id], cSize, BD_ext, binsize);
-
-                //clog << "Start to sliding_non_junction..." << endl;
-                //sliding_non_junction( n_rt, d_rt, n_bd, d_bd, junctions[chr_id], score, chr, NEGATIVE, OUT, shape_param, chr_mask, chr_seq);
-
-                //clog << "Start to sliding_junction..." << endl;
-                //sliding_junction( n_rt, d_rt, n_bd, d_bd, junctions[chr_id], score, chr, NEGATIVE, OUT, shape_param, chr_mask, chr_seq);
-                
-            }
-
-            ////////////////////////////////////////////////////////////////////////
-            //if(use_mask)
-            //{
-                STRAND s = strand=='+' ? POSITIVE : NEGATIVE;
-
-                if(param.base_separate){
-                    for(char c: param.bases)
-                    {
-                        clog << "Start to calculate base " << c << endl;
-                        vector<char> v;
-                        v.push_back(c);
-                        if(use_mask)
-                            bool success = build_chr_mask(fasta, chr, s, v, chr_mask, chr_seq);
-                        sliding_non_junction( n_rt, d_rt, n_bd, d_bd, junctions[chr_id], score, chr, s, OUT, shape_param, chr_mask, chr_seq);
-                        sliding_junction( n_rt, d_rt, n_bd, d_bd, junctions[chr_id], score, chr, s, OUT, shape_param, chr_mask, chr_seq);
-                    }
-                }else{
-                    clog << "Start to calculate all base " << param.bases << endl;
-                    if(use_mask)
-                        bool success = build_chr_mask(fasta, chr, s, param.bases, chr_mask, chr_seq);
-                    sliding_non_junction( n_rt, d_rt, n_bd, d_bd, junctions[chr_id], score, chr, s, OUT, shape_param, chr_mask, chr_seq);
-                    sliding_junction( n_rt, d_rt, n_bd, d_bd, junctions[chr_id], score, chr, s, OUT, shape_param, chr_mask, chr_seq);
-                }
-            //}
-            ////////////////////////////////////////////////////////////////////////
-
-            clog << " Finish " << chr_id << endl;
-        }
+                calc_TrtCont_unit(chr_id, record_array, chr_junctions, chr_size.at(chr_id), D_num, 
+                                    param, shape_param, genome, UNIT_OUT);
+            }, OUT);
 
         for(uLONG i=0; i<i_vec.size(); i++)
         {
-            i_vec[i]->close();
             delete i_vec[i];
         }
     }else{
@@ -848,129 +1006,24 @@ int main(int argc, char *argv[])
 
         clog << "Start to init input handles..." << endl;
         
-        uLONG N_num = param.NFiles.size();
-        vector<ifstream *> i_vec;
+        vector<Tab_Reader *> i_vec;
         for(string fn: param.NFiles)
         {
-            i_vec.push_back( new ifstream(fn, ifstream::in) );
-            check_input_handle(*i_vec.back(), fn);
+            i_vec.push_back( open_tab_reader(fn) );
         }
 
-        StringArray chr_ids(N_num);
-        vector< vector<Map_Record> > record_array(N_num);
-
         // parameter
-        //smartSHAPE_Param shape_param;
         smartSHAPE_Param shape_param = build_smartSHAPE_param(param);
 
-        int index = 1;
-        while(sync_chrs(i_vec, chr_ids, record_array))
-        {
-            const string chr_id = chr_ids.front();
-            const string chr = chr_id.substr(0, chr_id.size()-1);
-            const char strand = chr_id.back();
-
-            if(use_mask and not fasta.has_chr(chr))
-            {
-                cerr << RED << "Warning: " << chr_id << " not found on genome file, skip it" << DEF << endl;
-                continue;
-            }
-
-            if(chr_size.find(chr_id) == chr_size.end())
+        run_units(i_vec, param, genome, chr_size, junctions, 
+            [&](const string &chr_id, Record_Array &record_array, JunctionArray &chr_junctions, ostream &UNIT_OUT)
             {
-                cerr << RED << "Warning: " << chr_id << " not found on size file, skip it" << DEF << endl;
-                continue;
-            }
-
-            // 2. calculation
-            clog << index++ <<  ". read_chr " << chr_id << "\t" << chr_size.at(chr_id) << endl;
-
-            if(junctions.find(chr_id) == junctions.end())
-            {
-                if(not param.no_sliding)
-                    cerr << RED << "Warning: " << chr_id << " junction not found, init a empty junction" << DEF << endl;
-                junctions[chr_id];
-            }
-
-            if(junctions[chr_id].size() >= 1)
-            {
-                clog << "build_junction_support" << endl;
-                for(uLONG n=0; n<N_num; n++)
-                    build_junction_support(record_array.at(n), junctions.at(chr_id));
-
-                clog << "combine_junction" << endl;
-                combine_junction(junctions[chr_id]);
-
-                clog << "check_overlap" << endl;
-                check_overlap(junctions[chr_id], chr_size.at(chr_id));
-            }
-
-            uLONG cSize = chr_size.at(chr_id);
-            uIntArray n_rt(cSize+1, 0), n_bd(cSize+1, 0);
-
-            uLONG binsize = 1000000;
-            FloatArray score(cSize+1, null);
-
-            if(strand == '+')
-            {
-                clog << "Start to calc_chr_BDRT_Pos" << endl;
-                for(uLONG n=0; n<N_num; n++)
-                    calc_chr_BDRT_Pos(n_bd, n_rt, record_array.at(n), junctions[chr_id], cSize, shape_param.BD_ext, binsize);
-
-                //clog << "Start to sliding_non_junction..." << endl;
-                //sliding_non_junction( n_rt, n_bd, junctions[chr_id], score, chr, POSITIVE, OUT, shape_param, chr_mask, chr_seq);
-
-                //clog << "Start to sliding_junction..." << endl;
-                //sliding_junction( n_rt, n_bd, junctions[chr_id], score, chr, POSITIVE, OUT, shape_param, chr_mask, chr_seq);
-            }
-            else
-            {
-
-                clog << "Start to calc_chr_BDRT_Pos" << endl;
-                for(uLONG n=0; n<N_num; n++)
-                    calc_chr_BDRT_Neg(n_bd, n_rt, record_array.at(n), junctions[chr_id], cSize, shape_param.BD_ext, binsize);
-
-                //clog << "Start to sliding_non_junction..." << endl;
-                //sliding_non_junction( n_rt, n_bd, junctions[chr_id], score, chr, NEGATIVE, OUT, shape_param, chr_mask, chr_seq);
-
-                //clog << "Start to sliding_junction..." << endl;
-                //sliding_junction( n_rt, n_bd, junctions[chr_id], score, chr, NEGATIVE, OUT, shape_param, chr_mask, chr_seq);
-            }
-
-
-            ////////////////////////////////////////////////////////////////////////
-            //if(use_mask)
-            //{
-                STRAND s = strand=='+' ? POSITIVE : NEGATIVE;
-
-                if(param.base_separate){
-                    for(char c: param.bases)
-                    {
-                        clog << "Start to calculate all base " << c << endl;
-                        vector<char> v;
-                        v.push_back(c);
-                        if(use_mask)
-                            bool success = build_chr_mask(fasta, chr, s, v, chr_mask, chr_seq);
-                        sliding_non_junction( n_rt, n_bd, junctions[chr_id], score, chr, s, OUT, shape_param, chr_mask, chr_seq);
-                        sliding_junction( n_rt, n_bd, junctions[chr_id], score, chr, s, OUT, shape_param, chr_mask, chr_seq);
-                    }
-                }else{
-                    clog << "Start to calculate all base " << param.bases << endl;
-                    if(use_mask)
-                        bool success = build_chr_mask(fasta, chr, s, param.bases, chr_mask, chr_seq);
-                    sliding_non_junction( n_rt, n_bd, junctions[chr_id], score, chr, s, OUT, shape_param, chr_mask, chr_seq);
-                    sliding_junction( n_rt, n_bd, junctions[chr_id], score, chr, s, OUT, shape_param, chr_mask, chr_seq);
-                }
-            //}
-            ////////////////////////////////////////////////////////////////////////
-
-
-            clog << " Finish " << chr_id << endl;
-        }
+                calc_Trt_unit(chr_id, record_array, chr_junctions, chr_size.at(chr_id), 
+                                param, shape_param, genome, UNIT_OUT);
+            }, OUT);
 
         for(uLONG i=0; i<i_vec.size(); i++)
         {
-            i_vec[i]->close();
             delete i_vec[i];
         }
     }
@@ -987,6 +1040,6 @@ int main(int argc, char *argv[])
         write_junctions(junctions, param.out_junc_file);
     }
 
+    clog << "Peak memory: " << peak_rss_kb()/1024 << " MB" << endl;
 }
 
-
@@ -1,6 +1,9 @@
 
 #include "sliding_shape.h"
 #include "version.h"
+#include <thread_pool.h>
+
+#include <memory>
 
 #define WARNING "The input tab file must be sorted (generated by sam2tab)"
 
@@ -13,14 +16,17 @@ void print_usage()
             "\e[1mUSAGE:\e[0m\n"
             "\tcountRT -in input1.tab,input2.tab... -size chrSizeFile [-ijf junctionFile] -out outputFile\n"
             "\e[1mHELP:\e[0m\n"
-            "\t-in: tab file generated by sam2tab, multiple files seperated by comma \n"
+            "\t-in: tab file (.tab or .btab) generated by sam2tab, multiple files seperated by comma \n"
             "\t-size: input a chromosome size file generated by STAR (chrNameLength.txt) \n"
             "\t-ijf: input a junction file generated by STAR (sjdbList.fromGTF.out.tab)\n"
             "\t-ojf: output a junction file with sopported reads\n"
             "\t-omc: minimul DMSO BD for output (default: 50)\n"
+            "\t-sum_rt: only output the positions with RT summed over all inputs >= sum_rt (default: 0)\n"
+            "\t-sum_bd: only output the positions with BD summed over all inputs >= sum_bd (default: 0)\n"
             "\t-out: output RT and BD\n\n"
 
-            "\t-genome: genome fasta file, base will be output (default: None)\n\n"
+            "\t-genome: genome fasta file or .pgenome file of fa2pgenome, base will be output (default: None)\n"
+            "\t-threads: <int> chromosomes counted in parallel, the memory is multiplied (default: 1)\n\n"
 
             "\e[1mWARNING:\e[0m\n\t%s\n"
             "\e[1mVERSION:\e[0m\n\t%s\n"
@@ -45,6 +51,9 @@ struct Param
     string out_junc_file;
 
     uINT out_min_cov = 50;
+    uINT sum_rt = 0;
+    uINT sum_bd = 0;
+    uINT threads = 1;
 
     string genome_seq_file;
 
@@ -118,6 +127,21 @@ Param read_param(int argc, char *argv[])
                 has_next(argc, i);
                 param.out_min_cov = stoul(argv[i+1]);
                 i++;
+            }else if(not strcmp(argv[i]+1, "sum_rt"))
+            {
+                has_next(argc, i);
+                param.sum_rt = stoul(argv[i+1]);
+                i++;
+            }else if(not strcmp(argv[i]+1, "sum_bd"))
+            {
+                has_next(argc, i);
+                param.sum_bd = stoul(argv[i+1]);
+                i++;
+            }else if(not strcmp(argv[i]+1, "threads"))
+            {
+                has_next(argc, i);
+                param.threads = max(1, stoi(argv[i+1]));
+                i++;
             }else if(not strcmp(argv[i]+1, "genome"))
             {
                 has_next(argc, i);
@@ -137,55 +161,60 @@ Param read_param(int argc, char *argv[])
     return param;
 }
 
-void write_RTBD(ofstream &OUT, const string &chr_id_strand, vector<uIntArray> &rt_Array, vector<uIntArray> &bd_Array, const string &chr_seq, const uINT min_D)
+// write a position if any input has RT >= 1 or BD >= min_D, and the sums over all inputs are >= sum_rt and sum_bd
+void write_RTBD(ostream &OUT, const string &chr_id_strand, const Replicate_Coverage &coverage, const Seq_View &chr_seq, const uINT min_D,
+                const uINT sum_rt=0, const uINT sum_bd=0)
 {
-    const uLONG cSize = bd_Array.front().size() - 1;
+    const uLONG cSize = coverage.size() - 1;
+    const uLONG track_num = coverage.track_num();
 
-    if(rt_Array.size() != bd_Array.size())
+    if(not chr_seq.empty() and coverage.size()!=chr_seq.size()+1)
     {
-        cerr << RED << "FATAL Error: rt_Array and bd_Array different length" << DEF << endl;
-        exit(-1);
-    }
-    if(not chr_seq.empty() and rt_Array.front().size()!=chr_seq.size()+1)
-    {
-        cerr << RED << "FATAL Error: rt_Array and chr_seq different length " << rt_Array.front().size()-1 << " and " << chr_seq.size() << ". Skip this one" << DEF << endl;
+        cerr << RED << "FATAL Error: rt_Array and chr_seq different length " << coverage.size()-1 << " and " << chr_seq.size() << ". Skip this one" << DEF << endl;
         return;
     }
 
     string chr_id = chr_id_strand.substr(0, chr_id_strand.size()-1);
     char strand = chr_id_strand.back();
 
+    Fast_Writer writer(OUT);
 
     for(uLONG i=1; i<=cSize; i++)
     {
-        string base;
-        if(not chr_seq.empty())
-            base = base + "\t" + chr_seq[i-1];
+        bool covered = false;
+        uLONG total_rt = 0, total_bd = 0;
+        for(uLONG j=0; j<track_num; j++)
+        {
+            covered = covered or coverage.get_RT(i, j) >= 1 or coverage.get_BD(i, j) >= min_D;
+            total_rt += coverage.get_RT(i, j);
+            total_bd += coverage.get_BD(i, j);
+        }
 
-        if( any_of(rt_Array.begin(), rt_Array.end(), [&i](uIntArray &a){return a[i]>=1;}) or 
-            any_of(bd_Array.begin(), bd_Array.end(), [&i, &min_D](uIntArray &a){return a[i]>=min_D;}) )
+        if(covered and total_rt >= sum_rt and total_bd >= sum_bd)
         {
-            OUT << chr_id << "\t" << strand << "\t" << i << base;
-            for(uLONG j=0; j<rt_Array.size(); j++)
+            writer << chr_id << "\t" << strand << "\t" << i;
+            if(not chr_seq.empty())
+                writer << '\t' << chr_seq[i-1];
+            for(uLONG j=0; j<track_num; j++)
             {
-                OUT << "\t" << rt_Array[j][i] << "\t" <<  bd_Array[j][i];
+                writer << "\t" << coverage.get_RT(i, j) << "\t" <<  coverage.get_BD(i, j);
             }
-            OUT << "\n";
+            writer << "\n";
         }
     }
 }
 
-bool fetch_chr_seq(qFasta &seq_holder, const string &chrID, const STRAND &strand, string &chr_seq)
+// chr_seq is a view of the strand in the coordinates of the positive strand
+bool fetch_chr_seq(const Genome &seq_holder, const string &chrID, const STRAND &strand, Seq_View &chr_seq)
 {
     if(not seq_holder.has_chr(chrID))
     {
         return false;
     }
-    //uLONG chrLen = seq_holder.get_chr_len(chrID);
-    chr_seq = seq_holder.get_chr_subbseq(chrID, 0, string::npos, strand);
+    chr_seq = seq_holder.get_chr_view(chrID, strand);
 
     if(strand == NEGATIVE)
-        reverse(chr_seq.begin(),chr_seq.end());
+        chr_seq = chr_seq.reversed();
 
     return true;
 }
@@ -211,6 +240,52 @@ string compile_head(const StringArray &inputFiles, bool use_genome)
     return head;
 }
 
+// count a chr_id+strand and write its RT and BD to OUT
+void count_unit(const string &chr_id, vector<Map_Records> &record_array, JunctionArray &chr_junctions,
+                const uLONG &cSize, const Param &param, const Genome &genome, ostream &OUT)
+{
+    if(chr_junctions.size() > 0)
+    {
+        clog << "Start to build_junction_support" << endl;
+        for(const Map_Records &a: record_array)
+            build_junction_support(a, chr_junctions);
+
+        clog << "Start to combine_junction" << endl;
+        combine_junction(chr_junctions);
+
+        clog << "Start to check_overlap" << endl;
+        check_overlap(chr_junctions, cSize);
+    }
+
+    const uLONG binsize = 1000000;
+    const uLONG BD_ext = 0;
+    const STRAND s = record_array.front().strand;
+
+    // a track per replicate
+    clog << "Start to calc_chr_BDRT" << endl;
+    vector<uLONG> track_of(record_array.size());
+    iota(track_of.begin(), track_of.end(), 0);
+    Replicate_Coverage coverage(cSize+1, record_array.size());
+    calc_chr_BDRT(coverage, record_array, track_of, chr_junctions, cSize, s, BD_ext, binsize);
+
+    Seq_View chr_seq;
+    if(not param.genome_seq_file.empty())
+    {
+        string true_chr_id = chr_id.substr(0, chr_id.size()-1);
+        bool success = fetch_chr_seq(genome, true_chr_id, s, chr_seq);
+        if(not success)
+        {
+            cerr << RED << "Warning: " << chr_id << " not found on genome file, skip it" << DEF << endl;
+            return;
+        }
+    }
+
+    clog << "Start to write_RTBD: " << chr_id << endl;
+    write_RTBD(OUT, chr_id, coverage, chr_seq, param.out_min_cov, param.sum_rt, param.sum_bd);
+
+    clog << " Finish " << chr_id << endl;
+}
+
 int main(int argc, char *argv[])
 {
 
@@ -237,21 +312,19 @@ int main(int argc, char *argv[])
     }
 
     clog << "Start to init input handles..." << endl;
-    vector<ifstream *> i_vec;
+    vector<Tab_Reader *> i_vec;
     for(string fn: param.inputFiles)
     {
-        i_vec.push_back( new ifstream(fn, ifstream::in) );
-        check_input_handle(*i_vec.back(), fn);
+        i_vec.push_back( open_tab_reader(fn) );
     }
 
     StringArray chr_ids(i_vec.size());
-    vector< vector<Map_Record> > record_array(i_vec.size());
+    vector<Map_Records> record_array(i_vec.size());
 
-    string chr_seq;
     bool use_genome = param.genome_seq_file.empty() ? false : true;
-    qFasta fasta;
+    Genome genome;
     if(use_genome)
-        fasta.load_fasta_file(param.genome_seq_file);
+        genome.load(param.genome_seq_file);
 
     ofstream OUT(param.outputFile, ofstream::out);
 
@@ -264,6 +337,13 @@ int main(int argc, char *argv[])
 
     OUT << compile_head(param.inputFiles, use_genome);
 
+    // with -threads, the chr_id+strand are counted by a worker pool into their own buffers and the buffers
+    // are written in the reading order, at most threads units are held in memory
+    unique_ptr<Thread_Pool> pool;
+    if(param.threads > 1)
+        pool.reset(new Thread_Pool(param.threads));
+    deque< future<string> > pending;
+
     uLONG index = 0;
     while(sync_chrs(i_vec, chr_ids, record_array))
     {
@@ -280,75 +360,40 @@ int main(int argc, char *argv[])
             junctions[chr_id];
         }
 
-        if(junctions[chr_id].size() > 0)
-        {
-            clog << "Start to build_junction_support" << endl;
-            for(vector<Map_Record> &a: record_array)
-                build_junction_support(a, junctions.at(chr_id));
-
-            clog << "Start to combine_junction" << endl;
-            combine_junction(junctions[chr_id]);
-
-            clog << "Start to check_overlap" << endl;
-            check_overlap(junctions[chr_id], chr_size.at(chr_id));
-        }
-
         clog << index++ <<  ". read_chr " << chr_id << "\t" << chr_size.at(chr_id) << endl;
 
         const uLONG cSize = chr_size.at(chr_id);
-        
-        vector<uIntArray> rt_array(i_vec.size());
-        for(uIntArray &a: rt_array)
-            a.assign(cSize+1, 0);
-        
-        vector<uIntArray> bd_array(i_vec.size());
-        for(uIntArray &a: bd_array)
-            a.assign(cSize+1, 0);
-
-        const uLONG binsize = 1000000;
-
-        FloatArray score(cSize+1, null);
-
-        if(record_array.front().front().strand == POSITIVE)
+        JunctionArray &chr_junctions = junctions.at(chr_id);
+        if(not pool)
         {
-            clog << "Start to calc_chr_BDRT_Pos" << endl;
-            for(uLONG i=0; i<i_vec.size(); i++)
-            {
-                uLONG BD_ext = 0;
-                calc_chr_BDRT_Pos(bd_array.at(i), rt_array.at(i), record_array.at(i), junctions[chr_id], cSize, BD_ext, binsize);
-            }
-        }
-        else
-        {
-            clog << "Start to calc_chr_BDRT_Neg" << endl;
-            for(uLONG i=0; i<i_vec.size(); i++)
-            {
-                uLONG BD_ext = 0;
-                calc_chr_BDRT_Neg(bd_array.at(i), rt_array.at(i), record_array.at(i), junctions[chr_id], cSize, BD_ext, binsize);
-            }
+            count_unit(chr_id, record_array, chr_junctions, cSize, param, genome, OUT);
+            continue;
         }
 
-        if(use_genome)
+        if(pending.size() >= param.threads)
         {
-            string true_chr_id = chr_id.substr(0, chr_id.size()-1);
-            STRAND s = record_array.front().front().strand;
-            bool success = fetch_chr_seq(fasta, true_chr_id, s, chr_seq);
-            if(not success)
-            {
-                cerr << RED << "Warning: " << chr_id << " not found on genome file, skip it" << DEF << endl;
-                continue;
-            }
+            OUT << pending.front().get();
+            pending.pop_front();
         }
 
-        clog << "Start to write_RTBD: " << chr_id << endl;
-        write_RTBD(OUT, chr_id, rt_array, bd_array, chr_seq, param.out_min_cov);
+        shared_ptr< vector<Map_Records> > records = make_shared< vector<Map_Records> >(i_vec.size());
+        records->swap(record_array);
+        pending.push_back( pool->submit([chr_id, records, &chr_junctions, cSize, &param, &genome]() -> string
+        {
+            ostringstream buffer;
+            count_unit(chr_id, *records, chr_junctions, cSize, param, genome, buffer);
+            return buffer.str();
+        }) );
+    }
 
-        clog << " Finish " << chr_id << endl;
+    while(not pending.empty())
+    {
+        OUT << pending.front().get();
+        pending.pop_front();
     }
 
     for(uLONG i=0; i<i_vec.size(); i++)
     {
-        i_vec[i]->close();
         delete i_vec[i];
     }
 
@@ -357,6 +402,6 @@ int main(int argc, char *argv[])
         clog << "write_junctions" << endl;
         write_junctions(junctions, param.out_junc_file);
     }
-}
-
 
+    clog << "Peak memory: " << peak_rss_kb()/1024 << " MB" << endl;
+}
@@ -0,0 +1,483 @@
+#include "enrich_kernel.h"
+
+#include <cmath>
+#include <cstring>
+#include <cfloat>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define ENRICH_KERNEL_X86
+#include <immintrin.h>
+#endif
+
+/**** SIMD level ****/
+
+SIMD_Level detect_simd_level()
+{
+#ifdef ENRICH_KERNEL_X86
+    __builtin_cpu_init();
+    if(__builtin_cpu_supports("avx2"))
+        return SIMD_AVX2;
+    if(__builtin_cpu_supports("sse2"))
+        return SIMD_SSE2;
+#endif
+    return SIMD_SCALAR;
+}
+
+static SIMD_Level current_level = detect_simd_level();
+
+SIMD_Level simd_level()
+{
+    return current_level;
+}
+
+void set_simd_level(const SIMD_Level &level)
+{
+    current_level = min(level, detect_simd_level());
+}
+
+const char *simd_level_name(const SIMD_Level &level)
+{
+    if(level == SIMD_AVX2)
+        return "AVX2";
+    else if(level == SIMD_SSE2)
+        return "SSE2";
+    else
+        return "scalar";
+}
+
+/**** Scalar kernels, also used for the tails of SIMD kernels ****/
+
+static const float SQRT2 = 1.41421356f;
+
+// coefficients of 2/ln(2) * atanh(r) = log2((1+r)/(1-r))
+static const float LOG2_C1 = 2.88539008f;
+static const float LOG2_C3 = 0.96179669f;
+static const float LOG2_C5 = 0.57707801f;
+static const float LOG2_C7 = 0.41219858f;
+
+// x = m*2^e with m in [sqrt(2)/2, sqrt(2)), log2(m) = log2((1+r)/(1-r)) with r = (m-1)/(m+1), |r| < 0.172
+float fast_log2(const float &value)
+{
+    if(not (value >= FLT_MIN and value <= FLT_MAX))
+        return log2(value);
+
+    uint32_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+    int32_t e = int32_t((bits >> 23) & 0xff) - 127;
+    bits = (bits & 0x7fffff) | 0x3f800000;
+    float m;
+    memcpy(&m, &bits, sizeof(m));
+    if(m > SQRT2)
+    {
+        m = m * 0.5f;
+        e = e + 1;
+    }
+
+    float r = (m - 1.0f) / (m + 1.0f);
+    float r2 = r * r;
+    float p = LOG2_C7;
+    p = p * r2 + LOG2_C5;
+    p = p * r2 + LOG2_C3;
+    p = p * r2 + LOG2_C1;
+    return float(e) + p * r;
+}
+
+static void substraction_scalar(const float *nai_rt, const float *dmso_rt, uLONG i, const uLONG &length,
+                                const float &nai_rt_sf, const float &dmso_rt_sf, const float &sub_fac, float *score)
+{
+    for(; i<length; i++)
+        score[i] = (nai_rt[i]/nai_rt_sf)-sub_fac*(dmso_rt[i]/dmso_rt_sf);
+}
+
+static void dividing_scalar(const float *nai_bd, const float *dmso_bd, uLONG i, const uLONG &length,
+                            const float &nai_bd_sf, const float &dmso_bd_sf, const float &div_fac,
+                            const float &null_value, float *score)
+{
+    for(; i<length; i++)
+        if(dmso_bd[i] > 0)
+            score[i] = div_fac * (nai_bd[i]/nai_bd_sf) / (dmso_bd[i]/dmso_bd_sf);
+        else
+            score[i] = null_value;
+}
+
+static void complex_scalar(const float *nai_rt, const float *dmso_rt, const float *dmso_bd, uLONG i, const uLONG &length,
+                            const float &nai_rt_sf, const float &dmso_rt_sf, const float &dmso_bd_sf,
+                            const float &sub_fac, const float &div_fac, const float &null_value, float *score)
+{
+    for(; i<length; i++)
+        if(dmso_bd[i] > 0)
+            score[i] = div_fac * ((nai_rt[i]/nai_rt_sf)-sub_fac*(dmso_rt[i]/dmso_rt_sf)) / (dmso_bd[i]/dmso_bd_sf);
+        else
+            score[i] = null_value;
+}
+
+// the ratio of log2 in enrich_log
+static void log_ratio_scalar(const float *nai_rt, const float *dmso_rt, uLONG i, const uLONG &length,
+                        const float &add_fac, float *score)
+{
+    for(; i<length; i++)
+        score[i] = (nai_rt[i]+add_fac)/(dmso_rt[i]+add_fac);
+}
+
+static void winsor_scale_scalar(float *score, uLONG i, const uLONG &length, const float &lower, const float &upper, const float &null_value)
+{
+    for(; i<length; i++)
+    {
+        if(score[i] != null_value)
+        {
+            if(score[i] > upper)
+                score[i] = 1;
+            else if(score[i] < lower)
+                score[i] = 0;
+            else
+                score[i] = (score[i] - lower)/(upper-lower);
+        }
+    }
+}
+
+#ifdef ENRICH_KERNEL_X86
+
+/**** SSE2 kernels ****/
+
+static inline __m128 blend_sse2(const __m128 &a, const __m128 &b, const __m128 &mask)
+{
+    return _mm_or_ps(_mm_and_ps(mask, b), _mm_andnot_ps(mask, a));
+}
+
+static uLONG substraction_sse2(const float *nai_rt, const float *dmso_rt, const uLONG &length,
+                                const float &nai_rt_sf, const float &dmso_rt_sf, const float &sub_fac, float *score)
+{
+    const __m128 v_nai_rt_sf = _mm_set1_ps(nai_rt_sf), v_dmso_rt_sf = _mm_set1_ps(dmso_rt_sf), v_sub_fac = _mm_set1_ps(sub_fac);
+    uLONG i = 0;
+    for(; i+4<=length; i+=4)
+    {
+        __m128 nai = _mm_div_ps(_mm_loadu_ps(nai_rt+i), v_nai_rt_sf);
+        __m128 dmso = _mm_div_ps(_mm_loadu_ps(dmso_rt+i), v_dmso_rt_sf);
+        _mm_storeu_ps(score+i, _mm_sub_ps(nai, _mm_mul_ps(v_sub_fac, dmso)));
+    }
+    return i;
+}
+
+static uLONG dividing_sse2(const float *nai_bd, const float *dmso_bd, const uLONG &length,
+                            const float &nai_bd_sf, const float &dmso_bd_sf, const float &div_fac,
+                            const float &null_value, float *score)
+{
+    const __m128 v_nai_bd_sf = _mm_set1_ps(nai_bd_sf), v_dmso_bd_sf = _mm_set1_ps(dmso_bd_sf);
+    const __m128 v_div_fac = _mm_set1_ps(div_fac), v_null = _mm_set1_ps(null_value), zero = _mm_setzero_ps();
+    uLONG i = 0;
+    for(; i+4<=length; i+=4)
+    {
+        __m128 d_bd = _mm_loadu_ps(dmso_bd+i);
+        __m128 nai = _mm_mul_ps(v_div_fac, _mm_div_ps(_mm_loadu_ps(nai_bd+i), v_nai_bd_sf));
+        __m128 value = _mm_div_ps(nai, _mm_div_ps(d_bd, v_dmso_bd_sf));
+        _mm_storeu_ps(score+i, blend_sse2(v_null, value, _mm_cmpgt_ps(d_bd, zero)));
+    }
+    return i;
+}
+
+static uLONG complex_sse2(const float *nai_rt, const float *dmso_rt, const float *dmso_bd, const uLONG &length,
+                        const float &nai_rt_sf, const float &dmso_rt_sf, const float &dmso_bd_sf,
+                        const float &sub_fac, const float &div_fac, const float &null_value, float *score)
+{
+    const __m128 v_nai_rt_sf = _mm_set1_ps(nai_rt_sf), v_dmso_rt_sf = _mm_set1_ps(dmso_rt_sf), v_dmso_bd_sf = _mm_set1_ps(dmso_bd_sf);
+    const __m128 v_sub_fac = _mm_set1_ps(sub_fac), v_div_fac = _mm_set1_ps(div_fac);
+    const __m128 v_null = _mm_set1_ps(null_value), zero = _mm_setzero_ps();
+    uLONG i = 0;
+    for(; i+4<=length; i+=4)
+    {
+        __m128 d_bd = _mm_loadu_ps(dmso_bd+i);
+        __m128 nai = _mm_div_ps(_mm_loadu_ps(nai_rt+i), v_nai_rt_sf);
+        __m128 dmso = _mm_div_ps(_mm_loadu_ps(dmso_rt+i), v_dmso_rt_sf);
+        __m128 value = _mm_mul_ps(v_div_fac, _mm_sub_ps(nai, _mm_mul_ps(v_sub_fac, dmso)));
+        value = _mm_div_ps(value, _mm_div_ps(d_bd, v_dmso_bd_sf));
+        _mm_storeu_ps(score+i, blend_sse2(v_null, value, _mm_cmpgt_ps(d_bd, zero)));
+    }
+    return i;
+}
+
+static uLONG log_ratio_sse2(const float *nai_rt, const float *dmso_rt, const uLONG &length, const float &add_fac, float *score)
+{
+    const __m128 v_add_fac = _mm_set1_ps(add_fac);
+    uLONG i = 0;
+    for(; i+4<=length; i+=4)
+    {
+        __m128 nai = _mm_add_ps(_mm_loadu_ps(nai_rt+i), v_add_fac);
+        __m128 dmso = _mm_add_ps(_mm_loadu_ps(dmso_rt+i), v_add_fac);
+        _mm_storeu_ps(score+i, _mm_div_ps(nai, dmso));
+    }
+    return i;
+}
+
+// fast_log2 of 4 values in place, the invalid values are left for scalar code
+static uLONG fast_log2_sse2(float *values, const uLONG &length)
+{
+    const __m128 v_min = _mm_set1_ps(FLT_MIN), v_max = _mm_set1_ps(FLT_MAX), v_sqrt2 = _mm_set1_ps(SQRT2);
+    const __m128 one = _mm_set1_ps(1.0f), half = _mm_set1_ps(0.5f);
+    const __m128i mantissa_mask = _mm_set1_epi32(0x7fffff), exponent_one = _mm_set1_epi32(0x3f800000);
+    const __m128i bias = _mm_set1_epi32(127), exponent_mask = _mm_set1_epi32(0xff), one_i = _mm_set1_epi32(1);
+    uLONG i = 0;
+    for(; i+4<=length; i+=4)
+    {
+        __m128 x = _mm_loadu_ps(values+i);
+        __m128 valid = _mm_and_ps(_mm_cmpge_ps(x, v_min), _mm_cmple_ps(x, v_max));
+        if(_mm_movemask_ps(valid) != 0xf)
+        {
+            for(uLONG j=i; j<i+4; j++)
+                values[j] = fast_log2(values[j]);
+            continue;
+        }
+
+        __m128i bits = _mm_castps_si128(x);
+        __m128i e = _mm_sub_epi32(_mm_and_si128(_mm_srli_epi32(bits, 23), exponent_mask), bias);
+        __m128 m = _mm_castsi128_ps(_mm_or_si128(_mm_and_si128(bits, mantissa_mask), exponent_one));
+        __m128 big = _mm_cmpgt_ps(m, v_sqrt2);
+        m = blend_sse2(m, _mm_mul_ps(m, half), big);
+        e = _mm_add_epi32(e, _mm_and_si128(_mm_castps_si128(big), one_i));
+
+        __m128 r = _mm_div_ps(_mm_sub_ps(m, one), _mm_add_ps(m, one));
+        __m128 r2 = _mm_mul_ps(r, r);
+        __m128 p = _mm_set1_ps(LOG2_C7);
+        p = _mm_add_ps(_mm_mul_ps(p, r2), _mm_set1_ps(LOG2_C5));
+        p = _mm_add_ps(_mm_mul_ps(p, r2), _mm_set1_ps(LOG2_C3));
+        p = _mm_add_ps(_mm_mul_ps(p, r2), _mm_set1_ps(LOG2_C1));
+        _mm_storeu_ps(values+i, _mm_add_ps(_mm_cvtepi32_ps(e), _mm_mul_ps(p, r)));
+    }
+    return i;
+}
+
+static uLONG winsor_scale_sse2(float *score, const uLONG &length, const float &lower, const float &upper, const float &null_value)
+{
+    const __m128 v_lower = _mm_set1_ps(lower), v_upper = _mm_set1_ps(upper), v_range = _mm_set1_ps(upper-lower);
+    const __m128 v_null = _mm_set1_ps(null_value), zero = _mm_setzero_ps(), one = _mm_set1_ps(1.0f);
+    uLONG i = 0;
+    for(; i+4<=length; i+=4)
+    {
+        __m128 x = _mm_loadu_ps(score+i);
+        __m128 value = _mm_div_ps(_mm_sub_ps(x, v_lower), v_range);
+        value = blend_sse2(value, zero, _mm_cmplt_ps(x, v_lower));
+        value = blend_sse2(value, one, _mm_cmpgt_ps(x, v_upper));
+        value = blend_sse2(value, x, _mm_cmpeq_ps(x, v_null));
+        _mm_storeu_ps(score+i, value);
+    }
+    return i;
+}
+
+/**** AVX2 kernels ****/
+
+#define AVX2_TARGET __attribute__((target("avx2")))
+
+AVX2_TARGET
+static uLONG substraction_avx2(const float *nai_rt, const float *dmso_rt, const uLONG &length,
+                                const float &nai_rt_sf, const float &dmso_rt_sf, const float &sub_fac, float *score)
+{
+    const __m256 v_nai_rt_sf = _mm256_set1_ps(nai_rt_sf), v_dmso_rt_sf = _mm256_set1_ps(dmso_rt_sf), v_sub_fac = _mm256_set1_ps(sub_fac);
+    uLONG i = 0;
+    for(; i+8<=length; i+=8)
+    {
+        __m256 nai = _mm256_div_ps(_mm256_loadu_ps(nai_rt+i), v_nai_rt_sf);
+        __m256 dmso = _mm256_div_ps(_mm256_loadu_ps(dmso_rt+i), v_dmso_rt_sf);
+        _mm256_storeu_ps(score+i, _mm256_sub_ps(nai, _mm256_mul_ps(v_sub_fac, dmso)));
+    }
+    return i;
+}
+
+AVX2_TARGET
+static uLONG dividing_avx2(const float *nai_bd, const float *dmso_bd, const uLONG &length,
+                            const float &nai_bd_sf, const float &dmso_bd_sf, const float &div_fac,
+                            const float &null_value, float *score)
+{
+    const __m256 v_nai_bd_sf = _mm256_set1_ps(nai_bd_sf), v_dmso_bd_sf = _mm256_set1_ps(dmso_bd_sf);
+    const __m256 v_div_fac = _mm256_set1_ps(div_fac), v_null = _mm256_set1_ps(null_value), zero = _mm256_setzero_ps();
+    uLONG i = 0;
+    for(; i+8<=length; i+=8)
+    {
+        __m256 d_bd = _mm256_loadu_ps(dmso_bd+i);
+        __m256 nai = _mm256_mul_ps(v_div_fac, _mm256_div_ps(_mm256_loadu_ps(nai_bd+i), v_nai_bd_sf));
+        __m256 value = _mm256_div_ps(nai, _mm256_div_ps(d_bd, v_dmso_bd_sf));
+        _mm256_storeu_ps(score+i, _mm256_blendv_ps(v_null, value, _mm256_cmp_ps(d_bd, zero, _CMP_GT_OQ)));
+    }
+    return i;
+}
+
+AVX2_TARGET
+static uLONG complex_avx2(const float *nai_rt, const float *dmso_rt, const float *dmso_bd, const uLONG &length,
+                        const float &nai_rt_sf, const float &dmso_rt_sf, const float &dmso_bd_sf,
+                        const float &sub_fac, const float &div_fac, const float &null_value, float *score)
+{
+    const __m256 v_nai_rt_sf = _mm256_set1_ps(nai_rt_sf), v_dmso_rt_sf = _mm256_set1_ps(dmso_rt_sf), v_dmso_bd_sf = _mm256_set1_ps(dmso_bd_sf);
+    const __m256 v_sub_fac = _mm256_set1_ps(sub_fac), v_div_fac = _mm256_set1_ps(div_fac);
+    const __m256 v_null = _mm256_set1_ps(null_value), zero = _mm256_setzero_ps();
+    uLONG i = 0;
+    for(; i+8<=length; i+=8)
+    {
+        __m256 d_bd = _mm256_loadu_ps(dmso_bd+i);
+        __m256 nai = _mm256_div_ps(_mm256_loadu_ps(nai_rt+i), v_nai_rt_sf);
+        __m256 dmso = _mm256_div_ps(_mm256_loadu_ps(dmso_rt+i), v_dmso_rt_sf);
+        __m256 value = _mm256_mul_ps(v_div_fac, _mm256_sub_ps(nai, _mm256_mul_ps(v_sub_fac, dmso)));
+        value = _mm256_div_ps(value, _mm256_div_ps(d_bd, v_dmso_bd_sf));
+        _mm256_storeu_ps(score+i, _mm256_blendv_ps(v_null, value, _mm256_cmp_ps(d_bd, zero, _CMP_GT_OQ)));
+    }
+    return i;
+}
+
+AVX2_TARGET
+static uLONG log_ratio_avx2(const float *nai_rt, const float *dmso_rt, const uLONG &length, const float &add_fac, float *score)
+{
+    const __m256 v_add_fac = _mm256_set1_ps(add_fac);
+    uLONG i = 0;
+    for(; i+8<=length; i+=8)
+    {
+        __m256 nai = _mm256_add_ps(_mm256_loadu_ps(nai_rt+i), v_add_fac);
+        __m256 dmso = _mm256_add_ps(_mm256_loadu_ps(dmso_rt+i), v_add_fac);
+        _mm256_storeu_ps(score+i, _mm256_div_ps(nai, dmso));
+    }
+    return i;
+}
+
+AVX2_TARGET
+static uLONG fast_log2_avx2(float *values, const uLONG &length)
+{
+    const __m256 v_min = _mm256_set1_ps(FLT_MIN), v_max = _mm256_set1_ps(FLT_MAX), v_sqrt2 = _mm256_set1_ps(SQRT2);
+    const __m256 one = _mm256_set1_ps(1.0f), half = _mm256_set1_ps(0.5f);
+    const __m256i mantissa_mask = _mm256_set1_epi32(0x7fffff), exponent_one = _mm256_set1_epi32(0x3f800000);
+    const __m256i bias = _mm256_set1_epi32(127), exponent_mask = _mm256_set1_epi32(0xff), one_i = _mm256_set1_epi32(1);
+    uLONG i = 0;
+    for(; i+8<=length; i+=8)
+    {
+        __m256 x = _mm256_loadu_ps(values+i);
+        __m256 valid = _mm256_and_ps(_mm256_cmp_ps(x, v_min, _CMP_GE_OQ), _mm256_cmp_ps(x, v_max, _CMP_LE_OQ));
+        if(_mm256_movemask_ps(valid) != 0xff)
+        {
+            for(uLONG j=i; j<i+8; j++)
+                values[j] = fast_log2(values[j]);
+            continue;
+        }
+
+        __m256i bits = _mm256_castps_si256(x);
+        __m256i e = _mm256_sub_epi32(_mm256_and_si256(_mm256_srli_epi32(bits, 23), exponent_mask), bias);
+        __m256 m = _mm256_castsi256_ps(_mm256_or_si256(_mm256_and_si256(bits, mantissa_mask), exponent_one));
+        __m256 big = _mm256_cmp_ps(m, v_sqrt2, _CMP_GT_OQ);
+        m = _mm256_blendv_ps(m, _mm256_mul_ps(m, half), big);
+        e = _mm256_add_epi32(e, _mm256_and_si256(_mm256_castps_si256(big), one_i));
+
+        __m256 r = _mm256_div_ps(_mm256_sub_ps(m, one), _mm256_add_ps(m, one));
+        __m256 r2 = _mm256_mul_ps(r, r);
+        __m256 p = _mm256_set1_ps(LOG2_C7);
+        p = _mm256_add_ps(_mm256_mul_ps(p, r2), _mm256_set1_ps(LOG2_C5));
+        p = _mm256_add_ps(_mm256_mul_ps(p, r2), _mm256_set1_ps(LOG2_C3));
+        p = _mm256_add_ps(_mm256_mul_ps(p, r2), _mm256_set1_ps(LOG2_C1));
+        _mm256_storeu_ps(values+i, _mm256_add_ps(_mm256_cvtepi32_ps(e), _mm256_mul_ps(p, r)));
+    }
+    return i;
+}
+
+AVX2_TARGET
+static uLONG winsor_scale_avx2(float *score, const uLONG &length, const float &lower, const float &upper, const float &null_value)
+{
+    const __m256 v_lower = _mm256_set1_ps(lower), v_upper = _mm256_set1_ps(upper), v_range = _mm256_set1_ps(upper-lower);
+    const __m256 v_null = _mm256_set1_ps(null_value), zero = _mm256_setzero_ps(), one = _mm256_set1_ps(1.0f);
+    uLONG i = 0;
+    for(; i+8<=length; i+=8)
+    {
+        __m256 x = _mm256_loadu_ps(score+i);
+        __m256 value = _mm256_div_ps(_mm256_sub_ps(x, v_lower), v_range);
+        value = _mm256_blendv_ps(value, zero, _mm256_cmp_ps(x, v_lower, _CMP_LT_OQ));
+        value = _mm256_blendv_ps(value, one, _mm256_cmp_ps(x, v_upper, _CMP_GT_OQ));
+        value = _mm256_blendv_ps(value, x, _mm256_cmp_ps(x, v_null, _CMP_EQ_OQ));
+        _mm256_storeu_ps(score+i, value);
+    }
+    return i;
+}
+
+#endif // ENRICH_KERNEL_X86
+
+/**** Dispatch, the SIMD kernels return the number of processed values ****/
+
+void enrich_substraction(const float *nai_rt, const float *dmso_rt, const uLONG &length,
+                        const float &nai_rt_sf, const float &dmso_rt_sf, const float &sub_fac, float *score)
+{
+    uLONG i = 0;
+#ifdef ENRICH_KERNEL_X86
+    if(current_level == SIMD_AVX2)
+        i = substraction_avx2(nai_rt, dmso_rt, length, nai_rt_sf, dmso_rt_sf, sub_fac, score);
+    else if(current_level == SIMD_SSE2)
+        i = substraction_sse2(nai_rt, dmso_rt, length, nai_rt_sf, dmso_rt_sf, sub_fac, score);
+#endif
+    substraction_scalar(nai_rt, dmso_rt, i, length, nai_rt_sf, dmso_rt_sf, sub_fac, score);
+}
+
+void enrich_dividing(const float *nai_bd, const float *dmso_bd, const uLONG &length,
+                    const float &nai_bd_sf, const float &dmso_bd_sf, const float &div_fac,
+                    const float &null_value, float *score)
+{
+    uLONG i = 0;
+#ifdef ENRICH_KERNEL_X86
+    if(current_level == SIMD_AVX2)
+        i = dividing_avx2(nai_bd, dmso_bd, length, nai_bd_sf, dmso_bd_sf, div_fac, null_value, score);
+    else if(current_level == SIMD_SSE2)
+        i = dividing_sse2(nai_bd, dmso_bd, length, nai_bd_sf, dmso_bd_sf, div_fac, null_value, score);
+#endif
+    dividing_scalar(nai_bd, dmso_bd, i, length, nai_bd_sf, dmso_bd_sf, div_fac, null_value, score);
+}
+
+void enrich_complex(const float *nai_rt, const float *dmso_rt, const float *dmso_bd, const uLONG &length,
+                    const float &nai_rt_sf, const float &dmso_rt_sf, const float &dmso_bd_sf,
+                    const float &sub_fac, const float &div_fac, const float &null_value, float *score)
+{
+    uLONG i = 0;
+#ifdef ENRICH_KERNEL_X86
+    if(current_level == SIMD_AVX2)
+        i = complex_avx2(nai_rt, dmso_rt, dmso_bd, length, nai_rt_sf, dmso_rt_sf, dmso_bd_sf, sub_fac, div_fac, null_value, score);
+    else if(current_level == SIMD_SSE2)
+        i = complex_sse2(nai_rt, dmso_rt, dmso_bd, length, nai_rt_sf, dmso_rt_sf, dmso_bd_sf, sub_fac, div_fac, null_value, score);
+#endif
+    complex_scalar(nai_rt, dmso_rt, dmso_bd, i, length, nai_rt_sf, dmso_rt_sf, dmso_bd_sf, sub_fac, div_fac, null_value, score);
+}
+
+void enrich_log(const float *nai_rt, const float *dmso_rt, const float *dmso_bd, const uLONG &length,
+                const float &add_fac, const bool &fast_log, const float &null_value, float *score)
+{
+    // 1. ratio
+    uLONG i = 0;
+#ifdef ENRICH_KERNEL_X86
+    if(current_level == SIMD_AVX2)
+        i = log_ratio_avx2(nai_rt, dmso_rt, length, add_fac, score);
+    else if(current_level == SIMD_SSE2)
+        i = log_ratio_sse2(nai_rt, dmso_rt, length, add_fac, score);
+#endif
+    log_ratio_scalar(nai_rt, dmso_rt, i, length, add_fac, score);
+
+    // 2. log2
+    if(fast_log)
+    {
+        i = 0;
+#ifdef ENRICH_KERNEL_X86
+        if(current_level == SIMD_AVX2)
+            i = fast_log2_avx2(score, length);
+        else if(current_level == SIMD_SSE2)
+            i = fast_log2_sse2(score, length);
+#endif
+        for(; i<length; i++)
+            score[i] = fast_log2(score[i]);
+    }else{
+        for(i=0; i<length; i++)
+            score[i] = log2(score[i]);
+    }
+
+    // 3. mask
+    for(i=0; i<length; i++)
+        if(not (dmso_bd[i] > 0))
+            score[i] = null_value;
+}
+
+void winsor_scale(float *score, const uLONG &length, const float &lower, const float &upper, const float &null_value)
+{
+    uLONG i = 0;
+#ifdef ENRICH_KERNEL_X86
+    if(current_level == SIMD_AVX2)
+        i = winsor_scale_avx2(score, length, lower, upper, null_value);
+    else if(current_level == SIMD_SSE2)
+        i = winsor_scale_sse2(score, length, lower, upper, null_value);
+#endif
+    winsor_scale_scalar(score, i, length, lower, upper, null_value);
+}
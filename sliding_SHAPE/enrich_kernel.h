@@ -0,0 +1,60 @@
+#ifndef ENRICH_KERNEL_H
+#define ENRICH_KERNEL_H
+
+#include <pan_type.h>
+
+using namespace std;
+using namespace pan;
+
+/**** Vectorized kernels of icSHAPE enrichment and winsorization ****/
+
+// The kernels work on contiguous arrays with AVX2 or SSE2, selected at runtime by CPU detection,
+// or with scalar code on other CPUs. All levels give the same bits as the scalar formulas,
+// except the fast log2 which is opt-in
+
+enum SIMD_Level { SIMD_SCALAR=0, SIMD_SSE2=1, SIMD_AVX2=2 };
+
+// the best level supported by the CPU
+SIMD_Level detect_simd_level();
+
+// the level used by the kernels, it is detect_simd_level() by default
+SIMD_Level simd_level();
+
+// use a lower level, such as for tests. The level is limited to detect_simd_level()
+void set_simd_level(const SIMD_Level &level);
+
+const char *simd_level_name(const SIMD_Level &level);
+
+// max absolute error of fast_log2 for values in [2^-8, 2^8] (measured 3.5e-7),
+// it grows with |log2(value)| to about 4e-6 at 1e-30
+const float FAST_LOG2_MAX_ERROR = 1e-6;
+
+// log2 by range reduction and a polynomial, see FAST_LOG2_MAX_ERROR.
+// Non-positive, subnormal, infinite and NaN values are passed to log2
+float fast_log2(const float &value);
+
+// score[i] = (nai_rt[i]/nai_rt_sf) - sub_fac*(dmso_rt[i]/dmso_rt_sf)
+void enrich_substraction(const float *nai_rt, const float *dmso_rt, const uLONG &length,
+                        const float &nai_rt_sf, const float &dmso_rt_sf, const float &sub_fac, float *score);
+
+// score[i] = div_fac * (nai_bd[i]/nai_bd_sf) / (dmso_bd[i]/dmso_bd_sf), or null_value if dmso_bd[i] <= 0
+void enrich_dividing(const float *nai_bd, const float *dmso_bd, const uLONG &length,
+                    const float &nai_bd_sf, const float &dmso_bd_sf, const float &div_fac,
+                    const float &null_value, float *score);
+
+// score[i] = div_fac * ((nai_rt[i]/nai_rt_sf)-sub_fac*(dmso_rt[i]/dmso_rt_sf)) / (dmso_bd[i]/dmso_bd_sf),
+// or null_value if dmso_bd[i] <= 0
+void enrich_complex(const float *nai_rt, const float *dmso_rt, const float *dmso_bd, const uLONG &length,
+                    const float &nai_rt_sf, const float &dmso_rt_sf, const float &dmso_bd_sf,
+                    const float &sub_fac, const float &div_fac, const float &null_value, float *score);
+
+// score[i] = log2( (nai_rt[i]+add_fac)/(dmso_rt[i]+add_fac) ), or null_value if dmso_bd[i] <= 0
+// fast_log -- use fast_log2 instead of log2
+void enrich_log(const float *nai_rt, const float *dmso_rt, const float *dmso_bd, const uLONG &length,
+                const float &add_fac, const bool &fast_log, const float &null_value, float *score);
+
+// the clamp/scale pass of winsorization, values equal to null_value are kept:
+//     score[i] = 1 if score[i] > upper; 0 if score[i] < lower; (score[i]-lower)/(upper-lower) otherwise
+void winsor_scale(float *score, const uLONG &length, const float &lower, const float &upper, const float &null_value);
+
+#endif // ENRICH_KERNEL_H
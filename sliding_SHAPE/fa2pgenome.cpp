@@ -0,0 +1,115 @@
+#include <param.h>
+#include <string_split.h>
+
+#include <iostream>
+#include <fstream>
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "version.h"
+#include <packed_genome.h>
+
+using namespace std;
+using namespace pan;
+
+Color::Modifier RED(Color::FG_RED);
+Color::Modifier DEF(Color::FG_DEFAULT);
+Color::Modifier YELLOW(Color::FG_YELLOW);
+
+void print_usage()
+{
+    char buff[2000];
+    const char *help_info =
+            "fa2pgenome - pack a genome fasta file into a 2-bit .pgenome file, it can be given to -genome of calc_sliding_shape and countRT\n"
+            "=============================================================\n"
+            "\e[1mUSAGE:\e[0m\n"
+            "\tfa2pgenome -in genome.fa -out genome.pgenome\n"
+            "\e[1mHELP:\e[0m\n"
+            "\t-in: input a genome fasta file\n"
+            "\t-out: output a .pgenome file\n\n"
+
+            "\e[1mVERSION:\e[0m\n\t%s\n"
+            "\e[1mLIB VERSION:\e[0m\n\t%s\n"
+            "\e[1mCOMPILE DATE:\e[0m\n\t%s\n"
+            "\e[1mAUTHOR:\e[0m\n\t%s\n";
+
+    sprintf(buff, help_info, BINVERSION, LIBVERSION, DATE, "Li Pan");
+    cerr << buff << endl;
+}
+
+struct Param
+{
+    string input_file;
+    string output_file;
+
+    operator bool()
+    {
+        return input_file.empty() or output_file.empty() ? false : true;
+    }
+};
+
+void has_next(int argc, int current)
+{
+    if(current + 1 >= argc)
+    {
+        cerr << RED << "FATAL ERROR: Parameter Error" << DEF << endl;
+        print_usage();
+        exit(-1);
+    }
+}
+
+Param read_param(int argc, char *argv[])
+{
+    Param param;
+    for(int i=1; i<argc; i++)
+    {
+        if( argv[i][0] == '-' )
+        {
+            if(not strcmp(argv[i]+1, "in"))
+            {
+                has_next(argc, i);
+                param.input_file = argv[i+1];
+                i++;
+            }else if(not strcmp(argv[i]+1, "out"))
+            {
+                has_next(argc, i);
+                param.output_file = argv[i+1];
+                i++;
+            }else{
+                cerr << RED << "FATAL ERROR: unknown option: " << argv[i] << DEF << endl;
+                print_usage();
+                exit(-1);
+            }
+        }else{
+            cerr << RED << "FATAL ERROR: unknown option: " << argv[i] << DEF << endl;
+            print_usage();
+            exit(-1);
+        }
+    }
+    return param;
+}
+
+int main(int argc, char *argv[])
+{
+    Param param = read_param(argc, argv);
+    if(not param)
+    {
+        print_usage();
+        exit(-1);
+    }
+
+    if(not is_packed_genome_file(param.output_file))
+        cerr << YELLOW << "Warning: " << param.output_file << " should end with .pgenome to be read as a packed genome" << DEF << endl;
+
+    try{
+        Packed_Genome::build(param.input_file, param.output_file);
+        Packed_Genome genome(param.output_file);
+        clog << "Packed " << genome.get_chr_num() << " sequences" << endl;
+    }catch(runtime_error &e){
+        cerr << RED << e.what() << DEF << endl;
+        exit(-1);
+    }
+
+    return 0;
+}
@@ -0,0 +1,157 @@
+#include <param.h>
+#include <string_split.h>
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "version.h"
+#include <gtab_file.h>
+
+using namespace std;
+using namespace pan;
+
+Color::Modifier RED(Color::FG_RED);
+Color::Modifier DEF(Color::FG_DEFAULT);
+Color::Modifier YELLOW(Color::FG_YELLOW);
+
+void print_usage()
+{
+    char buff[2000];
+    const char *help_info =
+            "gtab view - print a binary .bgTab file generated by calc_sliding_shape as a text gTab file\n"
+            "=============================================================\n"
+            "\e[1mUSAGE:\e[0m\n"
+            "\tgtab view -in input.bgTab [-out output.gTab] [-chr chr1+]\n"
+            "\e[1mHELP:\e[0m\n"
+            "\t-in: input a .bgTab file\n"
+            "\t-out: output a text gTab file (default: stdout)\n"
+            "\t-chr: only output a chromosome and strand, eg. chr1+ (default: all)\n\n"
+
+            "\e[1mVERSION:\e[0m\n\t%s\n"
+            "\e[1mLIB VERSION:\e[0m\n\t%s\n"
+            "\e[1mCOMPILE DATE:\e[0m\n\t%s\n"
+            "\e[1mAUTHOR:\e[0m\n\t%s\n";
+
+    sprintf(buff, help_info, BINVERSION, LIBVERSION, DATE, "Li Pan");
+    cerr << buff << endl;
+}
+
+struct Param
+{
+    string input_file;
+    string output_file;
+    string chr_id;
+
+    operator bool()
+    {
+        return input_file.empty() ? false : true;
+    }
+};
+
+void has_next(int argc, int current)
+{
+    if(current + 1 >= argc)
+    {
+        cerr << RED << "FATAL ERROR: Parameter Error" << DEF << endl;
+        print_usage();
+        exit(-1);
+    }
+}
+
+Param read_param(int argc, char *argv[])
+{
+    Param param;
+    if(argc < 2 or strcmp(argv[1], "view"))
+    {
+        print_usage();
+        exit(-1);
+    }
+    for(int i=2; i<argc; i++)
+    {
+        if( argv[i][0] == '-' )
+        {
+            if(not strcmp(argv[i]+1, "in"))
+            {
+                has_next(argc, i);
+                param.input_file = argv[i+1];
+                i++;
+            }else if(not strcmp(argv[i]+1, "out"))
+            {
+                has_next(argc, i);
+                param.output_file = argv[i+1];
+                i++;
+            }else if(not strcmp(argv[i]+1, "chr"))
+            {
+                has_next(argc, i);
+                param.chr_id = argv[i+1];
+                i++;
+            }else{
+                cerr << RED << "FATAL ERROR: unknown option: " << argv[i] << DEF << endl;
+                print_usage();
+                exit(-1);
+            }
+        }else{
+            cerr << RED << "FATAL ERROR: unknown option: " << argv[i] << DEF << endl;
+            print_usage();
+            exit(-1);
+        }
+    }
+    return param;
+}
+
+void view_gtab(const Param &param)
+{
+    BGTab_Reader IN(param.input_file);
+
+    ofstream OUT_FILE;
+    if(not param.output_file.empty())
+    {
+        OUT_FILE.open(param.output_file, ofstream::out);
+        if(not OUT_FILE)
+        {
+            cerr << RED << "FATAL Error: cannot write " << param.output_file << DEF << endl;
+            exit(-1);
+        }
+    }
+    ostream &OUT = param.output_file.empty() ? cout : OUT_FILE;
+    Fast_Writer writer(OUT);
+    writer << IN.head();
+
+    GTab_Records records;
+    if(not param.chr_id.empty())
+    {
+        if(not IN.load_chr(param.chr_id, records))
+        {
+            cerr << RED << "FATAL Error: " << param.chr_id << " is not in " << param.input_file << DEF << endl;
+            exit(-1);
+        }
+        write_gtab_text(records, IN.layout(), writer);
+    }else{
+        while(IN.read_chr(records))
+            write_gtab_text(records, IN.layout(), writer);
+    }
+    writer.flush();
+}
+
+int main(int argc, char *argv[])
+{
+    Param param = read_param(argc, argv);
+    if(not param)
+    {
+        print_usage();
+        exit(-1);
+    }
+
+    try{
+        view_gtab(param);
+    }catch(runtime_error &e){
+        cerr << RED << e.what() << DEF << endl;
+        exit(-1);
+    }
+
+    return 0;
+}
@@ -1,5 +1,6 @@
 #include <paris.h>
 #include <param.h>
+#include <thread_pool.h>
 
 #include <iostream>
 #include <fstream>
@@ -7,12 +8,16 @@
 #include <stdexcept>
 #include <unordered_map>
 #include <sstream>
+#include <queue>
+#include <deque>
+#include <numeric>
 
 #include <stdio.h>      /* printf, scanf, puts, NULL */
 #include <stdlib.h>     /* srand, rand */
 #include <time.h>       /* time */
 
 #include "version.h"
+#include "tab_file.h"
 
 using namespace std;
 using namespace pan;
@@ -30,12 +35,14 @@ void print_usage()
             "sam2tab - covert sam file to a tab-seperated file\n"
             "=============================================================\n"
             "\e[1mUSAGE:\e[0m\n"
-            "\tsam2tab -in input_sam -out output_tab -sort yes -ruj yes\n"
+            "\tsam2tab -in input_sam -out output_tab -sort yes -ruj yes -mem 4G -threads 8\n"
             "\e[1mHELP:\e[0m\n"
             "\t-in: input a sam or bam file, the file extension should be .sam or .bam\n"
-            "\t-out: output a tab-seperated file \n"
+            "\t-out: output a tab-seperated file (with a .idx index), or a binary compressed file if it ends with .btab \n"
             "\t-sort: <yes/no> whether to sort the output file (default: yes)\n"
-            "\t-ruj: <yes/no> whether to remove reads with unannotated junctions, only useful for .sam file (default: yes)\n\n"
+            "\t-ruj: <yes/no> whether to remove reads with unannotated junctions, only useful for .sam file (default: yes)\n"
+            "\t-mem: <int>[K/M/G] memory bound for the records; sorted runs are spilled to temporary files and merged when exceeded (default: no limit)\n"
+            "\t-threads: <int> threads to decompress bam and convert records (default: 1)\n\n"
 
             "\e[1mWARNING:\e[0m\n\t%s\n"
             "\e[1mVERSION:\e[0m\n\t%s\n"
@@ -58,6 +65,9 @@ struct Param
     bool will_sort = true;
     bool rem_anno_junc = true;
 
+    uLONG max_mem = 0;
+    uINT threads = 1;
+
     operator bool()
     { 
         return input_file.empty() or output_file.empty() ? false : true; 
@@ -66,6 +76,28 @@ struct Param
 };
 
 
+// parse memory size such as 512M, 4G; return 0 for invalid input
+uLONG parse_mem_size(const string &mem_str)
+{
+    if(mem_str.empty())
+        return 0;
+
+    uLONG unit = 1;
+    string digits = mem_str;
+    switch(toupper(digits.back()))
+    {
+        case 'K': unit = 1UL << 10; digits.pop_back(); break;
+        case 'M': unit = 1UL << 20; digits.pop_back(); break;
+        case 'G': unit = 1UL << 30; digits.pop_back(); break;
+        default: break;
+    }
+
+    if(digits.empty() or digits.find_first_not_of("0123456789") != string::npos)
+        return 0;
+
+    return stoul(digits) * unit;
+}
+
 void has_next(int argc, int current)
 {
     if(current + 1 >= argc)
@@ -79,7 +111,7 @@ void has_next(int argc, int current)
 Param read_param(int argc, char *argv[])
 {
     Param param;
-    for(size_t i=1; i<argc; i++)
+    for(int i=1; i<argc; i++)
     {
         if( argv[i][0] == '-' )
         {
@@ -109,6 +141,21 @@ Param read_param(int argc, char *argv[])
                 else
                     param.rem_anno_junc = false;
                 i++;
+            }else if(not strcmp(argv[i]+1, "mem"))
+            {
+                has_next(argc, i);
+                param.max_mem = parse_mem_size(argv[i+1]);
+                if(param.max_mem == 0)
+                {
+                    cerr << RED << "FATAL ERROR: invalid memory size: " << argv[i+1] << DEF << endl;
+                    exit(-1);
+                }
+                i++;
+            }else if(not strcmp(argv[i]+1, "threads"))
+            {
+                has_next(argc, i);
+                param.threads = max(1, atoi(argv[i+1]));
+                i++;
             }else{
                 cerr << RED << "FATAL ERROR: unknown option: " << argv[i] << DEF << endl;
                 print_usage();
@@ -125,33 +172,29 @@ Param read_param(int argc, char *argv[])
 
 enum STRAND{ NEG=0, POS=1 };
 
-struct Map_Record
+// approximate heap bytes taken by a record: its regions, offset and sort index
+inline uLONG record_mem_size(const Record_View &record)
 {
+    return record.size()*sizeof(Region) + 2*sizeof(uLONG);
+}
 
-    STRAND strand = POS;
-
-    vector<Region> regions;
-
-    Map_Record(const vector<Region> &regions, const STRAND &strand): strand(strand), regions(regions){ }
-
-    Map_Record() = default;
-};
-
+// records of a chr_id+strand, the regions of all records are in a single pool
 struct RecordArray
 {
-    vector<Map_Record *> content;
+    STRAND strand;
+    Tab_Records content;
+    vector<uLONG> order;                    // sorted record indexes, empty if not sorted
 
-    void clear()
-    {
-        for(Map_Record *p: content)
-            delete p;
+    RecordArray(const STRAND &strand): strand(strand){ }
 
-        content.clear();
-    }
+    uLONG size() const { return content.size(); }
+    // record i in the sorted order if sorted
+    Record_View record(const uLONG &i) const { return content[order.empty() ? i : order[i]]; }
 
-    ~RecordArray()
+    void clear()
     {
-        clear();
+        content.clear();
+        order.clear();
     }
 };
 
@@ -173,50 +216,408 @@ struct MapChrRecord
     }
 };
 
-/*  sort duplex group by read coordination for PARIS analysis  */
-bool Sort_Map_Record(const Map_Record* const mr_1, const Map_Record* const mr_2)
+/*  sort duplex group by read coordination for PARIS analysis, the records 
+    are of the same strand. The order is total (ties broken by the full region 
+    list), so the in-memory sort and the external merge produce identical files  */
+bool Sort_Map_Record(const STRAND &strand, const Record_View &mr_1, const Record_View &mr_2)
+{
+    auto &s1 = mr_1.front().first;
+    auto &e1 = mr_1.back().second;
+
+    auto &s2 = mr_2.front().first;
+    auto &e2 = mr_2.back().second;
+
+    if(strand == POS)
+    {
+        if(s1<s2)
+            return true;
+        else if(s1>s2)
+            return false;
+        else{
+            if(e1<e2)
+                return true;
+            else if(e1>e2)
+                return false;
+            else
+                return mr_1 < mr_2;
+        }
+    }else{
+        if(e1<e2)
+            return false;
+        else if(e1>e2)
+            return true;
+        else{
+            if(s1<s2)
+                return false;
+            else if(s1>s2)
+                return true;
+            else
+                return mr_1 < mr_2;
+        }
+    }
+}
+
+// sorted list of chr_id+strand keys
+StringArray sorted_chr_list(const MapChrRecord &mapChrRecords)
+{
+    StringArray chr_list;
+    for(auto it=mapChrRecords.content.begin(); it!=mapChrRecords.content.end(); it++)
+        chr_list.push_back(it->first);
+    std::sort(chr_list.begin(), chr_list.end());
+    return chr_list;
+}
+
+void sort_records(MapChrRecord &mapChrRecords)
+{
+    for(auto it=mapChrRecords.content.begin(); it!=mapChrRecords.content.end(); it++)
+    {
+        RecordArray *records = it->second;
+        records->order.resize(records->size());
+        iota(records->order.begin(), records->order.end(), 0);
+        sort(records->order.begin(), records->order.end(), [records](const uLONG &i, const uLONG &j)
+            { return Sort_Map_Record(records->strand, records->content[i], records->content[j]); });
+    }
+}
+
+void write_records(Tab_Writer &OUT, const MapChrRecord &mapChrRecords, const StringArray &chr_list)
 {
-    auto &st1 = mr_1->strand;
-    auto &st2 = mr_2->strand;
-    
-    auto &s1 = mr_1->regions.front().first;
-    auto &e1 = mr_1->regions.back().second;
+    for(auto it=chr_list.begin(); it!=chr_list.end(); it++)
+    {
+        const string &chr_id_strand = *it;
+
+        const string chr_id = chr_id_strand.substr(0, chr_id_strand.size()-1);
+        const char strand = chr_id_strand[chr_id_strand.size()-1];
+        
+        const RecordArray *records = mapChrRecords.content.at(chr_id_strand);
+        for(uLONG i=0; i<records->size(); i++)
+            OUT.write(chr_id, strand, records->record(i));
+    }
+}
+
+/*  Sort (if required) the buffered records, write them to a new run file 
+    and release them  */
+void spill_run(MapChrRecord &mapChrRecords, const Param &param, const string &run_file)
+{
+    if(param.will_sort)
+        sort_records(mapChrRecords);
 
-    auto &s2 = mr_2->regions.front().first;
-    auto &e2 = mr_2->regions.back().second;
+    Text_Tab_Writer RUN(run_file, false);
+    write_records(RUN, mapChrRecords, sorted_chr_list(mapChrRecords));
+    RUN.close();
 
-    if(st1<st2)
+    for(auto it=mapChrRecords.content.begin(); it!=mapChrRecords.content.end(); it++)
+    {
+        it->second->clear();
+        it->second->content.regions.shrink_to_fit();
+        it->second->content.offsets.shrink_to_fit();
+        it->second->order.shrink_to_fit();
+    }
+}
+
+// the current line of a run file
+struct Run_Cursor
+{
+    ifstream IN;
+    uINT run_id;
+
+    string line;
+    FieldArray data;
+    string chr_id;
+    char strand;
+    string chr_id_strand;
+    STRAND record_strand;
+    RegionArray regions;
+
+    bool next()
+    {
+        if(not getline(IN, line))
+            return false;
+
+        split(line, '\t', data);
+        if(data.size() < 2 or data.size() % 2 != 0)
+            throw Unexpected_Error("Bad run file line: "+line);
+
+        chr_id.assign(data[0].data(), data[0].size());
+        strand = data[1][0];
+        chr_id_strand.assign(chr_id).append(data[1].data(), data[1].size());
+        record_strand = data[1] == "+" ? POS : NEG;
+        regions.clear();
+        for(size_t i=2; i<data.size(); i+=2)
+            regions.push_back( Region(parse_uLONG(data[i]), parse_uLONG(data[i+1])) );
         return true;
-    else if(st1>st2)
-        return false;
-    else{
-        if(st1 == POS)
+    }
+};
+
+// heap order: chr_id+strand, then record (if sorted), then run
+struct Run_Cursor_Greater
+{
+    bool will_sort;
+
+    Run_Cursor_Greater(bool will_sort): will_sort(will_sort){ }
+
+    bool operator()(const Run_Cursor *c1, const Run_Cursor *c2) const
+    {
+        if(c1->chr_id_strand != c2->chr_id_strand)
+            return c1->chr_id_strand > c2->chr_id_strand;
+        if(will_sort)
         {
-            if(s1<s2)
+            if(Sort_Map_Record(c1->record_strand, c2->regions, c1->regions))
                 return true;
-            else if(s1>s2)
+            if(Sort_Map_Record(c1->record_strand, c1->regions, c2->regions))
                 return false;
-            else{
-                if(e1<e2)
-                    return true;
-                else
-                    return false;
-            }
-        }else{
-            if(e1<e2)
-                return false;
-            else if(e1>e2)
+        }
+        return c1->run_id > c2->run_id;
+    }
+};
+
+// k-way merge of the sorted run files
+void merge_runs(const StringArray &run_files, Tab_Writer &OUT, bool will_sort)
+{
+    vector<Run_Cursor *> cursors;
+    priority_queue<Run_Cursor *, vector<Run_Cursor *>, Run_Cursor_Greater> heap( (Run_Cursor_Greater(will_sort)) );
+
+    for(uINT i=0; i<run_files.size(); i++)
+    {
+        Run_Cursor *cursor = new Run_Cursor;
+        cursor->run_id = i;
+        cursor->IN.open(run_files[i], ifstream::in);
+        if(not cursor->IN)
+        {
+            cerr << RED << "FATAL Error: cannot read " << run_files[i] << DEF << endl;
+            exit(-1);
+        }
+        cursors.push_back(cursor);
+        if(cursor->next())
+            heap.push(cursor);
+    }
+
+    while(not heap.empty())
+    {
+        Run_Cursor *cursor = heap.top();
+        heap.pop();
+        OUT.write(cursor->chr_id, cursor->strand, cursor->regions);
+        if(cursor->next())
+            heap.push(cursor);
+    }
+
+    for(Run_Cursor *cursor: cursors)
+    {
+        cursor->IN.close();
+        delete cursor;
+    }
+}
+
+// whether the read has an unannotated junction (STAR jM:B:c code 0-6)
+bool has_unanno_junction(const Sam_Record &read_record)
+{
+    for(const string &attr: read_record.attributes)
+    {
+        const string &title = attr.substr(0, 6);
+        if(title == "jM:B:c")
+        {
+            const string code_list = attr.substr(7);
+            StringArray codes;
+            split(code_list, ',', codes);
+            long code = stol(codes[0]);
+            if( code >= 0 and code <= 6 )
                 return true;
-            else{
-                if(s1<=s2)
-                    return false;
-                else
-                    return true;
+        }
+    }
+    return false;
+}
+
+/*  Collect converted records in reading order. When param.max_mem is 
+    exceeded, the records are spilled to a sorted run file  */
+struct Record_Buffer
+{
+    MapChrRecord &mapChrRecords;
+    const Param &param;
+    const string run_prefix;
+
+    uLONG used_mem = 0;
+    StringArray run_files;
+
+    Record_Buffer(MapChrRecord &mapChrRecords, const Param &param, const string &run_prefix): 
+        mapChrRecords(mapChrRecords), param(param), run_prefix(run_prefix) { }
+
+    void add(RecordArray *records, const Record_View &record)
+    {
+        records->content.push_back( record );
+        used_mem += record_mem_size(record);
+        if(param.max_mem and used_mem >= param.max_mem)
+        {
+            cerr << "\t spill sorted run " << run_prefix << ".run" << run_files.size() << endl;
+            spill();
+        }
+    }
+
+    void spill()
+    {
+        const string run_file = run_prefix + ".run" + to_string(run_files.size());
+        spill_run(mapChrRecords, param, run_file);
+        run_files.push_back(run_file);
+        used_mem = 0;
+    }
+};
+
+/*  A batch of raw records converted by a worker. Converted records of sam 
+    input carry their chr_id+strand, those of bam input carry tid*2+strand  */
+struct Record_Batch
+{
+    vector<bam1_t *> bam_records;
+    StringArray sam_lines;
+
+    Tab_Records records;
+    StringArray keys;
+    vector<int32_t> bucket_ids;
+    uLONG removed_unanno = 0;
+
+    uLONG size() const { return bam_records.size() + sam_lines.size(); }
+};
+
+void convert_sam_batch(Record_Batch *batch, const Param &param)
+{
+    Sam_Record read_record;
+    RegionArray matchRegion;
+    for(const string &cur_line: batch->sam_lines)
+    {
+        parse_sam_record(cur_line, read_record);
+        if(not read_is_mapped(read_record))
+            continue;
+
+        if(param.rem_anno_junc and has_unanno_junction(read_record))
+        {
+            ++batch->removed_unanno;
+            continue;
+        }
+
+        // an unrecognized cigar or "*" has no region
+        get_global_match_region(read_record.cigar, read_record.pos, matchRegion);
+        if(matchRegion.empty())
+            continue;
+        batch->records.push_back( matchRegion );
+        batch->keys.push_back( read_record.chr_id+read_record.strand() );
+    }
+    batch->sam_lines.clear();
+}
+
+// the jM tag is not decoded from bam (see getBamTag), so -ruj does not apply
+void convert_bam_batch(Record_Batch *batch)
+{
+    RegionArray matchRegion;
+    for(bam1_t *record: batch->bam_records)
+    {
+        const uint16_t flag = getBamFlag(record);
+        if(not (flag & 4))
+        {
+            // the record of an unrecognized cigar or "*" (no cigar) is skipped
+            if(not getBamMatchRegion(record, matchRegion))
+                cerr << "Unrecognized Cigar Alpha: " << getBamCigar(record) << endl;
+            else if(not matchRegion.empty())
+            {
+                const STRAND strand = (flag & 16) ? NEG : POS;
+                batch->records.push_back( matchRegion );
+                batch->bucket_ids.push_back( record->core.tid*2 + (strand == POS ? 0 : 1) );
             }
         }
+        bam_destroy1(record);
     }
+    batch->bam_records.clear();
 }
 
+/*  Read batches of records on the main thread and convert them on a pool 
+    of workers; the batches are collected in reading order, so the output 
+    is the same as the single-threaded reading  */
+void read_records_threaded(BGZF* bam_hd, bam_hdr_t *hdr, istream *IN, const Param &param, 
+    Record_Buffer &record_buffer, uLONG &lineCount, uLONG &removed_unanno)
+{
+    const uLONG batch_size = 10000;
+    const uINT max_pending = 4 * param.threads;
+
+    vector<RecordArray *> bam_buckets;
+    if(bam_hd)
+    {
+        bgzf_mt(bam_hd, param.threads, 256);
+        for(int32_t tid=0; tid<hdr->n_targets; tid++)
+        {
+            const string chr_id = hdr->target_name[tid];
+            bam_buckets.push_back( record_buffer.mapChrRecords.content[chr_id+"+"] );
+            bam_buckets.push_back( record_buffer.mapChrRecords.content[chr_id+"-"] );
+        }
+    }
+
+    auto collect = [&](Record_Batch *batch)
+    {
+        removed_unanno += batch->removed_unanno;
+        for(size_t i=0; i<batch->records.size(); i++)
+        {
+            RecordArray *records = bam_hd ? bam_buckets.at(batch->bucket_ids[i]) : 
+                record_buffer.mapChrRecords.content[batch->keys[i]];
+            record_buffer.add(records, batch->records[i]);
+        }
+        delete batch;
+    };
+
+    Thread_Pool pool(param.threads);
+    std::deque< std::future<Record_Batch *> > pending;
+    bool more = true;
+    while(more)
+    {
+        Record_Batch *batch = new Record_Batch;
+        if(bam_hd)
+        {
+            while(batch->size() < batch_size)
+            {
+                bam1_t *record = bam_init1();
+                if(bam_read1(bam_hd, record) < 0)
+                {
+                    bam_destroy1(record);
+                    more = false;
+                    break;
+                }
+                batch->bam_records.push_back(record);
+            }
+        }else{
+            string cur_line;
+            while(batch->size() < batch_size)
+            {
+                if(not read_a_sam_line(*IN, cur_line))
+                {
+                    more = false;
+                    break;
+                }
+                batch->sam_lines.push_back(cur_line);
+            }
+        }
+
+        for(uLONG i=0; i<batch->size(); i++)
+            if(++lineCount % 1000000 == 0)
+                cerr << "\t lines " << lineCount << endl;
+
+        if(batch->size() == 0)
+        {
+            delete batch;
+            break;
+        }
+
+        if(bam_hd)
+            pending.push_back( pool.submit([batch](){ convert_bam_batch(batch); return batch; }) );
+        else
+            pending.push_back( pool.submit([batch, &param](){ convert_sam_batch(batch, param); return batch; }) );
+
+        if(pending.size() >= max_pending)
+        {
+            collect(pending.front().get());
+            pending.pop_front();
+        }
+    }
+
+    while(not pending.empty())
+    {
+        collect(pending.front().get());
+        pending.pop_front();
+    }
+}
 
 void sam2tab(const Param &param)
 {
@@ -225,7 +626,6 @@ void sam2tab(const Param &param)
 
     BGZF* bam_hd = nullptr;
     bam_hdr_t *hdr = nullptr;
-    Sam_Record *p = nullptr;
     ifstream IN;
 
     if( endswith(param.input_file, ".bam") )
@@ -267,8 +667,8 @@ void sam2tab(const Param &param)
         for(auto it=sam_head.trans_len.cbegin(); it!=sam_head.trans_len.cend(); it++)
         {
             const string &chr_id = it->first;
-            mapChrRecords.content[chr_id+"+"] = new RecordArray;
-            mapChrRecords.content[chr_id+"-"] = new RecordArray;
+            mapChrRecords.content[chr_id+"+"] = new RecordArray(POS);
+            mapChrRecords.content[chr_id+"-"] = new RecordArray(NEG);
         }
     }else{
         cerr << RED << "FATAL Error: Read sam head fail..." << DEF << endl;
@@ -277,56 +677,47 @@ void sam2tab(const Param &param)
 
     cerr << "Start to read records... " << endl;
 
+    Record_Buffer record_buffer(mapChrRecords, param, param.output_file + "." + randID);
     uLONG removed_unanno = 0;
     uLONG lineCount = 0;
-    Sam_Record read_record;
 
-    while(1) 
+    if(param.threads > 1)
     {
         if(bam_hd)
-            success = read_a_sam_record(bam_hd, hdr, read_record);
+            read_records_threaded(bam_hd, hdr, nullptr, param, record_buffer, lineCount, removed_unanno);
         else
-            success = read_a_sam_record(IN, read_record);
+            read_records_threaded(nullptr, nullptr, &IN, param, record_buffer, lineCount, removed_unanno);
+    }else{
+        Sam_Record read_record;
+        RegionArray matchRegion;
+        while(1) 
+        {
+            if(bam_hd)
+                success = read_a_sam_record(bam_hd, hdr, read_record);
+            else
+                success = read_a_sam_record(IN, read_record);
 
-        if(not success)
-            break;
+            if(not success)
+                break;
 
-        ++lineCount;
-        if(lineCount % 1000000 == 0)
-            cerr << "\t lines " << lineCount << endl;
+            ++lineCount;
+            if(lineCount % 1000000 == 0)
+                cerr << "\t lines " << lineCount << endl;
 
-        if(not read_is_mapped(read_record))
-            continue;
+            if(not read_is_mapped(read_record))
+                continue;
 
-        if(param.rem_anno_junc)
-        {
-            bool remove = false;
-            for(const string &attr: read_record.attributes)
-            {
-                const string &title = attr.substr(0, 6);
-                if(title == "jM:B:c")
-                {
-                    const string code_list = attr.substr(7);
-                    StringArray codes;
-                    split(code_list, ',', codes);
-                    long code = stol(codes[0]);
-                    if( code >= 0 and code <= 6 )
-                    {
-                        remove = true;
-                        break;
-                    }
-                }
-            }
-            if(remove)
+            if(param.rem_anno_junc and has_unanno_junction(read_record))
             {
                 ++removed_unanno;
                 continue;
             }
-        }
 
-        RegionArray matchRegion;
-        get_global_match_region(read_record.cigar, read_record.pos, matchRegion);
-        mapChrRecords.content[read_record.chr_id+read_record.strand()]->content.push_back( new Map_Record(matchRegion, read_record.strand() == '+' ? POS : NEG) );
+            get_global_match_region(read_record.cigar, read_record.pos, matchRegion);
+            if(matchRegion.empty())
+                continue;
+            record_buffer.add(mapChrRecords.content[read_record.chr_id+read_record.strand()], matchRegion);
+        }
     }
 
     if(bam_hd)
@@ -340,46 +731,30 @@ void sam2tab(const Param &param)
         cerr << "remove " << removed_unanno << " reads with unannotated junctions" << endl;
     }
 
-    if(param.will_sort)
+    StringArray &run_files = record_buffer.run_files;
+    if(not run_files.empty())
+        record_buffer.spill();
+
+    if(param.will_sort and run_files.empty())
     {
         cerr << "Start to sort..." << endl;
-        for(auto it=mapChrRecords.content.begin(); it!=mapChrRecords.content.end(); it++)
-        {
-            const string &chr_id = it->first;
-            sort(it->second->content.begin(), it->second->content.end(), Sort_Map_Record);
-        }
+        sort_records(mapChrRecords);
     }
 
     cerr << "Start to output..." << endl;
-    ofstream OUT(param.output_file, ofstream::out);
-    if(not OUT)
-    {
-        cerr << RED << "FATAL Error: cannot write " << param.output_file << DEF << endl;
-        exit(-1);
-    }
+    Tab_Writer *OUT = open_tab_writer(param.output_file);
 
-    StringArray chr_list;
-    for(auto it=mapChrRecords.content.begin(); it!=mapChrRecords.content.end(); it++)
-        chr_list.push_back(it->first);
-    std::sort(chr_list.begin(), chr_list.end());
-    
-    for(auto it=chr_list.begin(); it!=chr_list.end(); it++)
+    if(run_files.empty())
     {
-        const string &chr_id_strand = *it;
-
-        const string chr_id = chr_id_strand.substr(0, chr_id_strand.size()-1);
-        const char strand = chr_id_strand[chr_id_strand.size()-1];
-        
-        const auto &records = mapChrRecords.content.at(chr_id_strand);
-        for(auto it2=records->content.cbegin(); it2!=records->content.cend(); it2++)
-        {
-            OUT << chr_id << '\t' << strand;
-            for(const Region &r: (*it2)->regions)
-                OUT << '\t' << r.first << '\t' << r.second;
-            OUT << '\n';
-        }
+        write_records(*OUT, mapChrRecords, sorted_chr_list(mapChrRecords));
+    }else{
+        cerr << "Start to merge " << run_files.size() << " runs..." << endl;
+        merge_runs(run_files, *OUT, param.will_sort);
+        for(const string &run_file: run_files)
+            remove(run_file.c_str());
     }
-    OUT.close();
+    OUT->close();
+    delete OUT;
 }
 
 
@@ -1,31 +1,14 @@
 
 #include "sliding_shape.h"
 #include <math.h>
+#include <queue>
+#include <sys/resource.h>
 
 Color::Modifier RED(Color::FG_RED);
 Color::Modifier DEF(Color::FG_DEFAULT);
 Color::Modifier YELLOW(Color::FG_YELLOW);
 
 
-Map_Record::Map_Record(const StringArray &line_data)
-{
-    if(line_data[1] == "+")
-        strand = POSITIVE;
-    else
-        strand = NEGATIVE;
-
-    for(auto it=line_data.cbegin()+2; it!=line_data.cend(); it+=2)
-        regions.emplace_back( stoul(*it), stoul(*(it+1)) );
-
-    if(regions.size() == 0)
-    {
-        string str;
-        for(string v: line_data)
-            str += v;
-        throw Unexpected_Error("FATAL Error: invliad line: "+str);
-    }
-}
-
 /**** Junctions ****/
 
 // read sjdbList.fromGTF.out.tab file (in STAR index directory)
@@ -40,14 +23,14 @@ void load_junctions(const string &file_name, MapStringT<JunctionArray> &junction
     }
 
     string line;
+    FieldArray data;
     while(getline(IN, line))
     {
-        StringArray data;
         split(line, data);
 
-        const string chr_id = data[0]+data[3];
-        uLONG s = stoul(data[1]);
-        uLONG e = stoul(data[2]);
+        const string chr_id = data[0].str()+data[3].str();
+        uLONG s = parse_uLONG(data[1]);
+        uLONG e = parse_uLONG(data[2]);
 
         if( chr_size.find(chr_id) != chr_size.end() )
         {
@@ -68,50 +51,90 @@ void load_junctions(const string &file_name, MapStringT<JunctionArray> &junction
 
 
 // build junction index, left means build with junction start; right means build with junction end
-void buildLeftJunctionMap(JunctionArray &junctions, map<uLONG, vector<Junction*>> &junc_map, const uLONG &binsize)
+Junction_Index::Junction_Index(JunctionArray &junctions, const Key &key, const uLONG &binsize): 
+    key(key), binsize(binsize)
 {
-    junc_map.clear();
-    for(auto it=junctions.begin(); it!=junctions.end(); it++)
+    binned.reserve(junctions.size());
+    for(Junction &junction: junctions)
+        binned.push_back(&junction);
+    stable_sort(binned.begin(), binned.end(), [this](const Junction *a, const Junction *b){ return key_of(a)/this->binsize < key_of(b)/this->binsize; });
+
+    for(uLONG i=0; i<binned.size(); i++)
     {
-        uLONG index = it->first / binsize;
-        junc_map[index].push_back( &(*it) );
+        const uLONG bin_id = key_of(binned[i])/binsize;
+        if(bin_ids.empty() or bin_ids.back() != bin_id)
+        {
+            bin_ids.push_back(bin_id);
+            bin_offsets.push_back(i);
+            bin_disjoint.push_back(true);
+        }
+        const Junction *jp = binned[i];
+        if(jp->first > jp->second or (bin_offsets.back() != i and binned[i-1]->second >= jp->first))
+            bin_disjoint.back() = false;
     }
+    bin_offsets.push_back(binned.size());
+
+    keys.reserve(binned.size());
+    for(uLONG i=0; i<binned.size(); i++)
+        keys.emplace_back(key_of(binned[i]), i);
+    sort(keys.begin(), keys.end());
 }
 
-void buildRightJunctionMap(JunctionArray &junctions, map<uLONG, vector<Junction*>> &junc_map, const uLONG &binsize)
+Junction_Bin Junction_Index::bin(const uLONG &bin_id) const
 {
-    junc_map.clear();
-    for(auto it=junctions.begin(); it!=junctions.end(); it++)
+    Junction_Bin cur_bin;
+    auto it = lower_bound(bin_ids.cbegin(), bin_ids.cend(), bin_id);
+    if(it == bin_ids.cend() or *it != bin_id)
+        return cur_bin;
+
+    const uLONG i = it - bin_ids.cbegin();
+    cur_bin.junctions = binned.data() + bin_offsets[i];
+    cur_bin.count = bin_offsets[i+1] - bin_offsets[i];
+    cur_bin.disjoint = bin_disjoint[i];
+    return cur_bin;
+}
+
+Junction *Junction_Index::find(const uLONG &bin_id, const uLONG &value) const
+{
+    if(value/binsize != bin_id)
+        return nullptr;
+    auto it = lower_bound(keys.cbegin(), keys.cend(), make_pair(value, uLONG(0)));
+    if(it == keys.cend() or it->first != value)
+        return nullptr;
+    return binned[it->second];
+}
+
+Junction *Junction_Index::find(const uLONG &bin_id, const Region &region) const
+{
+    const uLONG value = key == LEFT ? region.first : region.second;
+    if(value/binsize != bin_id)
+        return nullptr;
+    for(auto it = lower_bound(keys.cbegin(), keys.cend(), make_pair(value, uLONG(0))); it != keys.cend() and it->first == value; ++it)
     {
-        uLONG index = it->second / binsize;
-        junc_map[index].push_back( &(*it) );
+        Junction *jp = binned[it->second];
+        if(jp->first == region.first and jp->second == region.second)
+            return jp;
     }
+    return nullptr;
 }
 
 // count junction reads
-void build_junction_support(const vector<Map_Record> &record_array, JunctionArray &junctions)
+void build_junction_support(const Map_Records &record_array, JunctionArray &junctions)
 {
-    map<uLONG, vector<Junction*>> junc_map;
     const uLONG binsize = 100000;
-    buildLeftJunctionMap(junctions, junc_map, binsize);
+    const Junction_Index junc_index(junctions, Junction_Index::LEFT, binsize);
 
-    for(auto it=record_array.cbegin(); it!=record_array.cend(); it++)
+    for(uLONG k=0; k<record_array.size(); k++)
     {
-        for(auto it2=it->regions.cbegin(); it2!=it->regions.cend()-1; it2++)
+        const Map_Record record = record_array[k];
+        for(auto it2=record.begin(); it2!=record.end()-1; it2++)
         {
             Region cur_junc(it2->second+1, (it2+1)->first-1);
             uLONG index = cur_junc.first / binsize;
-            if(junc_map.find(index) == junc_map.end())
-                continue;
-            for(Junction* const p: junc_map.at(index))
-            {
-                if(p->first == cur_junc.first and p->second == cur_junc.second)
-                {
-                    p->support++;
-                    break;
-                }
-                // TODO: if it is a unannotated junction...
-            }
+            Junction *p = junc_index.find(index, cur_junc);
+            if(p)
+                p->support++;
+            // TODO: if it is a unannotated junction...
         }
     }
 }
@@ -198,33 +221,32 @@ void write_junctions(const MapStringT<JunctionArray> &junctions, const string &o
 
 /**** Read Tab file (from sam file) ****/
 
+// the strand of the records, every record must have regions
+static void check_map_records(Map_Records &records)
+{
+    records.strand = records.chr_id.back() == '+' ? POSITIVE : NEGATIVE;
+    for(uLONG i=0; i<records.size(); i++)
+        if(records.offsets[i] == records.offsets[i+1])
+            throw Unexpected_Error("FATAL Error: invliad line: "+records.chr_id);
+}
+
 // read a single chromosome data, input file must be sorted!!
-bool read_chr(vector<Map_Record> &record_array, ifstream *hander, string &chr_id)
+bool read_chr(Map_Records &records, Tab_Reader *hander, string &chr_id)
 {
-    if(hander->eof())
+    if(not hander->read_chr(records))
         return false;
 
-    record_array.clear();
-
-    string line; StringArray data;
-    getline(*hander, line);
-    split(line, '\t', data);
-    chr_id = data[0]+data[1];
-    record_array.emplace_back(data);
+    chr_id = records.chr_id;
+    check_map_records(records);
+    return true;
+}
 
-    auto last_pos = hander->tellg();
-    while(getline(*hander, line))
-    {
-        split(line, '\t', data);
-        if(chr_id != data[0]+data[1])
-        {
-            hander->seekg(last_pos);
-            break;
-        }
-        record_array.emplace_back(data);
-        last_pos = hander->tellg();
-    }
+bool load_chr(Map_Records &records, const Tab_Reader *hander, const string &chr_id)
+{
+    if(not hander->load_chr(chr_id, records))
+        return false;
 
+    check_map_records(records);
     return true;
 }
 
@@ -244,13 +266,15 @@ void load_chr_size(const string &file_name, MapStringuLONG &chr_size)
     chr_size.clear();
 
     string line;
+    FieldArray data;
     while(getline(IN, line))
     {
-        StringArray data;
         split(line, data);
-        chr_size[ data[0] ] = stoul(data[1]);
-        chr_size[ data[0]+"+" ] = stoul(data[1]);
-        chr_size[ data[0]+"-" ] = stoul(data[1]);
+        const string chr_id = data[0];
+        const uLONG chr_len = parse_uLONG(data[1]);
+        chr_size[ chr_id ] = chr_len;
+        chr_size[ chr_id+"+" ] = chr_len;
+        chr_size[ chr_id+"-" ] = chr_len;
     }
     IN.close();
 }
@@ -259,50 +283,163 @@ void load_chr_size(const string &file_name, MapStringuLONG &chr_size)
 
 /**** calculate RT and BD ****/
 
-// calculate chromsome RT and BD in positive strand (input record_array must be in positive strand)
-void calc_chr_BDRT_Pos(uIntArray &BD, uIntArray &RT, 
-        const vector<Map_Record> &record_array, 
-        JunctionArray &junctions,
+// a track of an interleaved coverage array, position pos is at pos*stride+offset
+struct Coverage_Track
+{
+    Coverage_Track(Coverage_Array &array, const uLONG &stride=1, const uLONG &offset=0):
+        array(array), stride(stride), offset(offset) {}
+
+    uLONG size() const { return array.size() / stride; }
+    uINT &ref(const uLONG &pos) { return array.ref(pos*stride+offset); }
+
+    Coverage_Array &array;
+    const uLONG stride;
+    const uLONG offset;
+};
+
+// BD is accumulated in a sparse difference array: a run of positions is added by two updates,
+// and add_difference() adds the prefix sum of every track to BD. The unsigned arithmetic wraps
+// in the same way as the per-base increments
+static void add_difference(Coverage_Array &BD, const Coverage_Array &diff, const uLONG &stride)
+{
+    vector<uINT> carry(stride, 0);
+    for(uLONG b=0; b<diff.block_num(); b++)
+    {
+        const uINT *diff_block = diff.block(b);
+        if(not diff_block and all_of(carry.cbegin(), carry.cend(), [](const uINT &c){ return c == 0; }))
+            continue;
+
+        uINT *BD_block = BD.write_block(b);
+        uLONG t = (b*diff.block_size()) % stride;
+        for(uLONG i=0; i<diff.block_size(); i++)
+        {
+            if(diff_block)
+                carry[t] += diff_block[i];
+            BD_block[i] += carry[t];
+            if(++t == stride)
+                t = 0;
+        }
+    }
+}
+
+// add 1 to BD[first], BD[first+1]... BD[first+n-1] which are <= size
+static inline void add_BD_up(Coverage_Track &BD, const uLONG &first, const uLONG &n, const uLONG &size)
+{
+    if(n == 0 or first > size)
+        return;
+    const uLONG last = (n-1 > size-first) ? size : first+n-1;
+    ++BD.ref(first);
+    if(last+1 < BD.size())
+        --BD.ref(last+1);
+}
+
+// add 1 to BD[last], BD[last-1]... BD[last-n+1] which are <= size, the positions below 0 wrap to huge values and are skipped
+static inline void add_BD_down(Coverage_Track &BD, const uLONG &last, const uLONG &n, const uLONG &size)
+{
+    if(n == 0)
+        return;
+    const uLONG first = (last >= n-1) ? last-n+1 : 0;
+    if(first > size)
+        return;
+    add_BD_up(BD, first, min(last, size)-first+1, size);
+}
+
+// the junction of a bin which extends BD on positive strand from s: the first junction containing s (inside=true),
+// or the first junction followed by s before the next junction or bin_end (inside=false). Return -1 if not found
+static long find_ext_junction_Pos(const Junction_Bin &cur_bin, const uLONG &s, const uLONG &bin_end, bool &inside)
+{
+    if(cur_bin.disjoint)
+    {
+        // only the last junction starting at or before s can match
+        auto it = upper_bound(cur_bin.junctions, cur_bin.junctions+cur_bin.size(), s, [](const uLONG &v, const Junction *jp){ return v < jp->first; });
+        if(it == cur_bin.junctions)
+            return -1;
+        const long i = it - cur_bin.junctions - 1;
+        inside = s <= cur_bin[i]->second;
+        return i;
+    }
+
+    for(uLONG i=0; i<cur_bin.size(); i++)
+    {
+        const Junction* const cur_jp = cur_bin[i];
+        const uLONG next_first = i != cur_bin.size()-1 ? cur_bin[i+1]->first : bin_end;
+        if(cur_jp->first <= s and s <= cur_jp->second)
+        {
+            inside = true;
+            return i;
+        }else if(cur_jp->second < s and s < next_first)
+        {
+            inside = false;
+            return i;
+        }
+    }
+    return -1;
+}
+
+// the junction of a bin which extends BD on negative strand from s: the first junction containing s (inside=true),
+// or the first junction preceded by s after the last junction or bin_start (inside=false). Return -1 if not found
+static long find_ext_junction_Neg(const Junction_Bin &cur_bin, const uLONG &s, const uLONG &bin_start, bool &inside)
+{
+    if(cur_bin.disjoint)
+    {
+        // only the first junction ending at or after s can match
+        auto it = lower_bound(cur_bin.junctions, cur_bin.junctions+cur_bin.size(), s, [](const Junction *jp, const uLONG &v){ return jp->second < v; });
+        if(it == cur_bin.junctions+cur_bin.size())
+            return -1;
+        const long i = it - cur_bin.junctions;
+        inside = cur_bin[i]->first <= s;
+        if(not inside and i == 0 and bin_start >= s)
+            return -1;
+        return i;
+    }
+
+    for(uLONG i=0; i<cur_bin.size(); i++)
+    {
+        const Junction* const cur_jp = cur_bin[i];
+        const uLONG last_second = i != 0 ? cur_bin[i-1]->second : bin_start;
+        if(cur_jp->first <= s and s <= cur_jp->second)
+        {
+            inside = true;
+            return i;
+        }else if(last_second < s and s < cur_jp->first)
+        {
+            inside = false;
+            return i;
+        }
+    }
+    return -1;
+}
+
+// count RT and the BD difference in positive strand (input record_array must be in positive strand)
+static void count_BDRT_Pos(Coverage_Track BD_diff, Coverage_Track RT, 
+        const Map_Records &record_array, 
+        const Junction_Index &junc_index,
         const uLONG &size,
         const uLONG &BD_ext,
         const uLONG &binsize)
 {
-    // build junction map
-    map<uLONG, vector<Junction* >> junc_map;
-    buildRightJunctionMap(junctions, junc_map, binsize);
-
     // scan
-    for(auto it=record_array.crbegin(); it!=record_array.crend(); it++)
+    for(uLONG k=record_array.size(); k-->0; )
     {
+        const Map_Record record = record_array[k];
+
         // add BD
-        for(uLONG r_i=0; r_i<it->regions.size(); r_i++)
-            for(uLONG i=it->regions[r_i].first; i<=it->regions[r_i].second; i++)
-                if(i<=size)
-                    ++BD[i];
+        for(const Region &r: record)
+            if(r.first <= r.second)
+                add_BD_up(BD_diff, r.first, r.second-r.first+1, size);
 
-        uLONG s = it->regions[0].first;
+        uLONG s = record.front().first;
         uLONG bin_id = s/binsize;
 
         // add RT
-        if(junc_map.find(bin_id) == junc_map.end())
+        const Junction* const jp = junc_index.find(bin_id, s-1);
+        if(jp)
         {
-            if(s-1 <= size)
-                ++RT[s-1];
+            if(jp->first-1 <= size)
+                ++RT.ref(jp->first-1);
         }else{
-            bool find = false;
-            for(const Junction* const jp: junc_map[bin_id])
-            {
-                if(jp->second+1 == s)
-                {
-                    find = true;
-                    if(jp->first-1 <= size)
-                        ++RT[jp->first-1];
-                    break;
-                }
-            }
-            if(not find)
-                if(s-1 <= size)
-                    ++RT[s-1];
+            if(s-1 <= size)
+                ++RT.ref(s-1);
         }
 
         // ext BD
@@ -311,135 +448,105 @@ void calc_chr_BDRT_Pos(uIntArray &BD, uIntArray &RT,
             uLONG ext = BD_ext;
             if(BD_ext > s)
                 ext = s;
-            if(junc_map.find(bin_id) == junc_map.end())
+            const Junction_Bin cur_junc_map = junc_index.bin(bin_id);
+
+            bool inside = false;
+            const long i = cur_junc_map.empty() ? -1 : find_ext_junction_Pos(cur_junc_map, s, (bin_id+1)*binsize, inside);
+            if(i < 0)
             {
-                for(uLONG i=1; i<=ext; i++)
-                    if(s-i <= size)
-                        ++BD[s-i];
-            }else{
-                const vector<Junction *> &cur_junc_map = junc_map[bin_id];
+                // no junction or before the first junction
+                add_BD_down(BD_diff, s-1, ext, size);
+            }else if(inside)
+            {
+                // in junction
+                const Junction* const cur_jp = cur_junc_map[i];
+                uLONG ext_start;
+                if(s-cur_jp->first > ext)
+                    ext_start = s - ext;
+                else
+                    ext_start = cur_jp->first;
                 
-                bool find = false;
-                for(uINT i=0; i<cur_junc_map.size(); i++)
+                add_BD_down(BD_diff, s-1, s-ext_start, size);
+            }else{
+                // between junction
+                uLONG ext_left = ext;
+                uLONG start = cur_junc_map[i]->second;
+                uLONG cur_pos = s - 1;
+                long cur_jun_index = i;
+                while(ext_left > 0)
                 {
-                    const Junction* const cur_jp = cur_junc_map[i];
-                    if(cur_jp->first <= s and s <= cur_jp->second)
-                    {
-                        // in junction
-                        uLONG ext_start;
-                        if(s-cur_jp->first > ext)
-                            ext_start = s - ext;
-                        else
-                            ext_start = cur_jp->first;
-                        
-                        for(uLONG i=ext_start; i<s; i++)
-                            if(i <= size)
-                                ++BD[i];
-
-                        find = true;
-                        break;
-                    }else
+                    if(start==cur_pos)
                     {
-                        Junction* nex_jp = nullptr;
-                        if(i != cur_junc_map.size()-1)
-                            nex_jp = cur_junc_map[i+1];
-                        else
-                            nex_jp = new Junction( (bin_id+1)*binsize, (bin_id+1)*binsize );
-
-                        if(cur_jp->second < s and s < nex_jp->first)
+                        if(cur_jun_index >= 1)
                         {
-                            // between junction
-                            uLONG ext_left = ext;
-                            uLONG start = cur_jp->second;
-                            uLONG cur_pos = s - 1;
-                            long cur_jun_index = i;
-                            while(ext_left > 0)
-                            {
-                                if(start==cur_pos)
-                                {
-                                    if(cur_jun_index >= 1)
-                                    {
-                                        --cur_jun_index;
-                                        start = cur_junc_map[cur_jun_index]->second;
-                                        cur_pos = cur_junc_map[cur_jun_index+1]->first - 1;
-                                    }
-                                    else{
-                                        cur_pos = cur_junc_map[0]->first - 1;
-                                        start = 0;
-                                    }
-                                }
-                                if(cur_pos <= size)
-                                    ++BD[cur_pos];
-                                --ext_left;
-                                --cur_pos;
-                            }
-                            find = true;
-                           // break;
+                            --cur_jun_index;
+                            start = cur_junc_map[cur_jun_index]->second;
+                            cur_pos = cur_junc_map[cur_jun_index+1]->first - 1;
+                        }
+                        else{
+                            cur_pos = cur_junc_map[0]->first - 1;
+                            start = 0;
                         }
-                        if(i == cur_junc_map.size()-1)
-                            delete nex_jp;
-                        if(find)
-                            break;
                     }
+                    // cur_pos, cur_pos-1... until start is reached again
+                    uLONG n = cur_pos - start;
+                    if(n == 0 or n > ext_left)
+                        n = ext_left;
+                    add_BD_down(BD_diff, cur_pos, n, size);
+                    ext_left -= n;
+                    cur_pos -= n;
                 }
-                if(not find)
-                    // before the first junction
-                    for(uLONG i=1; i<=ext; i++)
-                        if(s-i <= size)
-                            ++BD[s-i];
             }
         }
     }
 }
 
-// calculate chromsome RT and BD in negative strand (input record_array must be in negative strand)
-void calc_chr_BDRT_Neg(uIntArray &BD, uIntArray &RT, 
-        const vector<Map_Record> &record_array, 
+// calculate chromsome RT and BD in positive strand (input record_array must be in positive strand)
+void calc_chr_BDRT_Pos(Coverage_Array &BD, Coverage_Array &RT, 
+        const Map_Records &record_array, 
         JunctionArray &junctions,
         const uLONG &size,
         const uLONG &BD_ext,
         const uLONG &binsize)
 {
-    // build junction map
-    map<uLONG, vector<Junction* >> junc_map;
-    buildLeftJunctionMap(junctions, junc_map, binsize);
+    // build junction index
+    const Junction_Index junc_index(junctions, Junction_Index::RIGHT, binsize);
 
-    //uLONG index = 0;
+    Coverage_Array BD_diff(BD.size());
+    count_BDRT_Pos(BD_diff, RT, record_array, junc_index, size, BD_ext, binsize);
+    add_difference(BD, BD_diff, 1);
+}
 
+// count RT and the BD difference in negative strand (input record_array must be in negative strand)
+static void count_BDRT_Neg(Coverage_Track BD_diff, Coverage_Track RT, 
+        const Map_Records &record_array, 
+        const Junction_Index &junc_index,
+        const uLONG &size,
+        const uLONG &BD_ext,
+        const uLONG &binsize)
+{
     // scan
-    for(auto it=record_array.cbegin(); it!=record_array.cend(); it++)
+    for(uLONG k=0; k<record_array.size(); k++)
     {
-        //clog << ++index << it->regions.back().second << endl;
+        const Map_Record record = record_array[k];
 
         // add BD
-        for(uLONG r_i=0; r_i<it->regions.size(); r_i++)
-            for(uLONG i=it->regions[r_i].first; i<=it->regions[r_i].second; i++)
-                if(i <= size)
-                    ++BD[i];
+        for(const Region &r: record)
+            if(r.first <= r.second)
+                add_BD_up(BD_diff, r.first, r.second-r.first+1, size);
 
-        uLONG s = it->regions.back().second;
+        uLONG s = record.back().second;
         uLONG bin_id = s/binsize;
 
         // add RT
-        if(junc_map.find(bin_id) == junc_map.end())
+        const Junction* const jp = junc_index.find(bin_id, s+1);
+        if(jp)
         {
-            if(s+1 <= size)
-                ++RT[s+1];
+            if(jp->second+1 <= size)
+                ++RT.ref(jp->second+1);
         }else{
-            bool find = false;
-            for(const Junction* const jp: junc_map[bin_id])
-            {
-                if(jp->first-1 == s)
-                {
-                    find = true;
-                    if(jp->second+1 <= size)
-                        ++RT[jp->second+1];
-                    break;
-                }
-            }
-            if(not find)
-                if(s+1 <= size)
-                    ++RT[s+1];
+            if(s+1 <= size)
+                ++RT.ref(s+1);
         }
 
         // ext BD
@@ -448,86 +555,130 @@ void calc_chr_BDRT_Neg(uIntArray &BD, uIntArray &RT,
             uLONG ext = BD_ext;
             if(BD_ext+s > size)
                 ext = size-s;
-            if(junc_map.find(bin_id) == junc_map.end())
+            const Junction_Bin cur_junc_map = junc_index.bin(bin_id);
+
+            bool inside = false;
+            const long i = cur_junc_map.empty() ? -1 : find_ext_junction_Neg(cur_junc_map, s, bin_id*binsize, inside);
+            if(i < 0)
             {
-                for(uLONG i=1; i<=ext; i++)
-                    if(s+i<=size)
-                        ++BD[s+i];
-            }else{
-                const vector<Junction *> &cur_junc_map = junc_map[bin_id];
+                // no junction or before the first junction
+                add_BD_up(BD_diff, s+1, ext, size);
+            }else if(inside)
+            {
+                // in junction
+                const Junction* const cur_jp = cur_junc_map[i];
+                uLONG ext_end;
+                if(cur_jp->second-s > ext)
+                    ext_end = s+ext;
+                else
+                    ext_end = cur_jp->second;
                 
-                bool find = false;
-                for(uLONG i=0; i<cur_junc_map.size(); i++)
+                add_BD_up(BD_diff, s+1, ext_end-s, size);
+            }else{
+                // between junction
+                uLONG ext_left = ext;
+                uLONG end = cur_junc_map[i]->first;
+                uLONG cur_pos = s + 1;
+                uLONG cur_jun_index = i;
+                while(ext_left > 0)
                 {
-                    const Junction* const cur_jp = cur_junc_map[i];
-                    if(cur_jp->first <= s and s <= cur_jp->second)
+                    if(end==cur_pos)
                     {
-                        // in junction
-                        uLONG ext_end;
-                        if(cur_jp->second-s > ext)
-                            ext_end = s+ext;
-                        else
-                            ext_end = cur_jp->second;
-                        
-                        for(uLONG i=s+1; i<=ext_end; i++)
-                            if(i<=size)
-                                ++BD[i];
-
-                        find = true;
-                        break;
-                    }else
-                    {
-                        Junction* last_jp = nullptr;
-                        if(i != 0)
-                            last_jp = cur_junc_map[i-1];
-                        else
-                            last_jp = new Junction( bin_id*binsize, bin_id*binsize );
-
-                        if(last_jp->second < s and s < cur_jp->first)
+                        if(cur_jun_index < cur_junc_map.size()-1)
                         {
-                            // between junction
-                            uLONG ext_left = ext;
-                            uLONG end = cur_jp->first;
-                            uLONG cur_pos = s + 1;
-                            uLONG cur_jun_index = i;
-                            while(ext_left > 0)
-                            {
-                                if(end==cur_pos)
-                                {
-                                    if(cur_jun_index < cur_junc_map.size()-1)
-                                    {
-                                        ++cur_jun_index;
-                                        end = cur_junc_map[cur_jun_index]->first;
-                                        cur_pos = cur_junc_map[cur_jun_index-1]->second + 1; // cur_jp->first-1;
-                                    }
-                                    else{
-                                        cur_pos = cur_junc_map.back()->second + 1;
-                                        end = size; // max value
-                                    }
-                                }
-                                if(cur_pos<=size)
-                                    ++BD[cur_pos];
-                                --ext_left;
-                                ++cur_pos;
-                            }
-                            find = true;
+                            ++cur_jun_index;
+                            end = cur_junc_map[cur_jun_index]->first;
+                            cur_pos = cur_junc_map[cur_jun_index-1]->second + 1;
+                        }
+                        else{
+                            cur_pos = cur_junc_map[cur_junc_map.size()-1]->second + 1;
+                            end = size; // max value
                         }
-                        if(i == 0)
-                            delete last_jp;
-                        if(find)
-                            break;
                     }
+                    // cur_pos, cur_pos+1... until end is reached again
+                    uLONG n = end - cur_pos;
+                    if(n == 0 or n > ext_left)
+                        n = ext_left;
+                    add_BD_up(BD_diff, cur_pos, n, size);
+                    ext_left -= n;
+                    cur_pos += n;
                 }
-                if(not find)
-                    // before the first junction
-                    for(uLONG i=1; i<=ext; i++)
-                        if(s+i<=size)
-                            ++BD[s+i];
             }
         }
     }
+}
+
+// calculate chromsome RT and BD in negative strand (input record_array must be in negative strand)
+void calc_chr_BDRT_Neg(Coverage_Array &BD, Coverage_Array &RT, 
+        const Map_Records &record_array, 
+        JunctionArray &junctions,
+        const uLONG &size,
+        const uLONG &BD_ext,
+        const uLONG &binsize)
+{
+    // build junction index
+    const Junction_Index junc_index(junctions, Junction_Index::LEFT, binsize);
+
+    Coverage_Array BD_diff(BD.size());
+    count_BDRT_Neg(BD_diff, RT, record_array, junc_index, size, BD_ext, binsize);
+    add_difference(BD, BD_diff, 1);
+}
+
+Replicate_Coverage::Replicate_Coverage(const uLONG &size, const uLONG &track_num):
+    RT(size*track_num), BD(size*track_num), chr_size(size), tracks(track_num) {}
+
+void calc_chr_BDRT(Replicate_Coverage &coverage, const vector<Map_Records> &record_array, const vector<uLONG> &track_of,
+        JunctionArray &junctions, const uLONG &size, const STRAND &strand, const uLONG &BD_ext, const uLONG &binsize)
+{
+    const uLONG tracks = coverage.track_num();
+    if(track_of.size() != record_array.size() or coverage.size() != size+1)
+        throw Unexpected_Error("FATAL Error: calc_chr_BDRT: the tracks do not match the replicates");
+
+    // build junction index
+    const Junction_Index junc_index(junctions, strand == POSITIVE ? Junction_Index::RIGHT : Junction_Index::LEFT, binsize);
+
+    Coverage_Array BD_diff(coverage.BD.size());
+    for(uLONG i=0; i<record_array.size(); i++)
+    {
+        if(strand == POSITIVE)
+            count_BDRT_Pos(Coverage_Track(BD_diff, tracks, track_of[i]), Coverage_Track(coverage.RT, tracks, track_of[i]),
+                record_array[i], junc_index, size, BD_ext, binsize);
+        else
+            count_BDRT_Neg(Coverage_Track(BD_diff, tracks, track_of[i]), Coverage_Track(coverage.RT, tracks, track_of[i]),
+                record_array[i], junc_index, size, BD_ext, binsize);
+    }
+    add_difference(coverage.BD, BD_diff, tracks);
+}
 
-    //clog << "Finish...FIsh" << endl;
+void calc_chr_BDRT(vector<Coverage_Array> &RT, vector<Coverage_Array> &BD, const vector<Map_Records> &record_array, const vector<uLONG> &track_of,
+        JunctionArray &junctions, const uLONG &size, const STRAND &strand, const uLONG &BD_ext, const uLONG &binsize)
+{
+    if(track_of.size() != record_array.size() or RT.size() != BD.size())
+        throw Unexpected_Error("FATAL Error: calc_chr_BDRT: the tracks do not match the replicates");
+    for(uLONG t=0; t<RT.size(); t++)
+        if(RT[t].size() != size+1 or BD[t].size() != size+1)
+            throw Unexpected_Error("FATAL Error: calc_chr_BDRT: the tracks do not match the chromosome size");
+    for(const uLONG &t: track_of)
+        if(t >= RT.size())
+            throw Unexpected_Error("FATAL Error: calc_chr_BDRT: the tracks do not match the replicates");
+
+    // build junction index
+    const Junction_Index junc_index(junctions, strand == POSITIVE ? Junction_Index::RIGHT : Junction_Index::LEFT, binsize);
+
+    for(uLONG t=0; t<RT.size(); t++)
+    {
+        Coverage_Array BD_diff(size+1);
+        for(uLONG i=0; i<record_array.size(); i++)
+        {
+            if(track_of[i] != t)
+                continue;
+            if(strand == POSITIVE)
+                count_BDRT_Pos(Coverage_Track(BD_diff), Coverage_Track(RT[t]), record_array[i], junc_index, size, BD_ext, binsize);
+            else
+                count_BDRT_Neg(Coverage_Track(BD_diff), Coverage_Track(RT[t]), record_array[i], junc_index, size, BD_ext, binsize);
+        }
+        add_difference(BD[t], BD_diff, 1);
+    }
 }
 
 /**** Cutoff functions ****/
@@ -590,13 +741,15 @@ bool valid_cov(const deque<float> &bd, const deque<float> &rt, const float &min_
 /**** icSHAPE fansion (with NAI+DMSO) ****/
 
 // calculate SHAPE score with NAI and DMSO RT/BD in non-junction regions
-void sliding_non_junction(  const uIntArray &NAI_RT, const uIntArray &DMSO_RT,
-                            const uIntArray &NAI_BD, const uIntArray &DMSO_BD,
-                            const JunctionArray &junctions, FloatArray &score, 
+void sliding_non_junction(  const Coverage_Array &NAI_RT, const Coverage_Array &DMSO_RT,
+                            const Coverage_Array &NAI_BD, const Coverage_Array &DMSO_BD,
+                            const JunctionArray &junctions, Score_Array &score, 
                             const string &chr_id, const STRAND &strand, 
-                            ofstream &OUT, const icSHAPE_Param &param,
-                            const vector<bool> &chr_mask, const string &chr_seq)
+                            ostream &OUT, const icSHAPE_Param &param,
+                            const Base_Mask &chr_mask, const Seq_View &chr_seq)
 {
+    Fast_Writer writer(OUT);
+
     bool use_mask = chr_mask.empty() ? false : true;
     if(use_mask and NAI_RT.size() != chr_mask.size())
         throw runtime_error("NAI_RT.size() != chr_mask.size() -- "+to_string(NAI_RT.size())+" != "+to_string(chr_mask.size()));
@@ -608,12 +761,6 @@ void sliding_non_junction(  const uIntArray &NAI_RT, const uIntArray &DMSO_RT,
     const uINT org_wstep = param.wstep;
     uINT wstep = org_wstep;
 
-    deque<bool> mask;
-    deque<float> nai_rt;
-    deque<float> nai_bd;
-    deque<float> dmso_rt;
-    deque<float> dmso_bd;
-
     const uLONG chr_size = NAI_RT.size() - 1;
     if(DMSO_RT.size() != chr_size+1 or NAI_BD.size() != chr_size+1 or DMSO_BD.size() != chr_size+1)
     {
@@ -631,6 +778,12 @@ void sliding_non_junction(  const uIntArray &NAI_RT, const uIntArray &DMSO_RT,
             return;
         }
 
+        deque<bool> mask;
+        deque<float> nai_rt;
+        deque<float> nai_bd;
+        deque<float> dmso_rt;
+        deque<float> dmso_bd;
+
         FloatArray scores;
         for(uLONG i=0; i<chr_size-30; i++)
         {
@@ -652,9 +805,9 @@ void sliding_non_junction(  const uIntArray &NAI_RT, const uIntArray &DMSO_RT,
 
         for(uLONG i=6; i<chr_size-30; i++)
             if(DMSO_BD[i] < min_cov)
-                score[i] = null;
+                score.set(i, null);
             else
-                score[i] = scores[i];
+                score.set(i, scores[i]);
 
         for(uLONG index=1; index<chr_size; index++)
         {
@@ -669,7 +822,7 @@ void sliding_non_junction(  const uIntArray &NAI_RT, const uIntArray &DMSO_RT,
 
             if(masked and (NAI_RT[index] >= 1 or DMSO_RT[index] >= 1 or DMSO_BD[index] >= out_min_cov))
             {
-                OUT << chr_id << '\t' << strand_char << '\t' << index << '\t' << base
+                writer << chr_id << '\t' << strand_char << '\t' << index << '\t' << base
                     << NAI_RT[index] << '\t' << NAI_BD[index] << '\t'
                     << DMSO_RT[index] << '\t' << DMSO_BD[index] << '\t'
                     << score[index] << '\t' << (score[index]==null ? 0 : 1) << '\t' 
@@ -689,6 +842,7 @@ void sliding_non_junction(  const uIntArray &NAI_RT, const uIntArray &DMSO_RT,
 
     uINT ji = 0;
 
+    icSHAPE_Window window(wsize);
     deque<uLONG> index_array;
 
     bool has_junction = (junctions.size() >= 1);
@@ -709,12 +863,7 @@ void sliding_non_junction(  const uIntArray &NAI_RT, const uIntArray &DMSO_RT,
             if(junctions[ji].first == cur_i)
                 cur_i = junctions[ji++].second+1;
 
-        nai_rt.push_back(NAI_RT[cur_i]);
-        nai_bd.push_back(NAI_BD[cur_i]);
-        dmso_rt.push_back(DMSO_RT[cur_i]);
-        dmso_bd.push_back(DMSO_BD[cur_i]);
-        if(use_mask)
-            mask.push_back(chr_mask[cur_i]);
+        window.push_back(NAI_RT[cur_i], NAI_BD[cur_i], DMSO_RT[cur_i], DMSO_BD[cur_i], use_mask ? chr_mask[cur_i] : true);
 
         index_array.push_back(cur_i);
 
@@ -726,12 +875,7 @@ void sliding_non_junction(  const uIntArray &NAI_RT, const uIntArray &DMSO_RT,
     deque<FloatArray> precalculated;
     FloatArray scores;
 
-    if(use_mask)
-    {
-        calculate_mask_score(nai_rt, nai_bd, dmso_rt, dmso_bd, scores, mask, param);
-    }else{
-        calculate_score(nai_rt, nai_bd, dmso_rt, dmso_bd, scores, param);
-    }
+    window.calculate_score(scores, param, use_mask);
 
     //calculate_score(nai_rt, nai_bd, dmso_rt, dmso_bd, scores, param);
     for(const float &score: scores)
@@ -756,7 +900,7 @@ void sliding_non_junction(  const uIntArray &NAI_RT, const uIntArray &DMSO_RT,
             //c_count[ index ] = valid_count;
             if(DMSO_BD[index] < min_cov)
                 shape_score = null;
-            score[ index ] = shape_score;
+            score.set(index, shape_score);
 
             string base;
             bool masked = true;
@@ -768,59 +912,43 @@ void sliding_non_junction(  const uIntArray &NAI_RT, const uIntArray &DMSO_RT,
 
             if(masked and (NAI_RT[index] >= 1 or DMSO_RT[index] >= 1 or DMSO_BD[index] >= out_min_cov))
             {
-                OUT << chr_id << '\t' << strand_char << '\t' << index << '\t' << base
+                writer << chr_id << '\t' << strand_char << '\t' << index << '\t' << base
                     << NAI_RT[index] << '\t' << NAI_BD[index] << '\t'
                     << DMSO_RT[index] << '\t' << DMSO_BD[index] << '\t'
                     << shape_score << '\t' << valid_count << '\t';
 
                 for(float v: precalculated.front())
-                    OUT << v << ',';
+                    writer << v << ',';
 
-                OUT << '\n';
+                writer << '\n';
             }
 
             index_array.pop_front();
             precalculated.pop_front();
 
-            nai_rt.pop_front();
-            nai_bd.pop_front();
-            dmso_rt.pop_front();
-            dmso_bd.pop_front();
-            if(use_mask)
-                mask.pop_front();
+            window.pop_front();
 
             if(has_junction and ji<juncNum)
                 if(junctions[ji].first == cur_i)
                     cur_i = junctions[ji++].second+1;
 
-            nai_rt.push_back(NAI_RT[cur_i]);
-            nai_bd.push_back(NAI_BD[cur_i]);
-            dmso_rt.push_back(DMSO_RT[cur_i]);
-            dmso_bd.push_back(DMSO_BD[cur_i]);
-            if(use_mask)
-                mask.push_back(chr_mask[cur_i]);
+            window.push_back(NAI_RT[cur_i], NAI_BD[cur_i], DMSO_RT[cur_i], DMSO_BD[cur_i], use_mask ? chr_mask[cur_i] : true);
 
             index_array.push_back(cur_i);
 
             ++cur_i;
         }
 
-        uLONG minBD=10;
-        if(low_exp_region(dmso_bd, minBD))
+        if(window.low_exp_region())
         {
             wstep = wsize - 1;
-            scores.assign(nai_rt.size(), null);
+            scores.assign(window.size(), null);
         }
         else
         {
             wstep = org_wstep;
 
-            if(use_mask)
-            {
-                calculate_mask_score(nai_rt, nai_bd, dmso_rt, dmso_bd, scores, mask, param);
-            }else{
-                calculate_score(nai_rt, nai_bd, dmso_rt, dmso_bd, scores, param);
-            }
+            window.calculate_score(scores, param, use_mask);
             //calculate_score(nai_rt, nai_bd, dmso_rt, dmso_bd, scores, param);
         }
 
@@ -848,7 +976,7 @@ void sliding_non_junction(  const uIntArray &NAI_RT, const uIntArray &DMSO_RT,
         float shape_score = mean_score(precalculated.front(), valid_count);
         if(DMSO_BD[index] < min_cov)
             shape_score = null;
-        score[ index ] = shape_score;
+        score.set(index, shape_score);
 
         string base;
         bool masked = true;
@@ -860,15 +988,15 @@ void sliding_non_junction(  const uIntArray &NAI_RT, const uIntArray &DMSO_RT,
 
         if(masked and (NAI_RT[index] >= 1 or DMSO_RT[index] >= 1 or DMSO_BD[index] >= out_min_cov))
         {
-            OUT << chr_id << '\t' << strand_char << '\t' << index << '\t' << base
+            writer << chr_id << '\t' << strand_char << '\t' << index << '\t' << base
                 << NAI_RT[index] << '\t' << NAI_BD[index] << '\t'
                 << DMSO_RT[index] << '\t' << DMSO_BD[index] << '\t'
                 << shape_score << '\t' << valid_count << '\t';
 
             for(float v: precalculated.front())
-                OUT << v << ',';
+                writer << v << ',';
 
-            OUT << '\n';
+            writer << '\n';
         }
 
         index_array.pop_front();
@@ -876,21 +1004,21 @@ void sliding_non_junction(  const uIntArray &NAI_RT, const uIntArray &DMSO_RT,
     }
 
     for(uLONG i=0; i<30 and i<=chr_size; i++)
-        score[i] = null;
+        score.set(i, null);
     uLONG s = 0;
     if(chr_size > 30)
         s = chr_size - 30;
     for(uLONG i=s; i<=chr_size; i++)
-        score[i] = null;
+        score.set(i, null);
 }
 
 // sliding all junctions in junction regions with NAI + DMSO RT/BD
-void sliding_junction( const uIntArray &NAI_RT, const uIntArray &DMSO_RT,
-                        const uIntArray &NAI_BD, const uIntArray &DMSO_BD,
-                        const JunctionArray &junctions, FloatArray &score, 
+void sliding_junction( const Coverage_Array &NAI_RT, const Coverage_Array &DMSO_RT,
+                        const Coverage_Array &NAI_BD, const Coverage_Array &DMSO_BD,
+                        const JunctionArray &junctions, Score_Array &score, 
                         const string &chr_id, const STRAND &strand, 
-                        ofstream &OUT, const icSHAPE_Param &param,
-                        const vector<bool> &chr_mask, const string &chr_seq)
+                        ostream &OUT, const icSHAPE_Param &param,
+                        const Base_Mask &chr_mask, const Seq_View &chr_seq)
 {
 
     ///////////////////////////
@@ -919,13 +1047,15 @@ void sliding_junction( const uIntArray &NAI_RT, const uIntArray &DMSO_RT,
 
 // sliding a single junction with NAI + DMSO RT/BD
 
-void sliding_single_junction(const uIntArray &NAI_RT, const uIntArray &DMSO_RT,
-                            const uIntArray &NAI_BD, const uIntArray &DMSO_BD,
-                            const uLONG &start, const uLONG &end, FloatArray &score,
+void sliding_single_junction(const Coverage_Array &NAI_RT, const Coverage_Array &DMSO_RT,
+                            const Coverage_Array &NAI_BD, const Coverage_Array &DMSO_BD,
+                            const uLONG &start, const uLONG &end, Score_Array &score,
                             const string &chr_id, const STRAND &strand, 
-                            ofstream &OUT, const icSHAPE_Param &param,
-                            const vector<bool> &chr_mask, const string &chr_seq)
+                            ostream &OUT, const icSHAPE_Param &param,
+                            const Base_Mask &chr_mask, const Seq_View &chr_seq)
 {
+    Fast_Writer writer(OUT);
+
     bool use_mask = chr_mask.empty() ? false : true;
     if(use_mask and NAI_RT.size() != chr_mask.size())
         throw runtime_error("NAI_RT.size() != chr_mask.size() -- "+to_string(NAI_RT.size())+" != "+to_string(chr_mask.size()));
@@ -941,12 +1071,7 @@ void sliding_single_junction(const uIntArray &NAI_RT, const uIntArray &DMSO_RT,
     if(junction_len < wsize)
         return;
 
-    deque<bool> mask;
-    deque<float> nai_rt;
-    deque<float> nai_bd;
-    deque<float> dmso_rt;
-    deque<float> dmso_bd;
-
+    icSHAPE_Window window(wsize);
     deque<uLONG> index_array;
 
     uLONG cur_i = 1;
@@ -956,12 +1081,7 @@ void sliding_single_junction(const uIntArray &NAI_RT, const uIntArray &DMSO_RT,
     uLONG de_len = 0;
     while(de_len < wsize and de_len<junction_len and cur_i<=end)
     {
-        nai_rt.push_back(NAI_RT[cur_i]);
-        nai_bd.push_back(NAI_BD[cur_i]);
-        dmso_rt.push_back(DMSO_RT[cur_i]);
-        dmso_bd.push_back(DMSO_BD[cur_i]);
-        if(use_mask)
-            mask.push_back(chr_mask[cur_i]);
+        window.push_back(NAI_RT[cur_i], NAI_BD[cur_i], DMSO_RT[cur_i], DMSO_BD[cur_i], use_mask ? chr_mask[cur_i] : true);
 
         index_array.push_back(cur_i);
 
@@ -972,12 +1092,7 @@ void sliding_single_junction(const uIntArray &NAI_RT, const uIntArray &DMSO_RT,
     //clog << "\tFirst calculate" << endl;
     deque<FloatArray> precalculated;
     FloatArray scores;
-    if(use_mask)
-    {
-        calculate_mask_score(nai_rt, nai_bd, dmso_rt, dmso_bd, scores, mask, param);
-    }else{
-        calculate_score(nai_rt, nai_bd, dmso_rt, dmso_bd, scores, param);
-    }
+    window.calculate_score(scores, param, use_mask);
     //calculate_score(nai_rt, nai_bd, dmso_rt, dmso_bd, scores, param);
     for(const float &cur_score: scores)
     {
@@ -1002,7 +1117,7 @@ void sliding_single_junction(const uIntArray &NAI_RT, const uIntArray &DMSO_RT,
                 float shape_score = mean_score(precalculated.front(), valid_count);
                 if(DMSO_BD[index] < min_cov)
                     shape_score = null;
-                score[ index ] = shape_score;
+                score.set(index, shape_score);
 
                 string base;
                 bool masked = true;
@@ -1014,55 +1129,39 @@ void sliding_single_junction(const uIntArray &NAI_RT, const uIntArray &DMSO_RT,
 
                 if(masked and (NAI_RT[index] >= 1 or DMSO_RT[index] >= 1 or DMSO_BD[index] >= out_min_cov))
                 {
-                    OUT << chr_id << '\t' << strand_char << '\t' << index << '\t' << base
+                    writer << chr_id << '\t' << strand_char << '\t' << index << '\t' << base
                         << NAI_RT[index] << '\t' << NAI_BD[index] << '\t'
                         << DMSO_RT[index] << '\t' << DMSO_BD[index] << '\t'
                         << shape_score << '\t' << valid_count << '\t';
 
                     for(float v: precalculated.front())
-                        OUT << v << ',';
+                        writer << v << ',';
 
-                    OUT << '\n';
+                    writer << '\n';
                 }
             }
 
             index_array.pop_front();
             precalculated.pop_front();
             
-            nai_rt.pop_front();
-            nai_bd.pop_front();
-            dmso_rt.pop_front();
-            dmso_bd.pop_front();
-            if(use_mask)
-                mask.pop_front();
+            window.pop_front();
             
-            nai_rt.push_back(NAI_RT[cur_i]);
-            nai_bd.push_back(NAI_BD[cur_i]);
-            dmso_rt.push_back(DMSO_RT[cur_i]);
-            dmso_bd.push_back(DMSO_BD[cur_i]);
-            if(use_mask)
-                mask.push_back(chr_mask[cur_i]);
+            window.push_back(NAI_RT[cur_i], NAI_BD[cur_i], DMSO_RT[cur_i], DMSO_BD[cur_i], use_mask ? chr_mask[cur_i] : true);
 
             index_array.push_back(cur_i);
 
             ++cur_i;
         }
 
-        uLONG minBD=10;
-        if(low_exp_region(dmso_bd, minBD))
+        if(window.low_exp_region())
         {
             wstep = wsize/2;
-            scores.assign(nai_rt.size(), null);
+            scores.assign(window.size(), null);
         }
         else
         {
             wstep = org_wstep;
-            if(use_mask)
-            {
-                calculate_mask_score(nai_rt, nai_bd, dmso_rt, dmso_bd, scores, mask, param);
-            }else{
-                calculate_score(nai_rt, nai_bd, dmso_rt, dmso_bd, scores, param);
-            }
+            window.calculate_score(scores, param, use_mask);
             //calculate_score(nai_rt, nai_bd, dmso_rt, dmso_bd, scores, param);
         }
 
@@ -1088,7 +1187,7 @@ void sliding_single_junction(const uIntArray &NAI_RT, const uIntArray &DMSO_RT,
             float shape_score = mean_score(precalculated.front(), valid_count);
                 if(DMSO_BD[index] < min_cov)
                     shape_score = null;
-                score[ index ] = shape_score;
+                score.set(index, shape_score);
             
             string base;
             bool masked = true;
@@ -1100,15 +1199,15 @@ void sliding_single_junction(const uIntArray &NAI_RT, const uIntArray &DMSO_RT,
 
             if(masked and (NAI_RT[index] >= 1 or DMSO_RT[index] >= 1 or DMSO_BD[index] >= out_min_cov))
             {
-                OUT << chr_id << '\t' << strand_char << '\t' << index << '\t' << base
+                writer << chr_id << '\t' << strand_char << '\t' << index << '\t' << base
                     << NAI_RT[index] << '\t' << NAI_BD[index] << '\t'
                     << DMSO_RT[index] << '\t' << DMSO_BD[index] << '\t'
                     << shape_score << '\t' << valid_count << '\t';
 
                 for(float v: precalculated.front())
-                    OUT << v << ',';
+                    writer << v << ',';
 
-                OUT << '\n';
+                writer << '\n';
             }
         }
 
@@ -1208,9 +1307,9 @@ void calculate_score(const deque<float> &nai_rt, const deque<float> &nai_bd,
     winsorization(scores, param.winsor_factor);
 }
 
-// calculate enrichment with DMSO and NAI
-void calcEnrich(const deque<float> &dmso_bd, const deque<float> &dmso_rt,
-                const deque<float> &nai_bd, const deque<float> &nai_rt,
+// calculate enrichment with DMSO and NAI in contiguous arrays with the vectorized kernels
+static void calc_enrich(const float *dmso_bd, const float *dmso_rt,
+                const float *nai_bd, const float *nai_rt, const uLONG &length,
                 const float &dmso_bd_sf, const float &dmso_rt_sf, 
                 const float &nai_bd_sf, const float &nai_rt_sf, 
                 FloatArray &score, const icSHAPE_Param &param)
@@ -1219,39 +1318,152 @@ void calcEnrich(const deque<float> &dmso_bd, const deque<float> &dmso_rt,
     float div_fac = param.div_factor;
     float add_fac = param.add_factor;
 
-    score.clear();
-    const uLONG length = dmso_bd.size();
+    score.resize(length);
 
     if(param.enrich_method==SUBSTRACTION)
+        enrich_substraction(nai_rt, dmso_rt, length, nai_rt_sf, dmso_rt_sf, sub_fac, score.data());
+    else if(param.enrich_method==DIVIDING)
+        enrich_dividing(nai_bd, dmso_bd, length, nai_bd_sf, dmso_bd_sf, div_fac, null, score.data());
+    else if(param.enrich_method==COMPLEX)
+        enrich_complex(nai_rt, dmso_rt, dmso_bd, length, nai_rt_sf, dmso_rt_sf, dmso_bd_sf, sub_fac, div_fac, null, score.data());
+    else if(param.enrich_method==LOG)
+        enrich_log(nai_rt, dmso_rt, dmso_bd, length, add_fac, param.fast_log, null, score.data());
+    else
+        throw Unexpected_Error("enrich_method unrecognized option");
+}
+
+// calculate enrichment with DMSO and NAI
+void calcEnrich(const deque<float> &dmso_bd, const deque<float> &dmso_rt,
+                const deque<float> &nai_bd, const deque<float> &nai_rt,
+                const float &dmso_bd_sf, const float &dmso_rt_sf, 
+                const float &nai_bd_sf, const float &nai_rt_sf, 
+                FloatArray &score, const icSHAPE_Param &param)
+{
+    FloatArray dmso_bd_v(dmso_bd.cbegin(), dmso_bd.cend()), dmso_rt_v(dmso_rt.cbegin(), dmso_rt.cend());
+    FloatArray nai_bd_v(nai_bd.cbegin(), nai_bd.cend()), nai_rt_v(nai_rt.cbegin(), nai_rt.cend());
+    calc_enrich(dmso_bd_v.data(), dmso_rt_v.data(), nai_bd_v.data(), nai_rt_v.data(), dmso_bd.size(), 
+                dmso_bd_sf, dmso_rt_sf, nai_bd_sf, nai_rt_sf, score, param);
+}
+
+/**** icSHAPE sliding window ****/
+
+icSHAPE_Window::icSHAPE_Window(const uLONG &wsize, const float &min_low_bd): 
+    nai_rt(wsize), nai_bd(wsize), dmso_rt(wsize), dmso_bd(wsize), mask(wsize),
+    sorted_nai_rt(wsize), sorted_nai_bd(wsize), sorted_dmso_rt(wsize), sorted_dmso_bd(wsize),
+    min_low_bd(min_low_bd)
+{
+
+}
+
+void icSHAPE_Window::push_back(const float &nai_rt_v, const float &nai_bd_v, const float &dmso_rt_v, const float &dmso_bd_v, const bool &selected)
+{
+    nai_rt.push_back(nai_rt_v);
+    nai_bd.push_back(nai_bd_v);
+    dmso_rt.push_back(dmso_rt_v);
+    dmso_bd.push_back(dmso_bd_v);
+    mask.push_back(selected);
+
+    if(dmso_bd_v >= min_low_bd)
+        ++low_bd_num;
+
+    if(selected)
     {
-        for(uLONG i=0; i<length; i++)
-            score.push_back( (nai_rt[i]/nai_rt_sf)-sub_fac*(dmso_rt[i]/dmso_rt_sf) );
-    }else if(param.enrich_method==DIVIDING)
+        sorted_nai_rt.insert(nai_rt_v);
+        sorted_nai_bd.insert(nai_bd_v);
+        sorted_dmso_rt.insert(dmso_rt_v);
+        sorted_dmso_bd.insert(dmso_bd_v);
+        selected_nai_rt_sum += nai_rt_v;
+    }
+}
+
+void icSHAPE_Window::pop_front()
+{
+    if(dmso_bd.front() >= min_low_bd)
+        --low_bd_num;
+
+    if(mask.front())
     {
-        for(uLONG i=0; i<length; i++)
-            if(dmso_bd[i] > 0)
-                score.push_back( div_fac * (nai_bd[i]/nai_bd_sf) / (dmso_bd[i]/dmso_bd_sf) );
-            else
-                score.push_back(null);
+        sorted_nai_rt.erase(nai_rt.front());
+        sorted_nai_bd.erase(nai_bd.front());
+        sorted_dmso_rt.erase(dmso_rt.front());
+        sorted_dmso_bd.erase(dmso_bd.front());
+        selected_nai_rt_sum -= nai_rt.front();
+    }
 
-    }else if(param.enrich_method==COMPLEX){
-        for(uLONG i=0; i<length; i++)
-            if(dmso_bd[i] > 0)
-                score.push_back( div_fac * ((nai_rt[i]/nai_rt_sf)-sub_fac*(dmso_rt[i]/dmso_rt_sf)) / (dmso_bd[i]/dmso_bd_sf) );
-            else
-                score.push_back(null);
-    }else if(param.enrich_method==LOG){
-        for(uLONG i=0; i<length; i++)
-            if(dmso_bd[i] > 0)
-            {
-                //cout << "add_fac: " << add_fac << endl;
-                //cout << "(nai_rt[i]+add_fac)/(dmso_rt[i]+add_fac): " << (nai_rt[i]+add_fac)/(dmso_rt[i]+add_fac) << endl;
-                score.push_back( log2( (nai_rt[i]+add_fac)/(dmso_rt[i]+add_fac) ) );
-            }
-            else
-                score.push_back(null);
-    }else{
-        throw Unexpected_Error("enrich_method unrecognized option");
+    nai_rt.pop_front();
+    nai_bd.pop_front();
+    dmso_rt.pop_front();
+    dmso_bd.pop_front();
+    mask.pop_front();
+}
+
+bool icSHAPE_Window::low_exp_region() const
+{
+    return low_bd_num < dmso_bd.size()/5;
+}
+
+void icSHAPE_Window::calculate_score(FloatArray &scores, const icSHAPE_Param &param, const bool &use_mask)
+{
+    scores.clear();
+
+    const uLONG selected_num = sorted_dmso_bd.size();
+    if(use_mask and selected_num < 20)
+    {
+        scores.assign(size(), null);
+        return;
+    }
+
+    // same as valid_cov(dmso_bd, nai_rt) of the selected values
+    const float min_bd = 50, min_rt = 1.0;
+    float ave_rt = selected_nai_rt_sum / selected_num;
+    if(not (sorted_dmso_bd.count_ge(min_bd) > selected_num/2 and ave_rt >= min_rt))
+    {
+        scores.assign(size(), null);
+        return;
+    }
+
+    float nai_rt_sf = calcScalingFactor(sorted_nai_rt.sorted(), param);
+    float nai_bd_sf = calcScalingFactor(sorted_nai_bd.sorted(), param);
+    float dmso_rt_sf = calcScalingFactor(sorted_dmso_rt.sorted(), param);
+    float dmso_bd_sf = calcScalingFactor(sorted_dmso_bd.sorted(), param);
+
+    if(nai_rt_sf == 0 or nai_bd_sf == 0 or dmso_rt_sf == 0 or dmso_bd_sf == 0)
+    {
+        scores.assign(size(), null);
+        return;
+    }
+
+    if(not use_mask)
+    {
+        calc_enrich(dmso_bd.data(), dmso_rt.data(), nai_bd.data(), nai_rt.data(), size(), 
+                    dmso_bd_sf, dmso_rt_sf, nai_bd_sf, nai_rt_sf, scores, param);
+        winsorization(scores, param.winsor_factor);
+        return;
+    }
+
+    nai_rt_mask.clear(); nai_bd_mask.clear(); dmso_rt_mask.clear(); dmso_bd_mask.clear();
+    for(uLONG i=0; i<size(); i++)
+    {
+        if(mask[i])
+        {
+            nai_rt_mask.push_back(nai_rt[i]);
+            nai_bd_mask.push_back(nai_bd[i]);
+            dmso_rt_mask.push_back(dmso_rt[i]);
+            dmso_bd_mask.push_back(dmso_bd[i]);
+        }
+    }
+
+    calc_enrich(dmso_bd_mask.data(), dmso_rt_mask.data(), nai_bd_mask.data(), nai_rt_mask.data(), selected_num, 
+                dmso_bd_sf, dmso_rt_sf, nai_bd_sf, nai_rt_sf, scores_mask, param);
+
+    winsorization(scores_mask, param.winsor_factor);
+
+    for(uLONG i=0,j=0; i<size(); i++)
+    {
+        if(mask[i])
+            scores.push_back(scores_mask[j++]);
+        else
+            scores.push_back(null);
     }
 }
 
@@ -1262,12 +1474,14 @@ void calcEnrich(const deque<float> &dmso_bd, const deque<float> &dmso_rt,
 //###############################
 
 // calculate SHAPE score with NAI RT/BD in non-junction regions
-void sliding_non_junction(  const uIntArray &NAI_RT, const uIntArray &NAI_BD,
-                            const JunctionArray &junctions, FloatArray &score, 
+void sliding_non_junction(  const Coverage_Array &NAI_RT, const Coverage_Array &NAI_BD,
+                            const JunctionArray &junctions, Score_Array &score, 
                             const string &chr_id, const STRAND &strand, 
-                            ofstream &OUT, const smartSHAPE_Param &param,
-                            const vector<bool> &chr_mask, const string &chr_seq)
+                            ostream &OUT, const smartSHAPE_Param &param,
+                            const Base_Mask &chr_mask, const Seq_View &chr_seq)
 {
+    Fast_Writer writer(OUT);
+
     bool use_mask = chr_mask.empty() ? false : true;
     if(use_mask and NAI_RT.size() != chr_mask.size())
         throw runtime_error("NAI_RT.size() != chr_mask.size() -- "+to_string(NAI_RT.size())+" != "+to_string(chr_mask.size()));
@@ -1317,9 +1531,9 @@ void sliding_non_junction(  const uIntArray &NAI_RT, const uIntArray &NAI_BD,
 
         for(uLONG i=6; i<chr_size-30; i++)
             if(NAI_BD[i] < min_cov)
-                score[i] = null;
+                score.set(i, null);
             else
-                score[i] = scores[i];
+                score.set(i, scores[i]);
 
         for(uLONG index=1; index<chr_size; index++)
         {
@@ -1333,7 +1547,7 @@ void sliding_non_junction(  const uIntArray &NAI_RT, const uIntArray &NAI_BD,
 
             if(masked and (NAI_RT[index] >= 1 or NAI_BD[index] >= out_min_cov))
             {
-                OUT << chr_id << '\t' << strand_char << '\t' << index << '\t' << base
+                writer << chr_id << '\t' << strand_char << '\t' << index << '\t' << base
                     << NAI_RT[index] << '\t' << NAI_BD[index] << '\t'
                     << score[index] << '\t' << (score[index]==null ? 0 : 1) << '\t' 
                     //<< ((index>=scores.size()) ? null : scores[index]) << '\n';
@@ -1419,7 +1633,7 @@ void sliding_non_junction(  const uIntArray &NAI_RT, const uIntArray &NAI_BD,
             float shape_score = mean_score(precalculated.front(), valid_count);
             if(NAI_BD[index] < min_cov)
                 shape_score = null;
-            score[ index ] = shape_score;
+            score.set(index, shape_score);
 
             string base;
             bool masked = true;
@@ -1431,14 +1645,14 @@ void sliding_non_junction(  const uIntArray &NAI_RT, const uIntArray &NAI_BD,
 
             if(masked and (NAI_RT[index] >= 1 or NAI_BD[index] >= out_min_cov))
             {
-                OUT << chr_id << '\t' << strand_char << '\t' << index << '\t' << base
+                writer << chr_id << '\t' << strand_char << '\t' << index << '\t' << base
                     << NAI_RT[index] << '\t' << NAI_BD[index] << '\t'
                     << shape_score << '\t' << valid_count << '\t';
 
                 for(float v: precalculated.front())
-                    OUT << v << ',';
+                    writer << v << ',';
 
-                OUT << '\n';
+                writer << '\n';
             }
 
 
@@ -1507,7 +1721,7 @@ void sliding_non_junction(  const uIntArray &NAI_RT, const uIntArray &NAI_BD,
         float shape_score = mean_score(precalculated.front(), valid_count);
         if(NAI_BD[index] < min_cov)
             shape_score = null;
-        score[ index ] = shape_score;
+        score.set(index, shape_score);
         
         string base;
         bool masked = true;
@@ -1519,14 +1733,14 @@ void sliding_non_junction(  const uIntArray &NAI_RT, const uIntArray &NAI_BD,
 
         if(masked and (NAI_RT[index] >= 1 or NAI_BD[index] >= out_min_cov))
         {
-            OUT << chr_id << '\t' << strand_char << '\t' << index << '\t' << base
+            writer << chr_id << '\t' << strand_char << '\t' << index << '\t' << base
                 << NAI_RT[index] << '\t' << NAI_BD[index] << '\t'
                 << shape_score << '\t' << valid_count << '\t';
 
             for(float v: precalculated.front())
-                OUT << v << ',';
+                writer << v << ',';
 
-            OUT << '\n';
+            writer << '\n';
         }
 
         index_array.pop_front();
@@ -1534,20 +1748,20 @@ void sliding_non_junction(  const uIntArray &NAI_RT, const uIntArray &NAI_BD,
     }
 
     for(uLONG i=0; i<30 and i<=chr_size; i++)
-        score[i] = null;
+        score.set(i, null);
     uLONG s = 0;
     if(chr_size > 30)
         s = chr_size - 30;
     for(uLONG i=s; i<=chr_size; i++)
-        score[i] = null;
+        score.set(i, null);
 }
 
 // sliding all junctions in junction regions with NAI RT/BD
-void sliding_junction( const uIntArray &NAI_RT, const uIntArray &NAI_BD,
-                        const JunctionArray &junctions, FloatArray &score, 
+void sliding_junction( const Coverage_Array &NAI_RT, const Coverage_Array &NAI_BD,
+                        const JunctionArray &junctions, Score_Array &score, 
                         const string &chr_id, const STRAND &strand, 
-                        ofstream &OUT, const smartSHAPE_Param &param,
-                        const vector<bool> &chr_mask, const string &chr_seq)
+                        ostream &OUT, const smartSHAPE_Param &param,
+                        const Base_Mask &chr_mask, const Seq_View &chr_seq)
 {
 
     ///////////////////////////
@@ -1574,12 +1788,14 @@ void sliding_junction( const uIntArray &NAI_RT, const uIntArray &NAI_BD,
 
 
 // sliding a single junction with NAI RT/BD
-void sliding_single_junction(const uIntArray &NAI_RT, const uIntArray &NAI_BD,
-                            const uLONG &start, const uLONG &end, FloatArray &score,
+void sliding_single_junction(const Coverage_Array &NAI_RT, const Coverage_Array &NAI_BD,
+                            const uLONG &start, const uLONG &end, Score_Array &score,
                             const string &chr_id, const STRAND &strand, 
-                            ofstream &OUT, const smartSHAPE_Param &param,
-                            const vector<bool> &chr_mask, const string &chr_seq)
+                            ostream &OUT, const smartSHAPE_Param &param,
+                            const Base_Mask &chr_mask, const Seq_View &chr_seq)
 {
+    Fast_Writer writer(OUT);
+
     bool use_mask = chr_mask.empty() ? false : true;
     if(use_mask and NAI_RT.size() != chr_mask.size())
         throw runtime_error("NAI_RT.size() != chr_mask.size() -- "+to_string(NAI_RT.size())+" != "+to_string(chr_mask.size()));
@@ -1649,7 +1865,7 @@ void sliding_single_junction(const uIntArray &NAI_RT, const uIntArray &NAI_BD,
                 if(NAI_BD[index] < min_cov)
                     shape_score = null;
                 
-                score[ index ] = shape_score;
+                score.set(index, shape_score);
 
                 string base;
                 bool masked = true;
@@ -1661,14 +1877,14 @@ void sliding_single_junction(const uIntArray &NAI_RT, const uIntArray &NAI_BD,
 
                 if(masked and (NAI_RT[index] >= 1 or NAI_BD[index] >= out_min_cov))
                 {
-                    OUT << chr_id << '\t' << strand_char << '\t' << index << '\t' << base
+                    writer << chr_id << '\t' << strand_char << '\t' << index << '\t' << base
                         << NAI_RT[index] << '\t' << NAI_BD[index] << '\t'
                         << shape_score << '\t' << valid_count << '\t';
 
                     for(float v: precalculated.front())
-                        OUT << v << ',';
+                        writer << v << ',';
 
-                    OUT << '\n';
+                    writer << '\n';
                 }
             }
             index_array.pop_front();
@@ -1729,7 +1945,7 @@ void sliding_single_junction(const uIntArray &NAI_RT, const uIntArray &NAI_BD,
             float shape_score = mean_score(precalculated.front(), valid_count);
             if(NAI_BD[index] < min_cov)
                 shape_score = null;
-            score[ index ] = shape_score;
+            score.set(index, shape_score);
             
 
             string base;
@@ -1742,14 +1958,14 @@ void sliding_single_junction(const uIntArray &NAI_RT, const uIntArray &NAI_BD,
 
             if(masked and (NAI_RT[index] >= 1 or NAI_BD[index] >= out_min_cov))
             {
-                OUT << chr_id << '\t' << strand_char << '\t' << index << '\t' << base
+                writer << chr_id << '\t' << strand_char << '\t' << index << '\t' << base
                     << NAI_RT[index] << '\t' << NAI_BD[index] << '\t'
                     << shape_score << '\t' << valid_count << '\t';
 
                 for(float v: precalculated.front())
-                    OUT << v << ',';
+                    writer << v << ',';
 
-                OUT << '\n';
+                writer << '\n';
             }
         }
 
@@ -1875,14 +2091,13 @@ void sink_score(FloatArray &score, const float &sink_index)
     if(sink_index == 0)
         return;
 
-    FloatArray sortedTrimed_array = score;
-
-    sort(sortedTrimed_array.begin(), sortedTrimed_array.end());
+    Order_Stat<float> stat;
+    stat.assign(score.cbegin(), score.cend());
 
-    uLONG len = sortedTrimed_array.size();
+    uLONG len = stat.size();
     uLONG winsorLen = sink_index * len;
 
-    float sink_value = sortedTrimed_array.at(winsorLen);
+    float sink_value = stat.kth_smallest(winsorLen);
 
     for(float &v: score)
         v -= sink_value;
@@ -1907,34 +2122,16 @@ void winsorization( FloatArray &score, const float &winsor_factor)
         return;
     }
 
-    for(uLONG i=0; i<score.size(); i++)
-    {
-        if(score[i] != null)
-        {
-            if(score[i] > winsorUpper)
-                score[i] = 1;
-            else if(score[i] < winsorLower)
-                score[i] = 0;
-            else
-                score[i] = (score[i] - winsorLower)/(winsorUpper-winsorLower);
-        }
-    }
+    winsor_scale(score.data(), score.size(), winsorLower, winsorUpper, null);
 }
 
 // Get winsor upper(U) and lower(L), and normalize each raw xi to (xi-L)/(U-L)
 void winsorWindow(  const FloatArray &score, const float &winsor_factor, float &winsorLower, float &winsorUpper)
 {
+    static thread_local Order_Stat<float> stat;
+    stat.assign_not(score.cbegin(), score.cend(), null);
 
-    FloatArray sortedTrimed_array;
-    for(uINT i=0; i<=score.size(); i++)
-    {
-        if(score[i] != null)
-            sortedTrimed_array.push_back(score[i]);
-    }
-
-    sort(sortedTrimed_array.begin(), sortedTrimed_array.end());
-
-    uLONG len = sortedTrimed_array.size();
+    uLONG len = stat.size();
     if(len < 20)
     {
         winsorLower = winsorUpper = 0;
@@ -1943,28 +2140,22 @@ void winsorWindow(  const FloatArray &score, const float &winsor_factor, float &
 
     uLONG winsorLen = winsor_factor * len;
 
-    winsorLower = sortedTrimed_array[winsorLen];
-    winsorUpper = sortedTrimed_array[len-winsorLen-1];
+    winsorLower = stat.kth_smallest(winsorLen);
+    winsorUpper = stat.kth_smallest(len-winsorLen-1);
 }
 
 
-// calculate calcScalingFactor when input a array
-float calcScalingFactor(const deque<float> &data_array, const icSHAPE_Param &param)
+// ranks of the values selected by norm_sample_method, counted from the largest value.
+// positive_num is the number of values > 0, which are selected by SMART
+static void select_scaling_ranks(const uINT &len, const uINT &positive_num, const icSHAPE_Param &param, 
+                                uINT &selectStart, uINT &selectNum)
 {
-    FloatArray sorted_data(data_array.cbegin(), data_array.cend());
-    sort(sorted_data.rbegin(), sorted_data.rend());
-
-    uINT len = sorted_data.size();
-    FloatArray rangeOfSelection;
+    selectStart = 0;
+    selectNum = 0;
     if(param.norm_sample_method == SMART)
     {
-        for(uLONG idx=0; idx<len; idx++)
-        {
-            if(sorted_data[idx] <= 0) break;
-            rangeOfSelection.push_back(sorted_data[idx]);
-        }
+        selectNum = positive_num;
     }else{
-        uINT selectStart = 0;
         uINT selectEnd = len - 1;
 
         float f = param.norm_sample_factor;
@@ -1987,42 +2178,113 @@ float calcScalingFactor(const deque<float> &data_array, const icSHAPE_Param &par
             throw Unexpected_Error("norm_method unrecognized option");
         }
 
-        for(auto it=sorted_data.cbegin()+selectStart; it!=sorted_data.cbegin()+selectEnd+1; it++)
-            rangeOfSelection.push_back(*it);
+        if(selectEnd+1 > selectStart)
+            selectNum = selectEnd + 1 - selectStart;
     }
+}
 
-    len = rangeOfSelection.size();
+// scaling factor of the selected values, desc(i) is the i-th largest value.
+// The values are summed from the largest one like the sorted selection
+template<typename Desc>
+static float selected_scaling_factor(const Desc &desc, const uINT &selectStart, const uINT &len, const icSHAPE_Param &param)
+{
+    if(len == 0)
+        return 0;
 
     float scalling_factor = 1.0;
     if(param.norm_calc_method == MEDIAN)
     {
         float median = 1;
-        if ( len % 2 == 0 ) {  median = (rangeOfSelection[len/2-1] + rangeOfSelection[len/2]) /2;  }
-        else {  median = rangeOfSelection[(len-1)/2];  }
+        if ( len % 2 == 0 ) {  median = (desc(selectStart+len/2-1) + desc(selectStart+len/2)) /2;  }
+        else {  median = desc(selectStart+(len-1)/2);  }
         scalling_factor = median;
 
     }else if(param.norm_calc_method == MEAN)
     {
         float Sum = 0.0;
-        for(const float &v: rangeOfSelection) Sum += v;
-        scalling_factor = Sum/rangeOfSelection.size();
+        for(uINT i=0; i<len; i++) Sum += desc(selectStart+i);
+        scalling_factor = Sum/len;
 
     }else if(param.norm_calc_method == PEAK)
     {
-        scalling_factor = rangeOfSelection[0];
+        scalling_factor = desc(selectStart);
     }
 
     return scalling_factor;
 }
 
+// calculate calcScalingFactor when input a array, only the selected values are sorted
+float calcScalingFactor(const deque<float> &data_array, const icSHAPE_Param &param)
+{
+    static thread_local Order_Stat<float> stat;
+    stat.assign(data_array.cbegin(), data_array.cend());
+
+    const uINT len = stat.size();
+    const uINT positive_num = param.norm_sample_method == SMART ? stat.count_greater(0) : 0;
+
+    uINT selectStart, selectNum;
+    select_scaling_ranks(len, positive_num, param, selectStart, selectNum);
+    if(selectNum == 0)
+        return 0;
+
+    stat.sort_ranks(len-selectStart-selectNum, len-selectStart);
+    return selected_scaling_factor([len](const uINT &idx){ return stat[len-1-idx]; }, selectStart, selectNum, param);
+}
+
+// calculate calcScalingFactor from values sorted in ascending order
+float calcScalingFactor(const vector<float> &sorted_data, const icSHAPE_Param &param)
+{
+    const uINT len = sorted_data.size();
+    const uINT positive_num = sorted_data.cend() - upper_bound(sorted_data.cbegin(), sorted_data.cend(), 0.0f);
+
+    uINT selectStart, selectNum;
+    select_scaling_ranks(len, positive_num, param, selectStart, selectNum);
+
+    return selected_scaling_factor([&sorted_data, len](const uINT &idx){ return sorted_data[len-1-idx]; }, selectStart, selectNum, param);
+}
+
 // Sync tab files (from sam2tab), must be sorted
-bool sync_chrs(vector<ifstream *> &i_vec, StringArray &chr_ids, vector< vector<Map_Record> > &record_array)
+// position of chr_id+strand in the index of hander, return -1 if not found
+static long index_pos(const Tab_Reader *hander, const string &chr_id)
+{
+    const Tab_Index_Item *item = hander->find_chr(chr_id);
+    return item ? item - hander->get_index().data() : -1;
+}
+
+bool sync_chrs(vector<Tab_Reader *> &i_vec, StringArray &chr_ids, vector<Map_Records> &record_array)
 {
     uLONG file_num = i_vec.size();
 
     if(file_num != chr_ids.size() or file_num != record_array.size())
         throw Unexpected_Error("FATAL Error: sync_chrs different size");
 
+    bool indexed = true;
+    for(uLONG i=0; i<file_num; i++)
+        indexed = indexed and i_vec[i]->has_index();
+
+    if(indexed)
+    {
+        // jump to the next chr_id+strand shared by all files
+        const vector<Tab_Index_Item> &first_index = i_vec[0]->get_index();
+        for(uLONG pos=i_vec[0]->next_chr_pos(); pos<first_index.size(); pos++)
+        {
+            const string &chr_id = first_index[pos].chr_id;
+            bool shared = true;
+            for(uLONG i=1; i<file_num and shared; i++)
+                shared = index_pos(i_vec[i], chr_id) >= long(i_vec[i]->next_chr_pos());
+            if(not shared)
+                continue;
+
+            for(uLONG i=0; i<file_num; i++)
+            {
+                i_vec[i]->seek_chr(chr_id);
+                read_chr(record_array[i], i_vec[i], chr_ids[i]);
+            }
+            return true;
+        }
+        return false;
+    }
+
     for(uLONG i=0; i<file_num; i++)
         if(not read_chr(record_array[i], i_vec[i], chr_ids[i]))
             return false;
@@ -2050,6 +2312,279 @@ bool sync_chrs(vector<ifstream *> &i_vec, StringArray &chr_ids, vector< vector<M
     return true;
 }
 
+StringArray shared_chrs(const vector<Tab_Reader *> &i_vec)
+{
+    StringArray chr_ids;
+    for(uLONG i=0; i<i_vec.size(); i++)
+        if(not i_vec[i]->has_index())
+            throw Unexpected_Error("FATAL Error: shared_chrs needs indexed tab files");
+
+    if(i_vec.empty())
+        return chr_ids;
+
+    for(const Tab_Index_Item &item: i_vec[0]->get_index())
+    {
+        bool shared = true;
+        for(uLONG i=1; i<i_vec.size() and shared; i++)
+            shared = i_vec[i]->find_chr(item.chr_id) != nullptr;
+        if(shared)
+            chr_ids.push_back(item.chr_id);
+    }
+    return chr_ids;
+}
+
+/**** Sort gTab ****/
+
+// rows [begin, end) of the file with the same chr_id+strand and ascending pos
+struct gTab_Run
+{
+    uLONG begin;
+    uLONG end;
+};
+
+// a row is chr_id \t strand \t pos [\t ...], strand_end is the end of strand, pos_end is the end of pos
+static void parse_gTab_row(const string &line, uLONG &strand_end, uLONG &pos, uLONG &pos_end)
+{
+    const uLONG tab = line.find('\t');
+    if(tab == string::npos or tab+3 >= line.size() or line[tab+2] != '\t')
+    {
+        cerr << RED << "FATAL Error: invalid gTab line: " << line << DEF << endl;
+        exit(-1);
+    }
+    strand_end = tab+2;
+    pos = 0;
+    for(pos_end=tab+3; pos_end<line.size() and line[pos_end]!='\t'; pos_end++)
+    {
+        if(line[pos_end] < '0' or line[pos_end] > '9')
+        {
+            cerr << RED << "FATAL Error: invalid gTab line: " << line << DEF << endl;
+            exit(-1);
+        }
+        pos = pos*10 + (line[pos_end]-'0');
+    }
+    if(pos_end == tab+3)
+    {
+        cerr << RED << "FATAL Error: invalid gTab line: " << line << DEF << endl;
+        exit(-1);
+    }
+}
+
+// read the rows of a run with a buffer of block_size bytes
+class gTab_Run_Reader
+{
+public:
+    gTab_Run_Reader(const gTab_Run &run): next(run.begin), end(run.end) {}
+
+    // read the next row, return false at the end of run
+    bool next_row(ifstream &IN, const uLONG &block_size)
+    {
+        line.clear();
+        while(true)
+        {
+            if(buffer_pos == buffer.size())
+            {
+                if(next == end)
+                    break;
+                buffer.resize( min(block_size, end-next) );
+                IN.clear();
+                IN.seekg(next);
+                if(not IN.read(&buffer[0], buffer.size()))
+                {
+                    cerr << RED << "FATAL Error: cannot read the gTab runs" << DEF << endl;
+                    exit(-1);
+                }
+                next += buffer.size();
+                buffer_pos = 0;
+            }
+
+            const char *p = buffer.data() + buffer_pos;
+            const char *line_end = (const char *)memchr(p, '\n', buffer.size()-buffer_pos);
+            if(line_end)
+            {
+                line.append(p, line_end);
+                buffer_pos += line_end - p + 1;
+                break;
+            }
+            line.append(p, buffer.size()-buffer_pos);
+            buffer_pos = buffer.size();
+        }
+
+        if(line.empty())
+            return false;
+        uLONG strand_end;
+        parse_gTab_row(line, strand_end, pos, pos_end);
+        return true;
+    }
+
+    string line;
+    uLONG pos = 0;
+    uLONG pos_end = 0;
+
+private:
+    uLONG next;
+    const uLONG end;
+    string buffer;
+    uLONG buffer_pos = 0;
+};
+
+// merge the runs of IN by pos, the run order breaks the ties of pos
+template<typename Row_Writer>
+static void merge_gTab_runs(ifstream &IN, const vector<gTab_Run> &runs, Row_Writer write_row)
+{
+    const uLONG block_size = max(uLONG(1<<12), uLONG(1<<24) / runs.size());
+
+    vector<gTab_Run_Reader> readers(runs.cbegin(), runs.cend());
+    priority_queue<pair<uLONG, uLONG>, vector<pair<uLONG, uLONG>>, greater<pair<uLONG, uLONG>>> heads;
+    for(uLONG i=0; i<readers.size(); i++)
+        if(readers[i].next_row(IN, block_size))
+            heads.emplace(readers[i].pos, i);
+
+    while(not heads.empty())
+    {
+        const uLONG i = heads.top().second;
+        heads.pop();
+        write_row(readers[i]);
+        if(readers[i].next_row(IN, block_size))
+            heads.emplace(readers[i].pos, i);
+    }
+}
+
+void sort_gTab(const string &inFn, const string &outFn, const uLONG &fan_in)
+{
+    ifstream IN(inFn, ifstream::in | ifstream::binary);
+    check_input_handle(IN, inFn);
+    IN.seekg(0, ios::end);
+    const uLONG file_size = IN.tellg();
+    IN.seekg(0);
+
+    // split the rows into ascending runs, the calculation writes a run for the non-junction region
+    // and a run for every junction of a chr_id+strand
+    map<pair<string, char>, vector<gTab_Run>> key_runs;
+    vector<gTab_Run> *runs = nullptr;
+    string head, line, last_key;
+    uLONG offset = 0, last_pos = 0, run_num = 0;
+    while(getline(IN, line))
+    {
+        const uLONG line_begin = offset;
+        offset = min(offset+line.size()+1, file_size);
+        if(line[0] == '@')
+        {
+            head += line + '\n';
+            runs = nullptr;
+            continue;
+        }
+
+        uLONG strand_end, pos, pos_end;
+        parse_gTab_row(line, strand_end, pos, pos_end);
+        if(not runs or pos <= last_pos or line.compare(0, strand_end, last_key) != 0)
+        {
+            last_key.assign(line, 0, strand_end);
+            runs = &key_runs[ make_pair(last_key.substr(0, strand_end-2), last_key.back()) ];
+            runs->push_back( gTab_Run{line_begin, line_begin} );
+            ++run_num;
+        }
+        runs->back().end = offset;
+        last_pos = pos;
+    }
+    clog << "\t" << run_num << " runs of " << key_runs.size() << " chr_id+strand" << endl;
+
+    ofstream OUT;
+    unique_ptr<Fast_Writer> text_writer;
+    unique_ptr<BGTab_Writer> bgtab_writer;
+    string row;
+    try{
+        if(is_bgtab_file(outFn))
+            bgtab_writer.reset(new BGTab_Writer(outFn, head));
+        else{
+            OUT.open(outFn, ofstream::out);
+            check_output_handle(OUT, outFn);
+            text_writer.reset(new Fast_Writer(OUT));
+            (*text_writer) << head;
+        }
+
+        // an empty column is added after pos
+        auto write_row = [&](const gTab_Run_Reader &reader)
+        {
+            if(text_writer)
+            {
+                text_writer->write(reader.line.data(), reader.pos_end);
+                (*text_writer) << '\t';
+                text_writer->write(reader.line.data()+reader.pos_end, reader.line.size()-reader.pos_end);
+                (*text_writer) << '\n';
+            }else{
+                row.assign(reader.line, 0, reader.pos_end);
+                row.push_back('\t');
+                row.append(reader.line, reader.pos_end, string::npos);
+                bgtab_writer->write_line(row);
+            }
+        };
+
+        /*  Merge the runs of each chr_id+strand by pos, at most fan_in runs at a time with 16M buffer in total.
+            A chr_id+strand with more runs is merged in passes: the groups of fan_in consecutive runs are merged
+            into the runs of a temporary file, which keeps the run order. The offsets of the runs take 16 bytes
+            a run (a run per junction), the other memory is constant  */
+        const string merge_files[] = { inFn+".merge0", inFn+".merge1" };
+        ifstream MERGE_IN[2];
+        bool merged_file = false;
+        for(const auto &key_run: key_runs)
+        {
+            vector<gTab_Run> chr_runs = key_run.second;
+            ifstream *source = &IN;
+            for(uINT pass=0; chr_runs.size() > fan_in; pass++)
+            {
+                const uINT k = pass % 2;
+                MERGE_IN[k].close();
+                ofstream MERGE(merge_files[k], ofstream::out | ofstream::binary);
+                check_output_handle(MERGE, merge_files[k]);
+                merged_file = true;
+
+                vector<gTab_Run> merged_runs;
+                uLONG merged_size = 0;
+                {
+                    Fast_Writer writer(MERGE);
+                    for(uLONG g=0; g<chr_runs.size(); g+=fan_in)
+                    {
+                        const vector<gTab_Run> group(chr_runs.cbegin()+g, chr_runs.cbegin()+min(g+fan_in, uLONG(chr_runs.size())));
+                        merged_runs.push_back( gTab_Run{merged_size, merged_size} );
+                        merge_gTab_runs(*source, group, [&](const gTab_Run_Reader &reader)
+                        {
+                            writer << reader.line << '\n';
+                            merged_size += reader.line.size() + 1;
+                        });
+                        merged_runs.back().end = merged_size;
+                    }
+                }
+                MERGE.close();
+                if(not MERGE)
+                {
+                    cerr << RED << "FATAL Error: cannot write " << merge_files[k] << DEF << endl;
+                    exit(-1);
+                }
+
+                MERGE_IN[k].open(merge_files[k], ifstream::in | ifstream::binary);
+                check_input_handle(MERGE_IN[k], merge_files[k]);
+                source = &MERGE_IN[k];
+                chr_runs.swap(merged_runs);
+            }
+
+            merge_gTab_runs(*source, chr_runs, write_row);
+        }
+        if(merged_file)
+        {
+            MERGE_IN[0].close();
+            MERGE_IN[1].close();
+            remove(merge_files[0].c_str());
+            remove(merge_files[1].c_str());
+        }
+
+        if(bgtab_writer)
+            bgtab_writer->close();
+    }catch(runtime_error &e){
+        cerr << RED << e.what() << DEF << endl;
+        exit(-1);
+    }
+}
+
 // Check if input handle opened
 void check_input_handle(ifstream &IN, const string &fn)
 {
@@ -2070,5 +2605,47 @@ void check_output_handle(ofstream &OUT, const string &fn)
     }
 }
 
+// peak resident memory of the process in KB
+uLONG peak_rss_kb()
+{
+    rusage usage;
+    if(getrusage(RUSAGE_SELF, &usage) != 0)
+        return 0;
+    // ru_maxrss is in bytes on macOS
+#ifdef __APPLE__
+    return usage.ru_maxrss / 1024;
+#else
+    return usage.ru_maxrss;
+#endif
+}
 
+/**** Genome ****/
 
+void Genome::load(const string &file_name)
+{
+    packed = is_packed_genome_file(file_name);
+    if(packed)
+        packed_genome.load(file_name);
+    else
+        fasta.load_fasta_file(file_name, true);
+}
+
+void Genome::base_mask(const string &chrID, const STRAND &strand, const vector<char> &bases, Base_Mask &chr_mask) const
+{
+    if(packed)
+    {
+        packed_genome.base_mask(chrID, strand, bases, chr_mask);
+        return;
+    }
+
+    // the bases of NEGATIVE are complementary in the coordinates of the positive strand
+    Seq_View chr_seq = fasta.get_chr_view(chrID, strand);
+    if(strand == NEGATIVE)
+        chr_seq = chr_seq.reversed();
+
+    const uLONG chrLen = chr_seq.size();
+    chr_mask.assign(chrLen+1, false);
+    for(uLONG i=1; i<=chrLen; i++)
+        if( find(bases.cbegin(), bases.cend(), chr_seq[i-1]) != bases.cend() )
+            chr_mask.set(i);
+}
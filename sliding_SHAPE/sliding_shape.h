@@ -3,6 +3,10 @@
 
 
 #include <param.h>
+#include <order_stat.h>
+#include <fast_writer.h>
+#include <gtab_file.h>
+#include <chunked_array.h>
 #include <sam.h>
 
 #include <iostream>
@@ -20,6 +24,10 @@
 #include <time.h>       /* time */
 
 #include "fasta.h"
+#include "packed_genome.h"
+#include "tab_file.h"
+#include "sliding_window.h"
+#include "enrich_kernel.h"
 
 using namespace std;
 using namespace pan;
@@ -44,15 +52,14 @@ enum EnrichMethod { SUBSTRACTION, DIVIDING, COMPLEX, RT, LOG }; // RT is for sma
 //enum STRAND{ NEG=0, POS=1 };
 
 
-struct Map_Record
+// the match regions of a read, in the region pool of Map_Records
+typedef Record_View Map_Record;
+
+// reads of a chr_id+strand, the regions of all reads are in a single pool (see Tab_Records),
+// so there is no allocation per read
+struct Map_Records: public Tab_Records
 {
     STRAND strand = POSITIVE;
-    vector<Region> regions;  
-
-    Map_Record(const vector<Region> &regions, const STRAND &strand): 
-        strand(strand), regions(regions){ }
-    Map_Record(const StringArray &line_data);
-    Map_Record() = default;
 };
 
 
@@ -78,6 +85,41 @@ struct icSHAPE_Param
     uINT min_cov = 200;
     uINT wsize = 200;
     uINT wstep = 5;
+
+    bool fast_log = false;      // fast_log2 for LOG enrich method
+};
+
+// sliding window of icSHAPE, moved by push_back()/pop_front().
+// The values selected by mask are also kept sorted in each track, so the scaling factors
+// of a window are read by index, instead of sorting 4 tracks after every step
+class icSHAPE_Window
+{
+public:
+    icSHAPE_Window(const uLONG &wsize, const float &min_low_bd=10);
+
+    // selected -- the base is selected by mask (always true without mask)
+    void push_back(const float &nai_rt, const float &nai_bd, const float &dmso_rt, const float &dmso_bd, const bool &selected=true);
+    void pop_front();
+
+    uLONG size() const { return nai_rt.size(); }
+
+    // same as low_exp_region(dmso_bd, min_low_bd)
+    bool low_exp_region() const;
+
+    // same as calculate_score (use_mask=false) or calculate_mask_score (use_mask=true)
+    void calculate_score(FloatArray &scores, const icSHAPE_Param &param, const bool &use_mask);
+
+private:
+    Sliding_Buffer<float> nai_rt, nai_bd, dmso_rt, dmso_bd;
+    Sliding_Buffer<char> mask;
+    Sorted_Window<float> sorted_nai_rt, sorted_nai_bd, sorted_dmso_rt, sorted_dmso_bd;
+
+    const float min_low_bd;
+    uLONG low_bd_num = 0;            // number of dmso_bd >= min_low_bd
+    double selected_nai_rt_sum = 0;  // sum of selected nai_rt, the values are counts so it is exact
+
+    // selected values of a masked window
+    FloatArray nai_rt_mask, nai_bd_mask, dmso_rt_mask, dmso_bd_mask, scores_mask;
 };
 
 struct smartSHAPE_Param
@@ -118,12 +160,54 @@ using JunctionArray = vector<Junction>;
 // read sjdbList.fromGTF.out.tab file (in STAR index directory)
 void load_junctions(const string &file_name, MapStringT<JunctionArray> &junctions, const MapStringuLONG &chr_size);
 
-// build junction index, left means build with junction start; right means build with junction end
-void buildLeftJunctionMap(JunctionArray &junctions, map<uLONG, vector<Junction*>> &junc_map, const uLONG &binsize=100000);
-void buildRightJunctionMap(JunctionArray &junctions, map<uLONG, vector<Junction*>> &junc_map, const uLONG &binsize=100000);
+// the junctions of a bin in the order of the junction array, empty if the bin has no junction
+struct Junction_Bin
+{
+    Junction *const *junctions = nullptr;
+    uLONG count = 0;
+    bool disjoint = true;       // first<=second of each junction and junctions[i]->second < junctions[i+1]->first
+
+    bool empty() const { return count == 0; }
+    uLONG size() const { return count; }
+    Junction *operator[](const uLONG &i) const { return junctions[i]; }
+};
+
+/*
+Junction index of a chromosome, left means build with junction start (Junction_Index::LEFT);
+right means build with junction end (Junction_Index::RIGHT).
+The junctions are binned by key/binsize into a sorted array, a bin is found by binary search,
+and a junction is found by binary search of its key. The junction array must not be changed while it is indexed
+*/
+class Junction_Index
+{
+public:
+    enum Key { LEFT, RIGHT };
+
+    Junction_Index(JunctionArray &junctions, const Key &key, const uLONG &binsize=100000);
+
+    Junction_Bin bin(const uLONG &bin_id) const;
+
+    // the first junction (in the order of the junction array) of bin_id with key == value, nullptr if not found
+    Junction *find(const uLONG &bin_id, const uLONG &value) const;
+
+    // the first junction of bin_id which is the region, nullptr if not found
+    Junction *find(const uLONG &bin_id, const Region &region) const;
+
+private:
+    uLONG key_of(const Junction *jp) const { return key == LEFT ? jp->first : jp->second; }
+
+    Key key;
+    uLONG binsize;
+
+    vector<Junction*> binned;           // sorted by bin, in the order of the junction array in a bin
+    vector<uLONG> bin_ids;              // bins with junctions, sorted
+    vector<uLONG> bin_offsets;          // bin_ids[i] is binned[bin_offsets[i], bin_offsets[i+1])
+    vector<char> bin_disjoint;
+    vector<pair<uLONG, uLONG>> keys;    // (key, index in binned), sorted
+};
 
 // count junction reads
-void build_junction_support(const vector<Map_Record> &record_array, JunctionArray &junctions);
+void build_junction_support(const Map_Records &record_array, JunctionArray &junctions);
 
 // preserve junctions with max supported reads when junctions overlap
 void combine_junction(JunctionArray &junctions);
@@ -137,8 +221,11 @@ void write_junctions(const MapStringT<JunctionArray> &junctions, const string &o
 
 /**** Read Tab file (from sam file) ****/
 
-// read a single chromosome data, input file must be sorted!!
-bool read_chr(vector<Map_Record> &record_array, ifstream *hander, string &chr_id);
+// read a single chromosome data (.tab or .btab), input file must be sorted!!
+bool read_chr(Map_Records &records, Tab_Reader *hander, string &chr_id);
+
+// load a chromosome (chr_id+strand) by the index of tab file, it can be called from multiple threads
+bool load_chr(Map_Records &records, const Tab_Reader *hander, const string &chr_id);
 
 /**** Read chromosome size file ****/
 
@@ -147,11 +234,47 @@ void load_chr_size(const string &file_name, MapStringuLONG &chr_size);
 
 /**** calculate RT and BD ****/
 
+// per-base RT/BD and scores of a chromosome, only the blocks with coverage are allocated
+typedef Chunked_Array<uINT> Coverage_Array;
+typedef Chunked_Array<float> Score_Array;
+
 // calculate chromsome RT and BD in positive strand (input record_array must be in positive strand)
-void calc_chr_BDRT_Pos(uIntArray &BD, uIntArray &RT, const vector<Map_Record> &record_array, JunctionArray &junctions,const uLONG &size, const uLONG &BD_ext=0, const uLONG &binsize=100000);
+void calc_chr_BDRT_Pos(Coverage_Array &BD, Coverage_Array &RT, const Map_Records &record_array, JunctionArray &junctions,const uLONG &size, const uLONG &BD_ext=0, const uLONG &binsize=100000);
 
 // calculate chromsome RT and BD in negative strand (input record_array must be in negative strand)
-void calc_chr_BDRT_Neg(uIntArray &BD, uIntArray &RT, const vector<Map_Record> &record_array, JunctionArray &junctions, const uLONG &size, const uLONG &BD_ext=0, const uLONG &binsize=100000);
+void calc_chr_BDRT_Neg(Coverage_Array &BD, Coverage_Array &RT, const Map_Records &record_array, JunctionArray &junctions, const uLONG &size, const uLONG &BD_ext=0, const uLONG &binsize=100000);
+
+// RT and BD of several tracks of a chromosome in interleaved arrays, the values of a position are stored
+// together: track t of position pos is at pos*track_num()+t
+class Replicate_Coverage
+{
+public:
+    // size -- the number of positions, chromosome size + 1
+    Replicate_Coverage(const uLONG &size, const uLONG &track_num);
+
+    uLONG size() const { return chr_size; }
+    uLONG track_num() const { return tracks; }
+
+    uINT get_RT(const uLONG &pos, const uLONG &t) const { return RT[pos*tracks+t]; }
+    uINT get_BD(const uLONG &pos, const uLONG &t) const { return BD[pos*tracks+t]; }
+
+    Coverage_Array RT;
+    Coverage_Array BD;
+
+private:
+    uLONG chr_size;
+    uLONG tracks;
+};
+
+// calculate RT and BD of all replicates of a chromosome (all in strand), the junction index is built once.
+// Replicate i is added to track track_of[i], so the replicates can be kept apart or summed, eg. track_of={0,0,1,1}
+void calc_chr_BDRT(Replicate_Coverage &coverage, const vector<Map_Records> &record_array, const vector<uLONG> &track_of,
+        JunctionArray &junctions, const uLONG &size, const STRAND &strand, const uLONG &BD_ext=0, const uLONG &binsize=100000);
+
+// the same with a pair of single arrays (size+1 positions) for each track, replicate i is added to RT[track_of[i]] 
+// and BD[track_of[i]]. The tracks are counted one by one, so a difference array of a track is allocated at a time
+void calc_chr_BDRT(vector<Coverage_Array> &RT, vector<Coverage_Array> &BD, const vector<Map_Records> &record_array, const vector<uLONG> &track_of,
+        JunctionArray &junctions, const uLONG &size, const STRAND &strand, const uLONG &BD_ext=0, const uLONG &binsize=100000);
 
 
 /**** Cutoff functions ****/
@@ -169,29 +292,29 @@ bool valid_cov(const deque<float> &bd, const deque<float> &rt, const float &min_
 
 // calculate SHAPE score with NAI and DMSO RT/BD in non-junction regions
 // score must be init
-void sliding_non_junction(  const uIntArray &NAI_RT, const uIntArray &DMSO_RT,
-                            const uIntArray &NAI_BD, const uIntArray &DMSO_BD,
-                            const JunctionArray &junctions, FloatArray &score, 
+void sliding_non_junction(  const Coverage_Array &NAI_RT, const Coverage_Array &DMSO_RT,
+                            const Coverage_Array &NAI_BD, const Coverage_Array &DMSO_BD,
+                            const JunctionArray &junctions, Score_Array &score, 
                             const string &chr_id, const STRAND &strand, 
-                            ofstream &OUT, const icSHAPE_Param &param,
-                            const vector<bool> &chr_mask, const string &chr_seq);
+                            ostream &OUT, const icSHAPE_Param &param,
+                            const Base_Mask &chr_mask, const Seq_View &chr_seq);
 
 // sliding all junctions in junction regions with NAI + DMSO RT/BD
 // score must be init
-void sliding_junction( const uIntArray &NAI_RT, const uIntArray &DMSO_RT,
-                        const uIntArray &NAI_BD, const uIntArray &DMSO_BD,
-                        const JunctionArray &junctions, FloatArray &score, 
+void sliding_junction( const Coverage_Array &NAI_RT, const Coverage_Array &DMSO_RT,
+                        const Coverage_Array &NAI_BD, const Coverage_Array &DMSO_BD,
+                        const JunctionArray &junctions, Score_Array &score, 
                         const string &chr_id, const STRAND &strand, 
-                        ofstream &OUT, const icSHAPE_Param &param,
-                        const vector<bool> &chr_mask, const string &chr_seq);
+                        ostream &OUT, const icSHAPE_Param &param,
+                        const Base_Mask &chr_mask, const Seq_View &chr_seq);
 
 // sliding a single junction with NAI + DMSO RT/BD
-void sliding_single_junction(const uIntArray &NAI_RT, const uIntArray &DMSO_RT,
-                            const uIntArray &NAI_BD, const uIntArray &DMSO_BD,
-                            const uLONG &start, const uLONG &end, FloatArray &score,
+void sliding_single_junction(const Coverage_Array &NAI_RT, const Coverage_Array &DMSO_RT,
+                            const Coverage_Array &NAI_BD, const Coverage_Array &DMSO_BD,
+                            const uLONG &start, const uLONG &end, Score_Array &score,
                             const string &chr_id, const STRAND &strand, 
-                            ofstream &OUT, const icSHAPE_Param &param,
-                            const vector<bool> &chr_mask, const string &chr_seq);
+                            ostream &OUT, const icSHAPE_Param &param,
+                            const Base_Mask &chr_mask, const Seq_View &chr_seq);
 
 // calculate SHAPE score with NAI + DMSO RT/BD
 void calculate_score(const deque<float> &nai_rt, const deque<float> &nai_bd, 
@@ -213,26 +336,26 @@ void calcEnrich(const deque<float> &dmso_bd, const deque<float> &dmso_rt,
 
 // calculate SHAPE score with NAI RT/BD in non-junction regions,
 // score must be init
-void sliding_non_junction(  const uIntArray &NAI_RT, const uIntArray &NAI_BD,
-                            const JunctionArray &junctions, FloatArray &score, 
+void sliding_non_junction(  const Coverage_Array &NAI_RT, const Coverage_Array &NAI_BD,
+                            const JunctionArray &junctions, Score_Array &score, 
                             const string &chr_id, const STRAND &strand, 
-                            ofstream &OUT, const smartSHAPE_Param &param,
-                            const vector<bool> &chr_mask, const string &chr_seq);
+                            ostream &OUT, const smartSHAPE_Param &param,
+                            const Base_Mask &chr_mask, const Seq_View &chr_seq);
 
 // sliding all junctions in junction regions with NAI RT/BD
 // score must be init
-void sliding_junction( const uIntArray &NAI_RT, const uIntArray &NAI_BD,
-                        const JunctionArray &junctions, FloatArray &score, 
+void sliding_junction( const Coverage_Array &NAI_RT, const Coverage_Array &NAI_BD,
+                        const JunctionArray &junctions, Score_Array &score, 
                         const string &chr_id, const STRAND &strand, 
-                        ofstream &OUT, const smartSHAPE_Param &param,
-                        const vector<bool> &chr_mask, const string &chr_seq);
+                        ostream &OUT, const smartSHAPE_Param &param,
+                        const Base_Mask &chr_mask, const Seq_View &chr_seq);
 
 // sliding a single junction with NAI RT/BD
-void sliding_single_junction(const uIntArray &NAI_RT, const uIntArray &NAI_BD,
-                            const uLONG &start, const uLONG &end, FloatArray &score,
+void sliding_single_junction(const Coverage_Array &NAI_RT, const Coverage_Array &NAI_BD,
+                            const uLONG &start, const uLONG &end, Score_Array &score,
                             const string &chr_id, const STRAND &strand, 
-                            ofstream &OUT, const smartSHAPE_Param &param,
-                            const vector<bool> &chr_mask, const string &chr_seq);
+                            ostream &OUT, const smartSHAPE_Param &param,
+                            const Base_Mask &chr_mask, const Seq_View &chr_seq);
 
 // calculate smart-SHAPE score with NAI RT and BD
 void calculate_score(const deque<float> &nai_rt, const deque<float> &nai_bd, FloatArray &scores, const smartSHAPE_Param &param);
@@ -256,11 +379,17 @@ void winsorization(FloatArray &score, const float &winsor_factor=0.05);
 void winsorWindow(const FloatArray &score, const float &winsor_factor, float &winsorLower, float &winsorUpper);
 
 
-// calculate calcScalingFactor when input a array
+// calculate calcScalingFactor when input a array, by selection of the sampled values
 float calcScalingFactor(const deque<float> &data_array, const icSHAPE_Param &param);
 
-// Sync tab files (from sam2tab), must be sorted
-bool sync_chrs(vector<ifstream *> &i_vec, StringArray &chr_ids, vector< vector<Map_Record> > &record_array);
+// calculate calcScalingFactor from values sorted in ascending order
+float calcScalingFactor(const vector<float> &sorted_data, const icSHAPE_Param &param);
+
+// Sync tab files (from sam2tab), must be sorted. With index, the non-shared chromosomes are skipped without reading
+bool sync_chrs(vector<Tab_Reader *> &i_vec, StringArray &chr_ids, vector<Map_Records> &record_array);
+
+// chromosomes (chr_id+strand) shared by all indexed tab files, in file order
+StringArray shared_chrs(const vector<Tab_Reader *> &i_vec);
 
 // Check if input handle opened
 void check_input_handle(ifstream &IN, const string &fn);
@@ -268,108 +397,60 @@ void check_input_handle(ifstream &IN, const string &fn);
 // Check if output handle opened
 void check_output_handle(ofstream &OUT, const string &fn);
 
+// peak resident memory of the process in KB
+uLONG peak_rss_kb();
+
 /**** load sequence ****/
 
-inline bool build_chr_mask(qFasta &seq_holder, 
+// the genome of -genome: a fasta file, which is memory mapped, or a .pgenome file built by fa2pgenome.
+// It is read-only after load, so the threads can read it together
+class Genome
+{
+public:
+    void load(const string &file_name);
+
+    bool has_chr(const string &chrID) const { return packed ? packed_genome.has_chr(chrID) : fasta.has_chr(chrID); }
+    uLONG get_chr_len(const string &chrID) const { return packed ? packed_genome.get_chr_len(chrID) : fasta.get_chr_len(chrID); }
+    Seq_View get_chr_view(const string &chrID, const STRAND &strand) const
+        { return packed ? packed_genome.get_chr_view(chrID, strand) : fasta.get_chr_view(chrID, strand); }
+
+    // chr_mask[i] is true if the base of the 1-based position i is in bases
+    void base_mask(const string &chrID, const STRAND &strand, const vector<char> &bases, Base_Mask &chr_mask) const;
+
+private:
+    bool packed = false;
+    qFasta fasta;
+    Packed_Genome packed_genome;
+};
+
+// build the mask of bases on a strand, chr_seq is a view of the strand in the coordinates of the positive strand
+inline bool build_chr_mask(const Genome &genome, 
                     const string &chrID, 
                     const STRAND &strand, 
                     const vector<char> &bases, 
-                    vector<bool> &chr_mask,
-                    string &chr_seq)
+                    Base_Mask &chr_mask,
+                    Seq_View &chr_seq)
 {
-    if(not seq_holder.has_chr(chrID))
+    if(not genome.has_chr(chrID))
     {
         return false;
     }
-    chr_mask.clear();
-    uLONG chrLen = seq_holder.get_chr_len(chrID);
-    chr_seq = seq_holder.get_chr_subbseq(chrID, 0, string::npos, strand);
-
-    //cout << chr_seq.substr(0, 100) << endl << endl;
-    //cout << chr_seq.substr(chr_seq.size()-100) << endl;
+    chr_seq = genome.get_chr_view(chrID, strand);
 
     if(strand == NEGATIVE)
-        reverse(chr_seq.begin(),chr_seq.end());
+        chr_seq = chr_seq.reversed();
 
-    chr_mask.assign(chrLen+1, false);
-    for(uLONG i=1; i<=chrLen; i++)
-        if( find(bases.cbegin(), bases.cend(), chr_seq[i-1]) != bases.cend() )
-            chr_mask[i] = true;
+    genome.base_mask(chrID, strand, bases, chr_mask);
 
     return true;
 }
 
 
 
-struct gTab_line
-{
-    string chrID;
-    char strand;
-    uLONG pos;
-    string left_content;
-};
-
-inline bool gTab_line_cmp(const gTab_line *p1, const gTab_line *p2)
-{
-    if(p1->chrID < p2->chrID)
-    {
-        return true;
-    }else if(p1->chrID > p2->chrID)
-    {
-        return false;
-    }else{
-        if(p1->strand < p2->strand)
-        {
-            return true;
-        }else if(p1->strand > p2->strand)
-        {
-            return false;
-        }else{
-            if(p1->pos < p2->pos)
-            {
-                return true;
-            }else{
-                return false;
-            }
-        }
-    }
-}
-
-inline void sort_gTab(const string &inFn, const string &outFn)
-{
-    vector<gTab_line*> gtab_vector;
-    string head;
-    ifstream IN;
-    IN.open(inFn, ifstream::in);
-    string line;
-    while (getline(IN, line))
-    {
-        if(line[0] == '@')
-        {
-            head += line + '\n';
-            continue;
-        }
-
-        istringstream iss(line);
-        gTab_line *pline = new gTab_line;
-        iss >> pline->chrID >> pline->strand >> pline->pos;
-        getline (iss, pline->left_content);
-        gtab_vector.push_back(pline);
-    }
-    IN.close();
-
-    sort(gtab_vector.begin(), gtab_vector.end(), gTab_line_cmp);
-
-    ofstream OUT;
-    OUT.open(outFn, ofstream::out);
-    OUT << head;
-    for(gTab_line *pline: gtab_vector)
-    {
-        OUT << pline->chrID << "\t" << pline->strand << "\t" << to_string(pline->pos)  << "\t" << pline->left_content << "\n";
-        delete pline;
-    }
-    OUT.close();
-}
+// sort the rows of the .tmp file of calc_sliding_shape by chr_id, strand and pos, with an empty column after pos.
+// The rows are read as ascending runs and merged at most fan_in runs at a time (in passes through the temporary
+// files inFn.merge0/1), rows of equal keys keep the input order. A .bgTab outFn is written in the binary format
+void sort_gTab(const string &inFn, const string &outFn, const uLONG &fan_in=256);
 
 
 
@@ -0,0 +1,97 @@
+#ifndef SLIDING_WINDOW_H
+#define SLIDING_WINDOW_H
+
+#include <pan_type.h>
+#include <exceptions.h>
+
+#include <algorithm>
+
+using namespace std;
+using namespace pan;
+
+/**** Containers for a sliding window ****/
+
+// values of a sliding window, the live values are always contiguous in a buffer of 2*capacity.
+// pop_front only moves the head, the live values are moved to the front when the buffer is full
+template<typename T>
+class Sliding_Buffer
+{
+public:
+    explicit Sliding_Buffer(const uLONG &capacity=0): buffer(2*capacity+1) { }
+
+    void push_back(const T &value)
+    {
+        if(tail == buffer.size())
+            compact();
+        buffer[tail++] = value;
+    }
+
+    void pop_front() { ++head; }
+    void clear() { head = tail = 0; }
+
+    uLONG size() const { return tail - head; }
+    bool empty() const { return tail == head; }
+
+    const T &front() const { return buffer[head]; }
+    const T &operator[](const uLONG &i) const { return buffer[head+i]; }
+
+    // the live values are data()[0, size())
+    const T *data() const { return buffer.data() + head; }
+
+private:
+    void compact()
+    {
+        std::move(buffer.begin()+head, buffer.begin()+tail, buffer.begin());
+        tail -= head;
+        head = 0;
+        if(tail == buffer.size())
+            buffer.resize(2*buffer.size());
+    }
+
+    vector<T> buffer;
+    uLONG head = 0;
+    uLONG tail = 0;
+};
+
+// a multiset in a sorted array (ascending), the order statistics are read by index.
+// insert/erase is a binary search and a move of the tail, which is cheap for windows of thousands of values
+template<typename T>
+class Sorted_Window
+{
+public:
+    explicit Sorted_Window(const uLONG &capacity=0) { values.reserve(capacity); }
+
+    void insert(const T &value)
+    {
+        values.insert(upper_bound(values.begin(), values.end(), value), value);
+    }
+
+    // the value must be in the window
+    void erase(const T &value)
+    {
+        auto it = lower_bound(values.begin(), values.end(), value);
+        if(it == values.end() or *it != value)
+            throw Unexpected_Error("Sorted_Window::erase: value not found");
+        values.erase(it);
+    }
+
+    void clear() { values.clear(); }
+
+    uLONG size() const { return values.size(); }
+
+    // the i-th smallest value
+    const T &operator[](const uLONG &i) const { return values[i]; }
+
+    // number of values >= value
+    uLONG count_ge(const T &value) const
+    {
+        return values.end() - lower_bound(values.begin(), values.end(), value);
+    }
+
+    const vector<T> &sorted() const { return values; }
+
+private:
+    vector<T> values;
+};
+
+#endif // SLIDING_WINDOW_H
@@ -0,0 +1,130 @@
+#include <param.h>
+#include <string_split.h>
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "version.h"
+#include "tab_file.h"
+
+using namespace std;
+using namespace pan;
+
+Color::Modifier RED(Color::FG_RED);
+Color::Modifier DEF(Color::FG_DEFAULT);
+Color::Modifier YELLOW(Color::FG_YELLOW);
+
+void print_usage()
+{
+    char buff[2000];
+    const char *help_info =
+            "tab2btab - convert a tab file generated by sam2tab to the binary compressed format\n"
+            "=============================================================\n"
+            "\e[1mUSAGE:\e[0m\n"
+            "\ttab2btab -in input.tab -out output.btab\n"
+            "\e[1mHELP:\e[0m\n"
+            "\t-in: input a .tab or .btab file\n"
+            "\t-out: output file, it will be binary if it ends with .btab, or text (with a .idx index) for other names\n\n"
+
+            "\e[1mVERSION:\e[0m\n\t%s\n"
+            "\e[1mLIB VERSION:\e[0m\n\t%s\n"
+            "\e[1mCOMPILE DATE:\e[0m\n\t%s\n"
+            "\e[1mAUTHOR:\e[0m\n\t%s\n";
+
+    sprintf(buff, help_info, BINVERSION, LIBVERSION, DATE, "Li Pan");
+    cerr << buff << endl;
+}
+
+struct Param
+{
+    string input_file;
+    string output_file;
+
+    operator bool()
+    {
+        return input_file.empty() or output_file.empty() ? false : true;
+    }
+};
+
+void has_next(int argc, int current)
+{
+    if(current + 1 >= argc)
+    {
+        cerr << RED << "FATAL ERROR: Parameter Error" << DEF << endl;
+        print_usage();
+        exit(-1);
+    }
+}
+
+Param read_param(int argc, char *argv[])
+{
+    Param param;
+    for(int i=1; i<argc; i++)
+    {
+        if( argv[i][0] == '-' )
+        {
+            if(not strcmp(argv[i]+1, "in"))
+            {
+                has_next(argc, i);
+                param.input_file = argv[i+1];
+                i++;
+            }else if(not strcmp(argv[i]+1, "out"))
+            {
+                has_next(argc, i);
+                param.output_file = argv[i+1];
+                i++;
+            }else{
+                cerr << RED << "FATAL ERROR: unknown option: " << argv[i] << DEF << endl;
+                print_usage();
+                exit(-1);
+            }
+        }else{
+            cerr << RED << "FATAL ERROR: unknown option: " << argv[i] << DEF << endl;
+            print_usage();
+            exit(-1);
+        }
+    }
+    return param;
+}
+
+void convert_tab(const Param &param)
+{
+    Tab_Reader *IN = open_tab_reader(param.input_file);
+    Tab_Writer *OUT = open_tab_writer(param.output_file);
+
+    Tab_Records records;
+    uLONG total = 0;
+    while(IN->read_chr(records))
+    {
+        const string chr_id = records.chr_id.substr(0, records.chr_id.size()-1);
+        const char strand = records.chr_id.back();
+        for(uLONG i=0; i<records.size(); i++)
+            OUT->write(chr_id, strand, records[i]);
+        total += records.size();
+        clog << "\t" << records.chr_id << ": " << records.size() << " records" << endl;
+    }
+
+    OUT->close();
+    delete OUT;
+    delete IN;
+
+    clog << "Total records: " << total << endl;
+}
+
+int main(int argc, char *argv[])
+{
+    Param param = read_param(argc, argv);
+    if(not param)
+    {
+        print_usage();
+        exit(-1);
+    }
+
+    convert_tab(param);
+
+    return 0;
+}
@@ -0,0 +1,532 @@
+#include "tab_file.h"
+
+#include <param.h>
+#include <string_split.h>
+#include <binary_io.h>
+
+#include <zlib.h>
+
+extern Color::Modifier RED;
+extern Color::Modifier DEF;
+
+static const char BTAB_MAGIC[] = "BTAB";
+static const uINT BTAB_VERSION = 1;
+
+/**** Writers ****/
+
+Text_Tab_Writer::Text_Tab_Writer(const string &file_name, bool write_index): file_name(file_name), write_index(write_index)
+{
+    OUT.open(file_name, ofstream::out);
+    if(not OUT)
+    {
+        cerr << RED << "FATAL Error: cannot write " << file_name << DEF << endl;
+        exit(-1);
+    }
+}
+
+void Text_Tab_Writer::write(const string &chr_id, const char &strand, const Record_View &regions)
+{
+    if(write_index and (index.empty() or strand != last_strand or chr_id != last_chr_id))
+    {
+        last_chr_id = chr_id;
+        last_strand = strand;
+        const string key = chr_id + strand;
+        if(written_chrs.count(key))
+        {
+            cerr << RED << "Warning: records of " << key << " are not contiguous, " << file_name << " will not be indexed" << DEF << endl;
+            write_index = false;
+            index.clear();
+            written_chrs.clear();
+        }else{
+            written_chrs.insert(key);
+            index.push_back( Tab_Index_Item() );
+            index.back().chr_id = key;
+            index.back().offset = OUT.tellp();
+        }
+    }
+
+    OUT << chr_id << '\t' << strand;
+    for(const Region &r: regions)
+        OUT << '\t' << r.first << '\t' << r.second;
+    OUT << '\n';
+
+    if(write_index)
+    {
+        ++index.back().record_num;
+        index.back().region_num += regions.size();
+    }
+}
+
+void Text_Tab_Writer::close()
+{
+    if(not OUT.is_open())
+        return;
+
+    const uLONG file_size = OUT.tellp();
+    OUT.close();
+
+    const string index_file = tab_index_file(file_name);
+    if(not write_index)
+    {
+        remove(index_file.c_str());
+        return;
+    }
+
+    ofstream INDEX(index_file, ofstream::out);
+    if(not INDEX)
+    {
+        cerr << RED << "Warning: cannot write " << index_file << DEF << endl;
+        return;
+    }
+    INDEX << "@FileSize\t" << file_size << "\n";
+    for(const Tab_Index_Item &item: index)
+        INDEX << item.chr_id.substr(0, item.chr_id.size()-1) << '\t' << item.chr_id.back() << '\t' 
+            << item.offset << '\t' << item.record_num << '\t' << item.region_num << '\n';
+    INDEX.close();
+}
+
+BTab_Writer::BTab_Writer(const string &file_name, const uLONG &block_size): block_size(block_size)
+{
+    OUT.open(file_name, ofstream::out | ofstream::binary);
+    if(not OUT)
+    {
+        cerr << RED << "FATAL Error: cannot write " << file_name << DEF << endl;
+        exit(-1);
+    }
+
+    string head(BTAB_MAGIC, 4);
+    put_fixed(head, BTAB_VERSION, 4);
+    OUT.write(head.data(), head.size());
+}
+
+void BTab_Writer::write(const string &chr_id, const char &strand, const Record_View &regions)
+{
+    const string key = chr_id + strand;
+    if(index.empty() or index.back().chr_id != key)
+    {
+        flush_block();
+        if(written_chrs.count(key))
+            throw Unexpected_Error("FATAL Error: records of "+key+" are not contiguous");
+        written_chrs.insert(key);
+
+        index.push_back( Tab_Index_Item() );
+        index.back().chr_id = key;
+        index.back().offset = OUT.tellp();
+    }
+
+    put_varint(block, regions.size());
+    uLONG last_end = 0;
+    for(uLONG i=0; i<regions.size(); i++)
+    {
+        const Region &r = regions[i];
+        if(r.second < r.first)
+            throw Unexpected_Error("FATAL Error: invalid region in "+key);
+
+        if(i == 0)
+        {
+            put_zigzag(block, r.first, last_start);
+            last_start = r.first;
+        }else
+            put_zigzag(block, r.first, last_end);
+        put_varint(block, r.second - r.first);
+        last_end = r.second;
+    }
+
+    ++block_records;
+    ++index.back().record_num;
+    index.back().region_num += regions.size();
+
+    if(block.size() >= block_size)
+        flush_block();
+}
+
+void BTab_Writer::flush_block()
+{
+    if(block_records == 0)
+        return;
+
+    uLongf compressed_size = compressBound(block.size());
+    string compressed(compressed_size, '\0');
+    if(compress2((Bytef*)&compressed[0], &compressed_size, (const Bytef*)block.data(), block.size(), Z_DEFAULT_COMPRESSION) != Z_OK)
+        throw Unexpected_Error("FATAL Error: compress btab block failed");
+
+    string head;
+    put_fixed(head, block.size(), 4);
+    put_fixed(head, compressed_size, 4);
+    put_fixed(head, block_records, 4);
+    OUT.write(head.data(), head.size());
+    OUT.write(compressed.data(), compressed_size);
+
+    ++index.back().block_num;
+    block.clear();
+    block_records = 0;
+    last_start = 0;
+}
+
+void BTab_Writer::close()
+{
+    if(closed)
+        return;
+    flush_block();
+
+    const uLONG footer_offset = OUT.tellp();
+    string footer;
+    put_fixed(footer, index.size(), 8);
+    for(const Tab_Index_Item &item: index)
+    {
+        put_fixed(footer, item.chr_id.size(), 4);
+        footer += item.chr_id;
+        put_fixed(footer, item.offset, 8);
+        put_fixed(footer, item.block_num, 8);
+        put_fixed(footer, item.record_num, 8);
+        put_fixed(footer, item.region_num, 8);
+    }
+    put_fixed(footer, footer_offset, 8);
+    footer.append(BTAB_MAGIC, 4);
+    OUT.write(footer.data(), footer.size());
+
+    OUT.close();
+    closed = true;
+}
+
+Tab_Writer *open_tab_writer(const string &file_name)
+{
+    if(endswith(file_name, ".btab"))
+        return new BTab_Writer(file_name);
+    else
+        return new Text_Tab_Writer(file_name);
+}
+
+/**** Readers ****/
+
+// parse a line into records, return false if it belongs to other chr_id+strand
+static bool parse_tab_line(const string &line, Tab_Records &records, FieldArray &data)
+{
+    split(line, '\t', data);
+    if(data.size() < 4 or data.size() % 2 != 0)
+        throw Unexpected_Error("FATAL Error: invliad line: "+line);
+
+    if(records.offsets.size() == 1)
+        records.chr_id.assign(data[0].data(), data[0].size()).append(data[1].data(), data[1].size());
+    else if(records.chr_id.size() != data[0].size() + data[1].size() or
+            records.chr_id.compare(0, data[0].size(), data[0].data(), data[0].size()) != 0 or
+            records.chr_id.compare(data[0].size(), string::npos, data[1].data(), data[1].size()) != 0)
+        return false;
+
+    for(auto it=data.cbegin()+2; it!=data.cend(); it+=2)
+        records.regions.emplace_back( parse_uLONG(*it), parse_uLONG(*(it+1)) );
+    records.offsets.push_back( records.regions.size() );
+    return true;
+}
+
+static void reserve_records(const Tab_Index_Item &item, Tab_Records &records)
+{
+    records.regions.reserve(item.region_num);
+    records.offsets.reserve(item.record_num + 1);
+}
+
+static void read_btab_blocks(ifstream &IN, const string &file_name, const Tab_Index_Item &item, 
+    Tab_Records &records, string &compressed, string &raw)
+{
+    records.chr_id = item.chr_id;
+    reserve_records(item, records);
+
+    IN.clear();
+    IN.seekg(item.offset);
+    for(uLONG b=0; b<item.block_num; b++)
+    {
+        char head[12];
+        read_exact(IN, head, 12, file_name);
+        const char *p = head;
+        uLongf raw_size = get_fixed(p, 4);
+        const uLONG compressed_size = get_fixed(p, 4);
+        const uLONG block_records = get_fixed(p, 4);
+
+        compressed.resize(compressed_size);
+        read_exact(IN, &compressed[0], compressed_size, file_name);
+        raw.resize(raw_size);
+        if(uncompress((Bytef*)&raw[0], &raw_size, (const Bytef*)compressed.data(), compressed_size) != Z_OK or raw_size != raw.size())
+            throw Unexpected_Error("FATAL Error: bad btab block in "+file_name);
+
+        p = raw.data();
+        const char *end = p + raw.size();
+        uLONG last_start = 0;
+        for(uLONG i=0; i<block_records; i++)
+        {
+            const uLONG region_num = get_varint(p, end);
+            if(region_num == 0)
+                throw Unexpected_Error("FATAL Error: invliad record without regions in "+file_name);
+            uLONG last_end = 0;
+            for(uLONG j=0; j<region_num; j++)
+            {
+                uLONG start;
+                if(j == 0)
+                    start = last_start = get_zigzag(p, end, last_start);
+                else
+                    start = get_zigzag(p, end, last_end);
+                last_end = start + get_varint(p, end);
+                records.regions.emplace_back(start, last_end);
+            }
+            records.offsets.push_back( records.regions.size() );
+        }
+    }
+}
+
+const Tab_Index_Item *Tab_Reader::find_chr(const string &chr_id) const
+{
+    auto it = index_map.find(chr_id);
+    if(it == index_map.end())
+        return nullptr;
+    return &index[it->second];
+}
+
+void Tab_Reader::build_index_map()
+{
+    index_map.clear();
+    for(uLONG i=0; i<index.size(); i++)
+        index_map[ index[i].chr_id ] = i;
+}
+
+Text_Tab_Reader::Text_Tab_Reader(const string &file_name): file_name(file_name)
+{
+    IN.open(file_name, ifstream::in);
+    if(not IN)
+    {
+        cerr << RED << "FATAL Error: " << file_name << " cannot be read" << DEF << endl;
+        exit(-1);
+    }
+    load_index();
+}
+
+void Text_Tab_Reader::load_index()
+{
+    ifstream INDEX(tab_index_file(file_name), ifstream::in);
+    if(not INDEX)
+        return;
+
+    IN.seekg(0, ios::end);
+    const uLONG file_size = IN.tellg();
+    IN.seekg(0);
+
+    string line;
+    StringArray fields;
+    try{
+        getline(INDEX, line);
+        split(line, '\t', fields);
+        if(fields.size() != 2 or fields[0] != "@FileSize" or stoul(fields[1]) != file_size)
+        {
+            cerr << RED << "Warning: " << tab_index_file(file_name) << " does not match " << file_name << ", ignore it" << DEF << endl;
+            return;
+        }
+        while(getline(INDEX, line))
+        {
+            split(line, '\t', fields);
+            if(fields.size() != 5)
+                throw Unexpected_Error("bad index line: "+line);
+            Tab_Index_Item item;
+            item.chr_id = fields[0] + fields[1];
+            item.offset = stoul(fields[2]);
+            item.record_num = stoul(fields[3]);
+            item.region_num = stoul(fields[4]);
+            index.push_back(item);
+        }
+    }catch(exception &e)
+    {
+        cerr << RED << "Warning: bad index " << tab_index_file(file_name) << ", ignore it" << DEF << endl;
+        index.clear();
+        return;
+    }
+
+    INDEX.close();
+    build_index_map();
+    indexed = true;
+}
+
+bool Text_Tab_Reader::read_chr(Tab_Records &records)
+{
+    records.clear();
+
+    while(next_line.empty())
+        if(not getline(IN, next_line))
+            return false;
+
+    parse_tab_line(next_line, records, data);
+    next_line.clear();
+
+    const Tab_Index_Item *item = indexed ? find_chr(records.chr_id) : nullptr;
+    if(item)
+    {
+        reserve_records(*item, records);
+        next_chr = index_map.at(item->chr_id) + 1;
+    }else
+        ++next_chr;
+
+    string line;
+    while(getline(IN, line))
+    {
+        if(line.empty())
+            continue;
+        if(not parse_tab_line(line, records, data))
+        {
+            next_line = line;
+            break;
+        }
+    }
+
+    return true;
+}
+
+void Text_Tab_Reader::seek_chr(const string &chr_id)
+{
+    const Tab_Index_Item *item = find_chr(chr_id);
+    if(not item)
+        throw Unexpected_Error("FATAL Error: "+chr_id+" not found in index of "+file_name);
+
+    IN.clear();
+    IN.seekg(item->offset);
+    next_line.clear();
+    next_chr = index_map.at(chr_id);
+}
+
+bool Text_Tab_Reader::load_chr(const string &chr_id, Tab_Records &records) const
+{
+    records.clear();
+    const Tab_Index_Item *item = find_chr(chr_id);
+    if(not item)
+        return false;
+
+    ifstream CHR_IN(file_name, ifstream::in);
+    if(not CHR_IN)
+    {
+        cerr << RED << "FATAL Error: " << file_name << " cannot be read" << DEF << endl;
+        exit(-1);
+    }
+    CHR_IN.seekg(item->offset);
+    reserve_records(*item, records);
+
+    string line;
+    FieldArray fields;
+    while(records.size() < item->record_num and getline(CHR_IN, line))
+    {
+        if(line.empty())
+            continue;
+        if(not parse_tab_line(line, records, fields) or records.chr_id != chr_id)
+            throw Unexpected_Error("FATAL Error: "+tab_index_file(file_name)+" does not match the file");
+    }
+    if(records.size() != item->record_num)
+        throw Unexpected_Error("FATAL Error: "+tab_index_file(file_name)+" does not match the file");
+
+    return true;
+}
+
+BTab_Reader::BTab_Reader(const string &file_name): file_name(file_name)
+{
+    IN.open(file_name, ifstream::in | ifstream::binary);
+    if(not IN)
+    {
+        cerr << RED << "FATAL Error: " << file_name << " cannot be read" << DEF << endl;
+        exit(-1);
+    }
+
+    // head: magic and version, trailer: footer offset and magic
+    IN.seekg(0, ios::end);
+    const uLONG file_size = IN.tellg();
+    if(file_size < 8 + 12)
+        throw Bad_IO("FATAL Error: bad btab file "+file_name);
+
+    char trailer[12];
+    IN.seekg(file_size - 12);
+    read_exact(IN, trailer, 12, file_name);
+    if(strncmp(trailer+8, BTAB_MAGIC, 4) != 0)
+        throw Bad_IO("FATAL Error: bad btab file "+file_name);
+
+    const char *p = trailer;
+    const uLONG footer_offset = get_fixed(p, 8);
+    if(footer_offset < 8 or footer_offset > file_size - 12)
+        throw Bad_IO("FATAL Error: bad footer offset in btab file "+file_name);
+    const uLONG footer_size = file_size - 12 - footer_offset;
+
+    string footer(footer_size, '\0');
+    IN.seekg(footer_offset);
+    read_exact(IN, &footer[0], footer_size, file_name);
+
+    try{
+        p = footer.data();
+        const char *end = p + footer.size();
+        const uLONG chr_num = get_fixed(p, end, 8);
+        for(uLONG i=0; i<chr_num; i++)
+        {
+            Tab_Index_Item item;
+            const uLONG key_size = get_fixed(p, end, 4);
+            if(uLONG(end - p) < key_size)
+                throw Bad_IO("FATAL Error: truncated binary data");
+            item.chr_id.assign(p, key_size);
+            p += key_size;
+            item.offset = get_fixed(p, end, 8);
+            item.block_num = get_fixed(p, end, 8);
+            item.record_num = get_fixed(p, end, 8);
+            item.region_num = get_fixed(p, end, 8);
+            if(item.offset < 8 or item.offset > footer_offset)
+                throw Bad_IO("FATAL Error: bad chromosome offset");
+            index.push_back(item);
+        }
+    }catch(Bad_IO &e){
+        throw Bad_IO(string(e.what())+" in the footer of "+file_name);
+    }
+
+    build_index_map();
+    indexed = true;
+}
+
+bool BTab_Reader::read_chr(Tab_Records &records)
+{
+    records.clear();
+    if(next_chr >= index.size())
+        return false;
+
+    read_btab_blocks(IN, file_name, index[next_chr++], records, compressed, raw);
+    return true;
+}
+
+void BTab_Reader::seek_chr(const string &chr_id)
+{
+    if(not find_chr(chr_id))
+        throw Unexpected_Error("FATAL Error: "+chr_id+" not found in "+file_name);
+    next_chr = index_map.at(chr_id);
+}
+
+bool BTab_Reader::load_chr(const string &chr_id, Tab_Records &records) const
+{
+    records.clear();
+    const Tab_Index_Item *item = find_chr(chr_id);
+    if(not item)
+        return false;
+
+    ifstream CHR_IN(file_name, ifstream::in | ifstream::binary);
+    if(not CHR_IN)
+    {
+        cerr << RED << "FATAL Error: " << file_name << " cannot be read" << DEF << endl;
+        exit(-1);
+    }
+    string chr_compressed, chr_raw;
+    read_btab_blocks(CHR_IN, file_name, *item, records, chr_compressed, chr_raw);
+    return true;
+}
+
+Tab_Reader *open_tab_reader(const string &file_name)
+{
+    char magic[4] = {0, 0, 0, 0};
+    ifstream IN(file_name, ifstream::in | ifstream::binary);
+    if(not IN)
+    {
+        cerr << RED << "FATAL Error: " << file_name << " cannot be read" << DEF << endl;
+        exit(-1);
+    }
+    IN.read(magic, 4);
+    IN.close();
+
+    if(strncmp(magic, BTAB_MAGIC, 4) == 0)
+        return new BTab_Reader(file_name);
+    else
+        return new Text_Tab_Reader(file_name);
+}
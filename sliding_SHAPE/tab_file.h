@@ -0,0 +1,229 @@
+#ifndef TAB_FILE_H
+#define TAB_FILE_H
+
+#include <pan_type.h>
+#include <exceptions.h>
+#include <string_split.h>
+
+#include <iostream>
+#include <fstream>
+#include <unordered_set>
+#include <algorithm>
+
+using namespace std;
+using namespace pan;
+
+/**** Tab file of read match regions (written by sam2tab) ****/
+
+// Text format (.tab), a line per read:
+//     chr_id \t strand \t start_1 \t end_1 [\t start_2 \t end_2 ...]
+//
+// Binary format (.btab):
+//     "BTAB" version(u32) | blocks | footer index | footer offset(u64) "BTAB"
+//     A block holds ~64KB of records of a single chr_id+strand, compressed with zlib:
+//         raw size(u32) compressed size(u32) record number(u32) zlib data
+//     A record is varint(region number), zigzag(start - start of last record in block),
+//     varint(end - start), then zigzag(start - last end), varint(end - start) for other regions.
+//     The footer index gives the offset of the first block and the block/record/region
+//     number of every chr_id+strand
+//
+// Index of text format (.tab.idx, written by sam2tab next to the .tab file):
+//     @FileSize \t size of .tab file
+//     chr_id \t strand \t offset of first line \t record number \t region number
+
+// the regions of a record, not owned
+class Record_View
+{
+public:
+    Record_View() {}
+    Record_View(const Region *data, const uLONG &len): data(data), len(len) {}
+    Record_View(const RegionArray &regions): data(regions.data()), len(regions.size()) {}
+
+    uLONG size() const { return len; }
+    bool empty() const { return len == 0; }
+    const Region &operator[](const uLONG &i) const { return data[i]; }
+    const Region &front() const { return data[0]; }
+    const Region &back() const { return data[len-1]; }
+    const Region *begin() const { return data; }
+    const Region *end() const { return data + len; }
+
+private:
+    const Region *data = nullptr;
+    uLONG len = 0;
+};
+
+// lexicographical order of the regions
+inline bool operator<(const Record_View &r_1, const Record_View &r_2)
+{
+    return lexicographical_compare(r_1.begin(), r_1.end(), r_2.begin(), r_2.end());
+}
+
+// records of a chr_id+strand, the regions of record i are regions[offsets[i], offsets[i+1])
+struct Tab_Records
+{
+    string chr_id;                                  // chr_id+strand, eg. chr1+
+    RegionArray regions;
+    vector<uLONG> offsets = vector<uLONG>(1, 0);
+
+    uLONG size() const { return offsets.size() - 1; }
+    bool empty() const { return offsets.size() == 1; }
+    void clear(){ chr_id.clear(); regions.clear(); offsets.assign(1, 0); }
+
+    Record_View operator[](const uLONG &i) const { return Record_View(regions.data()+offsets[i], offsets[i+1]-offsets[i]); }
+    void push_back(const Record_View &record)
+    {
+        regions.insert(regions.end(), record.begin(), record.end());
+        offsets.push_back(regions.size());
+    }
+};
+
+// index of a chr_id+strand
+struct Tab_Index_Item
+{
+    string chr_id;                                  // chr_id+strand
+    uLONG offset = 0;                               // file offset of first line or first block
+    uLONG block_num = 0;                            // only for .btab
+    uLONG record_num = 0;
+    uLONG region_num = 0;
+};
+
+// file name of the index of a text tab file
+inline string tab_index_file(const string &file_name){ return file_name + ".idx"; }
+
+/**** Writers ****/
+
+class Tab_Writer
+{
+public:
+    virtual ~Tab_Writer(){ }
+
+    // records of a chr_id+strand must be written contiguously
+    virtual void write(const string &chr_id, const char &strand, const Record_View &regions) = 0;
+    virtual void close() = 0;
+};
+
+class Text_Tab_Writer: public Tab_Writer
+{
+public:
+    // write_index -- write a .idx file when closed
+    Text_Tab_Writer(const string &file_name, bool write_index=true);
+    ~Text_Tab_Writer(){ close(); }
+
+    void write(const string &chr_id, const char &strand, const Record_View &regions);
+    void close();
+
+private:
+    ofstream OUT;
+    const string file_name;
+    bool write_index;
+
+    string last_chr_id;
+    char last_strand = 0;
+    vector<Tab_Index_Item> index;
+    unordered_set<string> written_chrs;
+};
+
+class BTab_Writer: public Tab_Writer
+{
+public:
+    BTab_Writer(const string &file_name, const uLONG &block_size=1<<16);
+    ~BTab_Writer(){ close(); }
+
+    void write(const string &chr_id, const char &strand, const Record_View &regions);
+    void close();
+
+private:
+    void flush_block();
+
+    ofstream OUT;
+    bool closed = false;
+    const uLONG block_size;
+
+    string block;
+    uLONG block_records = 0;
+    uLONG last_start = 0;
+
+    vector<Tab_Index_Item> index;
+    unordered_set<string> written_chrs;
+};
+
+// .btab file is written in binary format, other files in text
+Tab_Writer *open_tab_writer(const string &file_name);
+
+/**** Readers ****/
+
+class Tab_Reader
+{
+public:
+    virtual ~Tab_Reader(){ }
+
+    // read all records of next chr_id+strand, return false at the end of file
+    virtual bool read_chr(Tab_Records &records) = 0;
+
+    /**** Random access, need the footer of .btab or the .idx of .tab ****/
+
+    bool has_index() const { return indexed; }
+    const vector<Tab_Index_Item> &get_index() const { return index; }
+
+    // return nullptr if chr_id+strand is not in the file
+    const Tab_Index_Item *find_chr(const string &chr_id) const;
+
+    // the index position of the chr_id+strand read by next read_chr()
+    uLONG next_chr_pos() const { return next_chr; }
+
+    // let next read_chr() read the chr_id+strand
+    virtual void seek_chr(const string &chr_id) = 0;
+
+    // load a chr_id+strand with a private file handle, so it can be called from multiple threads.
+    // return false if it is not in the file
+    virtual bool load_chr(const string &chr_id, Tab_Records &records) const = 0;
+
+protected:
+    void build_index_map();
+
+    bool indexed = false;
+    vector<Tab_Index_Item> index;
+    MapStringuLONG index_map;                       // chr_id+strand => position in index
+    uLONG next_chr = 0;
+};
+
+class Text_Tab_Reader: public Tab_Reader
+{
+public:
+    // the index file is used if exists and it matches the file size
+    Text_Tab_Reader(const string &file_name);
+
+    bool read_chr(Tab_Records &records);
+    void seek_chr(const string &chr_id);
+    bool load_chr(const string &chr_id, Tab_Records &records) const;
+
+private:
+    void load_index();
+
+    ifstream IN;
+    const string file_name;
+    string next_line;       // first line of next chr_id+strand
+    FieldArray data;
+};
+
+class BTab_Reader: public Tab_Reader
+{
+public:
+    BTab_Reader(const string &file_name);
+
+    bool read_chr(Tab_Records &records);
+    void seek_chr(const string &chr_id);
+    bool load_chr(const string &chr_id, Tab_Records &records) const;
+
+private:
+    ifstream IN;
+    const string file_name;
+
+    string compressed;
+    string raw;
+};
+
+// check the magic number to choose binary or text reader
+Tab_Reader *open_tab_reader(const string &file_name);
+
+#endif // TAB_FILE_H
@@ -0,0 +1,8 @@
+g++ -O3 -std=c++0x -I../../PsBL/src -o test_enrich_kernel test_enrich_kernel.cpp ../enrich_kernel.cpp
+./test_enrich_kernel 203 20000
+
+g++ -O3 -std=c++0x -pthread -I../../PsBL/src -L../../PsBL/src -o test_calc_BDRT test_calc_BDRT.cpp ../sliding_shape.cpp ../enrich_kernel.cpp ../tab_file.cpp -lPsBL -lhts -lz
+./test_calc_BDRT 200000
+
+g++ -O3 -std=c++0x -pthread -I../../PsBL/src -L../../PsBL/src -o test_sort_gTab test_sort_gTab.cpp ../sliding_shape.cpp ../enrich_kernel.cpp ../tab_file.cpp -lPsBL -lhts -lz
+./test_sort_gTab
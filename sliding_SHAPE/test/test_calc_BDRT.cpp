@@ -0,0 +1,548 @@
+#include "../sliding_shape.h"
+
+#include <iostream>
+#include <random>
+#include <chrono>
+
+using namespace std;
+using namespace pan;
+
+// the binned junction maps used by the per-base loops
+void buildLeftJunctionMap(JunctionArray &junctions, map<uLONG, vector<Junction*>> &junc_map, const uLONG &binsize)
+{
+    junc_map.clear();
+    for(auto it=junctions.begin(); it!=junctions.end(); it++)
+    {
+        uLONG index = it->first / binsize;
+        junc_map[index].push_back( &(*it) );
+    }
+}
+
+void buildRightJunctionMap(JunctionArray &junctions, map<uLONG, vector<Junction*>> &junc_map, const uLONG &binsize)
+{
+    junc_map.clear();
+    for(auto it=junctions.begin(); it!=junctions.end(); it++)
+    {
+        uLONG index = it->second / binsize;
+        junc_map[index].push_back( &(*it) );
+    }
+}
+
+// calc_chr_BDRT_Pos with the per-base loop and the binned junction map
+void per_base_BDRT_Pos(uIntArray &BD, uIntArray &RT, 
+        const Map_Records &record_array, 
+        JunctionArray &junctions,
+        const uLONG &size,
+        const uLONG &BD_ext,
+        const uLONG &binsize)
+{
+    // build junction map
+    map<uLONG, vector<Junction* >> junc_map;
+    buildRightJunctionMap(junctions, junc_map, binsize);
+
+    // scan
+    for(uLONG k=record_array.size(); k-->0; )
+    {
+        const Map_Record regions = record_array[k];
+        // add BD
+        for(uLONG r_i=0; r_i<regions.size(); r_i++)
+            for(uLONG i=regions[r_i].first; i<=regions[r_i].second; i++)
+                if(i<=size)
+                    ++BD[i];
+
+        uLONG s = regions[0].first;
+        uLONG bin_id = s/binsize;
+
+        // add RT
+        if(junc_map.find(bin_id) == junc_map.end())
+        {
+            if(s-1 <= size)
+                ++RT[s-1];
+        }else{
+            bool find = false;
+            for(const Junction* const jp: junc_map[bin_id])
+            {
+                if(jp->second+1 == s)
+                {
+                    find = true;
+                    if(jp->first-1 <= size)
+                        ++RT[jp->first-1];
+                    break;
+                }
+            }
+            if(not find)
+                if(s-1 <= size)
+                    ++RT[s-1];
+        }
+
+        // ext BD
+        if(BD_ext > 0)
+        {
+            uLONG ext = BD_ext;
+            if(BD_ext > s)
+                ext = s;
+            if(junc_map.find(bin_id) == junc_map.end())
+            {
+                for(uLONG i=1; i<=ext; i++)
+                    if(s-i <= size)
+                        ++BD[s-i];
+            }else{
+                const vector<Junction *> &cur_junc_map = junc_map[bin_id];
+                
+                bool find = false;
+                for(uINT i=0; i<cur_junc_map.size(); i++)
+                {
+                    const Junction* const cur_jp = cur_junc_map[i];
+                    if(cur_jp->first <= s and s <= cur_jp->second)
+                    {
+                        // in junction
+                        uLONG ext_start;
+                        if(s-cur_jp->first > ext)
+                            ext_start = s - ext;
+                        else
+                            ext_start = cur_jp->first;
+                        
+                        for(uLONG i=ext_start; i<s; i++)
+                            if(i <= size)
+                                ++BD[i];
+
+                        find = true;
+                        break;
+                    }else
+                    {
+                        Junction* nex_jp = nullptr;
+                        if(i != cur_junc_map.size()-1)
+                            nex_jp = cur_junc_map[i+1];
+                        else
+                            nex_jp = new Junction( (bin_id+1)*binsize, (bin_id+1)*binsize );
+
+                        if(cur_jp->second < s and s < nex_jp->first)
+                        {
+                            // between junction
+                            uLONG ext_left = ext;
+                            uLONG start = cur_jp->second;
+                            uLONG cur_pos = s - 1;
+                            long cur_jun_index = i;
+                            while(ext_left > 0)
+                            {
+                                if(start==cur_pos)
+                                {
+                                    if(cur_jun_index >= 1)
+                                    {
+                                        --cur_jun_index;
+                                        start = cur_junc_map[cur_jun_index]->second;
+                                        cur_pos = cur_junc_map[cur_jun_index+1]->first - 1;
+                                    }
+                                    else{
+                                        cur_pos = cur_junc_map[0]->first - 1;
+                                        start = 0;
+                                    }
+                                }
+                                if(cur_pos <= size)
+                                    ++BD[cur_pos];
+                                --ext_left;
+                                --cur_pos;
+                            }
+                            find = true;
+                           // break;
+                        }
+                        if(i == cur_junc_map.size()-1)
+                            delete nex_jp;
+                        if(find)
+                            break;
+                    }
+                }
+                if(not find)
+                    // before the first junction
+                    for(uLONG i=1; i<=ext; i++)
+                        if(s-i <= size)
+                            ++BD[s-i];
+            }
+        }
+    }
+}
+
+// calc_chr_BDRT_Neg with the per-base loop and the binned junction map
+void per_base_BDRT_Neg(uIntArray &BD, uIntArray &RT, 
+        const Map_Records &record_array, 
+        JunctionArray &junctions,
+        const uLONG &size,
+        const uLONG &BD_ext,
+        const uLONG &binsize)
+{
+    // build junction map
+    map<uLONG, vector<Junction* >> junc_map;
+    buildLeftJunctionMap(junctions, junc_map, binsize);
+
+    //uLONG index = 0;
+
+    // scan
+    for(uLONG k=0; k<record_array.size(); k++)
+    {
+        const Map_Record regions = record_array[k];
+        //clog << ++index << regions.back().second << endl;
+
+        // add BD
+        for(uLONG r_i=0; r_i<regions.size(); r_i++)
+            for(uLONG i=regions[r_i].first; i<=regions[r_i].second; i++)
+                if(i <= size)
+                    ++BD[i];
+
+        uLONG s = regions.back().second;
+        uLONG bin_id = s/binsize;
+
+        // add RT
+        if(junc_map.find(bin_id) == junc_map.end())
+        {
+            if(s+1 <= size)
+                ++RT[s+1];
+        }else{
+            bool find = false;
+            for(const Junction* const jp: junc_map[bin_id])
+            {
+                if(jp->first-1 == s)
+                {
+                    find = true;
+                    if(jp->second+1 <= size)
+                        ++RT[jp->second+1];
+                    break;
+                }
+            }
+            if(not find)
+                if(s+1 <= size)
+                    ++RT[s+1];
+        }
+
+        // ext BD
+        if(BD_ext > 0)
+        {
+            uLONG ext = BD_ext;
+            if(BD_ext+s > size)
+                ext = size-s;
+            if(junc_map.find(bin_id) == junc_map.end())
+            {
+                for(uLONG i=1; i<=ext; i++)
+                    if(s+i<=size)
+                        ++BD[s+i];
+            }else{
+                const vector<Junction *> &cur_junc_map = junc_map[bin_id];
+                
+                bool find = false;
+                for(uLONG i=0; i<cur_junc_map.size(); i++)
+                {
+                    const Junction* const cur_jp = cur_junc_map[i];
+                    if(cur_jp->first <= s and s <= cur_jp->second)
+                    {
+                        // in junction
+                        uLONG ext_end;
+                        if(cur_jp->second-s > ext)
+                            ext_end = s+ext;
+                        else
+                            ext_end = cur_jp->second;
+                        
+                        for(uLONG i=s+1; i<=ext_end; i++)
+                            if(i<=size)
+                                ++BD[i];
+
+                        find = true;
+                        break;
+                    }else
+                    {
+                        Junction* last_jp = nullptr;
+                        if(i != 0)
+                            last_jp = cur_junc_map[i-1];
+                        else
+                            last_jp = new Junction( bin_id*binsize, bin_id*binsize );
+
+                        if(last_jp->second < s and s < cur_jp->first)
+                        {
+                            // between junction
+                            uLONG ext_left = ext;
+                            uLONG end = cur_jp->first;
+                            uLONG cur_pos = s + 1;
+                            uLONG cur_jun_index = i;
+                            while(ext_left > 0)
+                            {
+                                if(end==cur_pos)
+                                {
+                                    if(cur_jun_index < cur_junc_map.size()-1)
+                                    {
+                                        ++cur_jun_index;
+                                        end = cur_junc_map[cur_jun_index]->first;
+                                        cur_pos = cur_junc_map[cur_jun_index-1]->second + 1; // cur_jp->first-1;
+                                    }
+                                    else{
+                                        cur_pos = cur_junc_map.back()->second + 1;
+                                        end = size; // max value
+                                    }
+                                }
+                                if(cur_pos<=size)
+                                    ++BD[cur_pos];
+                                --ext_left;
+                                ++cur_pos;
+                            }
+                            find = true;
+                        }
+                        if(i == 0)
+                            delete last_jp;
+                        if(find)
+                            break;
+                    }
+                }
+                if(not find)
+                    // before the first junction
+                    for(uLONG i=1; i<=ext; i++)
+                        if(s+i<=size)
+                            ++BD[s+i];
+            }
+        }
+    }
+
+    //clog << "Finish...FIsh" << endl;
+}
+
+// build_junction_support with the binned junction map
+void binned_junction_support(const Map_Records &record_array, JunctionArray &junctions)
+{
+    map<uLONG, vector<Junction*>> junc_map;
+    const uLONG binsize = 100000;
+    buildLeftJunctionMap(junctions, junc_map, binsize);
+
+    for(uLONG k=0; k<record_array.size(); k++)
+    {
+        const Map_Record regions = record_array[k];
+        for(auto it2=regions.begin(); it2!=regions.end()-1; it2++)
+        {
+            Region cur_junc(it2->second+1, (it2+1)->first-1);
+            uLONG index = cur_junc.first / binsize;
+            if(junc_map.find(index) == junc_map.end())
+                continue;
+            for(Junction* const p: junc_map.at(index))
+            {
+                if(p->first == cur_junc.first and p->second == cur_junc.second)
+                {
+                    p->support++;
+                    break;
+                }
+            }
+        }
+    }
+}
+
+bool compare_support(const Map_Records &record_array, const JunctionArray &junctions)
+{
+    JunctionArray ref_junctions(junctions), new_junctions(junctions);
+    binned_junction_support(record_array, ref_junctions);
+    build_junction_support(record_array, new_junctions);
+    for(uLONG i=0; i<junctions.size(); i++)
+        if(ref_junctions[i].support != new_junctions[i].support)
+            return false;
+    return true;
+}
+
+// random spliced reads over random junctions (overlapping or disjoint), the reads are sorted by start as in a tab file.
+// The reads end before size, the per-base loop of negative strand does not stop for reads beyond size
+void random_reads(mt19937 &rng, const uLONG &size, const STRAND &strand, const bool &disjoint, JunctionArray &junctions, Map_Records &record_array)
+{
+    uniform_int_distribution<uLONG> pos(0, size-3500), len(20, 150), gap(50, 3000), coin(0, 3);
+
+    junctions.clear();
+    if(disjoint)
+    {
+        // sorted junctions without overlap, as after check_overlap
+        for(uLONG first=gap(rng); first+3500<size; first+=gap(rng))
+        {
+            junctions.push_back(Junction(first, first+gap(rng)/10));
+            first = junctions.back().second;
+        }
+    }else{
+        for(uLONG i=0; i<size/2000; i++)
+        {
+            uLONG first = pos(rng);
+            junctions.push_back(Junction(first, min(size, first+gap(rng))));
+        }
+        sort(junctions.begin(), junctions.end(), [](const Junction &a, const Junction &b){ return a.first < b.first; });
+    }
+
+    vector<RegionArray> reads;
+    for(uLONG i=0; i<size*2; i++)
+    {
+        vector<Region> regions;
+        uLONG start = pos(rng);
+        if(coin(rng) == 0 and not junctions.empty())
+        {
+            // read through a junction
+            const Junction &j = junctions[pos(rng) % junctions.size()];
+            const uLONG left = len(rng)/2, right = len(rng)/2;
+            start = j.first > left ? j.first - left : 0;
+            regions.push_back(Region(start, j.first-1 < start ? start : j.first-1));
+            regions.push_back(Region(j.second+1, j.second+right));
+        }else
+            regions.push_back(Region(start, start+len(rng)-1));
+        reads.push_back(regions);
+    }
+    sort(reads.begin(), reads.end(), [](const RegionArray &a, const RegionArray &b){ return a[0].first < b[0].first; });
+
+    record_array.clear();
+    record_array.strand = strand;
+    for(const RegionArray &regions: reads)
+        record_array.push_back(regions);
+}
+
+// run both versions on the same BD and RT, the first half of BD is not empty to check the accumulation
+bool compare(const Map_Records &record_array, JunctionArray &junctions, const uLONG &size, const uLONG &BD_ext, const uLONG &binsize, 
+    double &time_per_base, double &time_diff)
+{
+    uIntArray ref_BD(size+1, 0), ref_RT(size+1, 0);
+    Coverage_Array BD(size+1), RT(size+1);
+    for(uLONG i=0; i<=size/2; i++)
+        ref_BD[i] = BD.ref(i) = 3;
+    const bool positive = record_array.strand == POSITIVE;
+
+    auto t0 = chrono::steady_clock::now();
+    if(positive)
+        per_base_BDRT_Pos(ref_BD, ref_RT, record_array, junctions, size, BD_ext, binsize);
+    else
+        per_base_BDRT_Neg(ref_BD, ref_RT, record_array, junctions, size, BD_ext, binsize);
+    auto t1 = chrono::steady_clock::now();
+    if(positive)
+        calc_chr_BDRT_Pos(BD, RT, record_array, junctions, size, BD_ext, binsize);
+    else
+        calc_chr_BDRT_Neg(BD, RT, record_array, junctions, size, BD_ext, binsize);
+    auto t2 = chrono::steady_clock::now();
+
+    time_per_base += chrono::duration<double, milli>(t1-t0).count();
+    time_diff += chrono::duration<double, milli>(t2-t1).count();
+    return equal(ref_BD.cbegin(), ref_BD.cend(), BD.begin()) and equal(ref_RT.cbegin(), ref_RT.cend(), RT.begin());
+}
+
+// the fused counter against calc_chr_BDRT_Pos/Neg of each replicate, with a track per replicate and with summed tracks
+bool compare_fused(const vector<Map_Records> &replicates, JunctionArray &junctions, const uLONG &size, const uLONG &BD_ext)
+{
+    const uLONG rep_num = replicates.size();
+    const STRAND strand = replicates.front().strand;
+    vector<Coverage_Array> BD, RT;
+    for(uLONG r=0; r<rep_num; r++)
+    {
+        BD.emplace_back(size+1);
+        RT.emplace_back(size+1);
+        if(strand == POSITIVE)
+            calc_chr_BDRT_Pos(BD[r], RT[r], replicates[r], junctions, size, BD_ext, 1000);
+        else
+            calc_chr_BDRT_Neg(BD[r], RT[r], replicates[r], junctions, size, BD_ext, 1000);
+    }
+
+    vector<uLONG> track_of(rep_num);
+    iota(track_of.begin(), track_of.end(), 0);
+    Replicate_Coverage coverage(size+1, rep_num);
+    calc_chr_BDRT(coverage, replicates, track_of, junctions, size, strand, BD_ext, 1000);
+
+    // the first half of replicates in track 0, the others in track 1
+    for(uLONG r=0; r<rep_num; r++)
+        track_of[r] = r < rep_num/2 ? 0 : 1;
+    Replicate_Coverage summed(size+1, 2);
+    calc_chr_BDRT(summed, replicates, track_of, junctions, size, strand, BD_ext, 1000);
+    vector<Coverage_Array> sum_RT, sum_BD;
+    for(uLONG t=0; t<2; t++)
+    {
+        sum_RT.emplace_back(size+1);
+        sum_BD.emplace_back(size+1);
+    }
+    calc_chr_BDRT(sum_RT, sum_BD, replicates, track_of, junctions, size, strand, BD_ext, 1000);
+
+    bool same = true;
+    for(uLONG i=0; i<=size and same; i++)
+    {
+        uINT expect_RT[2] = {0, 0}, expect_BD[2] = {0, 0};
+        for(uLONG r=0; r<rep_num; r++)
+        {
+            same = same and coverage.get_RT(i, r) == RT[r][i] and coverage.get_BD(i, r) == BD[r][i];
+            expect_RT[track_of[r]] += RT[r][i];
+            expect_BD[track_of[r]] += BD[r][i];
+        }
+        for(uLONG t=0; t<2; t++)
+            same = same and sum_RT[t][i] == expect_RT[t] and sum_BD[t][i] == expect_BD[t] and 
+                summed.get_RT(i, t) == expect_RT[t] and summed.get_BD(i, t) == expect_BD[t];
+    }
+    return same;
+}
+
+int main(int argc, char *argv[])
+{
+    int failed = 0;
+    const uLONG ext_list[] = { 0, 1, 7, 50, 300 };
+
+    // 1. the example tab file
+    Tab_Reader *IN = open_tab_reader("../../PsBL/examples/test.tab");
+    Map_Records record_array;
+    string chr_id;
+    while(read_chr(record_array, IN, chr_id))
+    {
+        uLONG size = 0;
+        for(uLONG k=0; k<record_array.size(); k++)
+            size = max(size, record_array[k].back().second + 10);
+        JunctionArray junctions;
+        build_junction_support(record_array, junctions);
+        for(uLONG k=0; k<record_array.size(); k++)
+        {
+            const Map_Record record = record_array[k];
+            for(uLONG i=0; i+1<record.size(); i++)
+                junctions.push_back(Junction(record[i].second+1, record[i+1].first-1));
+        }
+
+        for(uLONG BD_ext: ext_list)
+        {
+            double t1 = 0, t2 = 0;
+            bool same = compare(record_array, junctions, size, BD_ext, 100, t1, t2);
+            failed += not same;
+            cout << chr_id << "\tBD_ext=" << BD_ext << "\t" << (same ? "same" : "FAILED") << endl;
+        }
+    }
+    delete IN;
+
+    // 2. random reads and junctions on both strands, with junctions in bins of different sizes
+    mt19937 rng(7);
+    JunctionArray junctions;
+    const uLONG size = argc > 1 ? stoul(argv[1]) : 200000;
+    for(bool disjoint: { false, true })
+        for(STRAND strand: { POSITIVE, NEGATIVE })
+        {
+            random_reads(rng, size, strand, disjoint, junctions, record_array);
+            bool same = compare_support(record_array, junctions);
+            failed += not same;
+            cout << (strand == POSITIVE ? "+" : "-") << "\tjunction support\t" << (same ? "same" : "FAILED") << endl;
+            for(uLONG binsize: { 1000, 100000 })
+                for(uLONG BD_ext: ext_list)
+                {
+                    double t1 = 0, t2 = 0;
+                    bool same = compare(record_array, junctions, size, BD_ext, binsize, t1, t2);
+                    failed += not same;
+                    cout << (strand == POSITIVE ? "+" : "-") << "\t" << junctions.size() << (disjoint ? " disjoint" : " overlapping") << " junctions"
+                         << "\tbinsize=" << binsize << "\tBD_ext=" << BD_ext << "\t" << (same ? "same" : "FAILED")
+                         << "\tper-base: " << t1 << " ms\tnew: " << t2 << " ms" << endl;
+                }
+        }
+
+    // 3. the fused counter of several replicates
+    for(STRAND strand: { POSITIVE, NEGATIVE })
+    {
+        vector<Map_Records> replicates(5);
+        JunctionArray rep_junctions;
+        for(uLONG r=0; r<replicates.size(); r++)
+            random_reads(rng, size, strand, false, r == 0 ? junctions : rep_junctions, replicates[r]);
+        for(uLONG BD_ext: ext_list)
+        {
+            bool same = compare_fused(replicates, junctions, size, BD_ext);
+            failed += not same;
+            cout << (strand == POSITIVE ? "+" : "-") << "\t" << replicates.size() << " replicates\tBD_ext=" << BD_ext << "\tfused " << (same ? "same" : "FAILED") << endl;
+        }
+    }
+
+    if(failed)
+    {
+        cerr << "FAILED: " << failed << " checks" << endl;
+        return -1;
+    }
+    cout << "All passed" << endl;
+    return 0;
+}
@@ -0,0 +1,155 @@
+#include "../enrich_kernel.h"
+
+#include <iostream>
+#include <random>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+
+using namespace std;
+
+const float null_value = -1.0;
+
+// formulas of the element-wise calcEnrich and winsorization
+void reference(const vector<float> &nai_rt, const vector<float> &nai_bd, const vector<float> &dmso_rt, const vector<float> &dmso_bd,
+                const int &method, vector<float> &score)
+{
+    const float nai_rt_sf = 3.7, nai_bd_sf = 41.3, dmso_rt_sf = 2.9, dmso_bd_sf = 38.1;
+    const float sub_fac = 0.25, div_fac = 10, add_fac = 1;
+    score.clear();
+    for(uLONG i=0; i<nai_rt.size(); i++)
+    {
+        if(method == 0)
+            score.push_back( (nai_rt[i]/nai_rt_sf)-sub_fac*(dmso_rt[i]/dmso_rt_sf) );
+        else if(dmso_bd[i] <= 0)
+            score.push_back(null_value);
+        else if(method == 1)
+            score.push_back( div_fac * (nai_bd[i]/nai_bd_sf) / (dmso_bd[i]/dmso_bd_sf) );
+        else if(method == 2)
+            score.push_back( div_fac * ((nai_rt[i]/nai_rt_sf)-sub_fac*(dmso_rt[i]/dmso_rt_sf)) / (dmso_bd[i]/dmso_bd_sf) );
+        else
+            score.push_back( log2( (nai_rt[i]+add_fac)/(dmso_rt[i]+add_fac) ) );
+    }
+}
+
+void kernel(const vector<float> &nai_rt, const vector<float> &nai_bd, const vector<float> &dmso_rt, const vector<float> &dmso_bd,
+            const int &method, const bool &fast_log, vector<float> &score)
+{
+    const float nai_rt_sf = 3.7, nai_bd_sf = 41.3, dmso_rt_sf = 2.9, dmso_bd_sf = 38.1;
+    const float sub_fac = 0.25, div_fac = 10, add_fac = 1;
+    const uLONG n = nai_rt.size();
+    score.resize(n);
+    if(method == 0)
+        enrich_substraction(nai_rt.data(), dmso_rt.data(), n, nai_rt_sf, dmso_rt_sf, sub_fac, score.data());
+    else if(method == 1)
+        enrich_dividing(nai_bd.data(), dmso_bd.data(), n, nai_bd_sf, dmso_bd_sf, div_fac, null_value, score.data());
+    else if(method == 2)
+        enrich_complex(nai_rt.data(), dmso_rt.data(), dmso_bd.data(), n, nai_rt_sf, dmso_rt_sf, dmso_bd_sf, sub_fac, div_fac, null_value, score.data());
+    else
+        enrich_log(nai_rt.data(), dmso_rt.data(), dmso_bd.data(), n, add_fac, fast_log, null_value, score.data());
+}
+
+void winsor_reference(vector<float> &score, const float &lower, const float &upper)
+{
+    for(float &v: score)
+        if(v != null_value)
+            v = v > upper ? 1 : (v < lower ? 0 : (v - lower)/(upper-lower));
+}
+
+bool same_bits(const vector<float> &a, const vector<float> &b)
+{
+    return a.size() == b.size() and memcmp(a.data(), b.data(), a.size()*sizeof(float)) == 0;
+}
+
+int main(int argc, char *argv[])
+{
+    const uLONG wsize = argc > 1 ? stoul(argv[1]) : 203;
+    const uLONG windows = argc > 2 ? stoul(argv[2]) : 20000;
+    int failed = 0;
+
+    // count-like tracks with zero coverage
+    mt19937 rng(11);
+    poisson_distribution<int> rt_dist(3), bd_dist(40);
+    bernoulli_distribution zero_bd(0.1);
+    vector<float> nai_rt(wsize), nai_bd(wsize), dmso_rt(wsize), dmso_bd(wsize);
+    for(uLONG i=0; i<wsize; i++)
+    {
+        nai_rt[i] = rt_dist(rng); dmso_rt[i] = rt_dist(rng);
+        nai_bd[i] = bd_dist(rng); dmso_bd[i] = zero_bd(rng) ? 0 : bd_dist(rng);
+    }
+
+    const char *methods[] = { "substraction", "dividing", "complex", "log" };
+    const SIMD_Level best = detect_simd_level();
+    vector<float> expected, score;
+
+    // 1. same bits with the element-wise formulas at every SIMD level
+    for(int level=SIMD_SCALAR; level<=best; level++)
+    {
+        set_simd_level(SIMD_Level(level));
+        cout << simd_level_name(simd_level()) << endl;
+        for(int method=0; method<4; method++)
+        {
+            reference(nai_rt, nai_bd, dmso_rt, dmso_bd, method, expected);
+
+            auto t0 = chrono::steady_clock::now();
+            for(uLONG w=0; w<windows; w++)
+                kernel(nai_rt, nai_bd, dmso_rt, dmso_bd, method, false, score);
+            auto t1 = chrono::steady_clock::now();
+
+            bool same = same_bits(expected, score);
+            failed += not same;
+            cout << "\t" << methods[method] << ": " << (same ? "same" : "FAILED") << "\t" 
+                 << chrono::duration<double, milli>(t1-t0).count() << " ms" << endl;
+        }
+
+        reference(nai_rt, nai_bd, dmso_rt, dmso_bd, 2, expected);
+        score = expected;
+        winsor_reference(expected, 0.05, 1.2);
+        winsor_scale(score.data(), score.size(), 0.05, 1.2, null_value);
+        bool same = same_bits(expected, score);
+        failed += not same;
+        cout << "\twinsor_scale: " << (same ? "same" : "FAILED") << endl;
+    }
+
+    // 2. fast log2: same bits at every SIMD level and the error bound
+    vector<float> ratio;
+    for(float x=1.0/256; x<=256; x*=1.0001)
+        ratio.push_back(x);
+    ratio.push_back(0); ratio.push_back(-1); ratio.push_back(INFINITY); ratio.push_back(1e-40);
+
+    double max_error = 0;
+    for(float x: ratio)
+    {
+        if(x >= 1.0/256 and x <= 256)
+            max_error = max(max_error, fabs(double(fast_log2(x)) - log2(double(x))));
+    }
+    bool bounded = max_error < FAST_LOG2_MAX_ERROR;
+    failed += not bounded;
+    cout << "fast_log2 max error in [2^-8, 2^8]: " << max_error << (bounded ? " < " : " >= ") << FAST_LOG2_MAX_ERROR << endl;
+
+    vector<float> zeros(ratio.size(), 0), ones(ratio.size(), 1);
+    for(int level=SIMD_SCALAR; level<=best; level++)
+    {
+        set_simd_level(SIMD_Level(level));
+        // (ratio-1+1)/(0+1) is ratio for the values here
+        vector<float> shifted(ratio);
+        for(float &v: shifted) v -= 1;
+        score.resize(shifted.size());
+        enrich_log(shifted.data(), zeros.data(), ones.data(), shifted.size(), 1, true, null_value, score.data());
+
+        vector<float> expected_log(shifted.size());
+        for(uLONG i=0; i<shifted.size(); i++)
+            expected_log[i] = fast_log2( (shifted[i]+1)/(zeros[i]+1) );
+        bool same = same_bits(expected_log, score);
+        failed += not same;
+        cout << "\tfast log2 " << simd_level_name(simd_level()) << ": " << (same ? "same" : "FAILED") << endl;
+    }
+
+    if(failed)
+    {
+        cerr << "FAILED: " << failed << " checks" << endl;
+        return -1;
+    }
+    cout << "All passed" << endl;
+    return 0;
+}
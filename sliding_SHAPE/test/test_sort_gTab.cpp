@@ -0,0 +1,113 @@
+
+#include "../sliding_shape.h"
+
+#include <iostream>
+#include <random>
+#include <chrono>
+
+using namespace std;
+using namespace pan;
+
+const string HEAD = "@ColNum 8\n@ChrID 1\n@Strand 2\n@ChrPos 3\n@N_RT 4\n@N_BD 5\n@Shape 6\n@ShapeNum 7\n@WindowShape 8\n";
+
+// rows of chr_id+strand are split into interleaved ascending runs as the junction windows,
+// the units are written in random order. Return the sorted text
+string write_tmp(const string &file_name, const uLONG &chr_num, const uLONG &max_runs, mt19937 &rng)
+{
+    map<pair<string, char>, vector<string>> sorted_rows;
+    vector< vector<string> > units;
+    uniform_int_distribution<int> step(1, 20), count(0, 500);
+    uniform_real_distribution<float> score(0, 1);
+    for(uLONG c=0; c<chr_num; c++)
+        for(const char strand: {'+', '-'})
+        {
+            const string chr = "chr" + to_string(c);
+            const uLONG run_num = 1 + rng() % max_runs;
+            vector< vector<string> > runs(run_num);
+            vector<string> &sorted = sorted_rows[ make_pair(chr, strand) ];
+            uLONG pos = step(rng);
+            for(uLONG i=rng()%3000; i>0; i--, pos+=step(rng))
+            {
+                ostringstream row;
+                row << count(rng) << "\t" << count(rng) << "\t" << score(rng) << "\t" << count(rng) << "\t" << score(rng) << ",";
+                runs[ rng() % run_num ].push_back(chr + "\t" + strand + "\t" + to_string(pos) + "\t" + row.str());
+                sorted.push_back(chr + "\t" + strand + "\t" + to_string(pos) + "\t\t" + row.str());
+            }
+            vector<string> unit;
+            for(const vector<string> &run: runs)
+                unit.insert(unit.end(), run.begin(), run.end());
+            units.push_back(unit);
+        }
+    shuffle(units.begin(), units.end(), rng);
+
+    ofstream OUT(file_name);
+    OUT << HEAD;
+    for(const vector<string> &unit: units)
+        for(const string &row: unit)
+            OUT << row << "\n";
+    OUT.close();
+
+    string text = HEAD;
+    for(const auto &key_rows: sorted_rows)
+        for(const string &row: key_rows.second)
+            text += row + "\n";
+    return text;
+}
+
+string read_text(const string &file_name)
+{
+    ifstream IN(file_name);
+    ostringstream text;
+    text << IN.rdbuf();
+    return text.str();
+}
+
+int main(int argc, char *argv[])
+{
+    int failed = 0;
+    mt19937 rng(11);
+    const uLONG max_runs_list[] = { 1, 2, 30, 500 };
+
+    for(uLONG max_runs: max_runs_list)
+    {
+        const string expected = write_tmp("test_sort.tmp", 12, max_runs, rng);
+
+        auto t0 = chrono::steady_clock::now();
+        sort_gTab("test_sort.tmp", "test_sort.gTab");
+        const double t = chrono::duration<double>(chrono::steady_clock::now() - t0).count();
+        const bool same = read_text("test_sort.gTab") == expected;
+        failed += not same;
+
+        sort_gTab("test_sort.tmp", "test_sort.bgTab");
+        BGTab_Reader reader("test_sort.bgTab");
+        ostringstream bgtab_text;
+        {
+            Fast_Writer writer(bgtab_text);
+            writer << reader.head();
+            GTab_Records records;
+            while(reader.read_chr(records))
+                write_gtab_text(records, reader.layout(), writer);
+        }
+        const bool bgtab_same = bgtab_text.str() == expected;
+        failed += not bgtab_same;
+
+        // merged in passes
+        sort_gTab("test_sort.tmp", "test_sort.gTab", 3);
+        const bool pass_same = read_text("test_sort.gTab") == expected;
+        failed += not pass_same;
+
+        cout << "max runs=" << max_runs << "\t" << (same ? "same" : "FAILED") << "\tbgTab " << (bgtab_same ? "same" : "FAILED") 
+            << "\tfan-in 3 " << (pass_same ? "same" : "FAILED") << "\t" << t << "s" << endl;
+    }
+    remove("test_sort.tmp");
+    remove("test_sort.gTab");
+    remove("test_sort.bgTab");
+
+    if(failed)
+    {
+        cerr << "FAILED: " << failed << " checks" << endl;
+        return -1;
+    }
+    cout << "All passed" << endl;
+    return 0;
+}